@@ -1,22 +1,82 @@
 #ifndef WET1CPP_AVL_TREE_H
 #define WET1CPP_AVL_TREE_H
 
+#include <algorithm>
+#include <cstddef>
 #include <iostream>
-
-template <class KeyType, class DataType>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "DataStorage.h"
+#include "ForkJoinPool.h"
+#include "FrozenTree.h"
+#include "KeyCompare.h"
+#include "TreeSnapshot.h"
+#include "TreeStats.h"
+#include "VertexAllocator.h"
+
+template <class KeyType, class DataType,
+        template <class> class VertexAllocator = HeapVertexAllocator,
+        class Compare = ThreeWayCompare,
+        template <class> class DataStorage = DataByPointer,
+        class Stats = NoTreeStats>
 class AVL_tree{
-    class AVLvertex{
+    /* the vertex holds it's data as the DataStorage policy defines, see
+     * DataStorage.h */
+    class AVLvertex : public DataStorage<DataType>{
     public:
         KeyType key;
-        DataType* data;
         AVLvertex *left, *right;
         int height;
 
-        explicit AVLvertex(KeyType key, DataType* data = nullptr)
-                : key(key), data(data), left(nullptr), right(nullptr), height(1) {}
+        template <class Key>
+        AVLvertex(Key&& key, DataType* data)
+                : DataStorage<DataType>(data), key(std::forward<Key>(key)),
+                  left(nullptr), right(nullptr), height(1) {}
+
+        template <class Key, class... Args>
+        AVLvertex(Key&& key, InPlace in_place, Args&&... args)
+                : DataStorage<DataType>(in_place, std::forward<Args>(args)...),
+                  key(std::forward<Key>(key)), left(nullptr), right(nullptr),
+                  height(1) {}
     };
 
+    /* the maximal height of a tree the fixed size path stacks can hold. An
+     * AVL tree of height h has at least F(h+2)-1 vertexes (F being the
+     * fibonacci sequence), so a tree of height 48 has over 10^10 vertexes */
+    static const int MAX_HEIGHT = 48;
+
     AVLvertex *root;
+    VertexAllocator<AVLvertex> allocator;
+    /* the order of the keys, see KeyCompare.h */
+    Compare compare;
+    /* the hot path counters, see TreeStats.h. Lookups count as well, so the
+     * policy is mutable */
+    mutable Stats statistics;
+
+    /* compare two keys through the comparator, counting the comparison */
+    template <class Key1, class Key2>
+    int compareKeys(const Key1& key1, const Key2& key2) const {
+        statistics.countComparison();
+        return compare(key1, key2);
+    }
+
+    /* allocate a vertex constructed out of "args", or deallocate a vertex,
+     * counting it */
+    template <class... Args>
+    AVLvertex* createVertex(Args&&... args){
+        AVLvertex* new_vertex = allocator.create(std::forward<Args>(args)...);
+        statistics.countAllocation();
+        return new_vertex;
+    }
+
+    void destroyVertex(AVLvertex* v){
+        allocator.destroy(v);
+        statistics.countDeallocation();
+    }
 
     /* the recursive method to traverse the tree in an inorder manner, while
      * applying the user supplied function to a vertex's key when visiting it */
@@ -30,6 +90,27 @@ class AVL_tree{
         inorderAux(curr_root->right, doSomething);
     }
 
+    /* the recursive method behind forEachInRange, which skips the subtrees
+     * that can't hold keys between "low" and "high" */
+    template <class Func>
+    void forEachInRangeAux(AVLvertex* curr_root, const KeyType& low,
+            const KeyType& high, Func& doSomething){
+        if(curr_root == nullptr){
+            return;
+        }
+        int low_result = compareKeys(low, curr_root->key);
+        int high_result = compareKeys(high, curr_root->key);
+        if(low_result < 0){
+            forEachInRangeAux(curr_root->left, low, high, doSomething);
+        }
+        if(low_result <= 0 && high_result >= 0){
+            doSomething(curr_root->key);
+        }
+        if(high_result > 0){
+            forEachInRangeAux(curr_root->right, low, high, doSomething);
+        }
+    }
+
     /* calculate the height of the given vertex */
     int getHeight(AVLvertex* v);
 
@@ -39,9 +120,11 @@ class AVL_tree{
     /* calculate the balance factor of the given vertex */
     int getBF(AVLvertex* v);
 
-    /* search a vertex with a matching key in the tree in a recursive manner.
-     * return a pointer to the vertex if found or nullptr otherwise */
-    AVLvertex* searchVertexRecursive(AVLvertex* curr_root, KeyType& key);
+    /* search a vertex with a matching key in the tree in an iterative manner.
+     * return a pointer to the vertex if found or nullptr otherwise. The key
+     * may be of any type the comparator accepts */
+    template <class LookupKey>
+    AVLvertex* searchVertex(const LookupKey& key) const;
 
     /* calculate the maximum of two integers */
     int max(int h1, int h2);
@@ -54,79 +137,757 @@ class AVL_tree{
      * root of the new subtree */
     AVLvertex* rotateLeft(AVLvertex* v);
 
-    /* insert a vertex to the tree using recursive calls in order to have a
-     * track of the vertexes we visited, so we can rebalance them when the
-     * recursive calls unwind. The method returns the root of the modified
-     * subtree */
-    AVLvertex* insertVertexRecursive(AVLvertex* curr_root, KeyType& key,
-            DataType* data);
-
-    /* delete a vertex from the tree using recursive calls in order to have a
-     * track of the vertexes we visited, so we can rebalance them when the
-     * recursive calls unwind. The method returns the root of the modified
-     * subtree */
-    AVLvertex* deleteVertexRecursive(AVLvertex* curr_root, KeyType& key);
+    /* walk back up the path of links (path[0] being &root) that was taken to
+     * reach an inserted or deleted vertex, updating heights and rebalancing
+     * the vertexes on it. The walk stops as soon as a subtree height is
+     * unchanged, since the vertexes above it can't be affected */
+    void rebalancePath(AVLvertex** path[], int depth);
+
+    /* search a vertex with a matching key while recording the links that
+     * lead to it. The method returns the link that points to the matching
+     * vertex, or the empty link where a vertex with the key should be
+     * inserted */
+    AVLvertex** searchLink(const KeyType& key, AVLvertex** path[],
+            int& depth);
+
+    /* insert a new vertex, constructed out of "args", to the empty link at
+     * the end of the given path and rebalance the path. The method returns
+     * the new vertex */
+    template <class... Args>
+    AVLvertex* insertAtLink(AVLvertex** link, AVLvertex** path[], int depth,
+            Args&&... args);
+
+    /* insert the given unlinked vertex to the tree */
+    void linkVertex(AVLvertex* new_vertex);
+
+    /* unlink the vertex at the end of the given path from the tree, which
+     * is the vertex "link" points to, and rebalance the path. The vertex's
+     * data must have been released or destroyed already. If the vertex has
+     * 2 children, the successor's key and data are moved into it and the
+     * successor is the one that is deallocated */
+    void removeAtLink(AVLvertex** link, AVLvertex** path[], int depth);
 
     /* deallocate every vertex and it's data in the tree which it's root is
      * curr_root, using a recursive postorder traversal */
     void deleteTree(AVLvertex* curr_root);
 
+    /* deallocate the data of every vertex in the tree which it's root is
+     * curr_root, leaving the memory of the vertexes themselves to the
+     * allocator */
+    void deleteTreeData(AVLvertex* curr_root);
+
+    /* copy the tree which it's root is curr_root vertex by vertex, keeping
+     * it's shape and heights, so no key is compared and nothing is rotated.
+     * The method returns the root of the copy */
+    AVLvertex* cloneTree(const AVLvertex* curr_root);
+
+    /* like cloneTree(), but the subtrees that are higher than "grain_height"
+     * are copied in parallel on "pool" */
+    AVLvertex* cloneTreeParallel(const AVLvertex* curr_root, ForkJoinPool& pool,
+            int grain_height);
+
+    /* build a perfectly balanced tree out of the next "size" (key, data
+     * pointer) pairs of a sorted sequence, setting the heights on the way.
+     * The sequence is consumed in an inorder manner, so the vertexes are
+     * created in key order. The method returns the root of the new tree */
+    template <class InputIt>
+    AVLvertex* buildBalancedTree(InputIt& it, int size);
+
+    /* like buildBalancedTree(), but the keys and data are decoded from a
+     * snapshot. Once a record can't be read "ok" is set to false, and the
+     * vertexes that were built so far are returned for deletion */
+    template <class KeyCodec, class DataCodec>
+    AVLvertex* loadBalancedTree(SnapshotReader& in, const KeyCodec& key_codec,
+            const DataCodec& data_codec, int size, bool& ok);
+
+    /* join the trees which their roots are "left" and "right" using "mid" as
+     * the connecting vertex, where every key in "left" is not greater than
+     * mid's key, and every key in "right" is not less than it. The method
+     * descends only along the spine of the taller tree, so it costs
+     * O(|height(left) - height(right)| + 1). It returns the new root */
+    AVLvertex* joinWithVertex(AVLvertex* left, AVLvertex* mid,
+            AVLvertex* right);
+
+    /* join two trees where every key in "left" is not greater than every key
+     * in "right". The method returns the new root */
+    AVLvertex* joinTrees(AVLvertex* left, AVLvertex* right);
+
+    /* unlink the vertex with the minimal key from the tree which it's root is
+     * curr_root into "min_vertex". The method returns the new root */
+    AVLvertex* removeMinVertex(AVLvertex* curr_root, AVLvertex*& min_vertex);
+
+    /* split the tree which it's root is curr_root into the tree of the keys
+     * that are less than "key" and the tree of the rest of the keys, in
+     * O(log n) and without allocating any vertex */
+    void splitTree(AVLvertex* curr_root, const KeyType& key, AVLvertex*& less,
+            AVLvertex*& greater_or_equal);
+
+    /* take all the vertexes of "other_tree", leaving it empty, and return
+     * their root. If the trees don't share their allocator, the keys and
+     * data are moved into new vertexes allocated by this tree */
+    AVLvertex* adoptTree(AVL_tree& other_tree);
+
+    /* append the (key, data pointer) pairs of the tree which it's root is
+     * curr_root to "pairs" in an inorder manner, detaching the data from the
+     * vertexes */
+    void detachToVector(AVLvertex* curr_root,
+            std::vector<std::pair<KeyType, DataType*> >& pairs);
+
     /* rebalance the given vertex if it's balance factor is not between -1 and
      * 1 */
     AVLvertex* rebalanceVertex(AVLvertex* curr_root);
 
+    /* a key of a batch deletion, and the number of vertexes with the key that
+     * are still to be deleted */
+    class BatchKey{
+    public:
+        KeyType key;
+        int remaining;
+    };
+
+    /* link the "size" unlinked vertexes of a sorted array into a perfectly
+     * balanced tree. The method returns the root of the new tree */
+    AVLvertex* linkBalancedTree(AVLvertex** vertexes, int size);
+
+    /* the batch operations descend the tree once for the whole sorted batch:
+     * the batch is split around the key of curr_root, each part is applied
+     * to a subtree, and the results are joined back through curr_root. Parts
+     * larger than "grain_size" are applied in parallel on "pool", so no
+     * vertex is allocated or deallocated on the way. The methods return the
+     * new root */
+    AVLvertex* insertBatchRec(AVLvertex* curr_root, AVLvertex** first,
+            AVLvertex** last, ForkJoinPool& pool, int grain_size);
+
+    /* the unlinked vertexes are collected into "removed" */
+    AVLvertex* deleteBatchRec(AVLvertex* curr_root, BatchKey* first,
+            BatchKey* last, std::vector<AVLvertex*>& removed,
+            ForkJoinPool& pool, int grain_size);
+
 public:
 
+    /* the batch operations recurse in parallel only on batch parts of more
+     * than this many keys */
+    static const int PARALLEL_GRAIN_SIZE = 1 << 13;
+
+    /* a bidirectional iterator over the keys of the tree in an inorder
+     * manner. The iterator keeps the path from the root to the current
+     * vertex, so advancing it costs amortized O(1) and needs no parent
+     * pointers in the vertexes. An iterator is invalidated by any insertion
+     * or deletion */
+    class iterator{
+        const AVL_tree* tree;
+        AVLvertex* path[MAX_HEIGHT];
+        /* the number of vertexes on the path, 0 for the end iterator */
+        int depth;
+
+        explicit iterator(const AVL_tree* tree) : tree(tree), depth(0) {}
+
+        /* push the leftmost (or rightmost) path of the subtree which it's
+         * root is curr_root */
+        void descendLeft(AVLvertex* curr_root){
+            while(curr_root != nullptr){
+                path[depth++] = curr_root;
+                curr_root = curr_root->left;
+            }
+        }
+
+        void descendRight(AVLvertex* curr_root){
+            while(curr_root != nullptr){
+                path[depth++] = curr_root;
+                curr_root = curr_root->right;
+            }
+        }
+
+        friend class AVL_tree;
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef KeyType value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const KeyType* pointer;
+        typedef const KeyType& reference;
+
+        iterator() : tree(nullptr), depth(0) {}
+
+        /* only the used part of the path is copied */
+        iterator(const iterator& other) : tree(other.tree), depth(other.depth){
+            for(int i = 0; i < depth; i++){
+                path[i] = other.path[i];
+            }
+        }
+
+        iterator& operator=(const iterator& other){
+            tree = other.tree;
+            depth = other.depth;
+            for(int i = 0; i < depth; i++){
+                path[i] = other.path[i];
+            }
+            return *this;
+        }
+
+        const KeyType& operator*() const {return path[depth - 1]->key;}
+
+        const KeyType* operator->() const {return &path[depth - 1]->key;}
+
+        /* the data held by the current vertex */
+        DataType* data() const {return path[depth - 1]->get();}
+
+        iterator& operator++(){
+            AVLvertex* curr = path[depth - 1];
+            if(curr->right != nullptr){
+                /* the successor is the minimum of the right subtree */
+                descendLeft(curr->right);
+                return *this;
+            }
+
+            /* otherwise it's the first ancestor we reach from it's left
+             * subtree */
+            depth--;
+            while(depth > 0 && path[depth - 1]->right == curr){
+                curr = path[--depth];
+            }
+            return *this;
+        }
+
+        iterator operator++(int){
+            iterator prev(*this);
+            ++*this;
+            return prev;
+        }
+
+        iterator& operator--(){
+            if(depth == 0){
+                /* the predecessor of the end is the maximum of the tree */
+                descendRight(tree->root);
+                return *this;
+            }
+
+            AVLvertex* curr = path[depth - 1];
+            if(curr->left != nullptr){
+                descendRight(curr->left);
+                return *this;
+            }
+
+            depth--;
+            while(depth > 0 && path[depth - 1]->left == curr){
+                curr = path[--depth];
+            }
+            return *this;
+        }
+
+        iterator operator--(int){
+            iterator prev(*this);
+            --*this;
+            return prev;
+        }
+
+        bool operator==(const iterator& other) const {
+            if(depth == 0 || other.depth == 0){
+                return depth == other.depth;
+            }
+            return path[depth - 1] == other.path[other.depth - 1];
+        }
+
+        bool operator!=(const iterator& other) const {
+            return !(*this == other);
+        }
+    };
+
+    /* a handle to a vertex of the tree, which lets the caller reach the
+     * vertex's key and data without searching the tree again. A handle stays
+     * valid until a key is deleted from the tree */
+    class Handle{
+        AVLvertex* vertex;
+
+        explicit Handle(AVLvertex* vertex) : vertex(vertex) {}
+
+        friend class AVL_tree;
+    public:
+        Handle() : vertex(nullptr) {}
+
+        /* return true if the handle refers to a vertex */
+        explicit operator bool() const {return vertex != nullptr;}
+
+        const KeyType& key() const {return vertex->key;}
+
+        DataType* data() const {return vertex->get();}
+    };
+
     /* constructor  */
     AVL_tree();
 
+    /* construct an empty tree that orders it's keys by "compare" */
+    explicit AVL_tree(const Compare& compare);
+
+    /* construct a tree out of the (key, data pointer) pairs in the range
+     * [first, last), see assign() */
+    template <class InputIt>
+    AVL_tree(InputIt first, InputIt last);
+
     /* destructor  */
     ~AVL_tree();
 
-    AVL_tree(const AVL_tree& tree) = delete;
+    /* copy every vertex and it's data (see DataStorage.h) in O(n), see
+     * cloneTree(). The copy gets an allocator of it's own */
+    AVL_tree(const AVL_tree& tree);
     AVL_tree& operator=(const AVL_tree& tree);
 
+    /* take the vertexes of "tree" in O(1), leaving it empty */
+    AVL_tree(AVL_tree&& tree);
+    AVL_tree& operator=(AVL_tree&& tree);
+
+    /* exchange the content of the trees in O(1). Iterators to the trees
+     * are invalidated */
+    void swap(AVL_tree& other_tree);
+
+    /* return a copy of the tree, made like the copy constructor, where the
+     * subtrees of more than about "grain_size" keys are copied in parallel
+     * on "pool". The copy is sequential if the allocator can't create
+     * vertexes concurrently */
+    AVL_tree clone(int grain_size = PARALLEL_GRAIN_SIZE,
+            ForkJoinPool& pool = ForkJoinPool::shared()) const;
+
+    /* delete every vertex and it's data from the tree */
+    void clear();
+
+    /* replace the content of the tree with the (key, data pointer) pairs in
+     * the range [first, last), which must be sorted by key. The tree is built
+     * perfectly balanced in O(n), without comparisons or rotations, and an
+     * arena allocator carves all of it's vertexes out of a single chunk */
+    template <class ForwardIt>
+    void assignSorted(ForwardIt first, ForwardIt last);
+
+    /* like assignSorted(), but the pairs are sorted by key first if they are
+     * not in order already */
+    template <class InputIt>
+    void assign(InputIt first, InputIt last);
+
     /* return true if a vertex with a matching key exists int the tree, false
      * otherwise  */
     bool keyExists(KeyType key);
 
     /* the interface method to insert a vertex with a "key" and "data" to the
-     * tree */
-    void insertKey(KeyType key,DataType* data);
+     * tree. The key is moved into the vertex if it's an rvalue */
+    void insertKey(const KeyType& key, DataType* data);
+    void insertKey(KeyType&& key, DataType* data);
+
+    /* insert a vertex with a key constructed out of "key" and data
+     * constructed in place out of "args", so neither is copied. The method
+     * returns a handle to the new vertex */
+    template <class Key, class... Args>
+    Handle emplace(Key&& key, Args&&... args);
 
     /* the interface method to delete a vertex with the matching key from the
-     * tree */
-    void deleteKey(KeyType key);
+     * tree. The vertex's data is detached from the tree and returned to the
+     * caller, or nullptr if the key is not in the tree */
+    DataType* deleteKey(KeyType key);
+
+    /* like deleteKey(), but the detached data is stored in "detached_data",
+     * and the method returns false if the key is not in the tree. It tells a
+     * missing key apart from a key that holds nullptr */
+    bool deleteKey(const KeyType& key, DataType*& detached_data);
+
+    /* delete a vertex with the matching key from the tree together with it's
+     * data. The method returns false if the key is not in the tree */
+    bool eraseKey(const KeyType& key);
 
     /* return the pointer to the data that the vertex with the matching key
      * holds */
     DataType* getData(KeyType key);
 
+    /* return a handle to the vertex with the matching key, or an empty handle
+     * if the key is not in the tree */
+    Handle find(KeyType key);
+
+    /* insert a vertex with "key" and "data" only if the key is not in the
+     * tree yet. The method returns a handle to the vertex with the key and
+     * whether the insertion took place. If it didn't, the caller keeps the
+     * ownership of "data" */
+    std::pair<Handle, bool> tryEmplace(KeyType key, DataType* data);
+
+    /* insert a vertex with "key" and "data", or if the key is already in the
+     * tree replace (and delete) the data it holds. The method returns a
+     * handle to the vertex and whether a new vertex was inserted */
+    std::pair<Handle, bool> insertOrAssign(KeyType key, DataType* data);
+
+    /* return a handle to the vertex with the matching key. If the key is not
+     * in the tree, a vertex is inserted with the data returned by calling
+     * "makeData()" */
+    template <class Factory>
+    Handle findOrInsert(KeyType key, Factory makeData);
+
     /* the interface method to traverse the tree in an inorder manner, while
      * applying the user supplied function to a vertex's key when visiting it */
     template <class Func>
     void inorder(Func& doSomething){inorderAux(root, doSomething);}
+
+    /* move every vertex with a key that is not less than "key" into
+     * "greater_or_equal_tree" in O(log n), keeping the rest in the tree. The
+     * previous content of "greater_or_equal_tree" is deleted. Both parts keep
+     * using the tree's allocator, so with an allocator that can't create
+     * vertexes concurrently (ArenaVertexAllocator) the two trees must not be
+     * changed by different threads at the same time, see splitDetached() */
+    void split(KeyType key, AVL_tree& greater_or_equal_tree);
+
+    /* like split(), but "greater_or_equal_tree" gets an allocator of it's own
+     * when the tree's allocator can't create vertexes concurrently, so the
+     * two parts may be handed to different threads. The moved vertexes are
+     * then copied in O(k), with k being the number of keys that moved */
+    void splitDetached(KeyType key, AVL_tree& greater_or_equal_tree);
+
+    /* move every vertex of "other_tree" into the tree, leaving "other_tree"
+     * empty. Every key in "other_tree" must not be less than any key in the
+     * tree. The join costs O(log n) if the trees share their allocator,
+     * otherwise the vertexes of "other_tree" are copied */
+    void join(AVL_tree& other_tree);
+
+    /* insert the (key, data pointer) pairs in the range [first, last) to the
+     * tree. The batch is sorted and merged into the tree in a single pass,
+     * which costs O(m*log(n/m + 1)) for a batch of m keys and a tree of n
+     * keys, and every vertex on the way is rebalanced once. Batch parts of
+     * more than "grain_size" keys are merged in parallel on "pool" */
+    template <class InputIt>
+    void insertBatch(InputIt first, InputIt last,
+            int grain_size = PARALLEL_GRAIN_SIZE,
+            ForkJoinPool& pool = ForkJoinPool::shared());
+
+    /* delete a vertex with a matching key for every key in the range
+     * [first, last), in a single pass like insertBatch(). The data of the
+     * deleted vertexes is detached from the tree and written to "removed" in
+     * key order. The method returns the end of the written range */
+    template <class InputIt, class OutputIt>
+    OutputIt deleteBatch(InputIt first, InputIt last, OutputIt removed,
+            int grain_size = PARALLEL_GRAIN_SIZE,
+            ForkJoinPool& pool = ForkJoinPool::shared());
+
+    /* iterators to the minimal key of the tree and past the maximal one */
+    iterator begin() const;
+    iterator end() const {return iterator(this);}
+
+    /* return an iterator to the key at the root of the tree, or end() if the
+     * tree is empty. The heights of the root's subtrees differ by at most 1,
+     * so it's key is a rough median found in O(1) */
+    iterator middle() const;
+
+    /* return an iterator to the first key that is not less than "key", or
+     * end() if there is no such key */
+    iterator lowerBound(const KeyType& key) const {return lowerBoundAux(key);}
+
+    /* return an iterator to the first key that is greater than "key", or
+     * end() if there is no such key */
+    iterator upperBound(const KeyType& key) const {return upperBoundAux(key);}
+
+    /* return the range of keys that are equal to "key" */
+    std::pair<iterator, iterator> equalRange(const KeyType& key) const;
+
+    /* apply the user supplied function to every key between "low" and "high"
+     * (inclusive) in an inorder manner. Subtrees that are out of the range
+     * are not visited, so k keys are visited in O(log n + k) */
+    template <class Func>
+    void forEachInRange(const KeyType& low, const KeyType& high,
+            Func& doSomething){
+        forEachInRangeAux(root, low, high, doSomething);
+    }
+
+    /* the lookups by a key of another type, such as std::string_view for
+     * std::string keys, which the comparator compares with the keys
+     * directly. They exist only if the comparator is transparent (see
+     * KeyCompare.h), and save building a KeyType for every lookup */
+    template <class LookupKey,
+            class = TransparentLookup<Compare, LookupKey, KeyType> >
+    bool keyExists(const LookupKey& key){
+        return searchVertex(key) != nullptr;
+    }
+
+    template <class LookupKey,
+            class = TransparentLookup<Compare, LookupKey, KeyType> >
+    DataType* getData(const LookupKey& key){
+        AVLvertex* v = searchVertex(key);
+        return v == nullptr ? nullptr : v->get();
+    }
+
+    template <class LookupKey,
+            class = TransparentLookup<Compare, LookupKey, KeyType> >
+    Handle find(const LookupKey& key){return Handle(searchVertex(key));}
+
+    template <class LookupKey,
+            class = TransparentLookup<Compare, LookupKey, KeyType> >
+    iterator lowerBound(const LookupKey& key) const {return lowerBoundAux(key);}
+
+    template <class LookupKey,
+            class = TransparentLookup<Compare, LookupKey, KeyType> >
+    iterator upperBound(const LookupKey& key) const {return upperBoundAux(key);}
+
+    template <class LookupKey,
+            class = TransparentLookup<Compare, LookupKey, KeyType> >
+    std::pair<iterator, iterator> equalRange(const LookupKey& key) const {
+        return std::make_pair(lowerBoundAux(key), upperBoundAux(key));
+    }
+
+    /* return an immutable snapshot of the tree for fast lookups, see
+     * FrozenTree.h. The snapshot shares the data of the tree, and searches
+     * it with operator<, so the tree must use the default order */
+    FrozenAVL_tree<KeyType, DataType> freeze() const;
+
+    /* write the keys and the data of the tree to a snapshot file at "path"
+     * (see TreeSnapshot.h) in an inorder manner, encoded by the given
+     * codecs. The method returns false if the file could not be written, in
+     * which case a previous snapshot at "path" is left as it was */
+    template <class KeyCodec = TrivialCodec<KeyType>,
+            class DataCodec = TrivialCodec<DataType> >
+    bool saveTo(const std::string& path, const KeyCodec& key_codec = KeyCodec(),
+            const DataCodec& data_codec = DataCodec()) const;
+
+    /* replace the content of the tree with a snapshot written by saveTo().
+     * The file is streamed into a perfectly balanced tree in O(n), without
+     * comparisons or rotations. KeyType and DataType must be default
+     * constructible for the codecs to decode into. If the file can't be
+     * read, is not a snapshot of keys and data or fails it's checksum, the
+     * tree is left as it was and false is returned */
+    template <class KeyCodec = TrivialCodec<KeyType>,
+            class DataCodec = TrivialCodec<DataType> >
+    bool loadFrom(const std::string& path, const KeyCodec& key_codec = KeyCodec(),
+            const DataCodec& data_codec = DataCodec());
+
+    /* report the counters of the Stats policy since the tree was created or
+     * resetStats() was called (all zero under NoTreeStats, see TreeStats.h),
+     * and the shape of the tree - the depth histogram, the average depth
+     * versus log2(n) and the bytes per vertex. The shape is measured in
+     * O(n) */
+    TreeStatsReport stats() const;
+
+    /* zero the counters of the Stats policy */
+    void resetStats();
+
+private:
+    /* the bodies of lowerBound() and upperBound() */
+    template <class LookupKey>
+    iterator lowerBoundAux(const LookupKey& key) const;
+
+    template <class LookupKey>
+    iterator upperBoundAux(const LookupKey& key) const;
 };
 
-template<class KeyType, class DataType>
-AVL_tree<KeyType, DataType>::AVL_tree()  : root(nullptr) {}
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVL_tree()  : root(nullptr) {}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVL_tree(const Compare& compare)
+        : root(nullptr), compare(compare) {}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+template <class InputIt>
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVL_tree(InputIt first, InputIt last)
+        : root(nullptr) {
+    assign(first, last);
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::~AVL_tree() {
+    clear();
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::clear() {
+    if(allocator.canReleaseAll()){
+        /* the arena holding the vertexes is dropped as a whole, so only the
+         * data needs to be deleted vertex by vertex */
+        deleteTreeData(root);
+        allocator.releaseAll();
+    } else {
+        /* call the recursive method that deletes every vertex and it's data
+         * from the tree whilst preforming a postorder traversal */
+        deleteTree(root);
+    }
+    root = nullptr;
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+template <class ForwardIt>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::assignSorted(ForwardIt first,
+        ForwardIt last) {
+    clear();
+
+    int size = std::distance(first, last);
+    allocator.reserve(size);
+    root = buildBalancedTree(first, size);
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+template <class InputIt>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::assign(InputIt first,
+        InputIt last) {
+    std::vector<std::pair<KeyType, DataType*> > pairs(first, last);
+    auto keyLess = [this](const std::pair<KeyType, DataType*>& p1,
+            const std::pair<KeyType, DataType*>& p2){
+        return compareKeys(p1.first, p2.first) < 0;
+    };
+    if(!std::is_sorted(pairs.begin(), pairs.end(), keyLess)){
+        std::stable_sort(pairs.begin(), pairs.end(), keyLess);
+    }
+    assignSorted(pairs.begin(), pairs.end());
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+template <class InputIt>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVLvertex*
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::buildBalancedTree(InputIt& it,
+        int size) {
+    if(size == 0){
+        return nullptr;
+    }
+
+    int left_size = (size - 1) / 2;
+    AVLvertex* left_subtree = buildBalancedTree(it, left_size);
+
+    AVLvertex* new_root = createVertex(it->first, it->second);
+    ++it;
+    new_root->left = left_subtree;
+    new_root->right = buildBalancedTree(it, size - 1 - left_size);
+
+    updateHeight(new_root);
+    return new_root;
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVL_tree(const AVL_tree& tree)
+        : root(nullptr), compare(tree.compare) {
+    root = cloneTree(tree.root);
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVL_tree(AVL_tree&& tree)
+        : root(nullptr) {
+    swap(tree);
+}
 
-template<class KeyType, class DataType>
-AVL_tree<KeyType, DataType>::~AVL_tree() {
-    /* call the recursive method that deletes every vertex and it's data from
-     * the tree whilst preforming a postorder traversal */
-    deleteTree(root);
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>&
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::operator=(const AVL_tree & tree) {
+    if(&tree != this){
+        AVL_tree copy(tree);
+        swap(copy);
+    }
+    return *this;
 }
 
-template<class KeyType, class DataType>
-AVL_tree<KeyType, DataType>& AVL_tree<KeyType, DataType>::operator=
-        (const AVL_tree & tree) {
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>&
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::operator=(AVL_tree&& tree) {
+    if(&tree != this){
+        clear();
+        swap(tree);
+    }
     return *this;
 }
 
-template<class KeyType, class DataType>
-bool AVL_tree<KeyType, DataType>::keyExists(KeyType key){
-    AVLvertex* v = searchVertexRecursive(root, key);
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::swap(AVL_tree& other_tree) {
+    std::swap(root, other_tree.root);
+    std::swap(allocator, other_tree.allocator);
+    std::swap(compare, other_tree.compare);
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::clone(int grain_size,
+        ForkJoinPool& pool) const {
+    AVL_tree copy(compare);
+    if(!copy.allocator.canCreateConcurrently()){
+        copy.root = copy.cloneTree(root);
+        return copy;
+    }
+
+    /* a perfectly balanced tree of "grain_size" keys is this high */
+    int grain_height = 0;
+    while((1 << grain_height) <= grain_size && grain_height < 30){
+        grain_height++;
+    }
+    copy.root = copy.cloneTreeParallel(root, pool, grain_height);
+    return copy;
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVLvertex*
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::cloneTree(const AVLvertex* curr_root) {
+    if(curr_root == nullptr){
+        return nullptr;
+    }
+
+    AVLvertex* new_root = createVertex(*curr_root);
+    new_root->left = nullptr;
+    new_root->right = nullptr;
+    try {
+        new_root->left = cloneTree(curr_root->left);
+        new_root->right = cloneTree(curr_root->right);
+    } catch (...) {
+        /* drop the part that was already copied */
+        deleteTree(new_root);
+        throw;
+    }
+    return new_root;
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVLvertex*
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::cloneTreeParallel(const AVLvertex* curr_root,
+        ForkJoinPool& pool, int grain_height) {
+    if(curr_root == nullptr || curr_root->height <= grain_height){
+        return cloneTree(curr_root);
+    }
+
+    AVLvertex* new_root = createVertex(*curr_root);
+    new_root->left = nullptr;
+    new_root->right = nullptr;
+    try {
+        pool.invokeBoth(
+                [&]{new_root->left = cloneTreeParallel(curr_root->left, pool,
+                        grain_height);},
+                [&]{new_root->right = cloneTreeParallel(curr_root->right,
+                        pool, grain_height);});
+    } catch (...) {
+        deleteTree(new_root);
+        throw;
+    }
+    return new_root;
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+bool AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::keyExists(KeyType key){
+    AVLvertex* v = searchVertex(key);
     if(v == nullptr) {
         return false;
     } else {
@@ -134,33 +895,47 @@ bool AVL_tree<KeyType, DataType>::keyExists(KeyType key){
     }
 }
 
-template<class KeyType, class DataType>
-DataType* AVL_tree<KeyType, DataType>::getData(KeyType key){
-    AVLvertex* v = searchVertexRecursive(root, key);
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+DataType* AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::getData(KeyType key){
+    AVLvertex* v = searchVertex(key);
     if(v == nullptr){
         return nullptr;
     }
 
-    return v->data;
+    return v->get();
 }
 
-template<class KeyType, class DataType>
-typename AVL_tree<KeyType, DataType>::AVLvertex*
-AVL_tree<KeyType, DataType>::searchVertexRecursive
-(AVL_tree::AVLvertex* curr_root, KeyType& key){
-    if (curr_root == nullptr) {
-        return nullptr;
-    } else if (curr_root->key == key) {
-        return curr_root;
-    } else if (curr_root->key < key) {
-        return searchVertexRecursive(curr_root->right, key);
-    } else {
-        return searchVertexRecursive(curr_root->left, key);
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+template <class LookupKey>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVLvertex*
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::searchVertex(const LookupKey& key) const {
+    AVLvertex* curr_root = root;
+    int length = 0;
+    while (curr_root != nullptr) {
+        length++;
+        int result = compareKeys(key, curr_root->key);
+        if (result == 0) {
+            statistics.countPath(length);
+            return curr_root;
+        } else if (result > 0) {
+            curr_root = curr_root->right;
+        } else {
+            curr_root = curr_root->left;
+        }
     }
+    statistics.countPath(length);
+    return nullptr;
 }
 
-template<class KeyType, class DataType>
-int AVL_tree<KeyType, DataType>::getHeight(AVL_tree::AVLvertex *v) {
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+int AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::getHeight
+(AVL_tree::AVLvertex *v) {
     if(v == nullptr){
         return 0;
     } else {
@@ -168,8 +943,11 @@ int AVL_tree<KeyType, DataType>::getHeight(AVL_tree::AVLvertex *v) {
     }
 }
 
-template<class KeyType, class DataType>
-int AVL_tree<KeyType, DataType>::updateHeight(AVL_tree::AVLvertex *v) {
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+int AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::updateHeight
+(AVL_tree::AVLvertex *v) {
     if(v == nullptr){
         return 0;
     } else{
@@ -178,13 +956,18 @@ int AVL_tree<KeyType, DataType>::updateHeight(AVL_tree::AVLvertex *v) {
     }
 }
 
-template<class KeyType, class DataType>
-int AVL_tree<KeyType, DataType>::max(int h1, int h2) {
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+int AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::max(int h1, int h2) {
     return h1 > h2 ? h1 : h2;
 }
 
-template<class KeyType, class DataType>
-int AVL_tree<KeyType, DataType>::getBF(AVL_tree::AVLvertex *v) {
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+int AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::getBF
+(AVL_tree::AVLvertex *v) {
     if(v == nullptr){
         return 0;
     } else{
@@ -192,9 +975,12 @@ int AVL_tree<KeyType, DataType>::getBF(AVL_tree::AVLvertex *v) {
     }
 }
 
-template<class KeyType, class DataType>
-typename AVL_tree<KeyType, DataType>::AVLvertex*
-AVL_tree<KeyType, DataType>::rotateRight(AVL_tree::AVLvertex *v) {
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVLvertex*
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::rotateRight
+(AVL_tree::AVLvertex *v) {
     AVLvertex* to_rotate = v;
     AVLvertex* to_rotate_left_child = to_rotate->left;
     AVLvertex* right_subtree = to_rotate_left_child->right;
@@ -211,9 +997,12 @@ AVL_tree<KeyType, DataType>::rotateRight(AVL_tree::AVLvertex *v) {
     return to_rotate_left_child;
 }
 
-template<class KeyType, class DataType>
-typename AVL_tree<KeyType, DataType>::AVLvertex*
-AVL_tree<KeyType, DataType>::rotateLeft(AVL_tree::AVLvertex *v) {
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVLvertex*
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::rotateLeft
+(AVL_tree::AVLvertex *v) {
     AVLvertex* to_rotate = v;
     AVLvertex* to_rotate_right_child = to_rotate->right;
     AVLvertex* left_subtree = to_rotate_right_child->left;
@@ -230,92 +1019,265 @@ AVL_tree<KeyType, DataType>::rotateLeft(AVL_tree::AVLvertex *v) {
     return to_rotate_right_child;
 }
 
-template<class KeyType, class DataType>
-void AVL_tree<KeyType, DataType>::insertKey(KeyType key, DataType *data) {
-    root = insertVertexRecursive(root, key, data);
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::insertKey(const KeyType& key,
+        DataType *data) {
+    linkVertex(createVertex(key, data));
 }
 
-template<class KeyType, class DataType>
-typename AVL_tree<KeyType, DataType>::AVLvertex*
-AVL_tree<KeyType, DataType>::insertVertexRecursive
-(AVL_tree::AVLvertex *curr_root, KeyType &key, DataType *data) {
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::insertKey(KeyType&& key,
+        DataType *data) {
+    linkVertex(createVertex(std::move(key), data));
+}
 
-    /* preform the usual insertion like in a regular binary search tree */
-    if(curr_root == nullptr){
-        return new AVLvertex(key, data);
-    } else if(curr_root->key < key){
-        curr_root->right = insertVertexRecursive(curr_root->right, key, data);
-    } else {
-        curr_root->left = insertVertexRecursive(curr_root->left, key, data);
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+template <class Key, class... Args>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::Handle
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::emplace(Key&& key,
+        Args&&... args) {
+    AVLvertex* new_vertex = createVertex(std::forward<Key>(key), InPlace(),
+            std::forward<Args>(args)...);
+    linkVertex(new_vertex);
+    return Handle(new_vertex);
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::linkVertex(AVLvertex* new_vertex) {
+    AVLvertex** path[MAX_HEIGHT];
+    int depth = 0;
+
+    /* preform the usual insertion like in a regular binary search tree,
+     * while recording the links that lead to the new vertex */
+    AVLvertex** link = &root;
+    while(*link != nullptr){
+        path[depth++] = link;
+        if(compareKeys(new_vertex->key, (*link)->key) > 0){
+            link = &(*link)->right;
+        } else {
+            link = &(*link)->left;
+        }
     }
+    *link = new_vertex;
+    statistics.countPath(depth);
 
-    updateHeight(curr_root);
+    rebalancePath(path, depth);
+}
 
-    /* rebalance the current root if needed */
-    return rebalanceVertex(curr_root);
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+DataType* AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::deleteKey
+(KeyType key) {
+    DataType* detached_data = nullptr;
+    deleteKey(key, detached_data);
+    return detached_data;
 }
 
-template<class KeyType, class DataType>
-void AVL_tree<KeyType, DataType>::deleteKey(KeyType key) {
-    root = deleteVertexRecursive(root, key);
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+bool AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::deleteKey
+(const KeyType& key, DataType*& detached_data) {
+    AVLvertex** path[MAX_HEIGHT];
+    int depth = 0;
+    AVLvertex** link = searchLink(key, path, depth);
+    if(*link == nullptr){
+        /* the key is not in the tree */
+        return false;
+    }
+
+    detached_data = (*link)->release();
+    removeAtLink(link, path, depth);
+    return true;
 }
 
-template<class KeyType, class DataType>
-typename AVL_tree<KeyType, DataType>::AVLvertex*
-AVL_tree<KeyType, DataType>::deleteVertexRecursive
-(AVL_tree::AVLvertex *curr_root, KeyType &key) {
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+bool AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::eraseKey
+(const KeyType& key) {
+    AVLvertex** path[MAX_HEIGHT];
+    int depth = 0;
+    AVLvertex** link = searchLink(key, path, depth);
+    if(*link == nullptr){
+        return false;
+    }
+
+    (*link)->destroyData();
+    removeAtLink(link, path, depth);
+    return true;
+}
 
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::removeAtLink
+(AVLvertex** link, AVLvertex** path[], int depth) {
     /* preform the usual deletion like in a regular binary search tree */
-    if(curr_root == nullptr){
-        return curr_root;
+    AVLvertex* to_delete = *link;
+    if(to_delete->left == nullptr || to_delete->right == nullptr){
+        /* no children or one child case */
+        if(to_delete->left != nullptr){
+            *link = to_delete->left;
+        } else {
+            *link = to_delete->right;
+        }
+    } else {
+        /* 2 children case: the successor's key and data are moved to the
+         * vertex, and the successor is unlinked from the right subtree */
+        path[depth++] = link;
+        AVLvertex** successor_link = &to_delete->right;
+        while((*successor_link)->left != nullptr){
+            path[depth++] = successor_link;
+            successor_link = &(*successor_link)->left;
+        }
+        AVLvertex* successor = *successor_link;
+        to_delete->key = std::move(successor->key);
+        to_delete->moveFrom(*successor);
+        *successor_link = successor->right;
+        to_delete = successor;
     }
+    destroyVertex(to_delete);
 
-    if(curr_root->key < key){
-        curr_root->right = deleteVertexRecursive(curr_root->right, key);
-    } else if (key < curr_root->key){
-        curr_root->left = deleteVertexRecursive(curr_root->left, key);
-    } else { /* means that curr_root is the vertex to delete */
-        if(curr_root->left == nullptr && curr_root->right == nullptr){
-            /* no children case */
-            AVLvertex* temp = curr_root;
-            curr_root = nullptr;
-            delete temp;
-        } else if(curr_root->left == nullptr || curr_root->right == nullptr){
-            /* one child case */
-            AVLvertex* existing_child;
-            if(curr_root->left != nullptr){
-                existing_child = curr_root->left;
-            } else {
-                existing_child = curr_root->right;
-            }
-            *curr_root = *existing_child;
-            delete existing_child;
+    rebalancePath(path, depth);
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVLvertex**
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::searchLink(const KeyType& key,
+        AVLvertex** path[], int& depth) {
+    AVLvertex** link = &root;
+    while(*link != nullptr){
+        int result = compareKeys(key, (*link)->key);
+        if(result == 0){
+            break;
+        }
+        path[depth++] = link;
+        if(result > 0){
+            link = &(*link)->right;
         } else {
-            /* 2 children case */
-            AVLvertex* successor = curr_root->right;
-            while (successor->left != nullptr){
-                successor = successor->left;
-            }
-            curr_root->key = successor->key;
-            curr_root->data = successor->data;
-            curr_root->right = deleteVertexRecursive(curr_root->right,
-                    successor->key);
+            link = &(*link)->left;
         }
     }
+    /* the matching vertex was compared as well */
+    statistics.countPath(*link == nullptr ? depth : depth + 1);
+    return link;
+}
 
-    if(curr_root == nullptr){
-        /* means the deleted vertex was the only vertex in the tree */
-        return curr_root;
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+template <class... Args>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVLvertex*
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::insertAtLink(AVLvertex** link,
+        AVLvertex** path[], int depth, Args&&... args) {
+    AVLvertex* new_vertex = createVertex(std::forward<Args>(args)...);
+    *link = new_vertex;
+
+    rebalancePath(path, depth);
+
+    /* rotations move vertexes around but never replace them, so the new
+     * vertex is still the one holding the key */
+    return new_vertex;
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::Handle
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::find(KeyType key) {
+    return Handle(searchVertex(key));
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+std::pair<typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::Handle, bool>
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::tryEmplace(KeyType key,
+        DataType* data) {
+    AVLvertex** path[MAX_HEIGHT];
+    int depth = 0;
+    AVLvertex** link = searchLink(key, path, depth);
+    if(*link != nullptr){
+        return std::make_pair(Handle(*link), false);
     }
 
-    updateHeight(curr_root);
+    return std::make_pair(Handle(insertAtLink(link, path, depth,
+            std::move(key), data)), true);
+}
 
-    /* rebalance the current root if needed */
-    return rebalanceVertex(curr_root);
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+std::pair<typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::Handle, bool>
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::insertOrAssign(KeyType key,
+        DataType* data) {
+    AVLvertex** path[MAX_HEIGHT];
+    int depth = 0;
+    AVLvertex** link = searchLink(key, path, depth);
+    if(*link != nullptr){
+        (*link)->assign(data);
+        return std::make_pair(Handle(*link), false);
+    }
+
+    return std::make_pair(Handle(insertAtLink(link, path, depth,
+            std::move(key), data)), true);
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+template <class Factory>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::Handle
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::findOrInsert(KeyType key,
+        Factory makeData) {
+    AVLvertex** path[MAX_HEIGHT];
+    int depth = 0;
+    AVLvertex** link = searchLink(key, path, depth);
+    if(*link != nullptr){
+        return Handle(*link);
+    }
+
+    return Handle(insertAtLink(link, path, depth, std::move(key),
+            makeData()));
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::rebalancePath
+(AVLvertex** path[], int depth) {
+    for(int i = depth - 1; i >= 0; i--){
+        AVLvertex* curr_root = *path[i];
+        int old_height = curr_root->height;
+
+        updateHeight(curr_root);
+
+        /* rebalance the current root if needed */
+        *path[i] = rebalanceVertex(curr_root);
+
+        if((*path[i])->height == old_height){
+            return;
+        }
+    }
 }
 
-template<class KeyType, class DataType>
-void AVL_tree<KeyType, DataType>::deleteTree(AVL_tree::AVLvertex *curr_root) {
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::deleteTree
+(AVL_tree::AVLvertex *curr_root) {
 
     /* base case */
     if(curr_root == nullptr){
@@ -324,13 +1286,34 @@ void AVL_tree<KeyType, DataType>::deleteTree(AVL_tree::AVLvertex *curr_root) {
 
     deleteTree(curr_root->left);
     deleteTree(curr_root->right);
-    delete curr_root->data;
-    delete curr_root;
+    curr_root->destroyData();
+    destroyVertex(curr_root);
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::deleteTreeData
+(AVL_tree::AVLvertex *curr_root) {
+
+    /* base case */
+    if(curr_root == nullptr){
+        return;
+    }
+
+    deleteTreeData(curr_root->left);
+    deleteTreeData(curr_root->right);
+    curr_root->destroyData();
+    curr_root->~AVLvertex();
+    statistics.countDeallocation();
 }
 
-template<class KeyType, class DataType>
-typename AVL_tree<KeyType, DataType>::AVLvertex*
-AVL_tree<KeyType, DataType>::rebalanceVertex(AVLvertex* curr_root){
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVLvertex*
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::rebalanceVertex
+(AVLvertex* curr_root){
 
     int BF = getBF(curr_root);
 
@@ -342,9 +1325,11 @@ AVL_tree<KeyType, DataType>::rebalanceVertex(AVLvertex* curr_root){
     if(BF == 2){
         if(getBF(curr_root->left) >= 0){
             /* LL rotation */
+            statistics.countSingleRotation();
             return rotateRight(curr_root);
         } else {
             /* LR rotation */
+            statistics.countDoubleRotation();
             curr_root->left = rotateLeft(curr_root->left);
             return rotateRight(curr_root);
         }
@@ -353,9 +1338,11 @@ AVL_tree<KeyType, DataType>::rebalanceVertex(AVLvertex* curr_root){
     if(BF == -2){
         if(getBF(curr_root->right) <= 0){
             /* RR rotation */
+            statistics.countSingleRotation();
             return rotateLeft(curr_root);
         } else {
             /* RL rotation */
+            statistics.countDoubleRotation();
             curr_root->right = rotateRight(curr_root->right);
             return rotateLeft(curr_root);
         }
@@ -364,5 +1351,566 @@ AVL_tree<KeyType, DataType>::rebalanceVertex(AVLvertex* curr_root){
     return curr_root;
 }
 
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::iterator
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::begin() const {
+    iterator it(this);
+    it.descendLeft(root);
+    return it;
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::iterator
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::middle() const {
+    iterator it(this);
+    if(root != nullptr){
+        it.path[it.depth++] = root;
+    }
+    return it;
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+template <class LookupKey>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::iterator
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::lowerBoundAux
+(const LookupKey& key) const {
+    iterator it(this);
+
+    /* the path to the last vertex we turned left at is the path to the
+     * first key which is not less than "key" */
+    int found_depth = 0;
+    AVLvertex* curr_root = root;
+    while(curr_root != nullptr){
+        it.path[it.depth++] = curr_root;
+        if(compareKeys(key, curr_root->key) > 0){
+            curr_root = curr_root->right;
+        } else {
+            found_depth = it.depth;
+            curr_root = curr_root->left;
+        }
+    }
+    it.depth = found_depth;
+    return it;
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+template <class LookupKey>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::iterator
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::upperBoundAux
+(const LookupKey& key) const {
+    iterator it(this);
+
+    int found_depth = 0;
+    AVLvertex* curr_root = root;
+    while(curr_root != nullptr){
+        it.path[it.depth++] = curr_root;
+        if(compareKeys(key, curr_root->key) < 0){
+            found_depth = it.depth;
+            curr_root = curr_root->left;
+        } else {
+            curr_root = curr_root->right;
+        }
+    }
+    it.depth = found_depth;
+    return it;
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+std::pair<typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::iterator,
+        typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::iterator>
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::equalRange
+(const KeyType& key) const {
+    return std::make_pair(lowerBound(key), upperBound(key));
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::split(KeyType key,
+        AVL_tree& greater_or_equal_tree) {
+    greater_or_equal_tree.clear();
+
+    /* the vertexes of both parts stay where they were allocated */
+    greater_or_equal_tree.allocator = allocator;
+    greater_or_equal_tree.compare = compare;
+
+    AVLvertex* less = nullptr;
+    splitTree(root, key, less, greater_or_equal_tree.root);
+    root = less;
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::splitDetached(KeyType key,
+        AVL_tree& greater_or_equal_tree) {
+    if(allocator.canCreateConcurrently()){
+        split(key, greater_or_equal_tree);
+        return;
+    }
+
+    AVL_tree shared_part(compare);
+    split(key, shared_part);
+    greater_or_equal_tree.clear();
+    greater_or_equal_tree.allocator = VertexAllocator<AVLvertex>();
+    greater_or_equal_tree.compare = compare;
+    /* the allocators differ, so the vertexes are copied into the new one */
+    greater_or_equal_tree.root = greater_or_equal_tree.adoptTree(shared_part);
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::join(AVL_tree& other_tree) {
+    if(&other_tree == this){
+        return;
+    }
+    root = joinTrees(root, adoptTree(other_tree));
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+template <class InputIt>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::insertBatch(InputIt first,
+        InputIt last, int grain_size, ForkJoinPool& pool) {
+    std::vector<std::pair<KeyType, DataType*> > pairs(first, last);
+    auto keyLess = [this](const std::pair<KeyType, DataType*>& p1,
+            const std::pair<KeyType, DataType*>& p2){
+        return compareKeys(p1.first, p2.first) < 0;
+    };
+    if(!std::is_sorted(pairs.begin(), pairs.end(), keyLess)){
+        std::stable_sort(pairs.begin(), pairs.end(), keyLess);
+    }
+
+    /* the vertexes are allocated up front, so the merge may run in
+     * parallel */
+    std::vector<AVLvertex*> vertexes;
+    vertexes.reserve(pairs.size());
+    allocator.reserve(pairs.size());
+    for(std::pair<KeyType, DataType*>& pair : pairs){
+        vertexes.push_back(createVertex(std::move(pair.first),
+                pair.second));
+    }
+
+    root = insertBatchRec(root, vertexes.data(),
+            vertexes.data() + vertexes.size(), pool, grain_size);
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+template <class InputIt, class OutputIt>
+OutputIt AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::deleteBatch(InputIt first,
+        InputIt last, OutputIt removed, int grain_size, ForkJoinPool& pool) {
+    std::vector<KeyType> keys(first, last);
+    auto keyLess = [this](const KeyType& key1, const KeyType& key2){
+        return compareKeys(key1, key2) < 0;
+    };
+    if(!std::is_sorted(keys.begin(), keys.end(), keyLess)){
+        std::sort(keys.begin(), keys.end(), keyLess);
+    }
+
+    /* equal keys are counted in a single batch key */
+    std::vector<BatchKey> batch;
+    for(const KeyType& key : keys){
+        if(!batch.empty() && compareKeys(batch.back().key, key) == 0){
+            batch.back().remaining++;
+        } else {
+            batch.push_back(BatchKey{key, 1});
+        }
+    }
+
+    std::vector<AVLvertex*> removed_vertexes;
+    root = deleteBatchRec(root, batch.data(), batch.data() + batch.size(),
+            removed_vertexes, pool, grain_size);
+
+    std::sort(removed_vertexes.begin(), removed_vertexes.end(),
+            [this](const AVLvertex* v1, const AVLvertex* v2){
+                return compareKeys(v1->key, v2->key) < 0;
+            });
+    for(AVLvertex* v : removed_vertexes){
+        *removed++ = v->release();
+        destroyVertex(v);
+    }
+    return removed;
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVLvertex*
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::linkBalancedTree(AVLvertex** vertexes,
+        int size) {
+    if(size == 0){
+        return nullptr;
+    }
+
+    int left_size = (size - 1) / 2;
+    AVLvertex* new_root = vertexes[left_size];
+    new_root->left = linkBalancedTree(vertexes, left_size);
+    new_root->right = linkBalancedTree(vertexes + left_size + 1,
+            size - 1 - left_size);
+
+    updateHeight(new_root);
+    return new_root;
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVLvertex*
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::insertBatchRec(AVLvertex* curr_root,
+        AVLvertex** first, AVLvertex** last, ForkJoinPool& pool,
+        int grain_size) {
+    if(first == last){
+        return curr_root;
+    }
+    if(curr_root == nullptr){
+        return linkBalancedTree(first, last - first);
+    }
+
+    /* the keys that are less than curr_root's key go to the left subtree */
+    AVLvertex** mid = std::lower_bound(first, last, curr_root,
+            [this](const AVLvertex* v1, const AVLvertex* v2){
+                return compareKeys(v1->key, v2->key) < 0;
+            });
+    AVLvertex* left = curr_root->left;
+    AVLvertex* right = curr_root->right;
+    if(last - first > grain_size){
+        pool.invokeBoth(
+                [&]{left = insertBatchRec(left, first, mid, pool, grain_size);},
+                [&]{right = insertBatchRec(right, mid, last, pool,
+                        grain_size);});
+    } else {
+        left = insertBatchRec(left, first, mid, pool, grain_size);
+        right = insertBatchRec(right, mid, last, pool, grain_size);
+    }
+    return joinWithVertex(left, curr_root, right);
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVLvertex*
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::deleteBatchRec(AVLvertex* curr_root,
+        BatchKey* first, BatchKey* last, std::vector<AVLvertex*>& removed,
+        ForkJoinPool& pool, int grain_size) {
+    if(curr_root == nullptr || first == last){
+        return curr_root;
+    }
+
+    /* split the batch into the keys that are less than curr_root's key, the
+     * matching key (if any) and the greater keys */
+    BatchKey* lower = std::lower_bound(first, last, curr_root->key,
+            [this](const BatchKey& batch_key, const KeyType& key){
+                return compareKeys(batch_key.key, key) < 0;
+            });
+    BatchKey* upper = lower;
+    if(upper != last && compareKeys(upper->key, curr_root->key) == 0){
+        upper++;
+    }
+    bool delete_vertex = lower != upper && lower->remaining > 0;
+    if(delete_vertex){
+        lower->remaining--;
+    }
+
+    AVLvertex* left = curr_root->left;
+    AVLvertex* right = curr_root->right;
+    if(delete_vertex && lower->remaining > 0){
+        /* more vertexes with the key may be in both subtrees, which share
+         * the count, so they are searched one after the other */
+        left = deleteBatchRec(left, first, upper, removed, pool, grain_size);
+        right = deleteBatchRec(right, lower, last, removed, pool, grain_size);
+    } else if(last - first > grain_size){
+        std::vector<AVLvertex*> right_removed;
+        pool.invokeBoth(
+                [&]{left = deleteBatchRec(left, first, lower, removed, pool,
+                        grain_size);},
+                [&]{right = deleteBatchRec(right, upper, last, right_removed,
+                        pool, grain_size);});
+        removed.insert(removed.end(), right_removed.begin(),
+                right_removed.end());
+    } else {
+        left = deleteBatchRec(left, first, lower, removed, pool, grain_size);
+        right = deleteBatchRec(right, upper, last, removed, pool, grain_size);
+    }
+
+    if(delete_vertex){
+        removed.push_back(curr_root);
+        return joinTrees(left, right);
+    }
+    return joinWithVertex(left, curr_root, right);
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVLvertex*
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::joinWithVertex(AVLvertex* left,
+        AVLvertex* mid, AVLvertex* right) {
+    int left_height = getHeight(left);
+    int right_height = getHeight(right);
+
+    if(left_height > right_height + 1){
+        /* descend the right spine of the taller left tree until the heights
+         * are close enough, and rebalance on the way back up */
+        left->right = joinWithVertex(left->right, mid, right);
+        updateHeight(left);
+        return rebalanceVertex(left);
+    }
+
+    if(right_height > left_height + 1){
+        right->left = joinWithVertex(left, mid, right->left);
+        updateHeight(right);
+        return rebalanceVertex(right);
+    }
+
+    mid->left = left;
+    mid->right = right;
+    updateHeight(mid);
+    return mid;
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVLvertex*
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::joinTrees(AVLvertex* left,
+        AVLvertex* right) {
+    if(left == nullptr){
+        return right;
+    }
+    if(right == nullptr){
+        return left;
+    }
+
+    AVLvertex* mid = nullptr;
+    right = removeMinVertex(right, mid);
+    return joinWithVertex(left, mid, right);
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVLvertex*
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::removeMinVertex(AVLvertex* curr_root,
+        AVLvertex*& min_vertex) {
+    if(curr_root->left == nullptr){
+        min_vertex = curr_root;
+        return curr_root->right;
+    }
+
+    curr_root->left = removeMinVertex(curr_root->left, min_vertex);
+    updateHeight(curr_root);
+    return rebalanceVertex(curr_root);
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::splitTree(AVLvertex* curr_root,
+        const KeyType& key, AVLvertex*& less, AVLvertex*& greater_or_equal) {
+    if(curr_root == nullptr){
+        less = nullptr;
+        greater_or_equal = nullptr;
+        return;
+    }
+
+    AVLvertex* left = curr_root->left;
+    AVLvertex* right = curr_root->right;
+    if(compareKeys(curr_root->key, key) < 0){
+        /* curr_root and it's left subtree belong to the "less" tree */
+        AVLvertex* right_less = nullptr;
+        splitTree(right, key, right_less, greater_or_equal);
+        less = joinWithVertex(left, curr_root, right_less);
+    } else {
+        AVLvertex* left_greater_or_equal = nullptr;
+        splitTree(left, key, less, left_greater_or_equal);
+        greater_or_equal = joinWithVertex(left_greater_or_equal, curr_root,
+                right);
+    }
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVLvertex*
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::adoptTree(AVL_tree& other_tree) {
+    AVLvertex* other_root = other_tree.root;
+    if(allocator == other_tree.allocator){
+        other_tree.root = nullptr;
+        return other_root;
+    }
+
+    std::vector<std::pair<KeyType, DataType*> > pairs;
+    detachToVector(other_root, pairs);
+    other_tree.clear();
+
+    auto it = pairs.begin();
+    allocator.reserve(pairs.size());
+    return buildBalancedTree(it, pairs.size());
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::detachToVector(AVLvertex* curr_root,
+        std::vector<std::pair<KeyType, DataType*> >& pairs) {
+    if(curr_root == nullptr){
+        return;
+    }
+
+    detachToVector(curr_root->left, pairs);
+    pairs.push_back(std::make_pair(std::move(curr_root->key),
+            curr_root->release()));
+    detachToVector(curr_root->right, pairs);
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+FrozenAVL_tree<KeyType, DataType>
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::freeze() const {
+    static_assert(std::is_same<Compare, ThreeWayCompare>::value,
+            "freeze() needs the default key order");
+    std::vector<std::pair<KeyType, DataType*> > pairs;
+    for(iterator it = begin(); it != end(); ++it){
+        pairs.push_back(std::make_pair(*it, it.data()));
+    }
+    return FrozenAVL_tree<KeyType, DataType>(pairs.begin(), pairs.end());
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+template <class KeyCodec, class DataCodec>
+bool AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::saveTo(const std::string& path,
+        const KeyCodec& key_codec, const DataCodec& data_codec) const {
+    SnapshotWriter out(path);
+    uint64_t key_count = 0;
+    for(iterator it = begin(); it != end(); ++it){
+        key_count++;
+    }
+    out.writeValue(SnapshotHeader(SnapshotHeader::KEYS_AND_DATA, key_count));
+
+    for(iterator it = begin(); it != end(); ++it){
+        key_codec.write(out, *it);
+        unsigned char has_data = it.data() != nullptr;
+        out.writeValue(has_data);
+        if(has_data){
+            data_codec.write(out, *it.data());
+        }
+    }
+    return out.finish();
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+template <class KeyCodec, class DataCodec>
+bool AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::loadFrom(const std::string& path,
+        const KeyCodec& key_codec, const DataCodec& data_codec) {
+    SnapshotReader in(path);
+    SnapshotHeader header;
+    if(!in.isOpen() || !in.readValue(header) ||
+            !header.isValid(SnapshotHeader::KEYS_AND_DATA) ||
+            header.key_count > uint64_t(in.bytesLeft()) ||
+            header.key_count > uint64_t(std::numeric_limits<int>::max())){
+        return false;
+    }
+
+    /* the snapshot is built aside, so a bad file leaves the tree intact */
+    AVL_tree loaded(compare);
+    int size = int(header.key_count);
+    loaded.allocator.reserve(size);
+    bool ok = true;
+    loaded.root = loaded.loadBalancedTree(in, key_codec, data_codec, size, ok);
+    if(!ok || !in.finish()){
+        return false;
+    }
+    swap(loaded);
+    return true;
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+template <class KeyCodec, class DataCodec>
+typename AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::AVLvertex*
+AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::loadBalancedTree(SnapshotReader& in,
+        const KeyCodec& key_codec, const DataCodec& data_codec, int size,
+        bool& ok) {
+    if(size == 0){
+        return nullptr;
+    }
+
+    int left_size = (size - 1) / 2;
+    AVLvertex* left_subtree = loadBalancedTree(in, key_codec, data_codec,
+            left_size, ok);
+    if(!ok){
+        return left_subtree;
+    }
+
+    KeyType key;
+    unsigned char has_data;
+    if(!key_codec.read(in, key) || !in.readValue(has_data)){
+        ok = false;
+        return left_subtree;
+    }
+    AVLvertex* new_root;
+    if(has_data){
+        DataType data;
+        if(!data_codec.read(in, data)){
+            ok = false;
+            return left_subtree;
+        }
+        new_root = createVertex(std::move(key), InPlace(), std::move(data));
+    } else {
+        new_root = createVertex(std::move(key),
+                static_cast<DataType*>(nullptr));
+    }
+    new_root->left = left_subtree;
+    new_root->right = loadBalancedTree(in, key_codec, data_codec,
+            size - 1 - left_size, ok);
+
+    updateHeight(new_root);
+    return new_root;
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+TreeStatsReport AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::stats() const {
+    TreeStatsReport report;
+    report.counters = statistics.counters();
+
+    /* DataByPointer keeps the data in a separate allocation */
+    const bool separate_data =
+            std::is_same<DataStorage<DataType>, DataByPointer<DataType> >::value;
+    measureTreeShape(root, report, [separate_data](const AVLvertex* v){
+        AVLvertex* vertex = const_cast<AVLvertex*>(v);
+        return sizeof(AVLvertex) + (separate_data && vertex->get() != nullptr ?
+                sizeof(DataType) : 0);
+    });
+    return report;
+}
+
+template<class KeyType, class DataType,
+        template <class> class VertexAllocator, class Compare,
+        template <class> class DataStorage, class Stats>
+void AVL_tree<KeyType, DataType, VertexAllocator, Compare, DataStorage, Stats>::resetStats() {
+    statistics.reset();
+}
 
 #endif //WET1CPP_AVL_TREE_H
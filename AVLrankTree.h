@@ -1,24 +1,84 @@
 #ifndef WET2CPP_AVLRANKTREE_H
 #define WET2CPP_AVLRANKTREE_H
 
+#include <algorithm>
+#include <cstddef>
 #include <iostream>
-
-template <class KeyType>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Augmentation.h"
+#include "ForkJoinPool.h"
+#include "FrozenTree.h"
+#include "KeyCompare.h"
+#include "TreeSnapshot.h"
+#include "TreeStats.h"
+#include "VertexAllocator.h"
+
+/* every vertex holds the number of keys in it's subtree, and the aggregate
+ * of those keys as defined by the Augmentation policy (see Augmentation.h).
+ * The default policy is the sum of the keys */
+template <class KeyType,
+        template <class> class VertexAllocator = HeapVertexAllocator,
+        class Augmentation = KeySum<>, class Compare = ThreeWayCompare,
+        class Stats = NoTreeStats>
 class AVLrankTree{
+public:
+    typedef typename Augmentation::value_type aggregate_type;
+
+private:
     class AVLvertex{
     public:
         KeyType key;
         AVLvertex *left, *right;
         int height;
         int count;
-        int sum;
-
-        explicit AVLvertex(KeyType key)
-                : key(key), left(nullptr), right(nullptr), height(1),
-                  count(1), sum(key.getKey()) {}
+        aggregate_type aggregate;
+
+        /* the key is constructed in place out of "args" */
+        template <class... Args>
+        explicit AVLvertex(InPlace, Args&&... args)
+                : key(std::forward<Args>(args)...), left(nullptr),
+                  right(nullptr), height(1), count(1),
+                  aggregate(Augmentation::fromKey(this->key)) {}
     };
 
+    /* the maximal height of a tree the fixed size path stacks can hold. An
+     * AVL tree of height h has at least F(h+2)-1 vertexes (F being the
+     * fibonacci sequence), so a tree of height 48 has over 10^10 vertexes */
+    static const int MAX_HEIGHT = 48;
+
     AVLvertex *root;
+    VertexAllocator<AVLvertex> allocator;
+    /* the order of the keys, see KeyCompare.h */
+    Compare compare;
+    /* the hot path counters, see TreeStats.h. Lookups count as well, so the
+     * policy is mutable */
+    mutable Stats statistics;
+
+    /* compare two keys through the comparator, counting the comparison */
+    template <class Key1, class Key2>
+    int compareKeys(const Key1& key1, const Key2& key2) const {
+        statistics.countComparison();
+        return compare(key1, key2);
+    }
+
+    /* allocate a vertex constructed out of "args", or deallocate a vertex,
+     * counting it */
+    template <class... Args>
+    AVLvertex* createVertex(Args&&... args){
+        AVLvertex* new_vertex = allocator.create(std::forward<Args>(args)...);
+        statistics.countAllocation();
+        return new_vertex;
+    }
+
+    void destroyVertex(AVLvertex* v){
+        allocator.destroy(v);
+        statistics.countDeallocation();
+    }
 
     /* the recursive method to traverse the tree in an inorder manner, while
      * applying the user supplied function to a vertex's key when visiting it */
@@ -32,6 +92,27 @@ class AVLrankTree{
         inorderAux(curr_root->right, doSomething);
     }
 
+    /* the recursive method behind forEachInRange, which skips the subtrees
+     * that can't hold keys between "low" and "high" */
+    template <class Func>
+    void forEachInRangeAux(AVLvertex* curr_root, const KeyType& low,
+            const KeyType& high, Func& doSomething){
+        if(curr_root == nullptr){
+            return;
+        }
+        int low_result = compareKeys(low, curr_root->key);
+        int high_result = compareKeys(high, curr_root->key);
+        if(low_result < 0){
+            forEachInRangeAux(curr_root->left, low, high, doSomething);
+        }
+        if(low_result <= 0 && high_result >= 0){
+            doSomething(curr_root->key);
+        }
+        if(high_result > 0){
+            forEachInRangeAux(curr_root->right, low, high, doSomething);
+        }
+    }
+
     /* calculate the height of the given vertex */
     int getHeight(AVLvertex* v);
 
@@ -43,17 +124,21 @@ class AVLrankTree{
 
     int getCount(AVLvertex* v);
 
-    int getSum(AVLvertex* v);
+    /* the aggregate of the given subtree, the identity for an empty one */
+    aggregate_type getAggregate(AVLvertex* v);
 
     int updateCount(AVLvertex* v);
 
-    int updateSum(AVLvertex* v);
+    /* recalculate the aggregate of the given vertex from it's children */
+    void updateAggregate(AVLvertex* v);
 
-    void updateSumAndCountAfterRotation(AVLvertex* v);
+    void updateCountAndAggregateAfterRotation(AVLvertex* v);
 
-    /* search a vertex with a matching key in the tree in a recursive manner.
-     * return a pointer to the vertex if found or nullptr otherwise */
-    AVLvertex* searchVertexRecursive(AVLvertex* curr_root, KeyType& key);
+    /* search a vertex with a matching key in the tree in an iterative manner.
+     * return a pointer to the vertex if found or nullptr otherwise. The key
+     * may be of any type the comparator accepts */
+    template <class LookupKey>
+    AVLvertex* searchVertex(const LookupKey& key) const;
 
     /* calculate the maximum of two integers */
     int max(int h1, int h2);
@@ -66,28 +151,38 @@ class AVLrankTree{
      * root of the new subtree */
     AVLvertex* rotateLeft(AVLvertex* v);
 
-    /* insert a vertex to the tree using recursive calls in order to have a
-     * track of the vertexes we visited, so we can rebalance them when the
-     * recursive calls unwind. The method returns the root of the modified
-     * subtree */
-    AVLvertex* insertVertexRecursive(AVLvertex* curr_root, KeyType& key);
+    /* walk back up the path of links (path[0] being &root) that was taken to
+     * reach an inserted or deleted vertex. Heights are updated and vertexes
+     * rebalanced until a subtree height is unchanged, above that point only
+     * the count and aggregate of the vertexes on the path are fixed */
+    void rebalancePath(AVLvertex** path[], int depth);
 
-    /* delete a vertex from the tree using recursive calls in order to have a
-     * track of the vertexes we visited, so we can rebalance them when the
-     * recursive calls unwind. The method returns the root of the modified
-     * subtree */
-    AVLvertex* deleteVertexRecursive(AVLvertex* curr_root, KeyType& key);
+    /* insert the given unlinked vertex to the tree */
+    void linkVertex(AVLvertex* new_vertex);
 
     /* deallocate every vertex in the tree which it's root is
      * curr_root, using a recursive postorder traversal */
     void deleteTree(AVLvertex* curr_root);
 
+    /* copy the tree which it's root is curr_root vertex by vertex, keeping
+     * it's shape, heights, counts and aggregates, so no key is compared and
+     * nothing is rotated or recalculated. The method returns the root of the
+     * copy */
+    AVLvertex* cloneTree(const AVLvertex* curr_root);
+
+    /* like cloneTree(), but the subtrees of more than "grain_size" keys are
+     * copied in parallel on "pool" */
+    AVLvertex* cloneTreeParallel(const AVLvertex* curr_root, ForkJoinPool& pool,
+            int grain_size);
+
     /* rebalance the given vertex if it's balance factor is not between -1 and
      * 1 */
     AVLvertex* rebalanceVertex(AVLvertex* curr_root);
 
-    void sumOfkLargestKeysRec(AVLvertex* curr_root,
-            int& remaining_elements_count, int& curr_sum);
+    /* prepend the aggregate of the "remaining_elements_count" largest keys
+     * of the subtree to "curr_aggregate" */
+    void aggregateOfkLargestKeysRec(AVLvertex* curr_root,
+            int& remaining_elements_count, aggregate_type& curr_aggregate);
 
     int getTreeSize(AVLvertex* curr_root);
 
@@ -96,33 +191,309 @@ class AVLrankTree{
 
     void treeToSortedArray(AVLvertex* curr_root, KeyType* arr, int* curr_index);
 
-    AVLvertex* sortedArrayToAVLtree(KeyType* arr, int start, int end);
+    /* build a perfectly balanced tree out of the next "size" keys of a sorted
+     * sequence, setting the height, count and aggregate of every vertex on the
+     * way. The sequence is consumed in an inorder manner, so the vertexes are
+     * created in key order. The method returns the root of the new tree */
+    template <class InputIt>
+    AVLvertex* buildBalancedTree(InputIt& it, int size);
+
+    /* like buildBalancedTree(), but the keys are decoded from a snapshot.
+     * Once a key can't be read "ok" is set to false, and the vertexes that
+     * were built so far are returned for deletion */
+    template <class KeyCodec>
+    AVLvertex* loadBalancedTree(SnapshotReader& in, const KeyCodec& key_codec,
+            int size, bool& ok);
 
     AVLvertex* mergeTrees(AVLvertex* this_root, AVLvertex* other_root,
             int this_tree_size, int other_tree_size);
 
-    void updateNodeFieldsAfterMerge(AVLvertex* curr_root);
+    /* join the trees which their roots are "left" and "right" using "mid" as
+     * the connecting vertex, where every key in "left" is not greater than
+     * mid's key, and every key in "right" is not less than it. The method
+     * descends only along the spine of the taller tree, so it costs
+     * O(|height(left) - height(right)| + 1). It returns the new root */
+    AVLvertex* joinWithVertex(AVLvertex* left, AVLvertex* mid,
+            AVLvertex* right);
+
+    /* join two trees where every key in "left" is not greater than every key
+     * in "right". The method returns the new root */
+    AVLvertex* joinTrees(AVLvertex* left, AVLvertex* right);
+
+    /* unlink the vertex with the minimal key from the tree which it's root is
+     * curr_root into "min_vertex". The method returns the new root */
+    AVLvertex* removeMinVertex(AVLvertex* curr_root, AVLvertex*& min_vertex);
+
+    /* split the tree which it's root is curr_root into the tree of the keys
+     * that are less than "key" and the tree of the rest of the keys, in
+     * O(log n) and without allocating any vertex */
+    void splitTree(AVLvertex* curr_root, const KeyType& key, AVLvertex*& less,
+            AVLvertex*& greater_or_equal);
+
+    /* merge two trees by splitting t2 around the root of t1 and joining the
+     * recursive results, keeping every vertex of both trees. With m being
+     * the size of the smaller tree and n the size of the larger one, this
+     * costs O(m*log(n/m + 1)). The method returns the new root */
+    AVLvertex* unionTrees(AVLvertex* t1, AVLvertex* t2);
+
+    /* take all the vertexes of "other_tree", leaving it empty, and return
+     * their root. If the trees don't share their allocator, the keys are
+     * copied into new vertexes allocated by this tree */
+    AVLvertex* adoptTree(AVLrankTree& other_tree);
+
+    /* split the tree which it's root is curr_root into the tree of the keys
+     * that are less than "key", a single vertex with a matching key (or
+     * nullptr if there is none) and the tree of the rest of the keys */
+    void splitAroundKey(AVLvertex* curr_root, const KeyType& key,
+            AVLvertex*& less, AVLvertex*& equal, AVLvertex*& greater);
+
+    /* the join based set operations: t2 (or t1 for the difference) is split
+     * around the root of the other tree and the operation recurses on both
+     * sides, in parallel on "pool" if the trees hold more than "grain_size"
+     * keys together. Vertexes that are left out of the result are not
+     * deallocated (the allocator may not be thread safe), but collected as
+     * subtree roots into "garbage". The methods return the new root */
+    AVLvertex* unionSets(AVLvertex* t1, AVLvertex* t2,
+            std::vector<AVLvertex*>& garbage, ForkJoinPool& pool,
+            int grain_size);
+
+    AVLvertex* intersectSets(AVLvertex* t1, AVLvertex* t2,
+            std::vector<AVLvertex*>& garbage, ForkJoinPool& pool,
+            int grain_size);
+
+    AVLvertex* differenceSets(AVLvertex* t1, AVLvertex* t2,
+            std::vector<AVLvertex*>& garbage, ForkJoinPool& pool,
+            int grain_size);
+
+    /* deallocate the subtrees collected by a set operation */
+    void deleteGarbage(std::vector<AVLvertex*>& garbage);
+
+    /* a key of a batch deletion, and the number of vertexes with the key that
+     * are still to be deleted */
+    class BatchKey{
+    public:
+        KeyType key;
+        int remaining;
+    };
+
+    /* link the "size" unlinked vertexes of a sorted array into a perfectly
+     * balanced tree. The method returns the root of the new tree */
+    AVLvertex* linkBalancedTree(AVLvertex** vertexes, int size);
+
+    /* the batch operations descend the tree once for the whole sorted batch:
+     * the batch is split around the key of curr_root, each part is applied
+     * to a subtree, and the results are joined back through curr_root, which
+     * recalculates it's count and aggregate once. Parts larger than
+     * "grain_size" are applied in parallel on "pool", so no vertex is
+     * allocated or deallocated on the way. The methods return the new
+     * root */
+    AVLvertex* insertBatchRec(AVLvertex* curr_root, AVLvertex** first,
+            AVLvertex** last, ForkJoinPool& pool, int grain_size);
+
+    /* the unlinked vertexes are collected into "removed" */
+    AVLvertex* deleteBatchRec(AVLvertex* curr_root, BatchKey* first,
+            BatchKey* last, std::vector<AVLvertex*>& removed,
+            ForkJoinPool& pool, int grain_size);
+
+    /* return the number of keys in the tree that are not greater than
+     * "key" */
+    int countNotGreater(const KeyType& key);
 
     void printTreeRec(AVLvertex* curr_root);
 
 public:
 
+    /* mergeTrees() joins the vertexes of the smaller tree into the larger one
+     * only if it is at least this many times smaller, otherwise both trees
+     * are flattened to arrays and rebuilt, which is faster for trees of
+     * similar sizes */
+    static const int JOIN_MERGE_SIZE_RATIO = 4;
+
+    /* the set operations recurse in parallel only on trees that hold more
+     * than this many keys together */
+    static const int PARALLEL_GRAIN_SIZE = 1 << 13;
+
+    /* a bidirectional iterator over the keys of the tree in an inorder
+     * manner. The iterator keeps the path from the root to the current
+     * vertex, so advancing it costs amortized O(1) and needs no parent
+     * pointers in the vertexes. An iterator is invalidated by any insertion
+     * or deletion */
+    class iterator{
+        const AVLrankTree* tree;
+        AVLvertex* path[MAX_HEIGHT];
+        /* the number of vertexes on the path, 0 for the end iterator */
+        int depth;
+
+        explicit iterator(const AVLrankTree* tree) : tree(tree), depth(0) {}
+
+        /* push the leftmost (or rightmost) path of the subtree which it's
+         * root is curr_root */
+        void descendLeft(AVLvertex* curr_root){
+            while(curr_root != nullptr){
+                path[depth++] = curr_root;
+                curr_root = curr_root->left;
+            }
+        }
+
+        void descendRight(AVLvertex* curr_root){
+            while(curr_root != nullptr){
+                path[depth++] = curr_root;
+                curr_root = curr_root->right;
+            }
+        }
+
+        friend class AVLrankTree;
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef KeyType value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const KeyType* pointer;
+        typedef const KeyType& reference;
+
+        iterator() : tree(nullptr), depth(0) {}
+
+        /* only the used part of the path is copied */
+        iterator(const iterator& other) : tree(other.tree), depth(other.depth){
+            for(int i = 0; i < depth; i++){
+                path[i] = other.path[i];
+            }
+        }
+
+        iterator& operator=(const iterator& other){
+            tree = other.tree;
+            depth = other.depth;
+            for(int i = 0; i < depth; i++){
+                path[i] = other.path[i];
+            }
+            return *this;
+        }
+
+        const KeyType& operator*() const {return path[depth - 1]->key;}
+
+        const KeyType* operator->() const {return &path[depth - 1]->key;}
+
+        iterator& operator++(){
+            AVLvertex* curr = path[depth - 1];
+            if(curr->right != nullptr){
+                /* the successor is the minimum of the right subtree */
+                descendLeft(curr->right);
+                return *this;
+            }
+
+            /* otherwise it's the first ancestor we reach from it's left
+             * subtree */
+            depth--;
+            while(depth > 0 && path[depth - 1]->right == curr){
+                curr = path[--depth];
+            }
+            return *this;
+        }
+
+        iterator operator++(int){
+            iterator prev(*this);
+            ++*this;
+            return prev;
+        }
+
+        iterator& operator--(){
+            if(depth == 0){
+                /* the predecessor of the end is the maximum of the tree */
+                descendRight(tree->root);
+                return *this;
+            }
+
+            AVLvertex* curr = path[depth - 1];
+            if(curr->left != nullptr){
+                descendRight(curr->left);
+                return *this;
+            }
+
+            depth--;
+            while(depth > 0 && path[depth - 1]->left == curr){
+                curr = path[--depth];
+            }
+            return *this;
+        }
+
+        iterator operator--(int){
+            iterator prev(*this);
+            --*this;
+            return prev;
+        }
+
+        bool operator==(const iterator& other) const {
+            if(depth == 0 || other.depth == 0){
+                return depth == other.depth;
+            }
+            return path[depth - 1] == other.path[other.depth - 1];
+        }
+
+        bool operator!=(const iterator& other) const {
+            return !(*this == other);
+        }
+    };
+
     /* constructor  */
     AVLrankTree();
 
+    /* construct an empty tree that orders it's keys by "compare" */
+    explicit AVLrankTree(const Compare& compare);
+
+    /* construct a tree out of the keys in the range [first, last), see
+     * assign() */
+    template <class InputIt>
+    AVLrankTree(InputIt first, InputIt last);
+
     /* destructor  */
     ~AVLrankTree();
 
-    AVLrankTree(const AVLrankTree& tree) = delete;
+    /* copy every vertex in O(n), see cloneTree(). The copy gets an
+     * allocator of it's own */
+    AVLrankTree(const AVLrankTree& tree);
     AVLrankTree& operator=(const AVLrankTree& tree);
 
+    /* take the vertexes of "tree" in O(1), leaving it empty */
+    AVLrankTree(AVLrankTree&& tree);
+    AVLrankTree& operator=(AVLrankTree&& tree);
+
+    /* exchange the content of the trees in O(1). Iterators to the trees
+     * are invalidated */
+    void swap(AVLrankTree& other_tree);
+
+    /* return a copy of the tree, made like the copy constructor, where the
+     * subtrees of more than "grain_size" keys are copied in parallel on
+     * "pool". The copy is sequential if the allocator can't create vertexes
+     * concurrently */
+    AVLrankTree clone(int grain_size = PARALLEL_GRAIN_SIZE,
+            ForkJoinPool& pool = ForkJoinPool::shared()) const;
+
+    /* delete every vertex from the tree */
+    void clear();
+
+    /* replace the content of the tree with the keys in the range
+     * [first, last), which must be sorted. The tree is built perfectly
+     * balanced in O(n), without comparisons or rotations, and an arena
+     * allocator carves all of it's vertexes out of a single chunk */
+    template <class ForwardIt>
+    void assignSorted(ForwardIt first, ForwardIt last);
+
+    /* like assignSorted(), but the keys are sorted first if they are not in
+     * order already */
+    template <class InputIt>
+    void assign(InputIt first, InputIt last);
+
     /* return true if a vertex with a matching key exists int the tree, false
      * otherwise  */
     bool keyExists(KeyType key);
 
     /* the interface method to insert a vertex with a "key" to the
-     * tree */
-    void insertKey(KeyType key);
+     * tree. The key is moved into the vertex if it's an rvalue */
+    void insertKey(const KeyType& key);
+    void insertKey(KeyType&& key);
+
+    /* insert a vertex with a key constructed in place out of "args" */
+    template <class... Args>
+    void emplace(Args&&... args);
 
     /* the interface method to delete a vertex with the matching key from the
      * tree */
@@ -133,32 +504,381 @@ public:
     template <class Func>
     void inorder(Func& doSomething){inorderAux(root, doSomething);}
 
-    int sumOfkLargestKeys(int k);
+    /* iterators to the minimal key of the tree and past the maximal one */
+    iterator begin() const;
+    iterator end() const {return iterator(this);}
+
+    /* return an iterator to the first key that is not less than "key", or
+     * end() if there is no such key */
+    iterator lowerBound(const KeyType& key) const {return lowerBoundAux(key);}
+
+    /* return an iterator to the first key that is greater than "key", or
+     * end() if there is no such key */
+    iterator upperBound(const KeyType& key) const {return upperBoundAux(key);}
+
+    /* return the range of keys that are equal to "key" */
+    std::pair<iterator, iterator> equalRange(const KeyType& key) const {
+        return std::make_pair(lowerBoundAux(key), upperBoundAux(key));
+    }
+
+    /* apply the user supplied function to every key between "low" and "high"
+     * (inclusive) in an inorder manner. Subtrees that are out of the range
+     * are not visited, so k keys are visited in O(log n + k) */
+    template <class Func>
+    void forEachInRange(const KeyType& low, const KeyType& high,
+            Func& doSomething){
+        forEachInRangeAux(root, low, high, doSomething);
+    }
+
+    /* return the aggregate of the k largest keys of the tree, or of the
+     * whole tree if it has less than k keys */
+    aggregate_type aggregateOfkLargestKeys(int k);
+
+    /* the name of aggregateOfkLargestKeys() from when the aggregate was
+     * always the sum of the keys */
+    aggregate_type sumOfkLargestKeys(int k){
+        return aggregateOfkLargestKeys(k);
+    }
 
+    /* return the aggregate of the keys between "low" and "high" (inclusive)
+     * in O(log n). The aggregate is combined in key order, so the
+     * augmentation need not be commutative or invertible */
+    aggregate_type aggregate(const KeyType& low, const KeyType& high);
+
+    /* return an iterator to the first key, in an inorder manner, for which
+     * "predicate" holds on the aggregate of the keys up to and including it,
+     * or end() if there is no such key. The predicate must be monotone: once
+     * it holds for some prefix it must hold for every longer prefix (e.g.
+     * "the sum is at least x" for non negative keys). Costs O(log n) calls
+     * to the predicate */
+    template <class Predicate>
+    iterator prefixSearch(Predicate predicate);
+
+    /* return the number of keys in the tree */
+    int size();
+
+    /* return an iterator to the k-th smallest key (k-th largest key) of the
+     * tree, counting from 1, or end() if k is out of range */
+    iterator select(int k);
+    iterator selectLargest(int k);
+
+    /* return the number of keys in the tree that are less than "key" */
+    int rank(const KeyType& key) {return rankAux(key);}
+
+    /* return the number of keys in the tree between "low" and "high"
+     * (inclusive) */
+    int countInRange(const KeyType& low, const KeyType& high);
+
+    /* move every key of "other_tree" into the tree, leaving "other_tree"
+     * empty. When the trees share their allocator and one of them is much
+     * smaller, the smaller tree's vertexes are split into the larger tree
+     * and reused, otherwise the merged tree is rebuilt from sorted arrays */
     void mergeTrees(AVLrankTree& other_tree);
 
+    /* move every vertex with a key that is not less than "key" into
+     * "greater_or_equal_tree" in O(log n), keeping the rest in the tree. The
+     * previous content of "greater_or_equal_tree" is deleted. Both parts keep
+     * using the tree's allocator, so with an allocator that can't create
+     * vertexes concurrently (ArenaVertexAllocator) the two trees must not be
+     * changed by different threads at the same time, see splitDetached() */
+    void split(KeyType key, AVLrankTree& greater_or_equal_tree);
+
+    /* like split(), but "greater_or_equal_tree" gets an allocator of it's own
+     * when the tree's allocator can't create vertexes concurrently, so the
+     * two parts may be handed to different threads. The moved vertexes are
+     * then copied in O(k), with k being the number of keys that moved */
+    void splitDetached(KeyType key, AVLrankTree& greater_or_equal_tree);
+
+    /* move every vertex of "other_tree" into the tree, leaving "other_tree"
+     * empty. Every key in "other_tree" must not be less than any key in the
+     * tree. The join costs O(log n) if the trees share their allocator,
+     * otherwise the vertexes of "other_tree" are copied */
+    void join(AVLrankTree& other_tree);
+
+    /* the set operations: the tree becomes the union, intersection or
+     * difference of itself and "other_tree", which is left empty. Both trees
+     * are treated as sets, so a key that is in both trees appears once in
+     * the union. The operations reuse the vertexes of both trees and cost
+     * O(m*log(n/m + 1)) work, with m being the size of the smaller tree and
+     * n the size of the larger one. Subproblems larger than "grain_size"
+     * keys are solved in parallel on "pool" */
+    void unionWith(AVLrankTree& other_tree,
+            int grain_size = PARALLEL_GRAIN_SIZE,
+            ForkJoinPool& pool = ForkJoinPool::shared());
+
+    void intersectWith(AVLrankTree& other_tree,
+            int grain_size = PARALLEL_GRAIN_SIZE,
+            ForkJoinPool& pool = ForkJoinPool::shared());
+
+    void differenceWith(AVLrankTree& other_tree,
+            int grain_size = PARALLEL_GRAIN_SIZE,
+            ForkJoinPool& pool = ForkJoinPool::shared());
+
+    /* insert every key in the range [first, last) to the tree. The batch is
+     * sorted and merged into the tree in a single pass, which costs
+     * O(m*log(n/m + 1)) for a batch of m keys and a tree of n keys, and the
+     * count and aggregate of every vertex on the way are recalculated once.
+     * Batch parts of more than "grain_size" keys are merged in parallel on
+     * "pool" */
+    template <class InputIt>
+    void insertBatch(InputIt first, InputIt last,
+            int grain_size = PARALLEL_GRAIN_SIZE,
+            ForkJoinPool& pool = ForkJoinPool::shared());
+
+    /* delete a vertex with a matching key for every key in the range
+     * [first, last), in a single pass like insertBatch() */
+    template <class InputIt>
+    void deleteBatch(InputIt first, InputIt last,
+            int grain_size = PARALLEL_GRAIN_SIZE,
+            ForkJoinPool& pool = ForkJoinPool::shared());
+
+    /* the lookups by a key of another type, such as std::string_view for
+     * std::string keys, which the comparator compares with the keys
+     * directly. They exist only if the comparator is transparent (see
+     * KeyCompare.h) */
+    template <class LookupKey,
+            class = TransparentLookup<Compare, LookupKey, KeyType> >
+    bool keyExists(const LookupKey& key){
+        return searchVertex(key) != nullptr;
+    }
+
+    template <class LookupKey,
+            class = TransparentLookup<Compare, LookupKey, KeyType> >
+    iterator lowerBound(const LookupKey& key) const {return lowerBoundAux(key);}
+
+    template <class LookupKey,
+            class = TransparentLookup<Compare, LookupKey, KeyType> >
+    iterator upperBound(const LookupKey& key) const {return upperBoundAux(key);}
+
+    template <class LookupKey,
+            class = TransparentLookup<Compare, LookupKey, KeyType> >
+    std::pair<iterator, iterator> equalRange(const LookupKey& key) const {
+        return std::make_pair(lowerBoundAux(key), upperBoundAux(key));
+    }
+
+    template <class LookupKey,
+            class = TransparentLookup<Compare, LookupKey, KeyType> >
+    int rank(const LookupKey& key) {return rankAux(key);}
+
+    /* return an immutable snapshot of the tree, which answers lookups and
+     * order statistics queries without walking vertexes, see FrozenTree.h.
+     * The snapshot searches with operator<, so the tree must use the
+     * default order */
+    FrozenAVLrankTree<KeyType, Augmentation> freeze() const;
+
+    /* write the keys of the tree to a snapshot file at "path" (see
+     * TreeSnapshot.h) in an inorder manner, encoded by the given codec. The
+     * method returns false if the file could not be written, in which case
+     * a previous snapshot at "path" is left as it was */
+    template <class KeyCodec = TrivialCodec<KeyType> >
+    bool saveTo(const std::string& path,
+            const KeyCodec& key_codec = KeyCodec()) const;
+
+    /* replace the content of the tree with a snapshot written by saveTo().
+     * The file is streamed into a perfectly balanced tree in O(n), and the
+     * counts and aggregates are recalculated on the way rather than read.
+     * If the file can't be read, is not a snapshot of keys only or fails
+     * it's checksum, the tree is left as it was and false is returned */
+    template <class KeyCodec = TrivialCodec<KeyType> >
+    bool loadFrom(const std::string& path,
+            const KeyCodec& key_codec = KeyCodec());
+
+    /* report the counters of the Stats policy since the tree was created or
+     * resetStats() was called (all zero under NoTreeStats, see TreeStats.h),
+     * and the shape of the tree - the depth histogram, the average depth
+     * versus log2(n) and the bytes per vertex. The shape is measured in
+     * O(n) */
+    TreeStatsReport stats() const;
+
+    /* zero the counters of the Stats policy */
+    void resetStats();
+
     void printTree();
+
+private:
+    /* the bodies of lowerBound(), upperBound() and rank() */
+    template <class LookupKey>
+    iterator lowerBoundAux(const LookupKey& key) const;
+
+    template <class LookupKey>
+    iterator upperBoundAux(const LookupKey& key) const;
+
+    template <class LookupKey>
+    int rankAux(const LookupKey& key);
 };
 
-template<class KeyType>
-AVLrankTree<KeyType>::AVLrankTree()  : root(nullptr) {}
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLrankTree()  : root(nullptr) {}
 
-template<class KeyType>
-AVLrankTree<KeyType>::~AVLrankTree() {
-    /* call the recursive method that deletes every vertex from
-     * the tree whilst preforming a postorder traversal */
-    deleteTree(root);
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLrankTree(const Compare& compare)
+        : root(nullptr), compare(compare) {}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+template <class InputIt>
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLrankTree(InputIt first, InputIt last) : root(nullptr) {
+    assign(first, last);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::~AVLrankTree() {
+    clear();
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::clear() {
+    if(allocator.canReleaseAll() &&
+            std::is_trivially_destructible<AVLvertex>::value){
+        /* nothing has to be done per vertex, so the arena holding the
+         * vertexes is dropped as a whole */
+        allocator.releaseAll();
+    } else {
+        /* call the recursive method that deletes every vertex from
+         * the tree whilst preforming a postorder traversal */
+        deleteTree(root);
+    }
+    root = nullptr;
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+template <class ForwardIt>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::assignSorted(ForwardIt first, ForwardIt last) {
+    clear();
+
+    int size = std::distance(first, last);
+    allocator.reserve(size);
+    root = buildBalancedTree(first, size);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+template <class InputIt>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::assign(InputIt first, InputIt last) {
+    std::vector<KeyType> keys(first, last);
+    auto keyLess = [this](const KeyType& key1, const KeyType& key2){
+        return compareKeys(key1, key2) < 0;
+    };
+    if(!std::is_sorted(keys.begin(), keys.end(), keyLess)){
+        std::stable_sort(keys.begin(), keys.end(), keyLess);
+    }
+    assignSorted(keys.begin(), keys.end());
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLrankTree(const AVLrankTree& tree)
+        : root(nullptr), compare(tree.compare) {
+    root = cloneTree(tree.root);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLrankTree(AVLrankTree&& tree)
+        : root(nullptr) {
+    swap(tree);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>&
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::operator=(const AVLrankTree & tree) {
+    if(&tree != this){
+        AVLrankTree copy(tree);
+        swap(copy);
+    }
+    return *this;
 }
 
-template<class KeyType>
-AVLrankTree<KeyType>& AVLrankTree<KeyType>::operator=
-        (const AVLrankTree & tree) {
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>&
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::operator=(AVLrankTree&& tree) {
+    if(&tree != this){
+        clear();
+        swap(tree);
+    }
     return *this;
 }
 
-template<class KeyType>
-bool AVLrankTree<KeyType>::keyExists(KeyType key){
-    AVLvertex* v = searchVertexRecursive(root, key);
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::swap(AVLrankTree& other_tree) {
+    std::swap(root, other_tree.root);
+    std::swap(allocator, other_tree.allocator);
+    std::swap(compare, other_tree.compare);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::clone(int grain_size,
+        ForkJoinPool& pool) const {
+    AVLrankTree copy(compare);
+    if(copy.allocator.canCreateConcurrently()){
+        copy.root = copy.cloneTreeParallel(root, pool, grain_size);
+    } else {
+        copy.root = copy.cloneTree(root);
+    }
+    return copy;
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::cloneTree(const AVLvertex* curr_root) {
+    if(curr_root == nullptr){
+        return nullptr;
+    }
+
+    AVLvertex* new_root = createVertex(*curr_root);
+    new_root->left = nullptr;
+    new_root->right = nullptr;
+    try {
+        new_root->left = cloneTree(curr_root->left);
+        new_root->right = cloneTree(curr_root->right);
+    } catch (...) {
+        /* drop the part that was already copied */
+        deleteTree(new_root);
+        throw;
+    }
+    return new_root;
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::cloneTreeParallel(const AVLvertex* curr_root,
+        ForkJoinPool& pool, int grain_size) {
+    if(curr_root == nullptr || curr_root->count <= grain_size){
+        return cloneTree(curr_root);
+    }
+
+    AVLvertex* new_root = createVertex(*curr_root);
+    new_root->left = nullptr;
+    new_root->right = nullptr;
+    try {
+        pool.invokeBoth(
+                [&]{new_root->left = cloneTreeParallel(curr_root->left, pool,
+                        grain_size);},
+                [&]{new_root->right = cloneTreeParallel(curr_root->right,
+                        pool, grain_size);});
+    } catch (...) {
+        deleteTree(new_root);
+        throw;
+    }
+    return new_root;
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+bool AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::keyExists(KeyType key){
+    AVLvertex* v = searchVertex(key);
     if(v == nullptr) {
         return false;
     } else {
@@ -166,23 +886,32 @@ bool AVLrankTree<KeyType>::keyExists(KeyType key){
     }
 }
 
-template<class KeyType>
-typename AVLrankTree<KeyType>::AVLvertex*
-AVLrankTree<KeyType>::searchVertexRecursive
-        (AVLrankTree::AVLvertex* curr_root, KeyType& key){
-    if (curr_root == nullptr) {
-        return nullptr;
-    } else if (curr_root->key == key) {
-        return curr_root;
-    } else if (curr_root->key < key) {
-        return searchVertexRecursive(curr_root->right, key);
-    } else {
-        return searchVertexRecursive(curr_root->left, key);
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+template <class LookupKey>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::searchVertex(const LookupKey& key) const {
+    AVLvertex* curr_root = root;
+    int length = 0;
+    while (curr_root != nullptr) {
+        length++;
+        int result = compareKeys(key, curr_root->key);
+        if (result == 0) {
+            statistics.countPath(length);
+            return curr_root;
+        } else if (result > 0) {
+            curr_root = curr_root->right;
+        } else {
+            curr_root = curr_root->left;
+        }
     }
+    statistics.countPath(length);
+    return nullptr;
 }
 
-template<class KeyType>
-int AVLrankTree<KeyType>::getHeight(AVLrankTree::AVLvertex *v) {
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+int AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::getHeight(AVLrankTree::AVLvertex *v) {
     if(v == nullptr){
         return 0;
     } else {
@@ -190,8 +919,9 @@ int AVLrankTree<KeyType>::getHeight(AVLrankTree::AVLvertex *v) {
     }
 }
 
-template<class KeyType>
-int AVLrankTree<KeyType>::updateHeight(AVLrankTree::AVLvertex *v) {
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+int AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::updateHeight(AVLrankTree::AVLvertex *v) {
     if(v == nullptr){
         return 0;
     } else{
@@ -200,13 +930,15 @@ int AVLrankTree<KeyType>::updateHeight(AVLrankTree::AVLvertex *v) {
     }
 }
 
-template<class KeyType>
-int AVLrankTree<KeyType>::max(int h1, int h2) {
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+int AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::max(int h1, int h2) {
     return h1 > h2 ? h1 : h2;
 }
 
-template<class KeyType>
-int AVLrankTree<KeyType>::getBF(AVLrankTree::AVLvertex *v) {
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+int AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::getBF(AVLrankTree::AVLvertex *v) {
     if(v == nullptr){
         return 0;
     } else{
@@ -214,9 +946,10 @@ int AVLrankTree<KeyType>::getBF(AVLrankTree::AVLvertex *v) {
     }
 }
 
-template<class KeyType>
-typename AVLrankTree<KeyType>::AVLvertex*
-AVLrankTree<KeyType>::rotateRight(AVLrankTree::AVLvertex *v) {
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::rotateRight(AVLrankTree::AVLvertex *v) {
     AVLvertex* to_rotate = v;
     AVLvertex* to_rotate_left_child = to_rotate->left;
     AVLvertex* right_subtree = to_rotate_left_child->right;
@@ -233,9 +966,10 @@ AVLrankTree<KeyType>::rotateRight(AVLrankTree::AVLvertex *v) {
     return to_rotate_left_child;
 }
 
-template<class KeyType>
-typename AVLrankTree<KeyType>::AVLvertex*
-AVLrankTree<KeyType>::rotateLeft(AVLrankTree::AVLvertex *v) {
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::rotateLeft(AVLrankTree::AVLvertex *v) {
     AVLvertex* to_rotate = v;
     AVLvertex* to_rotate_right_child = to_rotate->right;
     AVLvertex* left_subtree = to_rotate_right_child->left;
@@ -252,99 +986,133 @@ AVLrankTree<KeyType>::rotateLeft(AVLrankTree::AVLvertex *v) {
     return to_rotate_right_child;
 }
 
-template<class KeyType>
-void AVLrankTree<KeyType>::insertKey(KeyType key) {
-    root = insertVertexRecursive(root, key);
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::insertKey(const KeyType& key) {
+    linkVertex(createVertex(InPlace(), key));
 }
 
-template<class KeyType>
-typename AVLrankTree<KeyType>::AVLvertex*
-AVLrankTree<KeyType>::insertVertexRecursive(AVLrankTree::AVLvertex *curr_root,
-        KeyType &key) {
-
-    /* preform the usual insertion like in a regular binary search tree */
-    if(curr_root == nullptr){
-        return new AVLvertex(key);
-    } else if(curr_root->key < key){
-        curr_root->count++; // added
-        curr_root->sum += key.getKey(); // added
-        curr_root->right = insertVertexRecursive(curr_root->right, key);
-    } else {
-        curr_root->count++; // added
-        curr_root->sum += key.getKey(); // added
-        curr_root->left = insertVertexRecursive(curr_root->left, key);
-    }
-
-    updateHeight(curr_root);
-
-    /* rebalance the current root if needed */
-    return rebalanceVertex(curr_root);
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::insertKey(KeyType&& key) {
+    linkVertex(createVertex(InPlace(), std::move(key)));
 }
 
-template<class KeyType>
-void AVLrankTree<KeyType>::deleteKey(KeyType key) {
-    root = deleteVertexRecursive(root, key);
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+template <class... Args>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::emplace(Args&&... args) {
+    linkVertex(createVertex(InPlace(), std::forward<Args>(args)...));
 }
 
-template<class KeyType>
-typename AVLrankTree<KeyType>::AVLvertex*
-AVLrankTree<KeyType>::deleteVertexRecursive
-        (AVLrankTree::AVLvertex *curr_root, KeyType &key) {
-
-    /* preform the usual deletion like in a regular binary search tree */
-    if(curr_root == nullptr){
-        return curr_root;
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::linkVertex(AVLvertex* new_vertex) {
+    AVLvertex** path[MAX_HEIGHT];
+    int depth = 0;
+
+    /* preform the usual insertion like in a regular binary search tree,
+     * while recording the links that lead to the new vertex */
+    AVLvertex** link = &root;
+    while(*link != nullptr){
+        path[depth++] = link;
+        if(compareKeys(new_vertex->key, (*link)->key) > 0){
+            link = &(*link)->right;
+        } else {
+            link = &(*link)->left;
+        }
     }
+    *link = new_vertex;
+    statistics.countPath(depth);
 
-    if(curr_root->key < key){
-        curr_root->count--; // added
-        curr_root->sum -= key.getKey(); // added
-        curr_root->right = deleteVertexRecursive(curr_root->right, key);
-    } else if (key < curr_root->key){
-        curr_root->count--; // added
-        curr_root->sum -= key.getKey(); // added
-        curr_root->left = deleteVertexRecursive(curr_root->left, key);
-    } else { /* means that curr_root is the vertex to delete */
-        if(curr_root->left == nullptr && curr_root->right == nullptr){
-            /* no children case */
-            AVLvertex* temp = curr_root;
-            curr_root = nullptr;
-            delete temp;
-        } else if(curr_root->left == nullptr || curr_root->right == nullptr){
-            /* one child case */
-            AVLvertex* existing_child;
-            if(curr_root->left != nullptr){
-                existing_child = curr_root->left;
-            } else {
-                existing_child = curr_root->right;
-            }
-            *curr_root = *existing_child;
-            delete existing_child;
+    rebalancePath(path, depth);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::deleteKey(KeyType key) {
+    AVLvertex** path[MAX_HEIGHT];
+    int depth = 0;
+
+    /* search the vertex to delete, while recording the links that lead to
+     * it */
+    AVLvertex** link = &root;
+    while(*link != nullptr){
+        int result = compareKeys(key, (*link)->key);
+        if(result == 0){
+            break;
+        }
+        path[depth++] = link;
+        if(result > 0){
+            link = &(*link)->right;
         } else {
-            /* 2 children case */
-            AVLvertex* successor = curr_root->right;
-            while (successor->left != nullptr){
-                successor = successor->left;
-            }
-            curr_root->key = successor->key;
-            curr_root->right = deleteVertexRecursive(curr_root->right,
-                                                     successor->key);
+            link = &(*link)->left;
         }
     }
+    /* the matching vertex was compared as well */
+    statistics.countPath(*link == nullptr ? depth : depth + 1);
+    if(*link == nullptr){
+        /* the key is not in the tree, so no count or aggregate has changed */
+        return;
+    }
 
-    if(curr_root == nullptr){
-        /* means the deleted vertex was the only vertex in the tree */
-        return curr_root;
+    /* preform the usual deletion like in a regular binary search tree */
+    AVLvertex* to_delete = *link;
+    if(to_delete->left == nullptr || to_delete->right == nullptr){
+        /* no children or one child case */
+        if(to_delete->left != nullptr){
+            *link = to_delete->left;
+        } else {
+            *link = to_delete->right;
+        }
+    } else {
+        /* 2 children case: the successor's key is moved to the vertex, and
+         * the successor is unlinked from the right subtree */
+        path[depth++] = link;
+        AVLvertex** successor_link = &to_delete->right;
+        while((*successor_link)->left != nullptr){
+            path[depth++] = successor_link;
+            successor_link = &(*successor_link)->left;
+        }
+        AVLvertex* successor = *successor_link;
+        to_delete->key = std::move(successor->key);
+        *successor_link = successor->right;
+        to_delete = successor;
     }
+    destroyVertex(to_delete);
 
-    updateHeight(curr_root);
+    rebalancePath(path, depth);
+}
 
-    /* rebalance the current root if needed */
-    return rebalanceVertex(curr_root);
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::rebalancePath(AVLvertex** path[], int depth) {
+    int i = depth - 1;
+    bool height_changed = true;
+    while(i >= 0 && height_changed){
+        AVLvertex* curr_root = *path[i];
+        int old_height = curr_root->height;
+
+        updateHeight(curr_root);
+
+        /* rebalance the current root if needed, this also updates it's count
+         * and aggregate */
+        *path[i] = rebalanceVertex(curr_root);
+
+        height_changed = (*path[i])->height != old_height;
+        i--;
+    }
+
+    /* the rest of the path keeps it's shape */
+    for(; i >= 0; i--){
+        updateCount(*path[i]);
+        updateAggregate(*path[i]);
+    }
 }
 
-template<class KeyType>
-void AVLrankTree<KeyType>::deleteTree(AVLrankTree::AVLvertex *curr_root) {
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::deleteTree(AVLrankTree::AVLvertex *curr_root) {
 
     /* base case */
     if(curr_root == nullptr){
@@ -353,32 +1121,35 @@ void AVLrankTree<KeyType>::deleteTree(AVLrankTree::AVLvertex *curr_root) {
 
     deleteTree(curr_root->left);
     deleteTree(curr_root->right);
-    delete curr_root;
+    destroyVertex(curr_root);
 }
 
-template<class KeyType>
-typename AVLrankTree<KeyType>::AVLvertex*
-AVLrankTree<KeyType>::rebalanceVertex(AVLvertex* curr_root){
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::rebalanceVertex(AVLvertex* curr_root){
 
     int BF = getBF(curr_root);
 
     if(BF >= -1 && BF <= 1) {
         /* balance factor is in bound therefore no rotations are needed */
-        updateSumAndCountAfterRotation(curr_root);
+        updateCountAndAggregateAfterRotation(curr_root);
         return curr_root;
     }
 
     if(BF == 2){
         if(getBF(curr_root->left) >= 0){
             /* LL rotation */
+            statistics.countSingleRotation();
             AVLvertex* new_root = rotateRight(curr_root);
-            updateSumAndCountAfterRotation(new_root);
+            updateCountAndAggregateAfterRotation(new_root);
             return new_root;
         } else {
             /* LR rotation */
+            statistics.countDoubleRotation();
             curr_root->left = rotateLeft(curr_root->left);
             AVLvertex* new_root = rotateRight(curr_root);
-            updateSumAndCountAfterRotation(new_root);
+            updateCountAndAggregateAfterRotation(new_root);
             return new_root;
         }
     }
@@ -386,14 +1157,16 @@ AVLrankTree<KeyType>::rebalanceVertex(AVLvertex* curr_root){
     if(BF == -2){
         if(getBF(curr_root->right) <= 0){
             /* RR rotation */
+            statistics.countSingleRotation();
             AVLvertex* new_root = rotateLeft(curr_root);
-            updateSumAndCountAfterRotation(new_root);
+            updateCountAndAggregateAfterRotation(new_root);
             return new_root;
         } else {
             /* RL rotation */
+            statistics.countDoubleRotation();
             curr_root->right = rotateRight(curr_root->right);
             AVLvertex* new_root = rotateLeft(curr_root);
-            updateSumAndCountAfterRotation(new_root);
+            updateCountAndAggregateAfterRotation(new_root);
             return new_root;
         }
     }
@@ -401,8 +1174,9 @@ AVLrankTree<KeyType>::rebalanceVertex(AVLvertex* curr_root){
     return curr_root;
 }
 
-template<class KeyType>
-int AVLrankTree<KeyType>::getCount(AVLrankTree::AVLvertex *v) {
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+int AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::getCount(AVLrankTree::AVLvertex *v) {
     if(v == nullptr) {
         return 0;
     } else {
@@ -410,17 +1184,20 @@ int AVLrankTree<KeyType>::getCount(AVLrankTree::AVLvertex *v) {
     }
 }
 
-template<class KeyType>
-int AVLrankTree<KeyType>::getSum(AVLrankTree::AVLvertex *v) {
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::aggregate_type
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::getAggregate(AVLrankTree::AVLvertex *v) {
     if(v == nullptr) {
-        return 0;
+        return Augmentation::identity();
     } else {
-        return v->sum;
+        return v->aggregate;
     }
 }
 
-template<class KeyType>
-int AVLrankTree<KeyType>::updateCount(AVLrankTree::AVLvertex *v) {
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+int AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::updateCount(AVLrankTree::AVLvertex *v) {
     if(v == nullptr) {
         return 0;
     } else {
@@ -429,74 +1206,85 @@ int AVLrankTree<KeyType>::updateCount(AVLrankTree::AVLvertex *v) {
     }
 }
 
-template<class KeyType>
-int AVLrankTree<KeyType>::updateSum(AVLrankTree::AVLvertex *v) {
-    if(v == nullptr) {
-        return 0;
-    } else {
-        v->sum = (v->key).getKey() + getSum(v->left) + getSum(v->right);
-        return v->sum;
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::updateAggregate(AVLrankTree::AVLvertex *v) {
+    if(v != nullptr) {
+        v->aggregate = Augmentation::combine(
+                Augmentation::combine(getAggregate(v->left),
+                        Augmentation::fromKey(v->key)),
+                getAggregate(v->right));
     }
 }
 
-template<class KeyType>
-void AVLrankTree<KeyType>::updateSumAndCountAfterRotation(AVLrankTree::AVLvertex *v) {
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::updateCountAndAggregateAfterRotation(AVLrankTree::AVLvertex *v) {
     updateCount(v->left);
-    updateSum(v->left);
+    updateAggregate(v->left);
 
     updateCount(v->right);
-    updateSum(v->right);
+    updateAggregate(v->right);
 
     updateCount(v);
-    updateSum(v);
+    updateAggregate(v);
 }
 
-template<class KeyType>
-int AVLrankTree<KeyType>::sumOfkLargestKeys(int k) {
-    int sum = 0;
-    sumOfkLargestKeysRec(root, k, sum);
-    return sum;
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::aggregate_type
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::aggregateOfkLargestKeys(int k) {
+    aggregate_type result = Augmentation::identity();
+    aggregateOfkLargestKeysRec(root, k, result);
+    return result;
 }
 
-template<class KeyType>
-void AVLrankTree<KeyType>::sumOfkLargestKeysRec(AVLrankTree::AVLvertex *curr_root,
-        int &remaining_elements_count, int &curr_sum) {
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::aggregateOfkLargestKeysRec(AVLrankTree::AVLvertex *curr_root,
+        int &remaining_elements_count, aggregate_type &curr_aggregate) {
     if (curr_root == nullptr) {
         return;
     }
 
+    /* the keys are visited from the largest down, so every part is
+     * prepended to the aggregate */
     if(curr_root->count == remaining_elements_count) {
         remaining_elements_count = 0;
-        curr_sum += curr_root->sum;
+        curr_aggregate = Augmentation::combine(curr_root->aggregate,
+                curr_aggregate);
         return;
     }
     else if(curr_root->count < remaining_elements_count){
         remaining_elements_count -= curr_root->count;
-        curr_sum += curr_root->sum;
+        curr_aggregate = Augmentation::combine(curr_root->aggregate,
+                curr_aggregate);
         return;
     }
     else {
-        sumOfkLargestKeysRec(curr_root->right, remaining_elements_count,
-                curr_sum);
+        aggregateOfkLargestKeysRec(curr_root->right, remaining_elements_count,
+                curr_aggregate);
         if(remaining_elements_count == 0){
             return;
         }
         else{
-            curr_sum += (curr_root->key).getKey();
+            curr_aggregate = Augmentation::combine(
+                    Augmentation::fromKey(curr_root->key), curr_aggregate);
             remaining_elements_count--;
             if(remaining_elements_count == 0){
                 return;
             }
             else {
-                sumOfkLargestKeysRec(curr_root->left, remaining_elements_count,
-                        curr_sum);
+                aggregateOfkLargestKeysRec(curr_root->left,
+                        remaining_elements_count, curr_aggregate);
             }
         }
     }
 }
 
-template<class KeyType>
-int AVLrankTree<KeyType>::getTreeSize(AVLrankTree::AVLvertex *curr_root) {
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+int AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::getTreeSize(AVLrankTree::AVLvertex *curr_root) {
     if(curr_root == nullptr){
         return 0;
     } else {
@@ -504,19 +1292,152 @@ int AVLrankTree<KeyType>::getTreeSize(AVLrankTree::AVLvertex *curr_root) {
     }
 }
 
-template<class KeyType>
-void AVLrankTree<KeyType>::mergeTrees(AVLrankTree &other_tree) {
-    AVLvertex* new_root = mergeTrees(root, other_tree.root, getTreeSize(root),
-            getTreeSize(other_tree.root));
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::mergeTrees(AVLrankTree &other_tree) {
+    int this_tree_size = getTreeSize(root);
+    int other_tree_size = getTreeSize(other_tree.root);
+    int smaller_size = this_tree_size;
+    int larger_size = other_tree_size;
+    if(smaller_size > larger_size){
+        smaller_size = other_tree_size;
+        larger_size = this_tree_size;
+    }
+
+    if(allocator == other_tree.allocator &&
+            (long long)smaller_size * JOIN_MERGE_SIZE_RATIO <= larger_size){
+        /* split the larger tree around the vertexes of the smaller one */
+        if(this_tree_size <= other_tree_size){
+            root = unionTrees(root, other_tree.root);
+        } else {
+            root = unionTrees(other_tree.root, root);
+        }
+        other_tree.root = nullptr;
+        return;
+    }
+
+    AVLvertex* new_root = mergeTrees(root, other_tree.root, this_tree_size,
+            other_tree_size);
     deleteTree(root);
-    deleteTree(other_tree.root);
+    other_tree.deleteTree(other_tree.root);
     other_tree.root = nullptr;
     root = new_root;
 }
 
-template<class KeyType>
-typename AVLrankTree<KeyType>::AVLvertex*
-AVLrankTree<KeyType>::mergeTrees(AVLrankTree::AVLvertex *this_root,
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::joinWithVertex(AVLvertex* left,
+        AVLvertex* mid, AVLvertex* right) {
+    int left_height = getHeight(left);
+    int right_height = getHeight(right);
+
+    if(left_height > right_height + 1){
+        /* descend the right spine of the taller left tree until the heights
+         * are close enough, and rebalance on the way back up */
+        left->right = joinWithVertex(left->right, mid, right);
+        updateHeight(left);
+        return rebalanceVertex(left);
+    }
+
+    if(right_height > left_height + 1){
+        right->left = joinWithVertex(left, mid, right->left);
+        updateHeight(right);
+        return rebalanceVertex(right);
+    }
+
+    mid->left = left;
+    mid->right = right;
+    updateHeight(mid);
+    updateCount(mid);
+    updateAggregate(mid);
+    return mid;
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::joinTrees(AVLvertex* left,
+        AVLvertex* right) {
+    if(left == nullptr){
+        return right;
+    }
+    if(right == nullptr){
+        return left;
+    }
+
+    AVLvertex* mid = nullptr;
+    right = removeMinVertex(right, mid);
+    return joinWithVertex(left, mid, right);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::removeMinVertex(AVLvertex* curr_root,
+        AVLvertex*& min_vertex) {
+    if(curr_root->left == nullptr){
+        min_vertex = curr_root;
+        return curr_root->right;
+    }
+
+    curr_root->left = removeMinVertex(curr_root->left, min_vertex);
+    updateHeight(curr_root);
+    return rebalanceVertex(curr_root);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::splitTree(AVLvertex* curr_root,
+        const KeyType& key, AVLvertex*& less, AVLvertex*& greater_or_equal) {
+    if(curr_root == nullptr){
+        less = nullptr;
+        greater_or_equal = nullptr;
+        return;
+    }
+
+    AVLvertex* left = curr_root->left;
+    AVLvertex* right = curr_root->right;
+    if(compareKeys(curr_root->key, key) < 0){
+        /* curr_root and it's left subtree belong to the "less" tree */
+        AVLvertex* right_less = nullptr;
+        splitTree(right, key, right_less, greater_or_equal);
+        less = joinWithVertex(left, curr_root, right_less);
+    } else {
+        AVLvertex* left_greater_or_equal = nullptr;
+        splitTree(left, key, less, left_greater_or_equal);
+        greater_or_equal = joinWithVertex(left_greater_or_equal, curr_root,
+                right);
+    }
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::unionTrees(AVLvertex* t1,
+        AVLvertex* t2) {
+    if(t1 == nullptr){
+        return t2;
+    }
+    if(t2 == nullptr){
+        return t1;
+    }
+
+    AVLvertex* t1_left = t1->left;
+    AVLvertex* t1_right = t1->right;
+    AVLvertex* less = nullptr;
+    AVLvertex* greater_or_equal = nullptr;
+    splitTree(t2, t1->key, less, greater_or_equal);
+
+    AVLvertex* left = unionTrees(t1_left, less);
+    AVLvertex* right = unionTrees(t1_right, greater_or_equal);
+    return joinWithVertex(left, t1, right);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::mergeTrees(AVLrankTree::AVLvertex *this_root,
         AVLrankTree::AVLvertex *other_root, int this_tree_size,
         int other_tree_size) {
     auto * this_tree_arr = new KeyType[this_tree_size];
@@ -528,6 +1449,7 @@ AVLrankTree<KeyType>::mergeTrees(AVLrankTree::AVLvertex *this_root,
     treeToSortedArray(other_root, other_tree_arr, &other_tree_index);
 
     auto * merged_arr = new KeyType[this_tree_size + other_tree_size];
+    allocator.reserve(this_tree_size + other_tree_size);
 
     mergeArrays(this_tree_arr, other_tree_arr, merged_arr, this_tree_size,
             other_tree_size);
@@ -535,25 +1457,25 @@ AVLrankTree<KeyType>::mergeTrees(AVLrankTree::AVLvertex *this_root,
     delete[] this_tree_arr;
     delete[] other_tree_arr;
 
-    AVLvertex* new_root = sortedArrayToAVLtree(merged_arr, 0,
-            this_tree_size + other_tree_size - 1);
+    KeyType* merged_it = merged_arr;
+    AVLvertex* new_root = buildBalancedTree(merged_it,
+            this_tree_size + other_tree_size);
 
     delete[] merged_arr;
 
-    updateNodeFieldsAfterMerge(new_root);
-
     return new_root;
 }
 
-template<class KeyType>
-void AVLrankTree<KeyType>::mergeArrays(KeyType *arr1, KeyType *arr2,
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::mergeArrays(KeyType *arr1, KeyType *arr2,
         KeyType *merged_arr, int size1, int size2) {
     int i1 = 0;
     int i2 = 0;
     int i_merged = 0;
 
     while (i1 < size1 && i2 < size2) {
-        if(arr1[i1] < arr2[i2]) {
+        if(compareKeys(arr1[i1], arr2[i2]) < 0) {
             merged_arr[i_merged] = arr1[i1];
             i_merged++;
             i1++;
@@ -577,39 +1499,32 @@ void AVLrankTree<KeyType>::mergeArrays(KeyType *arr1, KeyType *arr2,
     }
 }
 
-template<class KeyType>
-void AVLrankTree<KeyType>::updateNodeFieldsAfterMerge(AVLrankTree::AVLvertex *curr_root) {
-    /* base case */
-    if(curr_root == nullptr){
-        return;
-    }
-
-    updateNodeFieldsAfterMerge(curr_root->left);
-    updateNodeFieldsAfterMerge(curr_root->right);
-
-    updateHeight(curr_root);
-    updateCount(curr_root);
-    updateSum(curr_root);
-}
-
-template<class KeyType>
-typename AVLrankTree<KeyType>::AVLvertex*
-AVLrankTree<KeyType>::sortedArrayToAVLtree(KeyType *arr, int start, int end) {
-    if (start > end) {
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+template <class InputIt>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::buildBalancedTree(InputIt& it, int size) {
+    if (size == 0) {
         return nullptr;
     }
 
-    int mid = (start + end)/2;
-    auto *new_root = new AVLvertex(arr[mid]);
+    int left_size = (size - 1) / 2;
+    AVLvertex* left_subtree = buildBalancedTree(it, left_size);
 
-    new_root->left = sortedArrayToAVLtree(arr, start, mid-1);
-    new_root->right = sortedArrayToAVLtree(arr, mid+1, end);
+    auto *new_root = createVertex(InPlace(), *it);
+    ++it;
+    new_root->left = left_subtree;
+    new_root->right = buildBalancedTree(it, size - 1 - left_size);
 
+    updateHeight(new_root);
+    updateCount(new_root);
+    updateAggregate(new_root);
     return new_root;
 }
 
-template<class KeyType>
-void AVLrankTree<KeyType>::treeToSortedArray(AVLrankTree::AVLvertex *curr_root,
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::treeToSortedArray(AVLrankTree::AVLvertex *curr_root,
                                              KeyType *arr, int *curr_index) {
     if(curr_root == nullptr) {
         return;
@@ -623,13 +1538,15 @@ void AVLrankTree<KeyType>::treeToSortedArray(AVLrankTree::AVLvertex *curr_root,
     treeToSortedArray(curr_root->right, arr, curr_index);
 }
 
-template<class KeyType>
-void AVLrankTree<KeyType>::printTree() {
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::printTree() {
     printTreeRec(root);
 }
 
-template<class KeyType>
-void AVLrankTree<KeyType>::printTreeRec(AVLrankTree::AVLvertex *curr_root) {
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::printTreeRec(AVLrankTree::AVLvertex *curr_root) {
     if(curr_root == nullptr){
         return;
     }
@@ -637,8 +1554,776 @@ void AVLrankTree<KeyType>::printTreeRec(AVLrankTree::AVLvertex *curr_root) {
     std::cout << "\nnode details: " << std::endl;
     std::cout << "node's key: " << (curr_root->key).getKey() << std::endl;
     std::cout << "node's count: " << curr_root->count << std::endl;
-    std::cout << "node's sum: " << curr_root->sum << std::endl;
+    std::cout << "node's aggregate: " << curr_root->aggregate << std::endl;
     printTreeRec(curr_root->right);
 }
 
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::iterator
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::begin() const {
+    iterator it(this);
+    it.descendLeft(root);
+    return it;
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+template <class LookupKey>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::iterator
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::lowerBoundAux(const LookupKey& key) const {
+    iterator it(this);
+
+    /* the path to the last vertex we turned left at is the path to the
+     * first key which is not less than "key" */
+    int found_depth = 0;
+    AVLvertex* curr_root = root;
+    while(curr_root != nullptr){
+        it.path[it.depth++] = curr_root;
+        if(compareKeys(key, curr_root->key) > 0){
+            curr_root = curr_root->right;
+        } else {
+            found_depth = it.depth;
+            curr_root = curr_root->left;
+        }
+    }
+    it.depth = found_depth;
+    return it;
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+template <class LookupKey>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::iterator
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::upperBoundAux(const LookupKey& key) const {
+    iterator it(this);
+
+    int found_depth = 0;
+    AVLvertex* curr_root = root;
+    while(curr_root != nullptr){
+        it.path[it.depth++] = curr_root;
+        if(compareKeys(key, curr_root->key) < 0){
+            found_depth = it.depth;
+            curr_root = curr_root->left;
+        } else {
+            curr_root = curr_root->right;
+        }
+    }
+    it.depth = found_depth;
+    return it;
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::split(KeyType key,
+        AVLrankTree& greater_or_equal_tree) {
+    greater_or_equal_tree.clear();
+
+    /* the vertexes of both parts stay where they were allocated */
+    greater_or_equal_tree.allocator = allocator;
+    greater_or_equal_tree.compare = compare;
+
+    AVLvertex* less = nullptr;
+    splitTree(root, key, less, greater_or_equal_tree.root);
+    root = less;
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::splitDetached(KeyType key,
+        AVLrankTree& greater_or_equal_tree) {
+    if(allocator.canCreateConcurrently()){
+        split(key, greater_or_equal_tree);
+        return;
+    }
+
+    AVLrankTree shared_part(compare);
+    split(key, shared_part);
+    greater_or_equal_tree.clear();
+    greater_or_equal_tree.allocator = VertexAllocator<AVLvertex>();
+    greater_or_equal_tree.compare = compare;
+    /* the allocators differ, so the vertexes are copied into the new one */
+    greater_or_equal_tree.root = greater_or_equal_tree.adoptTree(shared_part);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::join(AVLrankTree& other_tree) {
+    if(&other_tree == this){
+        return;
+    }
+    root = joinTrees(root, adoptTree(other_tree));
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::adoptTree(AVLrankTree& other_tree) {
+    AVLvertex* other_root = other_tree.root;
+    if(allocator == other_tree.allocator){
+        other_tree.root = nullptr;
+        return other_root;
+    }
+
+    int size = getTreeSize(other_root);
+    std::vector<KeyType> keys(size);
+    int index = 0;
+    treeToSortedArray(other_root, keys.data(), &index);
+    other_tree.clear();
+
+    auto it = keys.begin();
+    allocator.reserve(size);
+    return buildBalancedTree(it, size);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::unionWith(AVLrankTree& other_tree,
+        int grain_size, ForkJoinPool& pool) {
+    if(&other_tree == this){
+        return;
+    }
+    AVLvertex* other_root = adoptTree(other_tree);
+    std::vector<AVLvertex*> garbage;
+    root = unionSets(root, other_root, garbage, pool, grain_size);
+    deleteGarbage(garbage);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::intersectWith(AVLrankTree& other_tree,
+        int grain_size, ForkJoinPool& pool) {
+    if(&other_tree == this){
+        return;
+    }
+    AVLvertex* other_root = adoptTree(other_tree);
+    std::vector<AVLvertex*> garbage;
+    root = intersectSets(root, other_root, garbage, pool, grain_size);
+    deleteGarbage(garbage);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::differenceWith(AVLrankTree& other_tree,
+        int grain_size, ForkJoinPool& pool) {
+    if(&other_tree == this){
+        clear();
+        return;
+    }
+    AVLvertex* other_root = adoptTree(other_tree);
+    std::vector<AVLvertex*> garbage;
+    root = differenceSets(root, other_root, garbage, pool, grain_size);
+    deleteGarbage(garbage);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+template <class InputIt>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::insertBatch(InputIt first,
+        InputIt last, int grain_size, ForkJoinPool& pool) {
+    std::vector<KeyType> keys(first, last);
+    auto keyLess = [this](const KeyType& key1, const KeyType& key2){
+        return compareKeys(key1, key2) < 0;
+    };
+    if(!std::is_sorted(keys.begin(), keys.end(), keyLess)){
+        std::sort(keys.begin(), keys.end(), keyLess);
+    }
+
+    /* the vertexes are allocated up front, so the merge may run in
+     * parallel */
+    std::vector<AVLvertex*> vertexes;
+    vertexes.reserve(keys.size());
+    allocator.reserve(keys.size());
+    for(KeyType& key : keys){
+        vertexes.push_back(createVertex(InPlace(), std::move(key)));
+    }
+
+    root = insertBatchRec(root, vertexes.data(),
+            vertexes.data() + vertexes.size(), pool, grain_size);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+template <class InputIt>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::deleteBatch(InputIt first,
+        InputIt last, int grain_size, ForkJoinPool& pool) {
+    std::vector<KeyType> keys(first, last);
+    auto keyLess = [this](const KeyType& key1, const KeyType& key2){
+        return compareKeys(key1, key2) < 0;
+    };
+    if(!std::is_sorted(keys.begin(), keys.end(), keyLess)){
+        std::sort(keys.begin(), keys.end(), keyLess);
+    }
+
+    /* equal keys are counted in a single batch key */
+    std::vector<BatchKey> batch;
+    for(const KeyType& key : keys){
+        if(!batch.empty() && compareKeys(batch.back().key, key) == 0){
+            batch.back().remaining++;
+        } else {
+            batch.push_back(BatchKey{key, 1});
+        }
+    }
+
+    std::vector<AVLvertex*> removed;
+    root = deleteBatchRec(root, batch.data(), batch.data() + batch.size(),
+            removed, pool, grain_size);
+    for(AVLvertex* v : removed){
+        destroyVertex(v);
+    }
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::linkBalancedTree(AVLvertex** vertexes,
+        int size) {
+    if(size == 0){
+        return nullptr;
+    }
+
+    int left_size = (size - 1) / 2;
+    AVLvertex* new_root = vertexes[left_size];
+    new_root->left = linkBalancedTree(vertexes, left_size);
+    new_root->right = linkBalancedTree(vertexes + left_size + 1,
+            size - 1 - left_size);
+
+    updateHeight(new_root);
+    updateCount(new_root);
+    updateAggregate(new_root);
+    return new_root;
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::insertBatchRec(AVLvertex* curr_root,
+        AVLvertex** first, AVLvertex** last, ForkJoinPool& pool,
+        int grain_size) {
+    if(first == last){
+        return curr_root;
+    }
+    if(curr_root == nullptr){
+        return linkBalancedTree(first, last - first);
+    }
+
+    /* the keys that are less than curr_root's key go to the left subtree */
+    AVLvertex** mid = std::lower_bound(first, last, curr_root,
+            [this](const AVLvertex* v1, const AVLvertex* v2){
+                return compareKeys(v1->key, v2->key) < 0;
+            });
+    AVLvertex* left = curr_root->left;
+    AVLvertex* right = curr_root->right;
+    if(last - first > grain_size){
+        pool.invokeBoth(
+                [&]{left = insertBatchRec(left, first, mid, pool, grain_size);},
+                [&]{right = insertBatchRec(right, mid, last, pool,
+                        grain_size);});
+    } else {
+        left = insertBatchRec(left, first, mid, pool, grain_size);
+        right = insertBatchRec(right, mid, last, pool, grain_size);
+    }
+    return joinWithVertex(left, curr_root, right);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::deleteBatchRec(AVLvertex* curr_root,
+        BatchKey* first, BatchKey* last, std::vector<AVLvertex*>& removed,
+        ForkJoinPool& pool, int grain_size) {
+    if(curr_root == nullptr || first == last){
+        return curr_root;
+    }
+
+    /* split the batch into the keys that are less than curr_root's key, the
+     * matching key (if any) and the greater keys */
+    BatchKey* lower = std::lower_bound(first, last, curr_root->key,
+            [this](const BatchKey& batch_key, const KeyType& key){
+                return compareKeys(batch_key.key, key) < 0;
+            });
+    BatchKey* upper = lower;
+    if(upper != last && compareKeys(upper->key, curr_root->key) == 0){
+        upper++;
+    }
+    bool delete_vertex = lower != upper && lower->remaining > 0;
+    if(delete_vertex){
+        lower->remaining--;
+    }
+
+    AVLvertex* left = curr_root->left;
+    AVLvertex* right = curr_root->right;
+    if(delete_vertex && lower->remaining > 0){
+        /* more vertexes with the key may be in both subtrees, which share
+         * the count, so they are searched one after the other */
+        left = deleteBatchRec(left, first, upper, removed, pool, grain_size);
+        right = deleteBatchRec(right, lower, last, removed, pool, grain_size);
+    } else if(last - first > grain_size){
+        std::vector<AVLvertex*> right_removed;
+        pool.invokeBoth(
+                [&]{left = deleteBatchRec(left, first, lower, removed, pool,
+                        grain_size);},
+                [&]{right = deleteBatchRec(right, upper, last, right_removed,
+                        pool, grain_size);});
+        removed.insert(removed.end(), right_removed.begin(),
+                right_removed.end());
+    } else {
+        left = deleteBatchRec(left, first, lower, removed, pool, grain_size);
+        right = deleteBatchRec(right, upper, last, removed, pool, grain_size);
+    }
+
+    if(delete_vertex){
+        removed.push_back(curr_root);
+        return joinTrees(left, right);
+    }
+    return joinWithVertex(left, curr_root, right);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::splitAroundKey(AVLvertex* curr_root,
+        const KeyType& key, AVLvertex*& less, AVLvertex*& equal,
+        AVLvertex*& greater) {
+    if(curr_root == nullptr){
+        less = nullptr;
+        equal = nullptr;
+        greater = nullptr;
+        return;
+    }
+
+    AVLvertex* left = curr_root->left;
+    AVLvertex* right = curr_root->right;
+    int result = compareKeys(key, curr_root->key);
+    if(result > 0){
+        AVLvertex* right_less = nullptr;
+        splitAroundKey(right, key, right_less, equal, greater);
+        less = joinWithVertex(left, curr_root, right_less);
+    } else if(result < 0){
+        AVLvertex* left_greater = nullptr;
+        splitAroundKey(left, key, less, equal, left_greater);
+        greater = joinWithVertex(left_greater, curr_root, right);
+    } else {
+        less = left;
+        greater = right;
+        equal = curr_root;
+        equal->left = nullptr;
+        equal->right = nullptr;
+    }
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::unionSets(AVLvertex* t1, AVLvertex* t2,
+        std::vector<AVLvertex*>& garbage, ForkJoinPool& pool,
+        int grain_size) {
+    if(t1 == nullptr){
+        return t2;
+    }
+    if(t2 == nullptr){
+        return t1;
+    }
+
+    bool in_parallel = getTreeSize(t1) + getTreeSize(t2) > grain_size;
+    AVLvertex* t1_left = t1->left;
+    AVLvertex* t1_right = t1->right;
+    AVLvertex *less, *equal, *greater;
+    splitAroundKey(t2, t1->key, less, equal, greater);
+    if(equal != nullptr){
+        /* t1's vertex represents the key in the union */
+        garbage.push_back(equal);
+    }
+
+    AVLvertex *left, *right;
+    if(in_parallel){
+        std::vector<AVLvertex*> right_garbage;
+        pool.invokeBoth(
+                [&]{left = unionSets(t1_left, less, garbage, pool,
+                        grain_size);},
+                [&]{right = unionSets(t1_right, greater, right_garbage, pool,
+                        grain_size);});
+        garbage.insert(garbage.end(), right_garbage.begin(),
+                right_garbage.end());
+    } else {
+        left = unionSets(t1_left, less, garbage, pool, grain_size);
+        right = unionSets(t1_right, greater, garbage, pool, grain_size);
+    }
+
+    return joinWithVertex(left, t1, right);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::intersectSets(AVLvertex* t1, AVLvertex* t2,
+        std::vector<AVLvertex*>& garbage, ForkJoinPool& pool,
+        int grain_size) {
+    if(t1 == nullptr || t2 == nullptr){
+        if(t1 != nullptr){
+            garbage.push_back(t1);
+        }
+        if(t2 != nullptr){
+            garbage.push_back(t2);
+        }
+        return nullptr;
+    }
+
+    bool in_parallel = getTreeSize(t1) + getTreeSize(t2) > grain_size;
+    AVLvertex* t1_left = t1->left;
+    AVLvertex* t1_right = t1->right;
+    AVLvertex *less, *equal, *greater;
+    splitAroundKey(t2, t1->key, less, equal, greater);
+
+    AVLvertex *left, *right;
+    if(in_parallel){
+        std::vector<AVLvertex*> right_garbage;
+        pool.invokeBoth(
+                [&]{left = intersectSets(t1_left, less, garbage, pool,
+                        grain_size);},
+                [&]{right = intersectSets(t1_right, greater, right_garbage,
+                        pool, grain_size);});
+        garbage.insert(garbage.end(), right_garbage.begin(),
+                right_garbage.end());
+    } else {
+        left = intersectSets(t1_left, less, garbage, pool, grain_size);
+        right = intersectSets(t1_right, greater, garbage, pool, grain_size);
+    }
+
+    if(equal != nullptr){
+        /* the key is in both trees, t1's vertex represents it */
+        garbage.push_back(equal);
+        return joinWithVertex(left, t1, right);
+    }
+
+    t1->left = nullptr;
+    t1->right = nullptr;
+    garbage.push_back(t1);
+    return joinTrees(left, right);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::differenceSets(AVLvertex* t1, AVLvertex* t2,
+        std::vector<AVLvertex*>& garbage, ForkJoinPool& pool,
+        int grain_size) {
+    if(t1 == nullptr || t2 == nullptr){
+        if(t2 != nullptr){
+            garbage.push_back(t2);
+        }
+        return t1;
+    }
+
+    bool in_parallel = getTreeSize(t1) + getTreeSize(t2) > grain_size;
+    AVLvertex* t2_left = t2->left;
+    AVLvertex* t2_right = t2->right;
+    AVLvertex *less, *equal, *greater;
+    splitAroundKey(t1, t2->key, less, equal, greater);
+    t2->left = nullptr;
+    t2->right = nullptr;
+    garbage.push_back(t2);
+    if(equal != nullptr){
+        garbage.push_back(equal);
+    }
+
+    AVLvertex *left, *right;
+    if(in_parallel){
+        std::vector<AVLvertex*> right_garbage;
+        pool.invokeBoth(
+                [&]{left = differenceSets(less, t2_left, garbage, pool,
+                        grain_size);},
+                [&]{right = differenceSets(greater, t2_right, right_garbage,
+                        pool, grain_size);});
+        garbage.insert(garbage.end(), right_garbage.begin(),
+                right_garbage.end());
+    } else {
+        left = differenceSets(less, t2_left, garbage, pool, grain_size);
+        right = differenceSets(greater, t2_right, garbage, pool, grain_size);
+    }
+
+    return joinTrees(left, right);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::deleteGarbage(std::vector<AVLvertex*>& garbage) {
+    for(AVLvertex* subtree_root : garbage){
+        deleteTree(subtree_root);
+    }
+    garbage.clear();
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+int AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::size() {
+    return getTreeSize(root);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::iterator
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::select(int k) {
+    iterator it(this);
+    if(k < 1 || k > getTreeSize(root)){
+        return it;
+    }
+
+    /* descend using the counts, recording the path for the iterator */
+    AVLvertex* curr_root = root;
+    while(true){
+        it.path[it.depth++] = curr_root;
+        int left_count = getCount(curr_root->left);
+        if(k <= left_count){
+            curr_root = curr_root->left;
+        } else if(k == left_count + 1){
+            return it;
+        } else {
+            k -= left_count + 1;
+            curr_root = curr_root->right;
+        }
+    }
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::iterator
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::selectLargest(int k) {
+    if(k < 1){
+        return end();
+    }
+    return select(getTreeSize(root) - k + 1);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+template <class LookupKey>
+int AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::rankAux(const LookupKey& key) {
+    int less_count = 0;
+    AVLvertex* curr_root = root;
+    while(curr_root != nullptr){
+        if(compareKeys(key, curr_root->key) > 0){
+            /* curr_root and it's left subtree are all less than the key */
+            less_count += getCount(curr_root->left) + 1;
+            curr_root = curr_root->right;
+        } else {
+            curr_root = curr_root->left;
+        }
+    }
+    return less_count;
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+int AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::countNotGreater(const KeyType& key) {
+    int not_greater_count = 0;
+    AVLvertex* curr_root = root;
+    while(curr_root != nullptr){
+        if(compareKeys(key, curr_root->key) < 0){
+            curr_root = curr_root->left;
+        } else {
+            not_greater_count += getCount(curr_root->left) + 1;
+            curr_root = curr_root->right;
+        }
+    }
+    return not_greater_count;
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+int AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::countInRange(const KeyType& low,
+        const KeyType& high) {
+    if(compareKeys(high, low) < 0){
+        return 0;
+    }
+    return countNotGreater(high) - rankAux(low);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::aggregate_type
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::aggregate(const KeyType& low,
+        const KeyType& high) {
+    /* find the highest vertex in the range, every other vertex in the range
+     * is in one of it's subtrees */
+    AVLvertex* split_vertex = root;
+    while(split_vertex != nullptr){
+        if(compareKeys(low, split_vertex->key) > 0){
+            split_vertex = split_vertex->right;
+        } else if(compareKeys(high, split_vertex->key) < 0){
+            split_vertex = split_vertex->left;
+        } else {
+            break;
+        }
+    }
+    if(split_vertex == nullptr){
+        return Augmentation::identity();
+    }
+
+    /* along the left boundary every vertex in the range comes with it's
+     * right subtree, and precedes the parts that were already found */
+    aggregate_type left_aggregate = Augmentation::identity();
+    AVLvertex* curr_root = split_vertex->left;
+    while(curr_root != nullptr){
+        if(compareKeys(low, curr_root->key) > 0){
+            curr_root = curr_root->right;
+        } else {
+            left_aggregate = Augmentation::combine(
+                    Augmentation::combine(Augmentation::fromKey(curr_root->key),
+                            getAggregate(curr_root->right)),
+                    left_aggregate);
+            curr_root = curr_root->left;
+        }
+    }
+
+    /* along the right boundary every vertex in the range comes with it's
+     * left subtree, and follows the parts that were already found */
+    aggregate_type right_aggregate = Augmentation::identity();
+    curr_root = split_vertex->right;
+    while(curr_root != nullptr){
+        if(compareKeys(high, curr_root->key) < 0){
+            curr_root = curr_root->left;
+        } else {
+            right_aggregate = Augmentation::combine(right_aggregate,
+                    Augmentation::combine(getAggregate(curr_root->left),
+                            Augmentation::fromKey(curr_root->key)));
+            curr_root = curr_root->right;
+        }
+    }
+
+    return Augmentation::combine(
+            Augmentation::combine(left_aggregate,
+                    Augmentation::fromKey(split_vertex->key)),
+            right_aggregate);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+template <class Predicate>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::iterator
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::prefixSearch(Predicate predicate) {
+    iterator it(this);
+    aggregate_type prefix = Augmentation::identity();
+    AVLvertex* curr_root = root;
+    while(curr_root != nullptr){
+        it.path[it.depth++] = curr_root;
+        aggregate_type with_left = Augmentation::combine(prefix,
+                getAggregate(curr_root->left));
+        if(curr_root->left != nullptr && predicate(with_left)){
+            curr_root = curr_root->left;
+            continue;
+        }
+        prefix = Augmentation::combine(with_left,
+                Augmentation::fromKey(curr_root->key));
+        if(predicate(prefix)){
+            return it;
+        }
+        curr_root = curr_root->right;
+    }
+    return end();
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+FrozenAVLrankTree<KeyType, Augmentation>
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::freeze() const {
+    static_assert(std::is_same<Compare, ThreeWayCompare>::value,
+            "freeze() needs the default key order");
+    std::vector<KeyType> sorted_keys;
+    for(iterator it = begin(); it != end(); ++it){
+        sorted_keys.push_back(*it);
+    }
+    return FrozenAVLrankTree<KeyType, Augmentation>(sorted_keys);
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+template <class KeyCodec>
+bool AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::saveTo(const std::string& path,
+        const KeyCodec& key_codec) const {
+    SnapshotWriter out(path);
+    uint64_t key_count = root == nullptr ? 0 : uint64_t(root->count);
+    out.writeValue(SnapshotHeader(SnapshotHeader::KEYS_ONLY, key_count));
+
+    for(iterator it = begin(); it != end(); ++it){
+        key_codec.write(out, *it);
+    }
+    return out.finish();
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+template <class KeyCodec>
+bool AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::loadFrom(const std::string& path,
+        const KeyCodec& key_codec) {
+    SnapshotReader in(path);
+    SnapshotHeader header;
+    if(!in.isOpen() || !in.readValue(header) ||
+            !header.isValid(SnapshotHeader::KEYS_ONLY) ||
+            header.key_count > uint64_t(in.bytesLeft()) ||
+            header.key_count > uint64_t(std::numeric_limits<int>::max())){
+        return false;
+    }
+
+    /* the snapshot is built aside, so a bad file leaves the tree intact */
+    AVLrankTree loaded(compare);
+    int size = int(header.key_count);
+    loaded.allocator.reserve(size);
+    bool ok = true;
+    loaded.root = loaded.loadBalancedTree(in, key_codec, size, ok);
+    if(!ok || !in.finish()){
+        return false;
+    }
+    swap(loaded);
+    return true;
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+template <class KeyCodec>
+typename AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::AVLvertex*
+AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::loadBalancedTree(SnapshotReader& in,
+        const KeyCodec& key_codec, int size, bool& ok) {
+    if(size == 0){
+        return nullptr;
+    }
+
+    int left_size = (size - 1) / 2;
+    AVLvertex* left_subtree = loadBalancedTree(in, key_codec, left_size, ok);
+    if(!ok){
+        return left_subtree;
+    }
+
+    KeyType key;
+    if(!key_codec.read(in, key)){
+        ok = false;
+        return left_subtree;
+    }
+    AVLvertex* new_root = createVertex(InPlace(), std::move(key));
+    new_root->left = left_subtree;
+    new_root->right = loadBalancedTree(in, key_codec, size - 1 - left_size,
+            ok);
+
+    updateHeight(new_root);
+    updateCount(new_root);
+    updateAggregate(new_root);
+    return new_root;
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+TreeStatsReport AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::stats() const {
+    TreeStatsReport report;
+    report.counters = statistics.counters();
+    measureTreeShape(root, report, [](const AVLvertex*){
+        return sizeof(AVLvertex);
+    });
+    return report;
+}
+
+template<class KeyType, template <class> class VertexAllocator,
+        class Augmentation, class Compare, class Stats>
+void AVLrankTree<KeyType, VertexAllocator, Augmentation, Compare, Stats>::resetStats() {
+    statistics.reset();
+}
+
 #endif //WET2CPP_AVLRANKTREE_H
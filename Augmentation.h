@@ -0,0 +1,129 @@
+#ifndef WET2CPP_AUGMENTATION_H
+#define WET2CPP_AUGMENTATION_H
+
+#include <limits>
+#include <utility>
+
+/* the augmentation policies of AVLrankTree. Every vertex of the tree holds
+ * the aggregate of the keys in it's subtree, which the policy defines as a
+ * monoid over the keys:
+ *   value_type         - the type of an aggregate
+ *   identity()         - the aggregate of no keys
+ *   combine(a, b)      - the aggregate of the keys of a followed by the keys
+ *                        of b, which must be associative
+ *   fromKey(key)       - the aggregate of a single key */
+
+/* the value a policy aggregates for a key: key.getKey() if the key type has
+ * such a method, otherwise the key itself */
+template <class KeyType>
+auto augmentedValue(const KeyType& key, int) -> decltype(key.getKey()) {
+    return key.getKey();
+}
+
+template <class KeyType>
+const KeyType& augmentedValue(const KeyType& key, long) {
+    return key;
+}
+
+/* the sum of the keys, which is the default augmentation */
+template <class ValueType = long long>
+class KeySum{
+public:
+    typedef ValueType value_type;
+
+    static value_type identity(){return value_type(0);}
+
+    static value_type combine(const value_type& a, const value_type& b){
+        return a + b;
+    }
+
+    template <class KeyType>
+    static value_type fromKey(const KeyType& key){
+        return value_type(augmentedValue(key, 0));
+    }
+};
+
+/* the sum of the squares of the keys */
+template <class ValueType = long long>
+class KeySumOfSquares{
+public:
+    typedef ValueType value_type;
+
+    static value_type identity(){return value_type(0);}
+
+    static value_type combine(const value_type& a, const value_type& b){
+        return a + b;
+    }
+
+    template <class KeyType>
+    static value_type fromKey(const KeyType& key){
+        value_type value = value_type(augmentedValue(key, 0));
+        return value * value;
+    }
+};
+
+/* the minimal key */
+template <class ValueType = long long>
+class KeyMin{
+public:
+    typedef ValueType value_type;
+
+    static value_type identity(){
+        return std::numeric_limits<value_type>::max();
+    }
+
+    static value_type combine(const value_type& a, const value_type& b){
+        return b < a ? b : a;
+    }
+
+    template <class KeyType>
+    static value_type fromKey(const KeyType& key){
+        return value_type(augmentedValue(key, 0));
+    }
+};
+
+/* the maximal key */
+template <class ValueType = long long>
+class KeyMax{
+public:
+    typedef ValueType value_type;
+
+    static value_type identity(){
+        return std::numeric_limits<value_type>::lowest();
+    }
+
+    static value_type combine(const value_type& a, const value_type& b){
+        return a < b ? b : a;
+    }
+
+    template <class KeyType>
+    static value_type fromKey(const KeyType& key){
+        return value_type(augmentedValue(key, 0));
+    }
+};
+
+/* maintain two augmentations in the same tree. More augmentations can be
+ * combined by nesting, e.g. CombinedAugmentation<KeySum<>,
+ * CombinedAugmentation<KeyMin<>, KeyMax<> > > */
+template <class First, class Second>
+class CombinedAugmentation{
+public:
+    typedef std::pair<typename First::value_type,
+            typename Second::value_type> value_type;
+
+    static value_type identity(){
+        return value_type(First::identity(), Second::identity());
+    }
+
+    static value_type combine(const value_type& a, const value_type& b){
+        return value_type(First::combine(a.first, b.first),
+                Second::combine(a.second, b.second));
+    }
+
+    template <class KeyType>
+    static value_type fromKey(const KeyType& key){
+        return value_type(First::fromKey(key), Second::fromKey(key));
+    }
+};
+
+#endif //WET2CPP_AUGMENTATION_H
@@ -0,0 +1,722 @@
+#ifndef WET1CPP_BLOCKAVL_TREE_H
+#define WET1CPP_BLOCKAVL_TREE_H
+
+#include <iterator>
+#include <utility>
+#include <vector>
+#include "VertexAllocator.h"
+
+/* an AVL tree with the interface of AVL_tree whose vertexes hold sorted
+ * blocks of up to BlockSize keys (and their data pointers) rather than a
+ * single key. Every key in the left (right) subtree of a vertex is not
+ * greater (not less) than the keys of it's block. The tree is about
+ * log2(BlockSize) levels lower than an AVL_tree with the same keys, and a
+ * traversal reads every block sequentially. A full block is split in two on
+ * insertion, and a block that drops under a quarter full is merged with a
+ * neighbouring block when they fit in one, or takes keys from it otherwise,
+ * like a B-tree deletion, so every block but a lone root stays at least a
+ * quarter full. KeyType must be default constructible and assignable */
+template <class KeyType, class DataType, int BlockSize = 64,
+        template <class> class VertexAllocator = HeapVertexAllocator>
+class BlockAVL_tree{
+    class AVLvertex{
+    public:
+        AVLvertex *left, *right;
+        int height;
+        int size;
+        /* a copy of the last key of the block, so a search compares with
+         * both ends of the block without reading the whole of it */
+        KeyType high;
+        KeyType keys[BlockSize];
+        DataType* data[BlockSize];
+
+        AVLvertex() : left(nullptr), right(nullptr), height(1), size(0) {}
+    };
+
+    static_assert(BlockSize >= 4, "a block must hold at least 4 keys");
+
+    /* a block with less keys than that is merged with a neighbour */
+    static const int MIN_FILL = BlockSize / 4;
+
+    /* the maximal height of a tree the fixed size path stacks can hold, see
+     * AVL_tree */
+    static const int MAX_HEIGHT = 48;
+
+    AVLvertex *root;
+    int key_count;
+    VertexAllocator<AVLvertex> allocator;
+
+    /* the recursive method to traverse the tree in an inorder manner, while
+     * applying the user supplied function to every key of a vertex's block
+     * when visiting it */
+    template <class Func>
+    void inorderAux(AVLvertex* curr_root, Func& doSomething){
+        if(curr_root == nullptr){
+            return;
+        }
+        inorderAux(curr_root->left, doSomething);
+        for(int i = 0; i < curr_root->size; i++){
+            doSomething(curr_root->keys[i]);
+        }
+        inorderAux(curr_root->right, doSomething);
+    }
+
+    /* the recursive method behind forEachInRange, which skips the subtrees
+     * that can't hold keys between "low" and "high" */
+    template <class Func>
+    void forEachInRangeAux(AVLvertex* curr_root, const KeyType& low,
+            const KeyType& high, Func& doSomething){
+        if(curr_root == nullptr){
+            return;
+        }
+        if(!(curr_root->keys[0] < low)){
+            forEachInRangeAux(curr_root->left, low, high, doSomething);
+        }
+        for(int i = lowerBoundInBlock(curr_root, low);
+            i < curr_root->size && !(high < curr_root->keys[i]); i++){
+            doSomething(curr_root->keys[i]);
+        }
+        if(!(high < curr_root->high)){
+            forEachInRangeAux(curr_root->right, low, high, doSomething);
+        }
+    }
+
+    /* calculate the height of the given vertex */
+    int getHeight(AVLvertex* v);
+
+    /* calculate and update the height of the given vertex */
+    void updateHeight(AVLvertex* v);
+
+    /* calculate the balance factor of the given vertex */
+    int getBF(AVLvertex* v);
+
+    /* preform a right (left) rotation to the given vertex. The method returns
+     * the root of the new subtree */
+    AVLvertex* rotateRight(AVLvertex* v);
+    AVLvertex* rotateLeft(AVLvertex* v);
+
+    /* rebalance the given vertex if it's balance factor is not between -1 and
+     * 1 */
+    AVLvertex* rebalanceVertex(AVLvertex* curr_root);
+
+    /* walk back up the path of links (path[0] being &root) that was taken to
+     * reach an inserted or deleted vertex, see AVL_tree */
+    void rebalancePath(AVLvertex** path[], int depth);
+
+    /* return the number of keys in the block that are less than (not
+     * greater than) "key". The whole block is scanned without branching on
+     * the keys, which compilers turn into SIMD comparisons for arithmetic
+     * keys */
+    static int lowerBoundInBlock(const AVLvertex* v, const KeyType& key);
+    static int upperBoundInBlock(const AVLvertex* v, const KeyType& key);
+
+    /* search the vertex whose block holds "key", or should hold it if it is
+     * not in the tree, while recording the links that lead to it. The method
+     * returns the link that points to the vertex, or an empty link if the
+     * key can't be in the tree */
+    AVLvertex** searchLink(const KeyType& key, AVLvertex** path[],
+            int& depth);
+
+    /* insert the key and data into the block of the given vertex, which must
+     * not be full */
+    void insertIntoBlock(AVLvertex* v, const KeyType& key, DataType* data);
+
+    /* move the "count" first (last) entries of the block of "from" to the
+     * end (start) of the block of "to", which must have room for them */
+    void moveToBack(AVLvertex* from, AVLvertex* to, int count);
+    void moveToFront(AVLvertex* from, AVLvertex* to, int count);
+
+    /* split the full block of the vertex at the end of the given path in
+     * two, linking the upper half as a new vertex right after it. The method
+     * returns the new vertex */
+    AVLvertex* splitBlock(AVLvertex** link, AVLvertex** path[], int depth);
+
+    /* merge the block of the vertex at the end of the given path with a
+     * neighbouring block if they fit in one, and remove the vertex that was
+     * left empty. Otherwise move keys from the neighbouring block, so both
+     * end over half full */
+    void mergeBlock(AVLvertex** link, AVLvertex** path[], int depth);
+
+    /* deallocate every vertex and it's data in the tree which it's root is
+     * curr_root, using a recursive postorder traversal */
+    void deleteTree(AVLvertex* curr_root);
+
+    /* build a perfectly balanced tree of "block_count" blocks out of the
+     * next pairs of a sorted sequence. The first "larger_blocks" blocks get
+     * "block_keys"+1 keys and the rest get "block_keys" keys */
+    template <class InputIt>
+    AVLvertex* buildBalancedTree(InputIt& it, int block_count,
+            int& larger_blocks, int block_keys);
+
+public:
+
+    /* constructor  */
+    BlockAVL_tree();
+
+    /* destructor  */
+    ~BlockAVL_tree();
+
+    BlockAVL_tree(const BlockAVL_tree& tree) = delete;
+    BlockAVL_tree& operator=(const BlockAVL_tree& tree) = delete;
+
+    /* delete every vertex and it's data from the tree */
+    void clear();
+
+    /* replace the content of the tree with the (key, data pointer) pairs in
+     * the range [first, last), which must be sorted by key. The tree is built
+     * perfectly balanced in O(n) with full blocks */
+    template <class ForwardIt>
+    void assignSorted(ForwardIt first, ForwardIt last);
+
+    /* return true if a vertex with a matching key exists int the tree, false
+     * otherwise  */
+    bool keyExists(KeyType key);
+
+    /* the interface method to insert a "key" and "data" to the tree */
+    void insertKey(KeyType key, DataType* data);
+
+    /* the interface method to delete the matching key from the tree. The
+     * key's data is detached from the tree and returned to the caller, or
+     * nullptr if the key is not in the tree */
+    DataType* deleteKey(KeyType key);
+
+    /* return the pointer to the data of the matching key */
+    DataType* getData(KeyType key);
+
+    /* the interface method to traverse the tree in an inorder manner, while
+     * applying the user supplied function to every key */
+    template <class Func>
+    void inorder(Func& doSomething){inorderAux(root, doSomething);}
+
+    /* apply the user supplied function to every key between "low" and "high"
+     * (inclusive) in an inorder manner */
+    template <class Func>
+    void forEachInRange(const KeyType& low, const KeyType& high,
+            Func& doSomething){
+        forEachInRangeAux(root, low, high, doSomething);
+    }
+
+    /* return the number of keys in the tree */
+    int size() const {return key_count;}
+};
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::BlockAVL_tree()
+        : root(nullptr), key_count(0) {}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::~BlockAVL_tree() {
+    clear();
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+void BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::clear() {
+    deleteTree(root);
+    root = nullptr;
+    key_count = 0;
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+void BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::deleteTree
+(AVLvertex* curr_root) {
+    if(curr_root == nullptr){
+        return;
+    }
+    deleteTree(curr_root->left);
+    deleteTree(curr_root->right);
+    for(int i = 0; i < curr_root->size; i++){
+        delete curr_root->data[i];
+    }
+    allocator.destroy(curr_root);
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+template <class ForwardIt>
+void BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::assignSorted
+(ForwardIt first, ForwardIt last) {
+    clear();
+
+    int size = std::distance(first, last);
+    int block_count = (size + BlockSize - 1) / BlockSize;
+    if(block_count == 0){
+        return;
+    }
+    int larger_blocks = size % block_count;
+    allocator.reserve(block_count);
+    root = buildBalancedTree(first, block_count, larger_blocks,
+            size / block_count);
+    key_count = size;
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+template <class InputIt>
+typename BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::AVLvertex*
+BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::buildBalancedTree
+(InputIt& it, int block_count, int& larger_blocks, int block_keys) {
+    if(block_count == 0){
+        return nullptr;
+    }
+
+    int left_count = (block_count - 1) / 2;
+    AVLvertex* left_subtree = buildBalancedTree(it, left_count,
+            larger_blocks, block_keys);
+
+    AVLvertex* new_root = allocator.create();
+    new_root->size = block_keys;
+    if(larger_blocks > 0){
+        new_root->size++;
+        larger_blocks--;
+    }
+    for(int i = 0; i < new_root->size; i++, ++it){
+        new_root->keys[i] = it->first;
+        new_root->data[i] = it->second;
+    }
+    new_root->high = new_root->keys[new_root->size - 1];
+
+    new_root->left = left_subtree;
+    new_root->right = buildBalancedTree(it, block_count - 1 - left_count,
+            larger_blocks, block_keys);
+
+    updateHeight(new_root);
+    return new_root;
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+int BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::getHeight
+(AVLvertex *v) {
+    if(v == nullptr){
+        return 0;
+    } else {
+        return v->height;
+    }
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+void BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::updateHeight
+(AVLvertex *v) {
+    int left_height = getHeight(v->left);
+    int right_height = getHeight(v->right);
+    v->height = 1 + (left_height > right_height ? left_height : right_height);
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+int BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::getBF
+(AVLvertex *v) {
+    if(v == nullptr){
+        return 0;
+    } else{
+        return getHeight(v->left) - getHeight(v->right);
+    }
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+typename BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::AVLvertex*
+BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::rotateRight
+(AVLvertex *v) {
+    AVLvertex* to_rotate = v;
+    AVLvertex* to_rotate_left_child = to_rotate->left;
+    AVLvertex* right_subtree = to_rotate_left_child->right;
+
+    /* preform rotation */
+    to_rotate_left_child->right = to_rotate;
+    to_rotate->left = right_subtree;
+
+    /* update the height of the vertexes that their subtree changed */
+    updateHeight(to_rotate);
+    updateHeight(to_rotate_left_child);
+
+    /* return the root of the new subtree */
+    return to_rotate_left_child;
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+typename BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::AVLvertex*
+BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::rotateLeft
+(AVLvertex *v) {
+    AVLvertex* to_rotate = v;
+    AVLvertex* to_rotate_right_child = to_rotate->right;
+    AVLvertex* left_subtree = to_rotate_right_child->left;
+
+    /* preform rotation */
+    to_rotate_right_child->left = to_rotate;
+    to_rotate->right = left_subtree;
+
+    /* update the height of the vertexes that their subtree changed */
+    updateHeight(to_rotate);
+    updateHeight(to_rotate_right_child);
+
+    /* return the root of the new subtree */
+    return to_rotate_right_child;
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+typename BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::AVLvertex*
+BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::rebalanceVertex
+(AVLvertex* curr_root){
+
+    int BF = getBF(curr_root);
+
+    if(BF >= -1 && BF <= 1) {
+        /* balance factor is in bound therefore no rotations are needed */
+        return curr_root;
+    }
+
+    if(BF == 2){
+        if(getBF(curr_root->left) >= 0){
+            /* LL rotation */
+            return rotateRight(curr_root);
+        } else {
+            /* LR rotation */
+            curr_root->left = rotateLeft(curr_root->left);
+            return rotateRight(curr_root);
+        }
+    }
+
+    if(BF == -2){
+        if(getBF(curr_root->right) <= 0){
+            /* RR rotation */
+            return rotateLeft(curr_root);
+        } else {
+            /* RL rotation */
+            curr_root->right = rotateRight(curr_root->right);
+            return rotateLeft(curr_root);
+        }
+    }
+
+    return curr_root;
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+void BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::rebalancePath
+(AVLvertex** path[], int depth) {
+    for(int i = depth - 1; i >= 0; i--){
+        AVLvertex* curr_root = *path[i];
+        int old_height = curr_root->height;
+
+        updateHeight(curr_root);
+
+        /* rebalance the current root if needed */
+        *path[i] = rebalanceVertex(curr_root);
+
+        if((*path[i])->height == old_height){
+            return;
+        }
+    }
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+int BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::lowerBoundInBlock
+(const AVLvertex* v, const KeyType& key) {
+    int position = 0;
+    for(int i = 0; i < v->size; i++){
+        position += v->keys[i] < key;
+    }
+    return position;
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+int BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::upperBoundInBlock
+(const AVLvertex* v, const KeyType& key) {
+    int position = 0;
+    for(int i = 0; i < v->size; i++){
+        position += !(key < v->keys[i]);
+    }
+    return position;
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+typename BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::AVLvertex**
+BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::searchLink
+(const KeyType& key, AVLvertex** path[], int& depth) {
+    AVLvertex** link = &root;
+    while(*link != nullptr){
+        AVLvertex* v = *link;
+        if(key < v->keys[0]){
+            if(v->left == nullptr){
+                /* the key belongs before the first key of the block */
+                return link;
+            }
+            path[depth++] = link;
+            link = &v->left;
+        } else if(v->high < key){
+            if(v->right == nullptr){
+                return link;
+            }
+            path[depth++] = link;
+            link = &v->right;
+        } else {
+            return link;
+        }
+    }
+    return link;
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+bool BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::keyExists
+(KeyType key) {
+    AVLvertex** path[MAX_HEIGHT];
+    int depth = 0;
+    AVLvertex* v = *searchLink(key, path, depth);
+    if(v == nullptr){
+        return false;
+    }
+    int position = lowerBoundInBlock(v, key);
+    return position < v->size && v->keys[position] == key;
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+DataType* BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::getData
+(KeyType key) {
+    AVLvertex** path[MAX_HEIGHT];
+    int depth = 0;
+    AVLvertex* v = *searchLink(key, path, depth);
+    if(v == nullptr){
+        return nullptr;
+    }
+    int position = lowerBoundInBlock(v, key);
+    if(position < v->size && v->keys[position] == key){
+        return v->data[position];
+    }
+    return nullptr;
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+void BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::insertIntoBlock
+(AVLvertex* v, const KeyType& key, DataType* data) {
+    int position = upperBoundInBlock(v, key);
+    for(int i = v->size; i > position; i--){
+        v->keys[i] = v->keys[i - 1];
+        v->data[i] = v->data[i - 1];
+    }
+    v->keys[position] = key;
+    v->data[position] = data;
+    v->size++;
+    v->high = v->keys[v->size - 1];
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+void BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::moveToBack
+(AVLvertex* from, AVLvertex* to, int count) {
+    for(int i = 0; i < count; i++){
+        to->keys[to->size + i] = from->keys[i];
+        to->data[to->size + i] = from->data[i];
+    }
+    to->size += count;
+    for(int i = count; i < from->size; i++){
+        from->keys[i - count] = from->keys[i];
+        from->data[i - count] = from->data[i];
+    }
+    from->size -= count;
+
+    to->high = to->keys[to->size - 1];
+    if(from->size > 0){
+        from->high = from->keys[from->size - 1];
+    }
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+void BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::moveToFront
+(AVLvertex* from, AVLvertex* to, int count) {
+    for(int i = to->size - 1; i >= 0; i--){
+        to->keys[i + count] = to->keys[i];
+        to->data[i + count] = to->data[i];
+    }
+    for(int i = 0; i < count; i++){
+        to->keys[i] = from->keys[from->size - count + i];
+        to->data[i] = from->data[from->size - count + i];
+    }
+    to->size += count;
+    from->size -= count;
+
+    to->high = to->keys[to->size - 1];
+    if(from->size > 0){
+        from->high = from->keys[from->size - 1];
+    }
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+typename BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::AVLvertex*
+BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::splitBlock
+(AVLvertex** link, AVLvertex** path[], int depth) {
+    AVLvertex* v = *link;
+    AVLvertex* upper = allocator.create();
+    moveToFront(v, upper, BlockSize - BlockSize / 2);
+
+    /* the new vertex is the leftmost vertex of the right subtree */
+    path[depth++] = link;
+    AVLvertex** upper_link = &v->right;
+    while(*upper_link != nullptr){
+        path[depth++] = upper_link;
+        upper_link = &(*upper_link)->left;
+    }
+    *upper_link = upper;
+
+    rebalancePath(path, depth);
+    return upper;
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+void BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::insertKey
+(KeyType key, DataType* data) {
+    key_count++;
+    if(root == nullptr){
+        root = allocator.create();
+        insertIntoBlock(root, key, data);
+        return;
+    }
+
+    AVLvertex** path[MAX_HEIGHT];
+    int depth = 0;
+    AVLvertex** link = searchLink(key, path, depth);
+    AVLvertex* v = *link;
+    if(v->size < BlockSize){
+        insertIntoBlock(v, key, data);
+        return;
+    }
+
+    /* the vertex keeps the lower half of it's block, the new vertex is the
+     * next one inorder so the key goes to it if it's not less than it's
+     * first key. The split may rotate v, so it's kept by pointer */
+    AVLvertex* upper = splitBlock(link, path, depth);
+    if(key < upper->keys[0]){
+        insertIntoBlock(v, key, data);
+    } else {
+        insertIntoBlock(upper, key, data);
+    }
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+DataType* BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::deleteKey
+(KeyType key) {
+    AVLvertex** path[MAX_HEIGHT];
+    int depth = 0;
+    AVLvertex** link = searchLink(key, path, depth);
+    AVLvertex* v = *link;
+    if(v == nullptr){
+        return nullptr;
+    }
+    int position = lowerBoundInBlock(v, key);
+    if(position == v->size || !(v->keys[position] == key)){
+        /* the key is not in the tree */
+        return nullptr;
+    }
+
+    DataType* detached_data = v->data[position];
+    for(int i = position + 1; i < v->size; i++){
+        v->keys[i - 1] = v->keys[i];
+        v->data[i - 1] = v->data[i];
+    }
+    v->size--;
+    if(v->size > 0){
+        v->high = v->keys[v->size - 1];
+    }
+    key_count--;
+
+    if(v->size < MIN_FILL){
+        mergeBlock(link, path, depth);
+    }
+    return detached_data;
+}
+
+template<class KeyType, class DataType, int BlockSize,
+        template <class> class VertexAllocator>
+void BlockAVL_tree<KeyType, DataType, BlockSize, VertexAllocator>::mergeBlock
+(AVLvertex** link, AVLvertex** path[], int depth) {
+    AVLvertex* v = *link;
+
+    if(v->right != nullptr){
+        /* merge the successor, the leftmost vertex of the right subtree, into
+         * the vertex */
+        path[depth++] = link;
+        AVLvertex** successor_link = &v->right;
+        while((*successor_link)->left != nullptr){
+            path[depth++] = successor_link;
+            successor_link = &(*successor_link)->left;
+        }
+        AVLvertex* successor = *successor_link;
+        if(v->size + successor->size > BlockSize){
+            moveToBack(successor, v, (successor->size - v->size) / 2);
+            return;
+        }
+        moveToBack(successor, v, successor->size);
+        *successor_link = successor->right;
+        allocator.destroy(successor);
+        rebalancePath(path, depth);
+        return;
+    }
+
+    if(v->left != nullptr){
+        /* merge the predecessor, the rightmost vertex of the left subtree,
+         * into the vertex */
+        path[depth++] = link;
+        AVLvertex** predecessor_link = &v->left;
+        while((*predecessor_link)->right != nullptr){
+            path[depth++] = predecessor_link;
+            predecessor_link = &(*predecessor_link)->right;
+        }
+        AVLvertex* predecessor = *predecessor_link;
+        if(v->size + predecessor->size > BlockSize){
+            moveToFront(predecessor, v, (predecessor->size - v->size) / 2);
+            return;
+        }
+        moveToFront(predecessor, v, predecessor->size);
+        *predecessor_link = predecessor->left;
+        allocator.destroy(predecessor);
+        rebalancePath(path, depth);
+        return;
+    }
+
+    /* a leaf is merged into it's parent, which is it's successor if the
+     * leaf is a left child and it's predecessor otherwise */
+    if(depth == 0){
+        if(v->size == 0){
+            allocator.destroy(v);
+            *link = nullptr;
+        }
+        return;
+    }
+    AVLvertex* parent = *path[depth - 1];
+    if(v->size + parent->size > BlockSize){
+        int count = (parent->size - v->size) / 2;
+        if(link == &parent->left){
+            moveToBack(parent, v, count);
+        } else {
+            moveToFront(parent, v, count);
+        }
+        return;
+    }
+    if(link == &parent->left){
+        moveToFront(v, parent, v->size);
+    } else {
+        moveToBack(v, parent, v->size);
+    }
+    *link = nullptr;
+    allocator.destroy(v);
+    rebalancePath(path, depth);
+}
+
+#endif //WET1CPP_BLOCKAVL_TREE_H
@@ -0,0 +1,928 @@
+#ifndef WET1CPP_COMPACTAVL_TREE_H
+#define WET1CPP_COMPACTAVL_TREE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+/* an AVL tree with the interface of AVL_tree, which keeps all of it's
+ * vertexes in a single vector. Children are 32 bit indexes into the vector
+ * and the height is a single byte, so for an 8 byte key a vertex takes 32
+ * bytes with no allocation header, about half of an AVL_tree vertex. Deleted
+ * vertexes are kept in a free list for reuse, and compact() rewrites the
+ * vector in a search friendly order. The tree can hold up to 2^32-1
+ * vertexes */
+template <class KeyType, class DataType>
+class CompactAVL_tree{
+    class AVLvertex{
+    public:
+        KeyType key;
+        DataType* data;
+        uint32_t left, right;
+        int8_t height;
+
+        AVLvertex(KeyType key, DataType* data);
+    };
+
+    /* the index that stands for an empty subtree */
+    static const uint32_t NIL = UINT32_MAX;
+
+    /* the maximal height of a tree the fixed size path stacks can hold, see
+     * AVL_tree */
+    static const int MAX_HEIGHT = 48;
+
+    std::vector<AVLvertex> vertices;
+    uint32_t root;
+    /* the first slot of the free list, which is threaded through the left
+     * index of the free slots */
+    uint32_t free_list;
+    int free_count;
+
+    /* the recursive method to traverse the tree in an inorder manner, while
+     * applying the user supplied function to a vertex's key when visiting it */
+    template <class Func>
+    void inorderAux(uint32_t curr_root, Func& doSomething){
+        if(curr_root == NIL){
+            return;
+        }
+        inorderAux(vertices[curr_root].left, doSomething);
+        doSomething(vertices[curr_root].key);
+        inorderAux(vertices[curr_root].right, doSomething);
+    }
+
+    /* the recursive method behind forEachInRange, which skips the subtrees
+     * that can't hold keys between "low" and "high" */
+    template <class Func>
+    void forEachInRangeAux(uint32_t curr_root, const KeyType& low,
+            const KeyType& high, Func& doSomething){
+        if(curr_root == NIL){
+            return;
+        }
+        AVLvertex& v = vertices[curr_root];
+        if(low < v.key){
+            forEachInRangeAux(v.left, low, high, doSomething);
+        }
+        if(!(v.key < low) && !(high < v.key)){
+            doSomething(v.key);
+        }
+        if(v.key < high){
+            forEachInRangeAux(v.right, low, high, doSomething);
+        }
+    }
+
+    /* calculate the height of the given vertex */
+    int getHeight(uint32_t v) const;
+
+    /* calculate and update the height of the given vertex */
+    void updateHeight(uint32_t v);
+
+    /* calculate the balance factor of the given vertex */
+    int getBF(uint32_t v) const;
+
+    /* search a vertex with a matching key in the tree in an iterative manner.
+     * return it's index if found or NIL otherwise */
+    uint32_t searchVertex(const KeyType& key) const;
+
+    /* preform a right (left) rotation to the given vertex. The method returns
+     * the root of the new subtree */
+    uint32_t rotateRight(uint32_t v);
+    uint32_t rotateLeft(uint32_t v);
+
+    /* rebalance the given vertex if it's balance factor is not between -1 and
+     * 1 */
+    uint32_t rebalanceVertex(uint32_t curr_root);
+
+    /* walk back up the path of links (path[0] being &root) that was taken to
+     * reach an inserted or deleted vertex, see AVL_tree */
+    void rebalancePath(uint32_t* path[], int depth);
+
+    /* make sure the next call to createVertex() takes a free slot or fits in
+     * the capacity of the vector. The links on a path are pointers into the
+     * vector, so it must not reallocate between a search and an insertion */
+    void reserveSlot();
+
+    /* construct a vertex in a free slot, or at the end of the vector, and
+     * return it's index */
+    uint32_t createVertex(const KeyType& key, DataType* data);
+
+    /* return the slot of the given vertex to the free list */
+    void destroyVertex(uint32_t v);
+
+    /* search a vertex with a matching key while recording the links that
+     * lead to it, see AVL_tree */
+    uint32_t* searchLink(const KeyType& key, uint32_t* path[], int& depth);
+
+    /* insert a new vertex to the empty link at the end of the given path and
+     * rebalance the path. reserveSlot() must be called before the path is
+     * recorded. The method returns the new vertex */
+    uint32_t insertAtLink(uint32_t* link, uint32_t* path[], int depth,
+            const KeyType& key, DataType* data);
+
+    /* build a perfectly balanced tree out of the next "size" (key, data
+     * pointer) pairs of a sorted sequence, see AVL_tree */
+    template <class InputIt>
+    uint32_t buildBalancedTree(InputIt& it, int size);
+
+public:
+
+    /* the orders compact() can lay the vertexes out in. In breadth first
+     * order the top levels of the tree, which every search visits, share
+     * a few cache lines. In preorder every vertex is followed by it's left
+     * child, which suits inorder scans */
+    enum Layout {BREADTH_FIRST, PREORDER};
+
+    /* a bidirectional iterator over the keys of the tree in an inorder
+     * manner, keeping the path from the root like AVL_tree::iterator. An
+     * iterator is invalidated by any insertion, deletion or compaction */
+    class iterator{
+        const CompactAVL_tree* tree;
+        uint32_t path[MAX_HEIGHT];
+        /* the number of vertexes on the path, 0 for the end iterator */
+        int depth;
+
+        explicit iterator(const CompactAVL_tree* tree) : tree(tree),
+                                                         depth(0) {}
+
+        const AVLvertex& vertex(uint32_t v) const {return tree->vertices[v];}
+
+        /* push the leftmost (or rightmost) path of the subtree which it's
+         * root is curr_root */
+        void descendLeft(uint32_t curr_root){
+            while(curr_root != NIL){
+                path[depth++] = curr_root;
+                curr_root = vertex(curr_root).left;
+            }
+        }
+
+        void descendRight(uint32_t curr_root){
+            while(curr_root != NIL){
+                path[depth++] = curr_root;
+                curr_root = vertex(curr_root).right;
+            }
+        }
+
+        friend class CompactAVL_tree;
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef KeyType value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const KeyType* pointer;
+        typedef const KeyType& reference;
+
+        iterator() : tree(nullptr), depth(0) {}
+
+        /* only the used part of the path is copied */
+        iterator(const iterator& other) : tree(other.tree), depth(other.depth){
+            for(int i = 0; i < depth; i++){
+                path[i] = other.path[i];
+            }
+        }
+
+        iterator& operator=(const iterator& other){
+            tree = other.tree;
+            depth = other.depth;
+            for(int i = 0; i < depth; i++){
+                path[i] = other.path[i];
+            }
+            return *this;
+        }
+
+        const KeyType& operator*() const {return vertex(path[depth - 1]).key;}
+
+        const KeyType* operator->() const {
+            return &vertex(path[depth - 1]).key;
+        }
+
+        /* the data held by the current vertex */
+        DataType* data() const {return vertex(path[depth - 1]).data;}
+
+        iterator& operator++(){
+            uint32_t curr = path[depth - 1];
+            if(vertex(curr).right != NIL){
+                /* the successor is the minimum of the right subtree */
+                descendLeft(vertex(curr).right);
+                return *this;
+            }
+
+            /* otherwise it's the first ancestor we reach from it's left
+             * subtree */
+            depth--;
+            while(depth > 0 && vertex(path[depth - 1]).right == curr){
+                curr = path[--depth];
+            }
+            return *this;
+        }
+
+        iterator operator++(int){
+            iterator prev(*this);
+            ++*this;
+            return prev;
+        }
+
+        iterator& operator--(){
+            if(depth == 0){
+                /* the predecessor of the end is the maximum of the tree */
+                descendRight(tree->root);
+                return *this;
+            }
+
+            uint32_t curr = path[depth - 1];
+            if(vertex(curr).left != NIL){
+                descendRight(vertex(curr).left);
+                return *this;
+            }
+
+            depth--;
+            while(depth > 0 && vertex(path[depth - 1]).left == curr){
+                curr = path[--depth];
+            }
+            return *this;
+        }
+
+        iterator operator--(int){
+            iterator prev(*this);
+            --*this;
+            return prev;
+        }
+
+        bool operator==(const iterator& other) const {
+            if(depth == 0 || other.depth == 0){
+                return depth == other.depth;
+            }
+            return path[depth - 1] == other.path[other.depth - 1];
+        }
+
+        bool operator!=(const iterator& other) const {
+            return !(*this == other);
+        }
+    };
+
+    /* a handle to a vertex of the tree, see AVL_tree::Handle. The handle
+     * holds the index of the vertex, so it stays valid when the vector grows,
+     * until a key is deleted from the tree or the tree is compacted */
+    class Handle{
+        CompactAVL_tree* tree;
+        uint32_t vertex;
+
+        Handle(CompactAVL_tree* tree, uint32_t vertex) : tree(tree),
+                                                         vertex(vertex) {}
+
+        friend class CompactAVL_tree;
+    public:
+        Handle() : tree(nullptr), vertex(NIL) {}
+
+        /* return true if the handle refers to a vertex */
+        explicit operator bool() const {return vertex != NIL;}
+
+        const KeyType& key() const {return tree->vertices[vertex].key;}
+
+        DataType* data() const {return tree->vertices[vertex].data;}
+    };
+
+    /* constructor  */
+    CompactAVL_tree();
+
+    /* construct a tree out of the (key, data pointer) pairs in the range
+     * [first, last), see assign() */
+    template <class InputIt>
+    CompactAVL_tree(InputIt first, InputIt last);
+
+    /* destructor  */
+    ~CompactAVL_tree();
+
+    CompactAVL_tree(const CompactAVL_tree& tree) = delete;
+    CompactAVL_tree& operator=(const CompactAVL_tree& tree) = delete;
+
+    /* delete every vertex and it's data from the tree */
+    void clear();
+
+    /* replace the content of the tree with the (key, data pointer) pairs in
+     * the range [first, last), which must be sorted by key. The tree is built
+     * perfectly balanced in O(n) and laid out in breadth first order */
+    template <class ForwardIt>
+    void assignSorted(ForwardIt first, ForwardIt last);
+
+    /* like assignSorted(), but the pairs are sorted by key first if they are
+     * not in order already */
+    template <class InputIt>
+    void assign(InputIt first, InputIt last);
+
+    /* return true if a vertex with a matching key exists int the tree, false
+     * otherwise  */
+    bool keyExists(KeyType key);
+
+    /* the interface method to insert a vertex with a "key" and "data" to the
+     * tree */
+    void insertKey(KeyType key, DataType* data);
+
+    /* the interface method to delete a vertex with the matching key from the
+     * tree. The vertex's data is detached from the tree and returned to the
+     * caller, or nullptr if the key is not in the tree. The slot of the
+     * vertex is reused by a later insertion */
+    DataType* deleteKey(KeyType key);
+
+    /* return the pointer to the data that the vertex with the matching key
+     * holds */
+    DataType* getData(KeyType key);
+
+    /* return a handle to the vertex with the matching key, or an empty handle
+     * if the key is not in the tree */
+    Handle find(KeyType key);
+
+    /* insert a vertex with "key" and "data" only if the key is not in the
+     * tree yet, see AVL_tree::tryEmplace() */
+    std::pair<Handle, bool> tryEmplace(KeyType key, DataType* data);
+
+    /* insert a vertex with "key" and "data", or if the key is already in the
+     * tree replace (and delete) the data it holds, see
+     * AVL_tree::insertOrAssign() */
+    std::pair<Handle, bool> insertOrAssign(KeyType key, DataType* data);
+
+    /* return a handle to the vertex with the matching key. If the key is not
+     * in the tree, a vertex is inserted with the data returned by calling
+     * "makeData()" */
+    template <class Factory>
+    Handle findOrInsert(KeyType key, Factory makeData);
+
+    /* the interface method to traverse the tree in an inorder manner, while
+     * applying the user supplied function to a vertex's key when visiting it */
+    template <class Func>
+    void inorder(Func& doSomething){inorderAux(root, doSomething);}
+
+    /* return the number of keys in the tree */
+    int size() const {return vertices.size() - free_count;}
+
+    /* rewrite the vector of vertexes in the given order, dropping the free
+     * slots. Takes O(n) time and O(n) temporary memory, so it is meant to be
+     * called once in a while, e.g. after a batch of updates */
+    void compact(Layout layout = BREADTH_FIRST);
+
+    /* iterators to the minimal key of the tree and past the maximal one */
+    iterator begin() const;
+    iterator end() const {return iterator(this);}
+
+    /* return an iterator to the first key that is not less than "key", or
+     * end() if there is no such key */
+    iterator lowerBound(const KeyType& key) const;
+
+    /* return an iterator to the first key that is greater than "key", or
+     * end() if there is no such key */
+    iterator upperBound(const KeyType& key) const;
+
+    /* return the range of keys that are equal to "key" */
+    std::pair<iterator, iterator> equalRange(const KeyType& key) const;
+
+    /* apply the user supplied function to every key between "low" and "high"
+     * (inclusive) in an inorder manner, see AVL_tree::forEachInRange() */
+    template <class Func>
+    void forEachInRange(const KeyType& low, const KeyType& high,
+            Func& doSomething){
+        forEachInRangeAux(root, low, high, doSomething);
+    }
+};
+
+template<class KeyType, class DataType>
+CompactAVL_tree<KeyType, DataType>::AVLvertex::AVLvertex(KeyType key,
+        DataType* data)
+        : key(key), data(data), left(NIL), right(NIL), height(1) {}
+
+template<class KeyType, class DataType>
+CompactAVL_tree<KeyType, DataType>::CompactAVL_tree()
+        : root(NIL), free_list(NIL), free_count(0) {}
+
+template<class KeyType, class DataType>
+template <class InputIt>
+CompactAVL_tree<KeyType, DataType>::CompactAVL_tree(InputIt first,
+        InputIt last) : root(NIL), free_list(NIL), free_count(0) {
+    assign(first, last);
+}
+
+template<class KeyType, class DataType>
+CompactAVL_tree<KeyType, DataType>::~CompactAVL_tree() {
+    clear();
+}
+
+template<class KeyType, class DataType>
+void CompactAVL_tree<KeyType, DataType>::clear() {
+    /* only the live vertexes own their data, so the data is deleted by
+     * walking the tree rather than the vector */
+    std::vector<uint32_t> stack;
+    if(root != NIL){
+        stack.push_back(root);
+    }
+    while(!stack.empty()){
+        AVLvertex& v = vertices[stack.back()];
+        stack.pop_back();
+        if(v.left != NIL){
+            stack.push_back(v.left);
+        }
+        if(v.right != NIL){
+            stack.push_back(v.right);
+        }
+        delete v.data;
+    }
+
+    std::vector<AVLvertex>().swap(vertices);
+    root = NIL;
+    free_list = NIL;
+    free_count = 0;
+}
+
+template<class KeyType, class DataType>
+template <class ForwardIt>
+void CompactAVL_tree<KeyType, DataType>::assignSorted(ForwardIt first,
+        ForwardIt last) {
+    clear();
+
+    int size = std::distance(first, last);
+    vertices.reserve(size);
+    root = buildBalancedTree(first, size);
+    compact(BREADTH_FIRST);
+}
+
+template<class KeyType, class DataType>
+template <class InputIt>
+void CompactAVL_tree<KeyType, DataType>::assign(InputIt first,
+        InputIt last) {
+    std::vector<std::pair<KeyType, DataType*> > pairs(first, last);
+    auto keyLess = [](const std::pair<KeyType, DataType*>& p1,
+            const std::pair<KeyType, DataType*>& p2){
+        return p1.first < p2.first;
+    };
+    if(!std::is_sorted(pairs.begin(), pairs.end(), keyLess)){
+        std::stable_sort(pairs.begin(), pairs.end(), keyLess);
+    }
+    assignSorted(pairs.begin(), pairs.end());
+}
+
+template<class KeyType, class DataType>
+template <class InputIt>
+uint32_t CompactAVL_tree<KeyType, DataType>::buildBalancedTree(InputIt& it,
+        int size) {
+    if(size == 0){
+        return NIL;
+    }
+
+    int left_size = (size - 1) / 2;
+    uint32_t left_subtree = buildBalancedTree(it, left_size);
+
+    uint32_t new_root = createVertex(it->first, it->second);
+    ++it;
+    vertices[new_root].left = left_subtree;
+    uint32_t right_subtree = buildBalancedTree(it, size - 1 - left_size);
+    vertices[new_root].right = right_subtree;
+
+    updateHeight(new_root);
+    return new_root;
+}
+
+template<class KeyType, class DataType>
+bool CompactAVL_tree<KeyType, DataType>::keyExists(KeyType key){
+    return searchVertex(key) != NIL;
+}
+
+template<class KeyType, class DataType>
+DataType* CompactAVL_tree<KeyType, DataType>::getData(KeyType key){
+    uint32_t v = searchVertex(key);
+    if(v == NIL){
+        return nullptr;
+    }
+
+    return vertices[v].data;
+}
+
+template<class KeyType, class DataType>
+uint32_t CompactAVL_tree<KeyType, DataType>::searchVertex
+(const KeyType& key) const {
+    uint32_t curr_root = root;
+    while (curr_root != NIL) {
+        const AVLvertex& v = vertices[curr_root];
+        if (v.key == key) {
+            return curr_root;
+        } else if (v.key < key) {
+            curr_root = v.right;
+        } else {
+            curr_root = v.left;
+        }
+    }
+    return NIL;
+}
+
+template<class KeyType, class DataType>
+int CompactAVL_tree<KeyType, DataType>::getHeight(uint32_t v) const {
+    if(v == NIL){
+        return 0;
+    } else {
+        return vertices[v].height;
+    }
+}
+
+template<class KeyType, class DataType>
+void CompactAVL_tree<KeyType, DataType>::updateHeight(uint32_t v) {
+    int left_height = getHeight(vertices[v].left);
+    int right_height = getHeight(vertices[v].right);
+    vertices[v].height = 1 + (left_height > right_height ? left_height
+                                                         : right_height);
+}
+
+template<class KeyType, class DataType>
+int CompactAVL_tree<KeyType, DataType>::getBF(uint32_t v) const {
+    if(v == NIL){
+        return 0;
+    } else{
+        return getHeight(vertices[v].left) - getHeight(vertices[v].right);
+    }
+}
+
+template<class KeyType, class DataType>
+uint32_t CompactAVL_tree<KeyType, DataType>::rotateRight(uint32_t v) {
+    uint32_t to_rotate = v;
+    uint32_t to_rotate_left_child = vertices[to_rotate].left;
+    uint32_t right_subtree = vertices[to_rotate_left_child].right;
+
+    /* preform rotation */
+    vertices[to_rotate_left_child].right = to_rotate;
+    vertices[to_rotate].left = right_subtree;
+
+    /* update the height of the vertexes that their subtree changed */
+    updateHeight(to_rotate);
+    updateHeight(to_rotate_left_child);
+
+    /* return the root of the new subtree */
+    return to_rotate_left_child;
+}
+
+template<class KeyType, class DataType>
+uint32_t CompactAVL_tree<KeyType, DataType>::rotateLeft(uint32_t v) {
+    uint32_t to_rotate = v;
+    uint32_t to_rotate_right_child = vertices[to_rotate].right;
+    uint32_t left_subtree = vertices[to_rotate_right_child].left;
+
+    /* preform rotation */
+    vertices[to_rotate_right_child].left = to_rotate;
+    vertices[to_rotate].right = left_subtree;
+
+    /* update the height of the vertexes that their subtree changed */
+    updateHeight(to_rotate);
+    updateHeight(to_rotate_right_child);
+
+    /* return the root of the new subtree */
+    return to_rotate_right_child;
+}
+
+template<class KeyType, class DataType>
+uint32_t CompactAVL_tree<KeyType, DataType>::rebalanceVertex
+(uint32_t curr_root){
+
+    int BF = getBF(curr_root);
+
+    if(BF >= -1 && BF <= 1) {
+        /* balance factor is in bound therefore no rotations are needed */
+        return curr_root;
+    }
+
+    if(BF == 2){
+        if(getBF(vertices[curr_root].left) >= 0){
+            /* LL rotation */
+            return rotateRight(curr_root);
+        } else {
+            /* LR rotation */
+            vertices[curr_root].left = rotateLeft(vertices[curr_root].left);
+            return rotateRight(curr_root);
+        }
+    }
+
+    if(BF == -2){
+        if(getBF(vertices[curr_root].right) <= 0){
+            /* RR rotation */
+            return rotateLeft(curr_root);
+        } else {
+            /* RL rotation */
+            vertices[curr_root].right = rotateRight(vertices[curr_root].right);
+            return rotateLeft(curr_root);
+        }
+    }
+
+    return curr_root;
+}
+
+template<class KeyType, class DataType>
+void CompactAVL_tree<KeyType, DataType>::rebalancePath(uint32_t* path[],
+        int depth) {
+    for(int i = depth - 1; i >= 0; i--){
+        uint32_t curr_root = *path[i];
+        int old_height = vertices[curr_root].height;
+
+        updateHeight(curr_root);
+
+        /* rebalance the current root if needed */
+        *path[i] = rebalanceVertex(curr_root);
+
+        if(vertices[*path[i]].height == old_height){
+            return;
+        }
+    }
+}
+
+template<class KeyType, class DataType>
+void CompactAVL_tree<KeyType, DataType>::reserveSlot() {
+    if(free_list == NIL && vertices.size() == vertices.capacity()){
+        vertices.reserve(vertices.size() < 16 ? 16 : 2 * vertices.size());
+    }
+}
+
+template<class KeyType, class DataType>
+uint32_t CompactAVL_tree<KeyType, DataType>::createVertex(const KeyType& key,
+        DataType* data) {
+    if(free_list != NIL){
+        uint32_t v = free_list;
+        free_list = vertices[v].left;
+        free_count--;
+        vertices[v] = AVLvertex(key, data);
+        return v;
+    }
+    vertices.push_back(AVLvertex(key, data));
+    return vertices.size() - 1;
+}
+
+template<class KeyType, class DataType>
+void CompactAVL_tree<KeyType, DataType>::destroyVertex(uint32_t v) {
+    vertices[v].data = nullptr;
+    vertices[v].left = free_list;
+    free_list = v;
+    free_count++;
+}
+
+template<class KeyType, class DataType>
+uint32_t* CompactAVL_tree<KeyType, DataType>::searchLink(const KeyType& key,
+        uint32_t* path[], int& depth) {
+    uint32_t* link = &root;
+    while(*link != NIL && !(vertices[*link].key == key)){
+        path[depth++] = link;
+        if(vertices[*link].key < key){
+            link = &vertices[*link].right;
+        } else {
+            link = &vertices[*link].left;
+        }
+    }
+    return link;
+}
+
+template<class KeyType, class DataType>
+uint32_t CompactAVL_tree<KeyType, DataType>::insertAtLink(uint32_t* link,
+        uint32_t* path[], int depth, const KeyType& key, DataType* data) {
+    uint32_t new_vertex = createVertex(key, data);
+    *link = new_vertex;
+
+    rebalancePath(path, depth);
+
+    /* rotations move vertexes around but never replace them, so the new
+     * vertex is still the one holding the key */
+    return new_vertex;
+}
+
+template<class KeyType, class DataType>
+void CompactAVL_tree<KeyType, DataType>::insertKey(KeyType key,
+        DataType *data) {
+    reserveSlot();
+
+    uint32_t* path[MAX_HEIGHT];
+    int depth = 0;
+
+    /* preform the usual insertion like in a regular binary search tree,
+     * while recording the links that lead to the new vertex */
+    uint32_t* link = &root;
+    while(*link != NIL){
+        path[depth++] = link;
+        if(vertices[*link].key < key){
+            link = &vertices[*link].right;
+        } else {
+            link = &vertices[*link].left;
+        }
+    }
+    insertAtLink(link, path, depth, key, data);
+}
+
+template<class KeyType, class DataType>
+DataType* CompactAVL_tree<KeyType, DataType>::deleteKey(KeyType key) {
+    uint32_t* path[MAX_HEIGHT];
+    int depth = 0;
+    uint32_t* link = searchLink(key, path, depth);
+    if(*link == NIL){
+        /* the key is not in the tree */
+        return nullptr;
+    }
+
+    /* preform the usual deletion like in a regular binary search tree */
+    uint32_t to_delete = *link;
+    DataType* detached_data = vertices[to_delete].data;
+    if(vertices[to_delete].left == NIL || vertices[to_delete].right == NIL){
+        /* no children or one child case */
+        if(vertices[to_delete].left != NIL){
+            *link = vertices[to_delete].left;
+        } else {
+            *link = vertices[to_delete].right;
+        }
+    } else {
+        /* 2 children case: the successor's key and data are copied to the
+         * vertex, and the successor is unlinked from the right subtree */
+        path[depth++] = link;
+        uint32_t* successor_link = &vertices[to_delete].right;
+        while(vertices[*successor_link].left != NIL){
+            path[depth++] = successor_link;
+            successor_link = &vertices[*successor_link].left;
+        }
+        uint32_t successor = *successor_link;
+        vertices[to_delete].key = vertices[successor].key;
+        vertices[to_delete].data = vertices[successor].data;
+        *successor_link = vertices[successor].right;
+        to_delete = successor;
+    }
+    destroyVertex(to_delete);
+
+    rebalancePath(path, depth);
+
+    return detached_data;
+}
+
+template<class KeyType, class DataType>
+typename CompactAVL_tree<KeyType, DataType>::Handle
+CompactAVL_tree<KeyType, DataType>::find(KeyType key) {
+    return Handle(this, searchVertex(key));
+}
+
+template<class KeyType, class DataType>
+std::pair<typename CompactAVL_tree<KeyType, DataType>::Handle, bool>
+CompactAVL_tree<KeyType, DataType>::tryEmplace(KeyType key, DataType* data) {
+    reserveSlot();
+
+    uint32_t* path[MAX_HEIGHT];
+    int depth = 0;
+    uint32_t* link = searchLink(key, path, depth);
+    if(*link != NIL){
+        return std::make_pair(Handle(this, *link), false);
+    }
+
+    return std::make_pair(Handle(this,
+            insertAtLink(link, path, depth, key, data)), true);
+}
+
+template<class KeyType, class DataType>
+std::pair<typename CompactAVL_tree<KeyType, DataType>::Handle, bool>
+CompactAVL_tree<KeyType, DataType>::insertOrAssign(KeyType key,
+        DataType* data) {
+    reserveSlot();
+
+    uint32_t* path[MAX_HEIGHT];
+    int depth = 0;
+    uint32_t* link = searchLink(key, path, depth);
+    if(*link != NIL){
+        AVLvertex& v = vertices[*link];
+        if(v.data != data){
+            delete v.data;
+            v.data = data;
+        }
+        return std::make_pair(Handle(this, *link), false);
+    }
+
+    return std::make_pair(Handle(this,
+            insertAtLink(link, path, depth, key, data)), true);
+}
+
+template<class KeyType, class DataType>
+template <class Factory>
+typename CompactAVL_tree<KeyType, DataType>::Handle
+CompactAVL_tree<KeyType, DataType>::findOrInsert(KeyType key,
+        Factory makeData) {
+    reserveSlot();
+
+    uint32_t* path[MAX_HEIGHT];
+    int depth = 0;
+    uint32_t* link = searchLink(key, path, depth);
+    if(*link != NIL){
+        return Handle(this, *link);
+    }
+
+    return Handle(this, insertAtLink(link, path, depth, key, makeData()));
+}
+
+template<class KeyType, class DataType>
+void CompactAVL_tree<KeyType, DataType>::compact(Layout layout) {
+    /* list the live vertexes in their new order */
+    std::vector<uint32_t> order;
+    order.reserve(size());
+    if(root != NIL){
+        if(layout == BREADTH_FIRST){
+            /* the order vector itself is the queue of the traversal */
+            order.push_back(root);
+            for(std::size_t i = 0; i < order.size(); i++){
+                const AVLvertex& v = vertices[order[i]];
+                if(v.left != NIL){
+                    order.push_back(v.left);
+                }
+                if(v.right != NIL){
+                    order.push_back(v.right);
+                }
+            }
+        } else {
+            std::vector<uint32_t> stack(1, root);
+            while(!stack.empty()){
+                uint32_t curr = stack.back();
+                stack.pop_back();
+                order.push_back(curr);
+                if(vertices[curr].right != NIL){
+                    stack.push_back(vertices[curr].right);
+                }
+                if(vertices[curr].left != NIL){
+                    stack.push_back(vertices[curr].left);
+                }
+            }
+        }
+    }
+
+    std::vector<uint32_t> new_index(vertices.size());
+    for(std::size_t i = 0; i < order.size(); i++){
+        new_index[order[i]] = i;
+    }
+
+    std::vector<AVLvertex> compacted;
+    compacted.reserve(order.size());
+    for(uint32_t old_index : order){
+        AVLvertex& v = vertices[old_index];
+        compacted.push_back(std::move(v));
+        AVLvertex& moved = compacted.back();
+        if(moved.left != NIL){
+            moved.left = new_index[moved.left];
+        }
+        if(moved.right != NIL){
+            moved.right = new_index[moved.right];
+        }
+    }
+
+    vertices.swap(compacted);
+    root = vertices.empty() ? NIL : 0;
+    free_list = NIL;
+    free_count = 0;
+}
+
+template<class KeyType, class DataType>
+typename CompactAVL_tree<KeyType, DataType>::iterator
+CompactAVL_tree<KeyType, DataType>::begin() const {
+    iterator it(this);
+    it.descendLeft(root);
+    return it;
+}
+
+template<class KeyType, class DataType>
+typename CompactAVL_tree<KeyType, DataType>::iterator
+CompactAVL_tree<KeyType, DataType>::lowerBound(const KeyType& key) const {
+    iterator it(this);
+
+    /* the path to the last vertex we turned left at is the path to the
+     * first key which is not less than "key" */
+    int found_depth = 0;
+    uint32_t curr_root = root;
+    while(curr_root != NIL){
+        it.path[it.depth++] = curr_root;
+        if(vertices[curr_root].key < key){
+            curr_root = vertices[curr_root].right;
+        } else {
+            found_depth = it.depth;
+            curr_root = vertices[curr_root].left;
+        }
+    }
+    it.depth = found_depth;
+    return it;
+}
+
+template<class KeyType, class DataType>
+typename CompactAVL_tree<KeyType, DataType>::iterator
+CompactAVL_tree<KeyType, DataType>::upperBound(const KeyType& key) const {
+    iterator it(this);
+
+    int found_depth = 0;
+    uint32_t curr_root = root;
+    while(curr_root != NIL){
+        it.path[it.depth++] = curr_root;
+        if(key < vertices[curr_root].key){
+            found_depth = it.depth;
+            curr_root = vertices[curr_root].left;
+        } else {
+            curr_root = vertices[curr_root].right;
+        }
+    }
+    it.depth = found_depth;
+    return it;
+}
+
+template<class KeyType, class DataType>
+std::pair<typename CompactAVL_tree<KeyType, DataType>::iterator,
+        typename CompactAVL_tree<KeyType, DataType>::iterator>
+CompactAVL_tree<KeyType, DataType>::equalRange(const KeyType& key) const {
+    return std::make_pair(lowerBound(key), upperBound(key));
+}
+
+#endif //WET1CPP_COMPACTAVL_TREE_H
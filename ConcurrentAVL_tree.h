@@ -0,0 +1,969 @@
+#ifndef WET1CPP_CONCURRENTAVL_TREE_H
+#define WET1CPP_CONCURRENTAVL_TREE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <thread>
+#include "EpochReclaimer.h"
+
+/* an AVL tree that may be shared by any number of threads, after the
+ * optimistic relaxed balance tree of Bronson, Casper, Chafi and Olukotun
+ * ("A Practical Concurrent Binary Search Tree", PPoPP 2010).
+ *
+ * Searches take no locks. Every vertex has a version which is changed while
+ * a rotation shrinks it's subtree or when it's unlinked, and a search moves
+ * from a vertex to a child only after checking that the vertex's version is
+ * unchanged, retrying from the parent otherwise. Updates lock only the
+ * vertexes they change, always a parent before it's child. A deleted key
+ * whose vertex has two children is kept as a routing vertex without data,
+ * and is unlinked once it has at most one child. Unlinked vertexes are
+ * freed through the EpochReclaimer.
+ *
+ * The keys form a set: insertKey() doesn't insert a key that is already in
+ * the tree. The tree owns the data of the keys it holds, and a data pointer
+ * returned by getData() is valid until the key is deleted */
+template <class KeyType, class DataType>
+class ConcurrentAVL_tree{
+    /* a one byte test and test and set lock */
+    class SpinLock{
+        std::atomic<bool> locked;
+    public:
+        SpinLock() : locked(false) {}
+
+        void lock(){
+            while(locked.exchange(true, std::memory_order_acquire)){
+                while(locked.load(std::memory_order_relaxed)){
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        void unlock(){
+            locked.store(false, std::memory_order_release);
+        }
+    };
+
+    class AVLvertex{
+    public:
+        /* the key is left unconstructed in the holder vertex. The fields a
+         * search reads come first, to share a cache line */
+        union {
+            KeyType key;
+        };
+        std::atomic<AVLvertex*> left, right;
+        std::atomic<uint64_t> version;
+        /* nullptr for a routing vertex */
+        std::atomic<DataType*> data;
+        std::atomic<AVLvertex*> parent;
+        std::atomic<int> height;
+        SpinLock lock;
+
+        /* the holder vertex, which is the parent of the root */
+        AVLvertex() : left(nullptr), right(nullptr), version(0),
+                      data(nullptr), parent(nullptr), height(0) {}
+
+        AVLvertex(const KeyType& key, DataType* data, AVLvertex* parent)
+                : key(key), left(nullptr), right(nullptr), version(0),
+                  data(data), parent(parent), height(1) {}
+
+        ~AVLvertex() {}
+
+        AVLvertex* child(int direction) const {
+            return direction < 0 ? left.load() : right.load();
+        }
+    };
+
+    typedef std::lock_guard<SpinLock> LockGuard;
+
+    /* the bits of a version: the vertex was unlinked, or a rotation is
+     * shrinking it's subtree right now. The rest counts the rotations */
+    static const uint64_t UNLINKED = 1;
+    static const uint64_t SHRINKING = 2;
+    static const uint64_t SHRINK_COUNT_INCREMENT = 4;
+
+    /* the results of an attempt, which is retried from the parent vertex if
+     * the vertex it started at has changed */
+    enum AttemptResult {RETRY, DONE};
+
+    /* the repairs nodeCondition() may find necessary, any other result is
+     * the height the vertex should have */
+    static const int UNLINK_REQUIRED = -1;
+    static const int REBALANCE_REQUIRED = -2;
+    static const int NOTHING_REQUIRED = -3;
+
+    /* the right child of the holder is the root of the tree */
+    AVLvertex* holder;
+
+    /* return -1, 0 or 1 if "key" is less than, equal to or greater than the
+     * key of "v" */
+    static int compare(const KeyType& key, const AVLvertex* v){
+        if(key < v->key){
+            return -1;
+        }
+        return v->key < key ? 1 : 0;
+    }
+
+    static int getHeight(AVLvertex* v){
+        return v == nullptr ? 0 : v->height.load();
+    }
+
+    static void setChild(AVLvertex* v, int direction, AVLvertex* child){
+        if(direction < 0){
+            v->left.store(child);
+        } else {
+            v->right.store(child);
+        }
+    }
+
+    /* free a vertex that was retired to the reclaimer */
+    static void destroyVertex(void* object){
+        AVLvertex* v = static_cast<AVLvertex*>(object);
+        v->key.~KeyType();
+        delete v;
+    }
+
+    /* wait for a rotation that is shrinking the subtree of "v" to end */
+    static void waitUntilShrinkCompleted(AVLvertex* v, uint64_t version);
+
+    /* the attempts behind the interface methods. Each one searches the
+     * subtree of the "direction" child of "v", given that the version of
+     * "v" was "version" when it was reached */
+    AttemptResult attemptGet(const KeyType& key, AVLvertex* v, int direction,
+            uint64_t version, DataType*& result) const;
+
+    AttemptResult attemptInsert(const KeyType& key, DataType* data,
+            AVLvertex* v, int direction, uint64_t version, bool& inserted);
+
+    AttemptResult attemptInsertIntoEmpty(const KeyType& key, DataType* data,
+            AVLvertex* v, int direction, uint64_t version);
+
+    /* give data to a routing vertex with a matching key */
+    AttemptResult attemptRevive(AVLvertex* v, DataType* data, bool& inserted);
+
+    AttemptResult attemptDelete(const KeyType& key, AVLvertex* v,
+            int direction, uint64_t version, DataType*& removed);
+
+    AttemptResult attemptDeleteVertex(AVLvertex* parent, AVLvertex* v,
+            DataType*& removed);
+
+    /* unlink "v", which must have at most one child, from "parent". Both
+     * vertexes must be locked. Return false if "v" is no longer a child of
+     * "parent" or has two children */
+    bool attemptUnlink(AVLvertex* parent, AVLvertex* v);
+
+    /* walk up from "v", fixing heights, unlinking routing vertexes and
+     * rebalancing, until a vertex needs no repair */
+    void fixHeightAndRebalance(AVLvertex* v);
+
+    /* the repair "v" needs, see UNLINK_REQUIRED */
+    static int nodeCondition(AVLvertex* v);
+
+    /* the following methods require "v" (and "parent") to be locked. They
+     * return the next vertex that needs repair, or nullptr */
+    AVLvertex* fixHeight(AVLvertex* v);
+
+    AVLvertex* rebalance(AVLvertex* parent, AVLvertex* v);
+
+    AVLvertex* rebalanceToRight(AVLvertex* parent, AVLvertex* v,
+            AVLvertex* left, int right_height);
+
+    AVLvertex* rebalanceToLeft(AVLvertex* parent, AVLvertex* v,
+            AVLvertex* right, int left_height);
+
+    AVLvertex* rotateRight(AVLvertex* parent, AVLvertex* v, AVLvertex* left,
+            int right_height, int left_left_height, AVLvertex* left_right,
+            int left_right_height);
+
+    AVLvertex* rotateLeft(AVLvertex* parent, AVLvertex* v, AVLvertex* right,
+            int left_height, int right_right_height, AVLvertex* right_left,
+            int right_left_height);
+
+    AVLvertex* rotateRightOverLeft(AVLvertex* parent, AVLvertex* v,
+            AVLvertex* left, int right_height, int left_left_height,
+            AVLvertex* left_right, int left_right_left_height);
+
+    AVLvertex* rotateLeftOverRight(AVLvertex* parent, AVLvertex* v,
+            AVLvertex* right, int left_height, int right_right_height,
+            AVLvertex* right_left, int right_left_right_height);
+
+    /* the recursive method to traverse the tree in an inorder manner, while
+     * applying the user supplied function to every key that has data */
+    template <class Func>
+    void inorderAux(AVLvertex* curr_root, Func& doSomething){
+        if(curr_root == nullptr){
+            return;
+        }
+        inorderAux(curr_root->left.load(), doSomething);
+        if(curr_root->data.load() != nullptr){
+            doSomething(curr_root->key);
+        }
+        inorderAux(curr_root->right.load(), doSomething);
+    }
+
+    /* deallocate every vertex and it's data in the tree which it's root is
+     * curr_root, using a recursive postorder traversal */
+    void deleteTree(AVLvertex* curr_root);
+
+public:
+
+    /* constructor  */
+    ConcurrentAVL_tree();
+
+    /* destructor, which must not run concurrently with any other method */
+    ~ConcurrentAVL_tree();
+
+    ConcurrentAVL_tree(const ConcurrentAVL_tree& tree) = delete;
+    ConcurrentAVL_tree& operator=(const ConcurrentAVL_tree& tree) = delete;
+
+    /* return true if the key is in the tree, false otherwise. Takes no
+     * locks */
+    bool keyExists(const KeyType& key) const {
+        return getData(key) != nullptr;
+    }
+
+    /* return the data of the matching key, or nullptr if the key is not in
+     * the tree. Takes no locks */
+    DataType* getData(const KeyType& key) const;
+
+    /* insert "key" with "data" if the key is not in the tree yet. Return
+     * true if the key was inserted, otherwise the caller keeps the ownership
+     * of "data". A vertex without data is a routing vertex, so a nullptr
+     * "data" is rejected and the method returns false */
+    bool insertKey(const KeyType& key, DataType* data);
+
+    /* delete the matching key from the tree. The key's data is detached from
+     * the tree and returned to the caller, or nullptr if the key is not in
+     * the tree */
+    DataType* deleteKey(const KeyType& key);
+
+    /* the interface method to traverse the tree in an inorder manner, while
+     * applying the user supplied function to every key. The traversal must
+     * not run concurrently with updates */
+    template <class Func>
+    void inorder(Func& doSomething){
+        inorderAux(holder->right.load(), doSomething);
+    }
+};
+
+template<class KeyType, class DataType>
+ConcurrentAVL_tree<KeyType, DataType>::ConcurrentAVL_tree()
+        : holder(new AVLvertex()) {}
+
+template<class KeyType, class DataType>
+ConcurrentAVL_tree<KeyType, DataType>::~ConcurrentAVL_tree() {
+    deleteTree(holder->right.load());
+    delete holder;
+}
+
+template<class KeyType, class DataType>
+void ConcurrentAVL_tree<KeyType, DataType>::deleteTree(AVLvertex* curr_root) {
+    if(curr_root == nullptr){
+        return;
+    }
+    deleteTree(curr_root->left.load());
+    deleteTree(curr_root->right.load());
+    delete curr_root->data.load();
+    destroyVertex(curr_root);
+}
+
+template<class KeyType, class DataType>
+void ConcurrentAVL_tree<KeyType, DataType>::waitUntilShrinkCompleted
+(AVLvertex* v, uint64_t version) {
+    if((version & SHRINKING) == 0){
+        return;
+    }
+    while(v->version.load() == version){
+        std::this_thread::yield();
+    }
+}
+
+template<class KeyType, class DataType>
+DataType* ConcurrentAVL_tree<KeyType, DataType>::getData(const KeyType& key) const {
+    EpochReclaimer::Guard guard;
+    DataType* result = nullptr;
+    /* the holder is never changed, so a search from it always succeeds */
+    while(attemptGet(key, holder, 1, 0, result) == RETRY){}
+    return result;
+}
+
+template<class KeyType, class DataType>
+typename ConcurrentAVL_tree<KeyType, DataType>::AttemptResult
+ConcurrentAVL_tree<KeyType, DataType>::attemptGet(const KeyType& key,
+        AVLvertex* v, int direction, uint64_t version,
+        DataType*& result) const {
+    while(true){
+        AVLvertex* child = v->child(direction);
+        if(child == nullptr){
+            if(v->version.load() != version){
+                return RETRY;
+            }
+            /* the empty link was read while "v" was still valid */
+            result = nullptr;
+            return DONE;
+        }
+
+        int child_direction = compare(key, child);
+        if(child_direction == 0){
+            /* however we got here, the key is in this vertex */
+            result = child->data.load();
+            return DONE;
+        }
+
+        uint64_t child_version = child->version.load();
+        if(child_version & (SHRINKING | UNLINKED)){
+            waitUntilShrinkCompleted(child, child_version);
+            if(v->version.load() != version){
+                return RETRY;
+            }
+        } else if(child != v->child(direction)){
+            /* the child version was not read from the current child */
+            if(v->version.load() != version){
+                return RETRY;
+            }
+        } else {
+            if(v->version.load() != version){
+                return RETRY;
+            }
+            /* the path to the child is valid, from here on the child's
+             * version protects the search */
+            if(attemptGet(key, child, child_direction, child_version,
+                    result) == DONE){
+                return DONE;
+            }
+        }
+    }
+}
+
+template<class KeyType, class DataType>
+bool ConcurrentAVL_tree<KeyType, DataType>::insertKey(const KeyType& key,
+        DataType* data) {
+    if(data == nullptr){
+        /* the key would be invisible to the lookups */
+        return false;
+    }
+    EpochReclaimer::Guard guard;
+    bool inserted = false;
+    while(attemptInsert(key, data, holder, 1, 0, inserted) == RETRY){}
+    return inserted;
+}
+
+template<class KeyType, class DataType>
+typename ConcurrentAVL_tree<KeyType, DataType>::AttemptResult
+ConcurrentAVL_tree<KeyType, DataType>::attemptInsert(const KeyType& key,
+        DataType* data, AVLvertex* v, int direction, uint64_t version,
+        bool& inserted) {
+    while(true){
+        AVLvertex* child = v->child(direction);
+        if(v->version.load() != version){
+            return RETRY;
+        }
+
+        if(child == nullptr){
+            if(attemptInsertIntoEmpty(key, data, v, direction, version) == DONE){
+                inserted = true;
+                return DONE;
+            }
+            continue;
+        }
+
+        int child_direction = compare(key, child);
+        if(child_direction == 0){
+            if(attemptRevive(child, data, inserted) == DONE){
+                return DONE;
+            }
+            continue;
+        }
+
+        uint64_t child_version = child->version.load();
+        if(child_version & (SHRINKING | UNLINKED)){
+            waitUntilShrinkCompleted(child, child_version);
+        } else if(child == v->child(direction)){
+            if(v->version.load() != version){
+                return RETRY;
+            }
+            if(attemptInsert(key, data, child, child_direction, child_version,
+                    inserted) == DONE){
+                return DONE;
+            }
+        }
+    }
+}
+
+template<class KeyType, class DataType>
+typename ConcurrentAVL_tree<KeyType, DataType>::AttemptResult
+ConcurrentAVL_tree<KeyType, DataType>::attemptInsertIntoEmpty
+(const KeyType& key, DataType* data, AVLvertex* v, int direction,
+        uint64_t version) {
+    {
+        LockGuard lock(v->lock);
+        if(v->version.load() != version || v->child(direction) != nullptr){
+            return RETRY;
+        }
+        setChild(v, direction, new AVLvertex(key, data, v));
+    }
+    fixHeightAndRebalance(v);
+    return DONE;
+}
+
+template<class KeyType, class DataType>
+typename ConcurrentAVL_tree<KeyType, DataType>::AttemptResult
+ConcurrentAVL_tree<KeyType, DataType>::attemptRevive(AVLvertex* v,
+        DataType* data, bool& inserted) {
+    if(v->data.load() != nullptr){
+        /* the key is in the tree */
+        inserted = false;
+        return DONE;
+    }
+
+    LockGuard lock(v->lock);
+    if(v->version.load() & UNLINKED){
+        return RETRY;
+    }
+    if(v->data.load() != nullptr){
+        inserted = false;
+        return DONE;
+    }
+    v->data.store(data);
+    inserted = true;
+    return DONE;
+}
+
+template<class KeyType, class DataType>
+DataType* ConcurrentAVL_tree<KeyType, DataType>::deleteKey(const KeyType& key) {
+    EpochReclaimer::Guard guard;
+    DataType* removed = nullptr;
+    while(attemptDelete(key, holder, 1, 0, removed) == RETRY){}
+    return removed;
+}
+
+template<class KeyType, class DataType>
+typename ConcurrentAVL_tree<KeyType, DataType>::AttemptResult
+ConcurrentAVL_tree<KeyType, DataType>::attemptDelete(const KeyType& key,
+        AVLvertex* v, int direction, uint64_t version, DataType*& removed) {
+    while(true){
+        AVLvertex* child = v->child(direction);
+        if(v->version.load() != version){
+            return RETRY;
+        }
+
+        if(child == nullptr){
+            /* the key is not in the tree */
+            removed = nullptr;
+            return DONE;
+        }
+
+        int child_direction = compare(key, child);
+        if(child_direction == 0){
+            if(attemptDeleteVertex(v, child, removed) == DONE){
+                return DONE;
+            }
+            continue;
+        }
+
+        uint64_t child_version = child->version.load();
+        if(child_version & (SHRINKING | UNLINKED)){
+            waitUntilShrinkCompleted(child, child_version);
+        } else if(child == v->child(direction)){
+            if(v->version.load() != version){
+                return RETRY;
+            }
+            if(attemptDelete(key, child, child_direction, child_version,
+                    removed) == DONE){
+                return DONE;
+            }
+        }
+    }
+}
+
+template<class KeyType, class DataType>
+typename ConcurrentAVL_tree<KeyType, DataType>::AttemptResult
+ConcurrentAVL_tree<KeyType, DataType>::attemptDeleteVertex(AVLvertex* parent,
+        AVLvertex* v, DataType*& removed) {
+    if(v->data.load() == nullptr){
+        /* a routing vertex, the key is not in the tree */
+        removed = nullptr;
+        return DONE;
+    }
+
+    if(v->left.load() == nullptr || v->right.load() == nullptr){
+        /* the vertex can be unlinked right away */
+        {
+            LockGuard parent_lock(parent->lock);
+            if((parent->version.load() & UNLINKED) ||
+               v->parent.load() != parent){
+                return RETRY;
+            }
+            LockGuard lock(v->lock);
+            removed = v->data.load();
+            if(removed == nullptr){
+                return DONE;
+            }
+            if(!attemptUnlink(parent, v)){
+                if(v->left.load() == nullptr || v->right.load() == nullptr){
+                    return RETRY;
+                }
+                /* a child was added meanwhile, keep it as a routing vertex */
+                v->data.store(nullptr);
+                return DONE;
+            }
+        }
+        fixHeightAndRebalance(parent);
+        return DONE;
+    }
+
+    /* the vertex has two children, so it's kept as a routing vertex */
+    {
+        LockGuard lock(v->lock);
+        if(v->version.load() & UNLINKED){
+            return RETRY;
+        }
+        removed = v->data.exchange(nullptr);
+    }
+    if(removed != nullptr &&
+       (v->left.load() == nullptr || v->right.load() == nullptr)){
+        /* a child was unlinked meanwhile, so the vertex should be too */
+        fixHeightAndRebalance(v);
+    }
+    return DONE;
+}
+
+template<class KeyType, class DataType>
+bool ConcurrentAVL_tree<KeyType, DataType>::attemptUnlink(AVLvertex* parent,
+        AVLvertex* v) {
+    AVLvertex* parent_left = parent->left.load();
+    AVLvertex* parent_right = parent->right.load();
+    if(parent_left != v && parent_right != v){
+        return false;
+    }
+
+    AVLvertex* left = v->left.load();
+    AVLvertex* right = v->right.load();
+    if(left != nullptr && right != nullptr){
+        return false;
+    }
+
+    AVLvertex* splice = left != nullptr ? left : right;
+    if(parent_left == v){
+        parent->left.store(splice);
+    } else {
+        parent->right.store(splice);
+    }
+    if(splice != nullptr){
+        splice->parent.store(parent);
+    }
+
+    v->version.store(UNLINKED);
+    v->data.store(nullptr);
+    EpochReclaimer::shared().retire(v, &destroyVertex);
+    return true;
+}
+
+template<class KeyType, class DataType>
+int ConcurrentAVL_tree<KeyType, DataType>::nodeCondition(AVLvertex* v) {
+    AVLvertex* left = v->left.load();
+    AVLvertex* right = v->right.load();
+
+    if((left == nullptr || right == nullptr) && v->data.load() == nullptr){
+        return UNLINK_REQUIRED;
+    }
+
+    int height = v->height.load();
+    int left_height = getHeight(left);
+    int right_height = getHeight(right);
+    int new_height = 1 + (left_height > right_height ? left_height
+                                                     : right_height);
+    int balance = left_height - right_height;
+
+    if(balance < -1 || balance > 1){
+        return REBALANCE_REQUIRED;
+    }
+    return height != new_height ? new_height : NOTHING_REQUIRED;
+}
+
+template<class KeyType, class DataType>
+void ConcurrentAVL_tree<KeyType, DataType>::fixHeightAndRebalance(AVLvertex* v) {
+    while(v != nullptr && v->parent.load() != nullptr){
+        int condition = nodeCondition(v);
+        if(condition == NOTHING_REQUIRED || (v->version.load() & UNLINKED)){
+            /* nothing to do, or no point in fixing the vertex */
+            return;
+        }
+
+        if(condition != UNLINK_REQUIRED && condition != REBALANCE_REQUIRED){
+            LockGuard lock(v->lock);
+            v = fixHeight(v);
+        } else {
+            AVLvertex* parent = v->parent.load();
+            AVLvertex* next = v;
+            {
+                LockGuard parent_lock(parent->lock);
+                if(!(parent->version.load() & UNLINKED) &&
+                   v->parent.load() == parent){
+                    LockGuard lock(v->lock);
+                    next = rebalance(parent, v);
+                }
+                /* otherwise retry with the new parent */
+            }
+            v = next;
+        }
+    }
+}
+
+template<class KeyType, class DataType>
+typename ConcurrentAVL_tree<KeyType, DataType>::AVLvertex*
+ConcurrentAVL_tree<KeyType, DataType>::fixHeight(AVLvertex* v) {
+    int condition = nodeCondition(v);
+    switch(condition){
+        case REBALANCE_REQUIRED:
+        case UNLINK_REQUIRED:
+            /* the parent has to be locked too */
+            return v;
+        case NOTHING_REQUIRED:
+            return nullptr;
+        default:
+            v->height.store(condition);
+            return v->parent.load();
+    }
+}
+
+template<class KeyType, class DataType>
+typename ConcurrentAVL_tree<KeyType, DataType>::AVLvertex*
+ConcurrentAVL_tree<KeyType, DataType>::rebalance(AVLvertex* parent,
+        AVLvertex* v) {
+    AVLvertex* left = v->left.load();
+    AVLvertex* right = v->right.load();
+
+    if((left == nullptr || right == nullptr) && v->data.load() == nullptr){
+        if(attemptUnlink(parent, v)){
+            return fixHeight(parent);
+        }
+        /* retry with the current parent */
+        return v;
+    }
+
+    int height = v->height.load();
+    int left_height = getHeight(left);
+    int right_height = getHeight(right);
+    int new_height = 1 + (left_height > right_height ? left_height
+                                                     : right_height);
+    int balance = left_height - right_height;
+
+    if(balance > 1){
+        return rebalanceToRight(parent, v, left, right_height);
+    } else if(balance < -1){
+        return rebalanceToLeft(parent, v, right, left_height);
+    } else if(new_height != height){
+        v->height.store(new_height);
+        return fixHeight(parent);
+    }
+    return nullptr;
+}
+
+template<class KeyType, class DataType>
+typename ConcurrentAVL_tree<KeyType, DataType>::AVLvertex*
+ConcurrentAVL_tree<KeyType, DataType>::rebalanceToRight(AVLvertex* parent,
+        AVLvertex* v, AVLvertex* left, int right_height) {
+    /* the left subtree is too high, so v is rotated right. If the left
+     * child's right subtree is the higher one, the left child is rotated
+     * left first */
+    LockGuard left_lock(left->lock);
+    int left_height = left->height.load();
+    if(left_height - right_height <= 1){
+        /* retry */
+        return v;
+    }
+
+    AVLvertex* left_right = left->right.load();
+    int left_left_height = getHeight(left->left.load());
+    int left_right_height = getHeight(left_right);
+    if(left_left_height >= left_right_height){
+        return rotateRight(parent, v, left, right_height, left_left_height,
+                left_right, left_right_height);
+    }
+
+    {
+        LockGuard left_right_lock(left_right->lock);
+        /* the height of left_right may have changed since it was read */
+        left_right_height = left_right->height.load();
+        if(left_left_height >= left_right_height){
+            return rotateRight(parent, v, left, right_height,
+                    left_left_height, left_right, left_right_height);
+        }
+
+        /* a double rotation is made only if it leaves the left child
+         * balanced, otherwise the left child is fixed on it's own first */
+        int left_right_left_height = getHeight(left_right->left.load());
+        int balance = left_left_height - left_right_left_height;
+        if(balance >= -1 && balance <= 1 &&
+           !((left_left_height == 0 || left_right_left_height == 0) &&
+             left->data.load() == nullptr)){
+            return rotateRightOverLeft(parent, v, left, right_height,
+                    left_left_height, left_right, left_right_left_height);
+        }
+    }
+    return rebalanceToLeft(v, left, left_right, left_left_height);
+}
+
+template<class KeyType, class DataType>
+typename ConcurrentAVL_tree<KeyType, DataType>::AVLvertex*
+ConcurrentAVL_tree<KeyType, DataType>::rebalanceToLeft(AVLvertex* parent,
+        AVLvertex* v, AVLvertex* right, int left_height) {
+    LockGuard right_lock(right->lock);
+    int right_height = right->height.load();
+    if(right_height - left_height <= 1){
+        return v;
+    }
+
+    AVLvertex* right_left = right->left.load();
+    int right_right_height = getHeight(right->right.load());
+    int right_left_height = getHeight(right_left);
+    if(right_right_height >= right_left_height){
+        return rotateLeft(parent, v, right, left_height, right_right_height,
+                right_left, right_left_height);
+    }
+
+    {
+        LockGuard right_left_lock(right_left->lock);
+        right_left_height = right_left->height.load();
+        if(right_right_height >= right_left_height){
+            return rotateLeft(parent, v, right, left_height,
+                    right_right_height, right_left, right_left_height);
+        }
+
+        int right_left_right_height = getHeight(right_left->right.load());
+        int balance = right_right_height - right_left_right_height;
+        if(balance >= -1 && balance <= 1 &&
+           !((right_right_height == 0 || right_left_right_height == 0) &&
+             right->data.load() == nullptr)){
+            return rotateLeftOverRight(parent, v, right, left_height,
+                    right_right_height, right_left, right_left_right_height);
+        }
+    }
+    return rebalanceToRight(v, right, right_left, right_right_height);
+}
+
+template<class KeyType, class DataType>
+typename ConcurrentAVL_tree<KeyType, DataType>::AVLvertex*
+ConcurrentAVL_tree<KeyType, DataType>::rotateRight(AVLvertex* parent,
+        AVLvertex* v, AVLvertex* left, int right_height, int left_left_height,
+        AVLvertex* left_right, int left_right_height) {
+    uint64_t version = v->version.load();
+    AVLvertex* parent_left = parent->left.load();
+
+    /* searches that pass through v wait or retry until the rotation ends */
+    v->version.store(version | SHRINKING);
+
+    v->left.store(left_right);
+    if(left_right != nullptr){
+        left_right->parent.store(v);
+    }
+    left->right.store(v);
+    v->parent.store(left);
+    if(parent_left == v){
+        parent->left.store(left);
+    } else {
+        parent->right.store(left);
+    }
+    left->parent.store(parent);
+
+    int v_height = 1 + (left_right_height > right_height ? left_right_height
+                                                         : right_height);
+    v->height.store(v_height);
+    left->height.store(1 + (left_left_height > v_height ? left_left_height
+                                                        : v_height));
+
+    v->version.store(version + SHRINK_COUNT_INCREMENT);
+
+    /* find the vertex that needs repair next */
+    int v_balance = left_right_height - right_height;
+    if(v_balance < -1 || v_balance > 1){
+        return v;
+    }
+    if((left_right == nullptr || right_height == 0) &&
+       v->data.load() == nullptr){
+        return v;
+    }
+    int left_balance = left_left_height - v_height;
+    if(left_balance < -1 || left_balance > 1){
+        return left;
+    }
+    if(left_left_height == 0 && left->data.load() == nullptr){
+        return left;
+    }
+    return fixHeight(parent);
+}
+
+template<class KeyType, class DataType>
+typename ConcurrentAVL_tree<KeyType, DataType>::AVLvertex*
+ConcurrentAVL_tree<KeyType, DataType>::rotateLeft(AVLvertex* parent,
+        AVLvertex* v, AVLvertex* right, int left_height, int right_right_height,
+        AVLvertex* right_left, int right_left_height) {
+    uint64_t version = v->version.load();
+    AVLvertex* parent_left = parent->left.load();
+
+    v->version.store(version | SHRINKING);
+
+    v->right.store(right_left);
+    if(right_left != nullptr){
+        right_left->parent.store(v);
+    }
+    right->left.store(v);
+    v->parent.store(right);
+    if(parent_left == v){
+        parent->left.store(right);
+    } else {
+        parent->right.store(right);
+    }
+    right->parent.store(parent);
+
+    int v_height = 1 + (left_height > right_left_height ? left_height
+                                                        : right_left_height);
+    v->height.store(v_height);
+    right->height.store(1 + (v_height > right_right_height ? v_height
+                                                           : right_right_height));
+
+    v->version.store(version + SHRINK_COUNT_INCREMENT);
+
+    int v_balance = right_left_height - left_height;
+    if(v_balance < -1 || v_balance > 1){
+        return v;
+    }
+    if((right_left == nullptr || left_height == 0) &&
+       v->data.load() == nullptr){
+        return v;
+    }
+    int right_balance = right_right_height - v_height;
+    if(right_balance < -1 || right_balance > 1){
+        return right;
+    }
+    if(right_right_height == 0 && right->data.load() == nullptr){
+        return right;
+    }
+    return fixHeight(parent);
+}
+
+template<class KeyType, class DataType>
+typename ConcurrentAVL_tree<KeyType, DataType>::AVLvertex*
+ConcurrentAVL_tree<KeyType, DataType>::rotateRightOverLeft(AVLvertex* parent,
+        AVLvertex* v, AVLvertex* left, int right_height, int left_left_height,
+        AVLvertex* left_right, int left_right_left_height) {
+    uint64_t version = v->version.load();
+    uint64_t left_version = left->version.load();
+    AVLvertex* parent_left = parent->left.load();
+    AVLvertex* left_right_left = left_right->left.load();
+    AVLvertex* left_right_right = left_right->right.load();
+    int left_right_right_height = getHeight(left_right_right);
+
+    v->version.store(version | SHRINKING);
+    left->version.store(left_version | SHRINKING);
+
+    v->left.store(left_right_right);
+    if(left_right_right != nullptr){
+        left_right_right->parent.store(v);
+    }
+    left->right.store(left_right_left);
+    if(left_right_left != nullptr){
+        left_right_left->parent.store(left);
+    }
+    left_right->left.store(left);
+    left->parent.store(left_right);
+    left_right->right.store(v);
+    v->parent.store(left_right);
+    if(parent_left == v){
+        parent->left.store(left_right);
+    } else {
+        parent->right.store(left_right);
+    }
+    left_right->parent.store(parent);
+
+    int v_height = 1 + (left_right_right_height > right_height
+                        ? left_right_right_height : right_height);
+    v->height.store(v_height);
+    int left_new_height = 1 + (left_left_height > left_right_left_height
+                               ? left_left_height : left_right_left_height);
+    left->height.store(left_new_height);
+    left_right->height.store(1 + (left_new_height > v_height
+                                  ? left_new_height : v_height));
+
+    v->version.store(version + SHRINK_COUNT_INCREMENT);
+    left->version.store(left_version + SHRINK_COUNT_INCREMENT);
+
+    int v_balance = left_right_right_height - right_height;
+    if(v_balance < -1 || v_balance > 1){
+        return v;
+    }
+    if((left_right_right == nullptr || right_height == 0) &&
+       v->data.load() == nullptr){
+        return v;
+    }
+    int left_right_balance = left_new_height - v_height;
+    if(left_right_balance < -1 || left_right_balance > 1){
+        return left_right;
+    }
+    return fixHeight(parent);
+}
+
+template<class KeyType, class DataType>
+typename ConcurrentAVL_tree<KeyType, DataType>::AVLvertex*
+ConcurrentAVL_tree<KeyType, DataType>::rotateLeftOverRight(AVLvertex* parent,
+        AVLvertex* v, AVLvertex* right, int left_height, int right_right_height,
+        AVLvertex* right_left, int right_left_right_height) {
+    uint64_t version = v->version.load();
+    uint64_t right_version = right->version.load();
+    AVLvertex* parent_left = parent->left.load();
+    AVLvertex* right_left_left = right_left->left.load();
+    AVLvertex* right_left_right = right_left->right.load();
+    int right_left_left_height = getHeight(right_left_left);
+
+    v->version.store(version | SHRINKING);
+    right->version.store(right_version | SHRINKING);
+
+    v->right.store(right_left_left);
+    if(right_left_left != nullptr){
+        right_left_left->parent.store(v);
+    }
+    right->left.store(right_left_right);
+    if(right_left_right != nullptr){
+        right_left_right->parent.store(right);
+    }
+    right_left->right.store(right);
+    right->parent.store(right_left);
+    right_left->left.store(v);
+    v->parent.store(right_left);
+    if(parent_left == v){
+        parent->left.store(right_left);
+    } else {
+        parent->right.store(right_left);
+    }
+    right_left->parent.store(parent);
+
+    int v_height = 1 + (left_height > right_left_left_height
+                        ? left_height : right_left_left_height);
+    v->height.store(v_height);
+    int right_new_height = 1 + (right_left_right_height > right_right_height
+                                ? right_left_right_height : right_right_height);
+    right->height.store(right_new_height);
+    right_left->height.store(1 + (v_height > right_new_height
+                                  ? v_height : right_new_height));
+
+    v->version.store(version + SHRINK_COUNT_INCREMENT);
+    right->version.store(right_version + SHRINK_COUNT_INCREMENT);
+
+    int v_balance = right_left_left_height - left_height;
+    if(v_balance < -1 || v_balance > 1){
+        return v;
+    }
+    if((right_left_left == nullptr || left_height == 0) &&
+       v->data.load() == nullptr){
+        return v;
+    }
+    int right_left_balance = right_new_height - v_height;
+    if(right_left_balance < -1 || right_left_balance > 1){
+        return right_left;
+    }
+    return fixHeight(parent);
+}
+
+#endif //WET1CPP_CONCURRENTAVL_TREE_H
@@ -0,0 +1,127 @@
+#ifndef WET1CPP_DATASTORAGE_H
+#define WET1CPP_DATASTORAGE_H
+
+#include <cassert>
+#include <type_traits>
+#include <utility>
+#include "VertexAllocator.h"
+
+/* the data storage policies of AVL_tree. A policy is a class template over
+ * the data type, which every vertex of the tree derives from. It provides:
+ *   Policy(data)              - take the ownership of a heap allocated data,
+ *                               or of no data if "data" is nullptr
+ *   Policy(InPlace(), args...) - construct the data out of "args"
+ *   get()                     - a pointer to the data the vertex holds
+ *   release()                 - detach the data from the vertex, returning
+ *                               a heap allocated data owned by the caller
+ *   assign(data)              - replace the data with a heap allocated one,
+ *                               deleting the previous data
+ *   moveFrom(other)           - take the data of another vertex, which is
+ *                               destroyed right after without it's data
+ *   destroyData()             - delete the data of a vertex that is about
+ *                               to be destroyed
+ *   copy constructor          - a deep copy of the data, used when a tree is
+ *                               copied */
+
+/* the default policy: the vertex holds a pointer to a separate heap
+ * allocation, so the data never moves and a deleted key hands it's data
+ * back to the caller as is */
+template <class DataType>
+class DataByPointer{
+    DataType* data;
+
+public:
+    explicit DataByPointer(DataType* data) : data(data) {}
+
+    template <class... Args>
+    explicit DataByPointer(InPlace, Args&&... args)
+            : data(new DataType(std::forward<Args>(args)...)) {}
+
+    DataByPointer(const DataByPointer& other)
+            : data(other.data == nullptr ? nullptr : new DataType(*other.data)) {}
+
+    DataByPointer& operator=(const DataByPointer& other) = delete;
+
+    DataType* get() {return data;}
+
+    DataType* release(){
+        DataType* detached_data = data;
+        data = nullptr;
+        return detached_data;
+    }
+
+    void assign(DataType* new_data){
+        if(new_data != data){
+            delete data;
+            data = new_data;
+        }
+    }
+
+    void moveFrom(DataByPointer& other){
+        data = other.data;
+        other.data = nullptr;
+    }
+
+    void destroyData(){
+        delete data;
+        data = nullptr;
+    }
+};
+
+/* the data is held by value inside the vertex, which saves an allocation
+ * and an indirection per key. emplace() constructs the data in place; the
+ * methods that pass the data by pointer move it into the vertex and delete
+ * the pointer, and the methods that hand the data back (deleteKey(),
+ * deleteBatch()) move it into a new heap allocation, so eraseKey() is the
+ * cheaper way to delete a key. A nullptr data stands for a default
+ * constructed value, so if DataType has no default constructor, passing
+ * nullptr (to insertKey(), tryEmplace(), insertOrAssign() and the like) is
+ * a precondition violation, caught by an assert */
+template <class DataType>
+class InlineData{
+    DataType value;
+
+    /* the value of the passed data, where nullptr stands for a default
+     * constructed value if DataType has one */
+    static DataType adopt(DataType* data, std::true_type){
+        return data == nullptr ? DataType() : std::move(*data);
+    }
+
+    static DataType adopt(DataType* data, std::false_type){
+        assert(data != nullptr &&
+               "nullptr data needs a default constructible DataType");
+        return std::move(*data);
+    }
+
+public:
+    explicit InlineData(DataType* data)
+            : value(adopt(data, std::is_default_constructible<DataType>())) {
+        delete data;
+    }
+
+    template <class... Args>
+    explicit InlineData(InPlace, Args&&... args)
+            : value(std::forward<Args>(args)...) {}
+
+    DataType* get() {return &value;}
+
+    DataType* release(){
+        return new DataType(std::move(value));
+    }
+
+    void assign(DataType* new_data){
+        if(new_data != &value){
+            value = adopt(new_data, std::is_default_constructible<DataType>());
+            delete new_data;
+        }
+    }
+
+    void moveFrom(InlineData& other){
+        value = std::move(other.value);
+    }
+
+    /* the value is destroyed with the vertex */
+    void destroyData(){}
+};
+
+#endif //WET1CPP_DATASTORAGE_H
@@ -0,0 +1,190 @@
+#ifndef WET1CPP_EPOCHRECLAIMER_H
+#define WET1CPP_EPOCHRECLAIMER_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+/* epoch based memory reclamation for the lock free readers of the
+ * concurrent trees. A thread wraps every access to shared vertexes in a
+ * Guard, and a vertex that was unlinked from a tree is retired rather than
+ * deleted. The retired vertexes are deleted once every thread that might
+ * still hold a pointer to them has left it's guard: a vertex retired in
+ * epoch e is deleted when the global epoch reaches e+2, and the epoch only
+ * advances when every thread inside a guard has seen the current epoch */
+class EpochReclaimer{
+    class Retired{
+    public:
+        void* object;
+        void (*destroy)(void* object);
+    };
+
+    /* the epoch announced by a thread that is outside of any guard */
+    static const uint64_t QUIESCENT = ~uint64_t(0);
+    /* the number of threads that may use the reclaimer at the same time,
+     * further threads wait for a slot */
+    static const int MAX_THREADS = 1024;
+    /* the number of retirements between attempts to advance the epoch */
+    static const int ADVANCE_INTERVAL = 64;
+
+    class alignas(64) ThreadSlot{
+    public:
+        std::atomic<uint64_t> epoch;
+        std::atomic<bool> in_use;
+
+        ThreadSlot() : epoch(QUIESCENT), in_use(false) {}
+    };
+
+    /* the per thread state, which deletes the thread's remaining retired
+     * objects when the thread exits */
+    class ThreadState{
+    public:
+        EpochReclaimer* reclaimer;
+        int slot;
+        int nesting;
+        int retired_since_advance;
+        /* bags[e % 3] holds the objects retired in epoch bag_epochs[e % 3] */
+        std::vector<Retired> bags[3];
+        uint64_t bag_epochs[3];
+
+        explicit ThreadState(EpochReclaimer* reclaimer)
+                : reclaimer(reclaimer), slot(reclaimer->claimSlot()),
+                  nesting(0), retired_since_advance(0),
+                  bag_epochs{0, 0, 0} {}
+
+        ~ThreadState(){
+            for(int i = 0; i < 3; i++){
+                if(!bags[i].empty()){
+                    reclaimer->waitForEpoch(bag_epochs[i] + 2);
+                    freeBag(bags[i]);
+                }
+            }
+            reclaimer->slots[slot].in_use.store(false);
+        }
+
+        ThreadState(const ThreadState& state) = delete;
+        ThreadState& operator=(const ThreadState& state) = delete;
+    };
+
+    ThreadSlot slots[MAX_THREADS];
+    /* one past the highest slot that was ever claimed */
+    std::atomic<int> slot_count;
+    std::atomic<uint64_t> global_epoch;
+
+    EpochReclaimer() : slot_count(0), global_epoch(0) {}
+
+    int claimSlot(){
+        while(true){
+            for(int i = 0; i < MAX_THREADS; i++){
+                if(!slots[i].in_use.load() && !slots[i].in_use.exchange(true)){
+                    int count = slot_count.load();
+                    while(count < i + 1 &&
+                          !slot_count.compare_exchange_weak(count, i + 1)){}
+                    return i;
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    ThreadState& threadState(){
+        static thread_local ThreadState state(this);
+        return state;
+    }
+
+    static void freeBag(std::vector<Retired>& bag){
+        for(Retired& retired : bag){
+            retired.destroy(retired.object);
+        }
+        bag.clear();
+    }
+
+    /* advance the global epoch if every thread inside a guard has announced
+     * the current epoch */
+    void tryAdvance(){
+        uint64_t epoch = global_epoch.load();
+        int count = slot_count.load();
+        for(int i = 0; i < count; i++){
+            uint64_t announced = slots[i].epoch.load();
+            if(announced != QUIESCENT && announced != epoch){
+                return;
+            }
+        }
+        global_epoch.compare_exchange_strong(epoch, epoch + 1);
+    }
+
+    void waitForEpoch(uint64_t epoch){
+        while(global_epoch.load() < epoch){
+            tryAdvance();
+            if(global_epoch.load() < epoch){
+                std::this_thread::yield();
+            }
+        }
+    }
+
+public:
+    EpochReclaimer(const EpochReclaimer& reclaimer) = delete;
+    EpochReclaimer& operator=(const EpochReclaimer& reclaimer) = delete;
+
+    /* the reclaimer shared by the concurrent trees */
+    static EpochReclaimer& shared(){
+        static EpochReclaimer reclaimer;
+        return reclaimer;
+    }
+
+    /* the scope in which a thread may hold pointers to shared objects.
+     * Guards may be nested */
+    class Guard{
+        EpochReclaimer& reclaimer;
+        ThreadState& state;
+
+    public:
+        Guard() : reclaimer(shared()), state(reclaimer.threadState()) {
+            if(state.nesting++ == 0){
+                /* announce the epoch, and make sure it was still the current
+                 * one once the announcement is visible */
+                uint64_t epoch = reclaimer.global_epoch.load();
+                while(true){
+                    reclaimer.slots[state.slot].epoch.store(epoch);
+                    uint64_t current = reclaimer.global_epoch.load();
+                    if(current == epoch){
+                        break;
+                    }
+                    epoch = current;
+                }
+            }
+        }
+
+        ~Guard(){
+            if(--state.nesting == 0){
+                reclaimer.slots[state.slot].epoch.store(QUIESCENT);
+            }
+        }
+
+        Guard(const Guard& guard) = delete;
+        Guard& operator=(const Guard& guard) = delete;
+    };
+
+    /* schedule "destroy(object)" for when no thread can hold a pointer to the
+     * object anymore. The object must already be unreachable for threads
+     * that enter a guard from now on */
+    void retire(void* object, void (*destroy)(void* object)){
+        ThreadState& state = threadState();
+        uint64_t epoch = global_epoch.load();
+        int bag = epoch % 3;
+        if(state.bag_epochs[bag] != epoch){
+            /* the bag holds objects of epoch-3 or older, which are safe */
+            freeBag(state.bags[bag]);
+            state.bag_epochs[bag] = epoch;
+        }
+        state.bags[bag].push_back(Retired{object, destroy});
+
+        if(++state.retired_since_advance >= ADVANCE_INTERVAL){
+            state.retired_since_advance = 0;
+            tryAdvance();
+        }
+    }
+};
+
+#endif //WET1CPP_EPOCHRECLAIMER_H
@@ -0,0 +1,218 @@
+#ifndef WET2CPP_FORKJOINPOOL_H
+#define WET2CPP_FORKJOINPOOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/* a work stealing thread pool for divide and conquer algorithms. Every
+ * worker thread owns a deque of tasks: a worker pushes and pops the tasks it
+ * forks at the back of it's own deque, while idle threads steal the oldest
+ * (and usually largest) tasks from the front of other deques. A thread that
+ * waits for a stolen task helps by running other tasks meanwhile, so nested
+ * invokeBoth() calls never block a worker */
+class ForkJoinPool{
+    /* a forked function, living on the stack of the thread that forked it
+     * until it is done */
+    class Task{
+    public:
+        void (*run)(void* function);
+        void* function;
+        std::atomic<bool> done;
+        std::exception_ptr error;
+
+        template <class Func>
+        explicit Task(Func* func) : run(&runFunction<Func>), function(func),
+                                    done(false) {}
+
+        template <class Func>
+        static void runFunction(void* function){
+            (*static_cast<Func*>(function))();
+        }
+
+        void execute(){
+            try {
+                run(function);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            done.store(true, std::memory_order_release);
+        }
+    };
+
+    class TaskQueue{
+    public:
+        std::mutex lock;
+        std::deque<Task*> tasks;
+    };
+
+    /* queues[0] receives the tasks forked by threads outside the pool, and
+     * queues[i] belongs to the i-th worker */
+    std::vector<TaskQueue> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> pending_tasks;
+    std::atomic<bool> stopping;
+    std::mutex idle_lock;
+    std::condition_variable idle_condition;
+
+    /* the index of the calling thread's queue in the pool it works for, and
+     * that pool */
+    static int& currentQueue(){
+        static thread_local int queue_index = 0;
+        return queue_index;
+    }
+
+    static ForkJoinPool*& currentPool(){
+        static thread_local ForkJoinPool* pool = nullptr;
+        return pool;
+    }
+
+    int ownQueue(){
+        return currentPool() == this ? currentQueue() : 0;
+    }
+
+    void push(Task* task){
+        TaskQueue& queue = queues[ownQueue()];
+        {
+            std::lock_guard<std::mutex> guard(queue.lock);
+            queue.tasks.push_back(task);
+        }
+        pending_tasks.fetch_add(1);
+        idle_condition.notify_one();
+    }
+
+    /* take back the given task if nobody stole it yet */
+    bool popOwn(Task* task){
+        TaskQueue& queue = queues[ownQueue()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if(!queue.tasks.empty() && queue.tasks.back() == task){
+            queue.tasks.pop_back();
+            pending_tasks.fetch_sub(1);
+            return true;
+        }
+        return false;
+    }
+
+    /* pop the newest task of the thread's own queue, or steal the oldest
+     * task of another queue */
+    Task* findTask(){
+        int own = ownQueue();
+        {
+            TaskQueue& queue = queues[own];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if(!queue.tasks.empty()){
+                Task* task = queue.tasks.back();
+                queue.tasks.pop_back();
+                pending_tasks.fetch_sub(1);
+                return task;
+            }
+        }
+        int queue_count = queues.size();
+        for(int i = 1; i < queue_count; i++){
+            TaskQueue& queue = queues[(own + i) % queue_count];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if(!queue.tasks.empty()){
+                Task* task = queue.tasks.front();
+                queue.tasks.pop_front();
+                pending_tasks.fetch_sub(1);
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void workerLoop(int queue_index){
+        currentPool() = this;
+        currentQueue() = queue_index;
+        while(!stopping.load()){
+            Task* task = findTask();
+            if(task != nullptr){
+                task->execute();
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(idle_lock);
+            idle_condition.wait_for(guard, std::chrono::milliseconds(10),
+                    [this]{return stopping.load() || pending_tasks.load() > 0;});
+        }
+    }
+
+public:
+    /* construct a pool of "thread_count" worker threads, by default one per
+     * hardware thread */
+    explicit ForkJoinPool(int thread_count = 0)
+            : queues(1 + (thread_count > 0 ? thread_count : defaultThreads())),
+              pending_tasks(0), stopping(false) {
+        for(int i = 1; i < (int)queues.size(); i++){
+            workers.emplace_back(&ForkJoinPool::workerLoop, this, i);
+        }
+    }
+
+    ~ForkJoinPool(){
+        stopping.store(true);
+        idle_condition.notify_all();
+        for(std::thread& worker : workers){
+            worker.join();
+        }
+    }
+
+    ForkJoinPool(const ForkJoinPool& pool) = delete;
+    ForkJoinPool& operator=(const ForkJoinPool& pool) = delete;
+
+    static int defaultThreads(){
+        int threads = std::thread::hardware_concurrency();
+        return threads > 0 ? threads : 1;
+    }
+
+    /* the pool shared by the trees' parallel operations */
+    static ForkJoinPool& shared(){
+        static ForkJoinPool pool;
+        return pool;
+    }
+
+    int threadCount() const {return workers.size();}
+
+    /* run both functions, the second one possibly on another thread, and
+     * return when both are done. An exception thrown by either function is
+     * rethrown after both are done */
+    template <class Func1, class Func2>
+    void invokeBoth(Func1&& func1, Func2&& func2){
+        Task task(&func2);
+        push(&task);
+
+        std::exception_ptr error;
+        try {
+            func1();
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        if(popOwn(&task)){
+            task.execute();
+        } else {
+            /* the task was stolen, help with other tasks until it is done */
+            while(!task.done.load(std::memory_order_acquire)){
+                Task* other = findTask();
+                if(other != nullptr){
+                    other->execute();
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        if(error){
+            std::rethrow_exception(error);
+        }
+        if(task.error){
+            std::rethrow_exception(task.error);
+        }
+    }
+};
+
+#endif //WET2CPP_FORKJOINPOOL_H
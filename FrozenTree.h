@@ -0,0 +1,511 @@
+#ifndef WET2CPP_FROZENTREE_H
+#define WET2CPP_FROZENTREE_H
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Augmentation.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/* immutable snapshots of AVL_tree and AVLrankTree for read mostly workloads,
+ * returned by the trees' freeze() methods. A snapshot holds the keys in
+ * Eytzinger (breadth first) order in a single array, so the first levels of
+ * every search share a few cache lines, and the vertexes a search visits 4
+ * levels ahead are prefetched while it compares. A snapshot is not updated
+ * by later changes to the tree it was taken from */
+
+/* the search structure shared by the snapshots. Slot 1 holds the root of an
+ * implicit complete binary tree and the children of slot s are slots 2s and
+ * 2s+1. Up to 2^31-1 keys are supported */
+template <class KeyType>
+class EytzingerIndex{
+    /* keys[s] is the key at slot s. keys[0] is an unused copy of the first
+     * key, so a search may read it instead of branching */
+    std::vector<KeyType> keys;
+    /* positions[s] is the inorder position (counting from 0) of the key at
+     * slot s, and positions[0] is the number of keys */
+    std::vector<uint32_t> positions;
+    uint32_t count;
+    /* the number of search steps which can't leave the tree, after them a
+     * single last step is taken only by the searches that are still in it */
+    int full_levels;
+
+    /* the number of slots between a slot and it's first descendant 4 levels
+     * below, which is where the prefetches are aimed */
+    static const uint32_t PREFETCH_DISTANCE = 16;
+
+    /* give the slots of the subtree which it's root is "slot" their inorder
+     * positions, starting with "next_position" */
+    void assignPositions(uint32_t slot, uint32_t& next_position);
+
+    void prefetch(uint32_t slot) const {
+#if defined(__GNUC__)
+        uint32_t target = PREFETCH_DISTANCE * slot;
+        __builtin_prefetch(&keys[target < count ? target : count]);
+#else
+        (void)slot;
+#endif
+    }
+
+    /* a search walks down until it falls off the tree, recording it's turns
+     * in the bits of the slot. Dropping the trailing right turns and the
+     * last left turn gives the slot it last turned left at, which is the
+     * answer, or 0 if it never turned left */
+    static uint32_t lastLeftTurn(uint32_t slot){
+#if defined(__GNUC__)
+        return slot >> __builtin_ffs(~slot);
+#else
+        while(slot & 1){
+            slot >>= 1;
+        }
+        return slot >> 1;
+#endif
+    }
+
+    template <class Less>
+    uint32_t searchSlot(const KeyType& key, Less goRight) const;
+
+    template <class T>
+    void lowerBoundBatchAux(const T* queries, int query_count,
+            uint32_t* slots) const;
+
+#ifdef __AVX2__
+    void lowerBoundBatchAux(const int* queries, int query_count,
+            uint32_t* slots) const;
+
+    /* long is 64 bits wide on LP64 but 32 bits wide on LLP64 (Windows), so
+     * the lanes are picked by it's size */
+    void lowerBoundBatchAux(const long* queries, int query_count,
+            uint32_t* slots) const {
+        lowerBoundBatchLong(queries, query_count, slots,
+                std::integral_constant<int, sizeof(long)>());
+    }
+
+    void lowerBoundBatchLong(const long* queries, int query_count,
+            uint32_t* slots, std::integral_constant<int, 8>) const {
+        lowerBoundBatch64(queries, query_count, slots);
+    }
+
+    void lowerBoundBatchLong(const long* queries, int query_count,
+            uint32_t* slots, std::integral_constant<int, 4>) const {
+        lowerBoundBatchAux(reinterpret_cast<const int*>(queries),
+                query_count, slots);
+    }
+
+    void lowerBoundBatchAux(const long long* queries, int query_count,
+            uint32_t* slots) const {
+        lowerBoundBatch64(queries, query_count, slots);
+    }
+
+    template <class T>
+    void lowerBoundBatch64(const T* queries, int query_count,
+            uint32_t* slots) const;
+#endif
+
+public:
+    EytzingerIndex() : positions(1, 0), count(0), full_levels(0) {}
+
+    /* build the index out of the given keys, which must be sorted */
+    explicit EytzingerIndex(const std::vector<KeyType>& sorted_keys);
+
+    uint32_t size() const {return count;}
+
+    /* return the slot of the first key that is not less than (greater than)
+     * "key", or 0 if there is no such key. The search takes the same number
+     * of steps for every key and has no data dependent branches */
+    uint32_t lowerBoundSlot(const KeyType& key) const;
+    uint32_t upperBoundSlot(const KeyType& key) const;
+
+    /* lowerBoundSlot() of "query_count" keys at once. The searches advance
+     * together level by level, so their cache misses overlap, and with AVX2
+     * int and 64 bit integer keys are compared 8 (4) at a time */
+    void lowerBoundBatch(const KeyType* queries, int query_count,
+            uint32_t* slots) const {
+        lowerBoundBatchAux(queries, query_count, slots);
+    }
+
+    const KeyType& key(uint32_t slot) const {return keys[slot];}
+
+    /* the inorder position of the key at the given slot, or size() for the
+     * slot 0 */
+    uint32_t position(uint32_t slot) const {return positions[slot];}
+};
+
+/* a snapshot of AVL_tree. The snapshot points to the data of the tree
+ * without owning it, so it must not outlive the data */
+template <class KeyType, class DataType>
+class FrozenAVL_tree{
+    EytzingerIndex<KeyType> index;
+    /* data[s] is the data of the key at slot s of the index */
+    std::vector<DataType*> data;
+
+public:
+    FrozenAVL_tree() : data(1, nullptr) {}
+
+    /* build a snapshot out of the (key, data pointer) pairs in the range
+     * [first, last), which must be sorted by key */
+    template <class InputIt>
+    FrozenAVL_tree(InputIt first, InputIt last);
+
+    int size() const {return index.size();}
+
+    bool keyExists(const KeyType& key) const {
+        uint32_t slot = index.lowerBoundSlot(key);
+        return slot != 0 && index.key(slot) == key;
+    }
+
+    /* return the data of the matching key, or nullptr if the key is not in
+     * the snapshot */
+    DataType* getData(const KeyType& key) const {
+        uint32_t slot = index.lowerBoundSlot(key);
+        return slot != 0 && index.key(slot) == key ? data[slot] : nullptr;
+    }
+
+    /* getData() of "query_count" keys at once, see
+     * EytzingerIndex::lowerBoundBatch() */
+    void getDataBatch(const KeyType* queries, int query_count,
+            DataType** results) const;
+};
+
+/* a snapshot of AVLrankTree, which answers the order statistics queries of
+ * the tree from prefix arrays */
+template <class KeyType, class Augmentation = KeySum<> >
+class FrozenAVLrankTree{
+public:
+    typedef typename Augmentation::value_type aggregate_type;
+
+private:
+    EytzingerIndex<KeyType> index;
+    /* slots[p] is the slot of the key at inorder position p */
+    std::vector<uint32_t> slots;
+    /* the aggregates of the k smallest and of the k largest keys */
+    std::vector<aggregate_type> smallest_prefix;
+    std::vector<aggregate_type> largest_prefix;
+
+public:
+    FrozenAVLrankTree() : smallest_prefix(1, Augmentation::identity()),
+                          largest_prefix(1, Augmentation::identity()) {}
+
+    /* build a snapshot out of the given keys, which must be sorted */
+    explicit FrozenAVLrankTree(const std::vector<KeyType>& sorted_keys);
+
+    int size() const {return index.size();}
+
+    bool keyExists(const KeyType& key) const {
+        uint32_t slot = index.lowerBoundSlot(key);
+        return slot != 0 && index.key(slot) == key;
+    }
+
+    /* return the number of keys in the snapshot that are less than "key" */
+    int rank(const KeyType& key) const {
+        return index.position(index.lowerBoundSlot(key));
+    }
+
+    /* rank() of "query_count" keys at once, see
+     * EytzingerIndex::lowerBoundBatch() */
+    void rankBatch(const KeyType* queries, int query_count,
+            int* ranks) const;
+
+    /* return the number of keys in the snapshot between "low" and "high"
+     * (inclusive) */
+    int countInRange(const KeyType& low, const KeyType& high) const {
+        if(high < low){
+            return 0;
+        }
+        return index.position(index.upperBoundSlot(high)) - rank(low);
+    }
+
+    /* return the k-th smallest (k-th largest) key of the snapshot, counting
+     * from 1, or nullptr if k is out of range */
+    const KeyType* select(int k) const {
+        if(k < 1 || k > size()){
+            return nullptr;
+        }
+        return &index.key(slots[k - 1]);
+    }
+
+    const KeyType* selectLargest(int k) const {
+        return select(size() - k + 1);
+    }
+
+    /* return the aggregate of the k smallest (k largest) keys of the
+     * snapshot, or of all of it if it has less than k keys, in O(1) */
+    aggregate_type aggregateOfkSmallestKeys(int k) const {
+        return smallest_prefix[k < 0 ? 0 : (k > size() ? size() : k)];
+    }
+
+    aggregate_type aggregateOfkLargestKeys(int k) const {
+        return largest_prefix[k < 0 ? 0 : (k > size() ? size() : k)];
+    }
+
+    aggregate_type sumOfkLargestKeys(int k) const {
+        return aggregateOfkLargestKeys(k);
+    }
+};
+
+template <class KeyType>
+EytzingerIndex<KeyType>::EytzingerIndex(const std::vector<KeyType>& sorted_keys)
+        : positions(sorted_keys.size() + 1), count(sorted_keys.size()),
+          full_levels(0) {
+    if(count == 0){
+        positions[0] = 0;
+        return;
+    }
+
+    uint32_t next_position = 0;
+    assignPositions(1, next_position);
+    positions[0] = count;
+
+    keys.reserve(count + 1);
+    keys.push_back(sorted_keys[0]);
+    for(uint32_t slot = 1; slot <= count; slot++){
+        keys.push_back(sorted_keys[positions[slot]]);
+    }
+
+    /* every slot on the first floor(log2(count)) levels exists */
+    while((uint32_t(2) << full_levels) - 1 <= count){
+        full_levels++;
+    }
+}
+
+template <class KeyType>
+void EytzingerIndex<KeyType>::assignPositions(uint32_t slot,
+        uint32_t& next_position) {
+    if(slot > count){
+        return;
+    }
+    assignPositions(2 * slot, next_position);
+    positions[slot] = next_position++;
+    assignPositions(2 * slot + 1, next_position);
+}
+
+template <class KeyType>
+template <class Less>
+uint32_t EytzingerIndex<KeyType>::searchSlot(const KeyType& key,
+        Less goRight) const {
+    if(count == 0){
+        return 0;
+    }
+
+    uint32_t slot = 1;
+    for(int level = 0; level < full_levels; level++){
+        prefetch(slot);
+        slot = 2 * slot + goRight(keys[slot], key);
+    }
+
+    /* the last level may be partial. A search that is past it reads the
+     * unused keys[0] and keeps it's slot */
+    bool in_tree = slot <= count;
+    uint32_t stepped = 2 * slot + goRight(keys[in_tree ? slot : 0], key);
+    slot = in_tree ? stepped : slot;
+
+    return lastLeftTurn(slot);
+}
+
+template <class KeyType>
+uint32_t EytzingerIndex<KeyType>::lowerBoundSlot(const KeyType& key) const {
+    return searchSlot(key, [](const KeyType& slot_key, const KeyType& key){
+        return slot_key < key;
+    });
+}
+
+template <class KeyType>
+uint32_t EytzingerIndex<KeyType>::upperBoundSlot(const KeyType& key) const {
+    return searchSlot(key, [](const KeyType& slot_key, const KeyType& key){
+        return !(key < slot_key);
+    });
+}
+
+template <class KeyType>
+template <class T>
+void EytzingerIndex<KeyType>::lowerBoundBatchAux(const T* queries,
+        int query_count, uint32_t* slots) const {
+    const int GROUP_SIZE = 8;
+    if(count == 0){
+        for(int q = 0; q < query_count; q++){
+            slots[q] = 0;
+        }
+        return;
+    }
+
+    for(int first = 0; first < query_count; first += GROUP_SIZE){
+        int group = query_count - first < GROUP_SIZE ? query_count - first
+                                                     : GROUP_SIZE;
+        uint32_t group_slots[GROUP_SIZE];
+        for(int q = 0; q < group; q++){
+            group_slots[q] = 1;
+        }
+        for(int level = 0; level < full_levels; level++){
+            for(int q = 0; q < group; q++){
+                uint32_t slot = group_slots[q];
+                prefetch(slot);
+                group_slots[q] = 2 * slot + (keys[slot] < queries[first + q]);
+            }
+        }
+        for(int q = 0; q < group; q++){
+            uint32_t slot = group_slots[q];
+            bool in_tree = slot <= count;
+            uint32_t stepped = 2 * slot +
+                    (keys[in_tree ? slot : 0] < queries[first + q]);
+            slots[first + q] = lastLeftTurn(in_tree ? stepped : slot);
+        }
+    }
+}
+
+#ifdef __AVX2__
+template <class KeyType>
+void EytzingerIndex<KeyType>::lowerBoundBatchAux(const int* queries,
+        int query_count, uint32_t* slots) const {
+    if(count == 0){
+        for(int q = 0; q < query_count; q++){
+            slots[q] = 0;
+        }
+        return;
+    }
+
+    const int* base = reinterpret_cast<const int*>(keys.data());
+    const __m256i limit = _mm256_set1_epi32(count + 1);
+    int first = 0;
+    for(; first + 8 <= query_count; first += 8){
+        __m256i query = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(queries + first));
+        __m256i slot = _mm256_set1_epi32(1);
+        for(int level = 0; level < full_levels; level++){
+            __m256i key = _mm256_i32gather_epi32(base, slot, 4);
+            /* all ones where the key is less than the query, which turns
+             * the subtraction into adding 1 */
+            __m256i go_right = _mm256_cmpgt_epi32(query, key);
+            slot = _mm256_sub_epi32(_mm256_add_epi32(slot, slot), go_right);
+        }
+
+        __m256i in_tree = _mm256_cmpgt_epi32(limit, slot);
+        __m256i key = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+                base, slot, in_tree, 4);
+        __m256i go_right = _mm256_and_si256(_mm256_cmpgt_epi32(query, key),
+                in_tree);
+        __m256i stepped = _mm256_sub_epi32(_mm256_add_epi32(slot, slot),
+                go_right);
+        slot = _mm256_blendv_epi8(slot, stepped, in_tree);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(slots + first), slot);
+        for(int q = first; q < first + 8; q++){
+            slots[q] = lastLeftTurn(slots[q]);
+        }
+    }
+    lowerBoundBatchAux<int>(queries + first, query_count - first,
+            slots + first);
+}
+
+template <class KeyType>
+template <class T>
+void EytzingerIndex<KeyType>::lowerBoundBatch64(const T* queries,
+        int query_count, uint32_t* slots) const {
+    if(count == 0){
+        for(int q = 0; q < query_count; q++){
+            slots[q] = 0;
+        }
+        return;
+    }
+
+    const long long* base = reinterpret_cast<const long long*>(keys.data());
+    const __m256i limit = _mm256_set1_epi64x(count + 1);
+    int first = 0;
+    for(; first + 4 <= query_count; first += 4){
+        __m256i query = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(queries + first));
+        __m256i slot = _mm256_set1_epi64x(1);
+        for(int level = 0; level < full_levels; level++){
+            __m256i key = _mm256_i64gather_epi64(base, slot, 8);
+            __m256i go_right = _mm256_cmpgt_epi64(query, key);
+            slot = _mm256_sub_epi64(_mm256_add_epi64(slot, slot), go_right);
+        }
+
+        __m256i in_tree = _mm256_cmpgt_epi64(limit, slot);
+        __m256i key = _mm256_mask_i64gather_epi64(_mm256_setzero_si256(),
+                base, slot, in_tree, 8);
+        __m256i go_right = _mm256_and_si256(_mm256_cmpgt_epi64(query, key),
+                in_tree);
+        __m256i stepped = _mm256_sub_epi64(_mm256_add_epi64(slot, slot),
+                go_right);
+        slot = _mm256_blendv_epi8(slot, stepped, in_tree);
+
+        long long lane_slots[4];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_slots), slot);
+        for(int q = 0; q < 4; q++){
+            slots[first + q] = lastLeftTurn(uint32_t(lane_slots[q]));
+        }
+    }
+    lowerBoundBatchAux<T>(queries + first, query_count - first,
+            slots + first);
+}
+#endif
+
+template <class KeyType, class DataType>
+template <class InputIt>
+FrozenAVL_tree<KeyType, DataType>::FrozenAVL_tree(InputIt first,
+        InputIt last) {
+    std::vector<KeyType> sorted_keys;
+    std::vector<DataType*> sorted_data;
+    for(; first != last; ++first){
+        sorted_keys.push_back(first->first);
+        sorted_data.push_back(first->second);
+    }
+
+    index = EytzingerIndex<KeyType>(sorted_keys);
+    data.resize(sorted_data.size() + 1, nullptr);
+    for(uint32_t slot = 1; slot <= index.size(); slot++){
+        data[slot] = sorted_data[index.position(slot)];
+    }
+}
+
+template <class KeyType, class DataType>
+void FrozenAVL_tree<KeyType, DataType>::getDataBatch(const KeyType* queries,
+        int query_count, DataType** results) const {
+    std::vector<uint32_t> slots(query_count);
+    index.lowerBoundBatch(queries, query_count, slots.data());
+    for(int q = 0; q < query_count; q++){
+        uint32_t slot = slots[q];
+        results[q] = slot != 0 && index.key(slot) == queries[q] ? data[slot]
+                                                                : nullptr;
+    }
+}
+
+template <class KeyType, class Augmentation>
+FrozenAVLrankTree<KeyType, Augmentation>::FrozenAVLrankTree(
+        const std::vector<KeyType>& sorted_keys)
+        : index(sorted_keys), slots(sorted_keys.size()) {
+    int n = sorted_keys.size();
+    for(uint32_t slot = 1; slot <= index.size(); slot++){
+        slots[index.position(slot)] = slot;
+    }
+
+    smallest_prefix.reserve(n + 1);
+    smallest_prefix.push_back(Augmentation::identity());
+    for(int i = 0; i < n; i++){
+        smallest_prefix.push_back(Augmentation::combine(smallest_prefix.back(),
+                Augmentation::fromKey(sorted_keys[i])));
+    }
+
+    largest_prefix.reserve(n + 1);
+    largest_prefix.push_back(Augmentation::identity());
+    for(int i = n - 1; i >= 0; i--){
+        largest_prefix.push_back(Augmentation::combine(
+                Augmentation::fromKey(sorted_keys[i]), largest_prefix.back()));
+    }
+}
+
+template <class KeyType, class Augmentation>
+void FrozenAVLrankTree<KeyType, Augmentation>::rankBatch(const KeyType* queries,
+        int query_count, int* ranks) const {
+    std::vector<uint32_t> found_slots(query_count);
+    index.lowerBoundBatch(queries, query_count, found_slots.data());
+    for(int q = 0; q < query_count; q++){
+        ranks[q] = index.position(found_slots[q]);
+    }
+}
+
+#endif //WET2CPP_FROZENTREE_H
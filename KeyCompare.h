@@ -0,0 +1,109 @@
+#ifndef WET1CPP_KEYCOMPARE_H
+#define WET1CPP_KEYCOMPARE_H
+
+#if __cplusplus > 201703L && defined(__cpp_impl_three_way_comparison)
+#include <compare>
+#endif
+#include <type_traits>
+#include <utility>
+
+/* the comparator policies of AVL_tree and AVLrankTree. A comparator is
+ * called as compare(a, b) and returns a negative number, zero or a positive
+ * number if "a" is less than, equivalent to or greater than "b", so a search
+ * calls it once per level. How many key comparisons that call makes is up to
+ * the comparator. A comparator that defines is_transparent lets
+ * the trees look keys up by any type it can compare with the keys (such as
+ * std::string_view for std::string keys) without building a KeyType */
+
+/* the default comparator, which orders keys by their own operators. It
+ * uses operator<=> if the keys have one (C++20), otherwise a compare()
+ * method that returns an int (std::string, std::string_view), otherwise
+ * operator<. Only the first two compare the keys once per call. The
+ * operator< fallback, which before C++20 includes the arithmetic keys, makes
+ * a second comparison whenever "a" is not less than "b", so a search does
+ * about two comparisons per level */
+class ThreeWayCompare{
+#if __cplusplus > 201703L && defined(__cpp_impl_three_way_comparison)
+    template <class A, class B>
+    static auto threeWay(const A& a, const B& b, int)
+            -> decltype(a <=> b, int()) {
+        auto result = a <=> b;
+        return result < 0 ? -1 : (result > 0 ? 1 : 0);
+    }
+#endif
+
+    template <class A, class B>
+    static auto threeWay(const A& a, const B& b, long)
+            -> decltype(int(a.compare(b))) {
+        return a.compare(b);
+    }
+
+    /* the last resort costs a second operator< when "a" is not less */
+    template <class A, class B>
+    static auto threeWay(const A& a, const B& b, ...)
+            -> decltype(a < b, b < a, int()) {
+        if(a < b){
+            return -1;
+        }
+        return b < a ? 1 : 0;
+    }
+
+public:
+    typedef void is_transparent;
+
+    /* declared only for the types that can be compared, so
+     * TransparentLookup can tell them apart */
+    template <class A, class B>
+    auto operator()(const A& a, const B& b) const
+            -> decltype(threeWay(a, b, 0)) {
+        return threeWay(a, b, 0);
+    }
+};
+
+/* defines is_transparent if "Less" does */
+template <class Less, class = void>
+class TransparentIf{};
+
+template <class Less>
+class TransparentIf<Less, typename std::conditional<true, void,
+        typename Less::is_transparent>::type>{
+public:
+    typedef void is_transparent;
+};
+
+/* adapts a "less than" comparator (like std::less or std::greater) to the
+ * three-way interface, calling it twice only for equivalent keys or when
+ * "a" is greater. It is transparent if the adapted comparator is */
+template <class Less>
+class LessCompare : public TransparentIf<Less>{
+    Less less;
+
+public:
+    LessCompare() {}
+    explicit LessCompare(const Less& less) : less(less) {}
+
+    template <class A, class B>
+    int operator()(const A& a, const B& b) const {
+        if(less(a, b)){
+            return -1;
+        }
+        return less(b, a) ? 1 : 0;
+    }
+};
+
+template <class Compare, class LookupKey, class KeyType,
+        class = typename Compare::is_transparent>
+auto transparentLookupCheck(int)
+        -> decltype(std::declval<const Compare&>()(
+                std::declval<const LookupKey&>(),
+                std::declval<const KeyType&>()), void());
+
+/* TransparentLookup<Compare, LookupKey, KeyType> names a type only if
+ * "Compare" is transparent and can compare a LookupKey with a key, so the
+ * heterogeneous lookups of the trees don't take over the lookups by values
+ * that merely convert to KeyType */
+template <class Compare, class LookupKey, class KeyType>
+using TransparentLookup =
+        decltype(transparentLookupCheck<Compare, LookupKey, KeyType>(0));
+
+#endif //WET1CPP_KEYCOMPARE_H
@@ -0,0 +1,926 @@
+#ifndef WET1CPP_LOGGEDAVL_H
+#define WET1CPP_LOGGEDAVL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include "AVL_tree.h"
+#include "AVLrankTree.h"
+#include "OperationLog.h"
+#include "TreeSnapshot.h"
+
+/* trees whose updates are durable: every insertion and deletion is appended
+ * to an OperationLog before it returns, and the tree is recovered from it's
+ * files by open(). The files of a tree at "path" are:
+ *   path.manifest - the generation of the current snapshot, replaced by a
+ *                   rename
+ *   path.snap.G   - the snapshot of the tree (see TreeSnapshot.h) as it was
+ *                   when log generation G started, for G > 0
+ *   path.log.G    - the log segments, replayed in order starting with the
+ *                   generation of the snapshot
+ * Recovery loads the snapshot and replays the segments, collecting runs of
+ * insertions (or deletions) into batches that are merged into the tree by
+ * insertBatch() (or deleteBatch()) in a single pass, rather than one
+ * descent per record.
+ *
+ * Compaction starts a new log segment, which is all it does under the
+ * lock. A background thread then rebuilds the tree from the last snapshot
+ * and the segments before the new one, which no longer change, writes it as
+ * the snapshot of the new generation, and removes the older snapshot and
+ * segments. A failed compaction leaves the last snapshot in place, and the
+ * next one replays from it. Compaction starts by itself once the current
+ * segment grows beyond "compact_threshold" bytes (0 turns that off), or by
+ * calling compact(). Recovery removes the files a crash left behind: the
+ * snapshots and segments older than the manifest's generation, the
+ * snapshots a compaction wrote but did not commit, and the temporary
+ * files.
+ *
+ * With a flush interval of 0 an update returns once it's record is synced;
+ * updates from several threads share their syncs. A longer interval lets
+ * updates return right away and syncs the log every interval, trading the
+ * last interval's updates on a crash for throughput. The trees take a single
+ * lock per operation, so they may be used from several threads */
+template <class Tree>
+class LoggedTreeBase{
+protected:
+    /* the records of a replay are merged into the tree in batches of up to
+     * this size */
+    static const int REPLAY_BATCH_SIZE = 1 << 16;
+
+    /* serializes the operations, and guards the tree and the members
+     * below */
+    std::mutex lock;
+    Tree tree;
+    /* the log is shared with the updates waiting for their records, so a
+     * compaction may replace it meanwhile */
+    std::shared_ptr<OperationLog> log;
+    std::string path;
+    SnapshotHeader::Kind kind;
+    std::chrono::milliseconds flush_interval;
+    uint64_t compact_threshold;
+    /* the generation of the log segment being appended, and of the last
+     * snapshot (0 if there is none). A compaction changes the snapshot
+     * generation once it's snapshot is committed */
+    uint64_t generation;
+    std::atomic<uint64_t> snapshot_generation;
+    /* the record being encoded */
+    std::vector<char> record;
+
+    std::thread compactor;
+    std::atomic<bool> compacting;
+    /* false once a compaction failed */
+    std::atomic<bool> compaction_ok;
+
+    std::string snapshotPath(uint64_t g) const {
+        return path + ".snap." + std::to_string(g);
+    }
+
+    std::string logPath(uint64_t g) const {
+        return path + ".log." + std::to_string(g);
+    }
+
+    std::string manifestPath() const {return path + ".manifest";}
+
+    static bool fileExists(const std::string& file_path){
+        struct stat file_stat;
+        return stat(file_path.c_str(), &file_stat) == 0;
+    }
+
+    LoggedTreeBase(SnapshotHeader::Kind kind,
+            std::chrono::milliseconds flush_interval,
+            uint64_t compact_threshold);
+    ~LoggedTreeBase();
+
+    LoggedTreeBase(const LoggedTreeBase& tree) = delete;
+    LoggedTreeBase& operator=(const LoggedTreeBase& tree) = delete;
+
+    /* read the generation of the current snapshot into "g". The method
+     * returns false if the manifest is missing or damaged */
+    bool readManifest(uint64_t& g) const;
+
+    bool writeManifest(uint64_t g) const;
+
+    /* load the snapshot of generation "first" into "target" (generation 0
+     * has none) and replay the segments from "first" on, before "end" and
+     * up to the first missing one. "files" is the TreeFiles of the derived
+     * tree: it's load(tree, path) reads a snapshot, and it's Replay(tree)
+     * collects the records and merges them into the tree when flush() is
+     * called. "next" is set to the generation after the last segment
+     * replayed, and "valid_size" to the size of that segment's intact part.
+     * Only a segment which is the last one on the disk may end with a torn
+     * record. The method returns false if the files are damaged */
+    template <class Files>
+    bool replayFiles(Tree& target, const Files& files, uint64_t first,
+            uint64_t end, uint64_t& next, uint64_t& valid_size) const;
+
+    /* close the tree and recover it from the files at "tree_path" by
+     * replayFiles(), then remove the files a crash left behind. The method
+     * returns false, and leaves the tree empty, if the files are damaged */
+    template <class Files>
+    bool recover(const std::string& tree_path, const Files& files);
+
+    /* remove the snapshots but that of generation "current", the segments
+     * before it and the temporary files */
+    void removeStaleFiles(uint64_t current) const;
+
+    /* append the encoded record to the log, with the lock held. The method
+     * returns it's sequence number, or 0 if the tree is closed */
+    uint64_t appendRecord();
+
+    /* after an update released the lock, wait for it's last record to be
+     * synced if the flush interval is 0 */
+    void commit(const std::shared_ptr<OperationLog>& update_log,
+            uint64_t sequence);
+
+    /* start a compaction unless one is running, with the lock held. The
+     * snapshot is rebuilt by replayFiles() and written by
+     * "files.save(tree, snapshot_path)" */
+    template <class Files>
+    bool startCompaction(const Files& files);
+
+    /* start a compaction if the current segment is too large */
+    template <class Files>
+    void compactIfDue(const Files& files){
+        if(compact_threshold > 0 && log && !compacting.load() &&
+                log->segmentSize() >= compact_threshold){
+            startCompaction(files);
+        }
+    }
+
+    void joinCompactor(){
+        if(compactor.joinable()){
+            compactor.join();
+        }
+    }
+
+public:
+    /* wait for a running compaction, sync the log and close it's files. The
+     * tree keeps it's keys, but later updates are not logged until open()
+     * is called again */
+    void close();
+
+    /* wait until every update so far is synced. The method returns false if
+     * the tree is closed or the log could not be written */
+    bool sync();
+
+    /* wait for a running compaction to end. The method returns false if a
+     * compaction failed since the tree was opened */
+    bool waitForCompaction();
+
+    /* return false once the log could not be written */
+    bool good();
+
+    /* call "func(tree)" with the lock held, for the queries the wrapper
+     * does not forward. "func" must not change the tree */
+    template <class Func>
+    auto query(Func func) -> decltype(func(std::declval<Tree&>())) {
+        std::lock_guard<std::mutex> guard(lock);
+        return func(tree);
+    }
+};
+
+template <class Tree>
+LoggedTreeBase<Tree>::LoggedTreeBase(SnapshotHeader::Kind kind,
+        std::chrono::milliseconds flush_interval, uint64_t compact_threshold)
+        : kind(kind), flush_interval(flush_interval),
+          compact_threshold(compact_threshold), generation(0),
+          snapshot_generation(0), compacting(false), compaction_ok(true) {}
+
+template <class Tree>
+LoggedTreeBase<Tree>::~LoggedTreeBase() {
+    close();
+}
+
+template <class Tree>
+bool LoggedTreeBase<Tree>::readManifest(uint64_t& g) const {
+    SnapshotReader in(manifestPath());
+    char magic[8];
+    return in.isOpen() && in.read(magic, sizeof(magic)) &&
+           std::memcmp(magic, "AVLMANIF", sizeof(magic)) == 0 &&
+           in.readValue(g) && in.finish();
+}
+
+template <class Tree>
+bool LoggedTreeBase<Tree>::writeManifest(uint64_t g) const {
+    SnapshotWriter out(manifestPath());
+    out.write("AVLMANIF", 8);
+    out.writeValue(g);
+    return out.finish() && OperationLog::syncDirectory(manifestPath());
+}
+
+template <class Tree>
+template <class Files>
+bool LoggedTreeBase<Tree>::replayFiles(Tree& target, const Files& files,
+        uint64_t first, uint64_t end, uint64_t& next,
+        uint64_t& valid_size) const {
+    next = first;
+    valid_size = 0;
+    if(first > 0 && !files.load(target, snapshotPath(first))){
+        return false;
+    }
+
+    /* every segment but the last was synced before the next one started,
+     * so only the last one may end with a torn record */
+    typename Files::Replay replay(target, files);
+    for(uint64_t g = first; g < end && fileExists(logPath(g)); g++){
+        uint64_t file_size;
+        bool ok = OperationLog::readSegment(logPath(g), kind, std::ref(replay),
+                valid_size, file_size);
+        replay.flush();
+        if(!ok || (valid_size < file_size && fileExists(logPath(g + 1)))){
+            return false;
+        }
+        next = g + 1;
+    }
+    return true;
+}
+
+template <class Tree>
+template <class Files>
+bool LoggedTreeBase<Tree>::recover(const std::string& tree_path,
+        const Files& files) {
+    close();
+    std::lock_guard<std::mutex> guard(lock);
+    path = tree_path;
+    tree = Tree();
+    compaction_ok.store(true);
+
+    uint64_t first = 0;
+    if(fileExists(manifestPath()) && !readManifest(first)){
+        return false;
+    }
+    uint64_t next;
+    uint64_t valid_size;
+    if(!replayFiles(tree, files, first, std::numeric_limits<uint64_t>::max(),
+            next, valid_size)){
+        tree = Tree();
+        return false;
+    }
+
+    uint64_t last = next > first ? next - 1 : first;
+    std::shared_ptr<OperationLog> new_log(new OperationLog(flush_interval));
+    bool opened = valid_size > 0 ? new_log->openForAppend(logPath(last), valid_size)
+                                 : new_log->create(logPath(last), kind);
+    if(!opened){
+        tree = Tree();
+        return false;
+    }
+    log = new_log;
+    generation = last;
+    snapshot_generation.store(first);
+    removeStaleFiles(first);
+    return true;
+}
+
+template <class Tree>
+void LoggedTreeBase<Tree>::removeStaleFiles(uint64_t current) const {
+    std::string::size_type slash = path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." :
+                            slash == 0 ? "/" : path.substr(0, slash);
+    std::string prefix = slash == std::string::npos ? path :
+                         path.substr(slash + 1);
+    std::string snapshot_prefix = prefix + ".snap.";
+    std::string log_prefix = prefix + ".log.";
+
+    DIR* listing = opendir(directory.c_str());
+    if(listing == nullptr){
+        return;
+    }
+    std::vector<std::string> stale;
+    while(struct dirent* entry = readdir(listing)){
+        std::string name = entry->d_name;
+        if(name.compare(0, prefix.size(), prefix) != 0){
+            continue;
+        }
+        bool temporary = name.size() > 4 &&
+                         name.compare(name.size() - 4, 4, ".tmp") == 0;
+        bool is_snapshot = name.compare(0, snapshot_prefix.size(),
+                snapshot_prefix) == 0;
+        bool is_log = name.compare(0, log_prefix.size(), log_prefix) == 0;
+        if(temporary){
+            if(is_snapshot || is_log || name == prefix + ".manifest.tmp"){
+                stale.push_back(name);
+            }
+            continue;
+        }
+        if(!is_snapshot && !is_log){
+            continue;
+        }
+        std::string number = name.substr(is_snapshot ? snapshot_prefix.size()
+                                                      : log_prefix.size());
+        if(number.empty() ||
+                number.find_first_not_of("0123456789") != std::string::npos){
+            continue;
+        }
+        uint64_t g = std::strtoull(number.c_str(), nullptr, 10);
+        if(is_snapshot ? g != current : g < current){
+            stale.push_back(name);
+        }
+    }
+    closedir(listing);
+
+    for(const std::string& name : stale){
+        std::remove((directory + "/" + name).c_str());
+    }
+}
+
+template <class Tree>
+uint64_t LoggedTreeBase<Tree>::appendRecord() {
+    if(!log){
+        return 0;
+    }
+    return log->append(record.data(), record.size());
+}
+
+template <class Tree>
+void LoggedTreeBase<Tree>::commit(const std::shared_ptr<OperationLog>& update_log,
+        uint64_t sequence) {
+    if(update_log && sequence > 0 && flush_interval.count() == 0){
+        update_log->waitDurable(sequence);
+    }
+}
+
+template <class Tree>
+template <class Files>
+bool LoggedTreeBase<Tree>::startCompaction(const Files& files) {
+    if(!log || compacting.load()){
+        return false;
+    }
+    joinCompactor();
+
+    /* the records from here on go to a new segment, so the snapshot of the
+     * tree as it is now replaces exactly the older segments */
+    uint64_t next = generation + 1;
+    std::shared_ptr<OperationLog> new_log(new OperationLog(flush_interval));
+    if(!new_log->create(logPath(next), kind)){
+        compaction_ok.store(false);
+        return false;
+    }
+    log->close();
+    log = new_log;
+    generation = next;
+
+    uint64_t previous = snapshot_generation.load();
+    compacting.store(true);
+    compactor = std::thread([this, files, previous, next]{
+        /* the segments before "next" no longer change, so the tree is
+         * rebuilt from them without holding the lock */
+        bool saved;
+        {
+            Tree rebuilt;
+            uint64_t replayed;
+            uint64_t valid_size;
+            saved = replayFiles(rebuilt, files, previous, next, replayed,
+                                valid_size) && replayed == next &&
+                    files.save(rebuilt, snapshotPath(next));
+        }
+        if(saved && writeManifest(next)){
+            snapshot_generation.store(next);
+            /* a crash from here on recovers from the new snapshot, so the
+             * older files, those of failed compactions included, are no
+             * longer needed */
+            for(uint64_t g = previous; g < next; g++){
+                if(g > 0){
+                    std::remove(snapshotPath(g).c_str());
+                }
+                std::remove(logPath(g).c_str());
+            }
+        } else {
+            /* the last snapshot stays the one to replay from. A snapshot
+             * that was written is kept, since the manifest may name it if
+             * only syncing it's directory failed */
+            if(!saved){
+                std::remove(snapshotPath(next).c_str());
+            }
+            compaction_ok.store(false);
+        }
+        compacting.store(false);
+    });
+    return true;
+}
+
+template <class Tree>
+void LoggedTreeBase<Tree>::close() {
+    joinCompactor();
+    std::lock_guard<std::mutex> guard(lock);
+    if(log){
+        log->close();
+        log.reset();
+    }
+}
+
+template <class Tree>
+bool LoggedTreeBase<Tree>::sync() {
+    std::shared_ptr<OperationLog> current_log;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        current_log = log;
+    }
+    return current_log && current_log->sync();
+}
+
+template <class Tree>
+bool LoggedTreeBase<Tree>::waitForCompaction() {
+    std::lock_guard<std::mutex> guard(lock);
+    joinCompactor();
+    return compaction_ok.load();
+}
+
+template <class Tree>
+bool LoggedTreeBase<Tree>::good() {
+    std::lock_guard<std::mutex> guard(lock);
+    return log && log->good();
+}
+
+/* a LoggedTreeBase of an AVL_tree, which owns the data of it's keys. The
+ * keys and the data are written to the log and the snapshots by the given
+ * codecs (see TreeSnapshot.h) */
+template <class KeyType, class DataType,
+        template <class> class VertexAllocator = HeapVertexAllocator,
+        class KeyCodec = TrivialCodec<KeyType>,
+        class DataCodec = TrivialCodec<DataType> >
+class LoggedAVL_tree
+        : public LoggedTreeBase<AVL_tree<KeyType, DataType, VertexAllocator> >{
+    typedef AVL_tree<KeyType, DataType, VertexAllocator> Tree;
+    typedef LoggedTreeBase<Tree> Base;
+
+    KeyCodec key_codec;
+    DataCodec data_codec;
+
+    /* encode a record into the record buffer */
+    void encodeInsert(const KeyType& key, const DataType* data);
+    void encodeDelete(const KeyType& key);
+
+    /* how the tree is read from and written to it's files, see
+     * LoggedTreeBase::replayFiles() */
+    class TreeFiles{
+        KeyCodec key_codec;
+        DataCodec data_codec;
+    public:
+        TreeFiles(const KeyCodec& key_codec, const DataCodec& data_codec)
+                : key_codec(key_codec), data_codec(data_codec) {}
+
+        bool save(const Tree& tree, const std::string& path) const {
+            return tree.saveTo(path, key_codec, data_codec);
+        }
+
+        bool load(Tree& tree, const std::string& path) const {
+            return tree.loadFrom(path, key_codec, data_codec);
+        }
+
+        /* collects runs of insertions (or deletions), which flush() merges
+         * into the tree by a single insertBatch() (or deleteBatch()) */
+        class Replay{
+            Tree& tree;
+            const TreeFiles& files;
+            std::vector<std::pair<KeyType, DataType*> > inserts;
+            std::vector<KeyType> deletes;
+
+        public:
+            Replay(Tree& tree, const TreeFiles& files)
+                    : tree(tree), files(files) {}
+
+            Replay(const Replay& replay) = delete;
+            Replay& operator=(const Replay& replay) = delete;
+
+            /* the data of a run that was never merged */
+            ~Replay(){
+                for(std::pair<KeyType, DataType*>& pair : inserts){
+                    delete pair.second;
+                }
+            }
+
+            bool operator()(LogRecordReader& in);
+
+            /* merge the run collected so far, there is only one kind at a
+             * time */
+            void flush();
+        };
+    };
+
+public:
+    /* constructor, see LoggedTreeBase for the flush interval and the
+     * compaction threshold */
+    explicit LoggedAVL_tree(
+            std::chrono::milliseconds flush_interval = std::chrono::milliseconds(0),
+            uint64_t compact_threshold = uint64_t(64) << 20,
+            const KeyCodec& key_codec = KeyCodec(),
+            const DataCodec& data_codec = DataCodec())
+            : Base(SnapshotHeader::KEYS_AND_DATA, flush_interval,
+                   compact_threshold),
+              key_codec(key_codec), data_codec(data_codec) {}
+
+    /* recover the tree from it's files at "path", creating them if there
+     * are none, and log the updates from now on. The method returns false,
+     * and leaves the tree empty, if the files could not be read or
+     * created */
+    bool open(const std::string& path);
+
+    /* return true if a vertex with a matching key exists int the tree, false
+     * otherwise */
+    bool keyExists(const KeyType& key){
+        std::lock_guard<std::mutex> guard(this->lock);
+        return this->tree.keyExists(key);
+    }
+
+    /* return the pointer to the data of the matching key, or nullptr. The
+     * data must not be changed, since the change would not be logged */
+    DataType* getData(const KeyType& key){
+        std::lock_guard<std::mutex> guard(this->lock);
+        return this->tree.getData(key);
+    }
+
+    /* the interface method to insert a vertex with a "key" and "data" to the
+     * tree */
+    void insertKey(const KeyType& key, DataType* data);
+
+    /* the interface method to delete a vertex with the matching key from the
+     * tree. The vertex's data is detached from the tree and returned to the
+     * caller, or nullptr if the key is not in the tree */
+    DataType* deleteKey(const KeyType& key);
+
+    /* the batch versions of the methods above, see AVL_tree. Every key of
+     * the batch is logged, and the batch waits for a single sync */
+    template <class InputIt>
+    void insertBatch(InputIt first, InputIt last);
+
+    template <class InputIt, class OutputIt>
+    OutputIt deleteBatch(InputIt first, InputIt last, OutputIt removed);
+
+    /* start a compaction in the background. The method returns false if
+     * the tree is closed or a compaction is already running */
+    bool compact(){
+        std::lock_guard<std::mutex> guard(this->lock);
+        return this->startCompaction(TreeFiles(key_codec, data_codec));
+    }
+};
+
+template <class KeyType, class DataType,
+        template <class> class VertexAllocator, class KeyCodec, class DataCodec>
+void LoggedAVL_tree<KeyType, DataType, VertexAllocator, KeyCodec, DataCodec>::encodeInsert(const KeyType& key,
+        const DataType* data) {
+    LogRecordWriter out(this->record);
+    out.writeValue(uint8_t(OperationLog::INSERT));
+    key_codec.write(out, key);
+    unsigned char has_data = data != nullptr;
+    out.writeValue(has_data);
+    if(has_data){
+        data_codec.write(out, *data);
+    }
+}
+
+template <class KeyType, class DataType,
+        template <class> class VertexAllocator, class KeyCodec, class DataCodec>
+void LoggedAVL_tree<KeyType, DataType, VertexAllocator, KeyCodec, DataCodec>::encodeDelete(const KeyType& key) {
+    LogRecordWriter out(this->record);
+    out.writeValue(uint8_t(OperationLog::DELETE));
+    key_codec.write(out, key);
+}
+
+template <class KeyType, class DataType,
+        template <class> class VertexAllocator, class KeyCodec, class DataCodec>
+bool LoggedAVL_tree<KeyType, DataType, VertexAllocator, KeyCodec, DataCodec>::open(const std::string& path) {
+    return this->recover(path, TreeFiles(key_codec, data_codec));
+}
+
+template <class KeyType, class DataType,
+        template <class> class VertexAllocator, class KeyCodec, class DataCodec>
+bool LoggedAVL_tree<KeyType, DataType, VertexAllocator, KeyCodec, DataCodec>::TreeFiles::Replay::operator()(LogRecordReader& in) {
+    uint8_t operation;
+    KeyType key;
+    if(!in.readValue(operation) || !files.key_codec.read(in, key)){
+        return false;
+    }
+    if(operation == OperationLog::INSERT){
+        unsigned char has_data;
+        if(!in.readValue(has_data)){
+            return false;
+        }
+        DataType* data = nullptr;
+        if(has_data){
+            DataType value;
+            if(!files.data_codec.read(in, value)){
+                return false;
+            }
+            data = new DataType(std::move(value));
+        }
+        if(!deletes.empty()){
+            flush();
+        }
+        inserts.push_back(std::make_pair(std::move(key), data));
+    } else if(operation == OperationLog::DELETE){
+        if(!inserts.empty()){
+            flush();
+        }
+        deletes.push_back(std::move(key));
+    } else {
+        return false;
+    }
+    if(int(inserts.size() + deletes.size()) >= Base::REPLAY_BATCH_SIZE){
+        flush();
+    }
+    return true;
+}
+
+template <class KeyType, class DataType,
+        template <class> class VertexAllocator, class KeyCodec, class DataCodec>
+void LoggedAVL_tree<KeyType, DataType, VertexAllocator, KeyCodec, DataCodec>::TreeFiles::Replay::flush() {
+    if(!inserts.empty()){
+        tree.insertBatch(inserts.begin(), inserts.end());
+        inserts.clear();
+    }
+    if(!deletes.empty()){
+        std::vector<DataType*> removed;
+        tree.deleteBatch(deletes.begin(), deletes.end(),
+                std::back_inserter(removed));
+        for(DataType* data : removed){
+            delete data;
+        }
+        deletes.clear();
+    }
+}
+
+template <class KeyType, class DataType,
+        template <class> class VertexAllocator, class KeyCodec, class DataCodec>
+void LoggedAVL_tree<KeyType, DataType, VertexAllocator, KeyCodec, DataCodec>::insertKey(const KeyType& key,
+        DataType* data) {
+    std::shared_ptr<OperationLog> update_log;
+    uint64_t sequence;
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->record.clear();
+        encodeInsert(key, data);
+        sequence = this->appendRecord();
+        update_log = this->log;
+        this->tree.insertKey(key, data);
+        this->compactIfDue(TreeFiles(key_codec, data_codec));
+    }
+    this->commit(update_log, sequence);
+}
+
+template <class KeyType, class DataType,
+        template <class> class VertexAllocator, class KeyCodec, class DataCodec>
+DataType* LoggedAVL_tree<KeyType, DataType, VertexAllocator, KeyCodec, DataCodec>::deleteKey(const KeyType& key) {
+    std::shared_ptr<OperationLog> update_log;
+    uint64_t sequence;
+    DataType* detached_data;
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->record.clear();
+        encodeDelete(key);
+        sequence = this->appendRecord();
+        update_log = this->log;
+        detached_data = this->tree.deleteKey(key);
+        this->compactIfDue(TreeFiles(key_codec, data_codec));
+    }
+    this->commit(update_log, sequence);
+    return detached_data;
+}
+
+template <class KeyType, class DataType,
+        template <class> class VertexAllocator, class KeyCodec, class DataCodec>
+template <class InputIt>
+void LoggedAVL_tree<KeyType, DataType, VertexAllocator, KeyCodec, DataCodec>::insertBatch(InputIt first,
+        InputIt last) {
+    std::vector<std::pair<KeyType, DataType*> > pairs(first, last);
+    std::shared_ptr<OperationLog> update_log;
+    uint64_t sequence = 0;
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        for(const std::pair<KeyType, DataType*>& pair : pairs){
+            this->record.clear();
+            encodeInsert(pair.first, pair.second);
+            sequence = this->appendRecord();
+        }
+        update_log = this->log;
+        this->tree.insertBatch(pairs.begin(), pairs.end());
+        this->compactIfDue(TreeFiles(key_codec, data_codec));
+    }
+    this->commit(update_log, sequence);
+}
+
+template <class KeyType, class DataType,
+        template <class> class VertexAllocator, class KeyCodec, class DataCodec>
+template <class InputIt, class OutputIt>
+OutputIt LoggedAVL_tree<KeyType, DataType, VertexAllocator, KeyCodec, DataCodec>::deleteBatch(InputIt first,
+        InputIt last, OutputIt removed) {
+    std::vector<KeyType> keys(first, last);
+    std::shared_ptr<OperationLog> update_log;
+    uint64_t sequence = 0;
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        for(const KeyType& key : keys){
+            this->record.clear();
+            encodeDelete(key);
+            sequence = this->appendRecord();
+        }
+        update_log = this->log;
+        removed = this->tree.deleteBatch(keys.begin(), keys.end(), removed);
+        this->compactIfDue(TreeFiles(key_codec, data_codec));
+    }
+    this->commit(update_log, sequence);
+    return removed;
+}
+
+/* a LoggedTreeBase of an AVLrankTree. The keys are written to the log and
+ * the snapshots by the given codec */
+template <class KeyType, class Augmentation = KeySum<>,
+        class KeyCodec = TrivialCodec<KeyType> >
+class LoggedAVLrankTree
+        : public LoggedTreeBase<AVLrankTree<KeyType, HeapVertexAllocator,
+                Augmentation> >{
+    typedef AVLrankTree<KeyType, HeapVertexAllocator, Augmentation> Tree;
+    typedef LoggedTreeBase<Tree> Base;
+
+    KeyCodec key_codec;
+
+    /* encode a record of the given operation into the record buffer */
+    void encode(OperationLog::Operation operation, const KeyType& key);
+
+    /* how the tree is read from and written to it's files, see
+     * LoggedAVL_tree */
+    class TreeFiles{
+        KeyCodec key_codec;
+    public:
+        explicit TreeFiles(const KeyCodec& key_codec) : key_codec(key_codec) {}
+
+        bool save(const Tree& tree, const std::string& path) const {
+            return tree.saveTo(path, key_codec);
+        }
+
+        bool load(Tree& tree, const std::string& path) const {
+            return tree.loadFrom(path, key_codec);
+        }
+
+        /* collects runs of keys of one operation, see LoggedAVL_tree */
+        class Replay{
+            Tree& tree;
+            const TreeFiles& files;
+            std::vector<KeyType> batch;
+            OperationLog::Operation batch_operation;
+
+        public:
+            Replay(Tree& tree, const TreeFiles& files)
+                    : tree(tree), files(files),
+                      batch_operation(OperationLog::INSERT) {}
+
+            Replay(const Replay& replay) = delete;
+            Replay& operator=(const Replay& replay) = delete;
+
+            bool operator()(LogRecordReader& in);
+
+            void flush();
+        };
+    };
+
+    /* log every key in [first, last) as "operation" and apply "update()"
+     * to the tree */
+    template <class Update>
+    void logBatch(OperationLog::Operation operation,
+            const std::vector<KeyType>& keys, Update update);
+
+public:
+    typedef typename Augmentation::value_type aggregate_type;
+
+    /* constructor, see LoggedTreeBase */
+    explicit LoggedAVLrankTree(
+            std::chrono::milliseconds flush_interval = std::chrono::milliseconds(0),
+            uint64_t compact_threshold = uint64_t(64) << 20,
+            const KeyCodec& key_codec = KeyCodec())
+            : Base(SnapshotHeader::KEYS_ONLY, flush_interval,
+                   compact_threshold),
+              key_codec(key_codec) {}
+
+    /* recover the tree from it's files at "path", see LoggedAVL_tree */
+    bool open(const std::string& path);
+
+    /* return true if a vertex with a matching key exists int the tree, false
+     * otherwise */
+    bool keyExists(const KeyType& key){
+        std::lock_guard<std::mutex> guard(this->lock);
+        return this->tree.keyExists(key);
+    }
+
+    /* return the number of keys in the tree */
+    int size(){
+        std::lock_guard<std::mutex> guard(this->lock);
+        return this->tree.size();
+    }
+
+    /* the interface methods to insert "key" to the tree or delete a matching
+     * key from it */
+    void insertKey(const KeyType& key){
+        logBatch(OperationLog::INSERT, std::vector<KeyType>(1, key),
+                [&](Tree& tree){tree.insertKey(key);});
+    }
+
+    void deleteKey(const KeyType& key){
+        logBatch(OperationLog::DELETE, std::vector<KeyType>(1, key),
+                [&](Tree& tree){tree.deleteKey(key);});
+    }
+
+    /* insert or delete every key in the range [first, last), see
+     * AVLrankTree. The batch waits for a single sync */
+    template <class InputIt>
+    void insertBatch(InputIt first, InputIt last){
+        std::vector<KeyType> keys(first, last);
+        logBatch(OperationLog::INSERT, keys, [&](Tree& tree){
+            tree.insertBatch(keys.begin(), keys.end());
+        });
+    }
+
+    template <class InputIt>
+    void deleteBatch(InputIt first, InputIt last){
+        std::vector<KeyType> keys(first, last);
+        logBatch(OperationLog::DELETE, keys, [&](Tree& tree){
+            tree.deleteBatch(keys.begin(), keys.end());
+        });
+    }
+
+    /* start a compaction in the background, see LoggedAVL_tree */
+    bool compact(){
+        std::lock_guard<std::mutex> guard(this->lock);
+        return this->startCompaction(TreeFiles(key_codec));
+    }
+};
+
+template <class KeyType, class Augmentation, class KeyCodec>
+void LoggedAVLrankTree<KeyType, Augmentation, KeyCodec>::encode(OperationLog::Operation operation,
+        const KeyType& key) {
+    LogRecordWriter out(this->record);
+    out.writeValue(uint8_t(operation));
+    key_codec.write(out, key);
+}
+
+template <class KeyType, class Augmentation, class KeyCodec>
+template <class Update>
+void LoggedAVLrankTree<KeyType, Augmentation, KeyCodec>::logBatch(OperationLog::Operation operation,
+        const std::vector<KeyType>& keys, Update update) {
+    std::shared_ptr<OperationLog> update_log;
+    uint64_t sequence = 0;
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        for(const KeyType& key : keys){
+            this->record.clear();
+            encode(operation, key);
+            sequence = this->appendRecord();
+        }
+        update_log = this->log;
+        update(this->tree);
+        this->compactIfDue(TreeFiles(key_codec));
+    }
+    this->commit(update_log, sequence);
+}
+
+template <class KeyType, class Augmentation, class KeyCodec>
+bool LoggedAVLrankTree<KeyType, Augmentation, KeyCodec>::open(const std::string& path) {
+    return this->recover(path, TreeFiles(key_codec));
+}
+
+template <class KeyType, class Augmentation, class KeyCodec>
+bool LoggedAVLrankTree<KeyType, Augmentation, KeyCodec>::TreeFiles::Replay::operator()(LogRecordReader& in) {
+    uint8_t operation;
+    KeyType key;
+    if(!in.readValue(operation) || !files.key_codec.read(in, key) ||
+            (operation != OperationLog::INSERT &&
+             operation != OperationLog::DELETE)){
+        return false;
+    }
+    if(operation != batch_operation){
+        flush();
+        batch_operation = OperationLog::Operation(operation);
+    }
+    batch.push_back(std::move(key));
+    if(int(batch.size()) >= Base::REPLAY_BATCH_SIZE){
+        flush();
+    }
+    return true;
+}
+
+template <class KeyType, class Augmentation, class KeyCodec>
+void LoggedAVLrankTree<KeyType, Augmentation, KeyCodec>::TreeFiles::Replay::flush() {
+    if(batch.empty()){
+        return;
+    }
+    if(batch_operation == OperationLog::INSERT){
+        tree.insertBatch(batch.begin(), batch.end());
+    } else {
+        tree.deleteBatch(batch.begin(), batch.end());
+    }
+    batch.clear();
+}
+
+#endif //WET1CPP_LOGGEDAVL_H
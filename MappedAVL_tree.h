@@ -0,0 +1,1030 @@
+#ifndef WET1CPP_MAPPEDAVL_TREE_H
+#define WET1CPP_MAPPEDAVL_TREE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "KeyCompare.h"
+
+/* an AVL tree that lives directly in a memory mapped file (POSIX). Like
+ * CompactAVL_tree, the vertexes are slots of a single array and children are
+ * 32 bit indexes into it, so the tree holds no pointers and the file can be
+ * mapped at any address. The file starts with a header that holds the root,
+ * the free list and the number of slots, followed by the array of vertexes:
+ *   header   - 64 bytes, see FileHeader
+ *   vertexes - "capacity" slots of sizeof(AVLvertex) bytes each
+ * Opening a tree only maps the file and checks the header, so it takes O(1)
+ * time no matter how many keys it holds, and the pages are read by the OS
+ * as the searches touch them. compact() lays the vertexes out in breadth
+ * first order, so the top levels every search visits share a few pages.
+ *
+ * The data is kept inside the vertex by value, so both KeyType and DataType
+ * must be trivially copyable. A tree opened read only maps the file shared
+ * and read only, so any number of processes can search the same file
+ * sharing one copy of it's pages. A tree opened for writing must be the only
+ * one open on it's file while it changes it - readers should open the file
+ * after the writer is closed (or open a copy of it). The file is grown by
+ * doubling, and sync() flushes the changes to the disk. The tree can hold up
+ * to 2^32-2 vertexes */
+template <class KeyType, class DataType, class Compare = ThreeWayCompare>
+class MappedAVL_tree{
+    static_assert(std::is_trivially_copyable<KeyType>::value &&
+                  std::is_trivially_copyable<DataType>::value,
+            "MappedAVL_tree keeps it's keys and data in a file, so they must "
+            "be trivially copyable");
+
+    class AVLvertex{
+    public:
+        KeyType key;
+        DataType data;
+        uint32_t left, right;
+        int8_t height;
+    };
+
+    /* the header at the start of the file. The sizes of the key, the data
+     * and the vertex are checked on open, so a file is not opened as a tree
+     * of different types */
+    class FileHeader{
+    public:
+        char magic[8];
+        uint32_t version;
+        uint32_t key_size;
+        uint32_t data_size;
+        uint32_t vertex_size;
+        uint32_t root;
+        /* the first slot of the free list, which is threaded through the left
+         * index of the free slots */
+        uint32_t free_list;
+        uint32_t free_count;
+        /* the number of slots in use or in the free list */
+        uint32_t slot_count;
+        /* the number of slots the file has room for */
+        uint32_t capacity;
+        char padding[20];
+    };
+
+    static_assert(sizeof(FileHeader) == 64, "the file header takes 64 bytes");
+
+    static const uint32_t VERSION = 1;
+
+    /* the index that stands for an empty subtree */
+    static const uint32_t NIL = UINT32_MAX;
+
+    /* the maximal height of a tree the fixed size path stacks can hold, see
+     * AVL_tree */
+    static const int MAX_HEIGHT = 48;
+
+    Compare compare;
+    int fd;
+    char* base;
+    size_t mapped_size;
+    bool read_only;
+
+    FileHeader& header() const {return *reinterpret_cast<FileHeader*>(base);}
+
+    AVLvertex& vertex(uint32_t v) const {
+        return reinterpret_cast<AVLvertex*>(base + sizeof(FileHeader))[v];
+    }
+
+    static size_t fileSize(uint32_t capacity){
+        return sizeof(FileHeader) + size_t(capacity) * sizeof(AVLvertex);
+    }
+
+    /* map "size" bytes of the open file, returning nullptr on failure */
+    char* mapFile(size_t size) const;
+
+    /* extend the file and the mapping to hold "capacity" slots. The method
+     * returns false (and leaves the tree as it was) if the file could not be
+     * extended */
+    bool grow(uint32_t capacity);
+
+    /* the recursive method to traverse the tree in an inorder manner, while
+     * applying the user supplied function to a vertex's key when visiting it */
+    template <class Func>
+    void inorderAux(uint32_t curr_root, Func& doSomething){
+        if(curr_root == NIL){
+            return;
+        }
+        inorderAux(vertex(curr_root).left, doSomething);
+        doSomething(vertex(curr_root).key);
+        inorderAux(vertex(curr_root).right, doSomething);
+    }
+
+    /* calculate the height of the given vertex */
+    int getHeight(uint32_t v) const;
+
+    /* calculate and update the height of the given vertex */
+    void updateHeight(uint32_t v);
+
+    /* calculate the balance factor of the given vertex */
+    int getBF(uint32_t v) const;
+
+    /* search a vertex with a matching key in the tree in an iterative manner.
+     * return it's index if found or NIL otherwise */
+    uint32_t searchVertex(const KeyType& key) const;
+
+    /* preform a right (left) rotation to the given vertex. The method returns
+     * the root of the new subtree */
+    uint32_t rotateRight(uint32_t v);
+    uint32_t rotateLeft(uint32_t v);
+
+    /* rebalance the given vertex if it's balance factor is not between -1 and
+     * 1 */
+    uint32_t rebalanceVertex(uint32_t curr_root);
+
+    /* walk back up the path of links (path[0] being the root in the header)
+     * that was taken to reach an inserted or deleted vertex, see AVL_tree */
+    void rebalancePath(uint32_t* path[], int depth);
+
+    /* make sure the next call to createVertex() takes a free slot or fits in
+     * the file. The links on a path point into the mapping, so it must not
+     * be remapped between a search and an insertion. The method returns
+     * false if the tree is read only or the file could not grow */
+    bool reserveSlot();
+
+    /* construct a vertex in a free slot, or after the used slots, and return
+     * it's index */
+    uint32_t createVertex(const KeyType& key, const DataType& data);
+
+    /* return the slot of the given vertex to the free list */
+    void destroyVertex(uint32_t v);
+
+    /* search a vertex with a matching key while recording the links that
+     * lead to it, see AVL_tree */
+    uint32_t* searchLink(const KeyType& key, uint32_t* path[], int& depth);
+
+    /* insert a new vertex to the empty link at the end of the given path and
+     * rebalance the path. reserveSlot() must be called before the path is
+     * recorded. The method returns the new vertex */
+    uint32_t insertAtLink(uint32_t* link, uint32_t* path[], int depth,
+            const KeyType& key, const DataType& data);
+
+    /* build a perfectly balanced tree out of the next "size" (key, data)
+     * pairs of a sorted sequence, see AVL_tree */
+    template <class InputIt>
+    uint32_t buildBalancedTree(InputIt& it, uint32_t size);
+
+public:
+
+    /* the ways to open an existing tree file */
+    enum OpenMode {READ_ONLY, READ_WRITE};
+
+    /* a bidirectional iterator over the keys of the tree in an inorder
+     * manner, keeping the path from the root like AVL_tree::iterator. An
+     * iterator is invalidated by any insertion, deletion or compaction */
+    class iterator{
+        const MappedAVL_tree* tree;
+        uint32_t path[MAX_HEIGHT];
+        /* the number of vertexes on the path, 0 for the end iterator */
+        int depth;
+
+        explicit iterator(const MappedAVL_tree* tree) : tree(tree),
+                                                        depth(0) {}
+
+        const AVLvertex& vertex(uint32_t v) const {return tree->vertex(v);}
+
+        /* push the leftmost (or rightmost) path of the subtree which it's
+         * root is curr_root */
+        void descendLeft(uint32_t curr_root){
+            while(curr_root != NIL){
+                path[depth++] = curr_root;
+                curr_root = vertex(curr_root).left;
+            }
+        }
+
+        void descendRight(uint32_t curr_root){
+            while(curr_root != NIL){
+                path[depth++] = curr_root;
+                curr_root = vertex(curr_root).right;
+            }
+        }
+
+        friend class MappedAVL_tree;
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef KeyType value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const KeyType* pointer;
+        typedef const KeyType& reference;
+
+        iterator() : tree(nullptr), depth(0) {}
+
+        /* only the used part of the path is copied */
+        iterator(const iterator& other) : tree(other.tree), depth(other.depth){
+            for(int i = 0; i < depth; i++){
+                path[i] = other.path[i];
+            }
+        }
+
+        iterator& operator=(const iterator& other){
+            tree = other.tree;
+            depth = other.depth;
+            for(int i = 0; i < depth; i++){
+                path[i] = other.path[i];
+            }
+            return *this;
+        }
+
+        const KeyType& operator*() const {return vertex(path[depth - 1]).key;}
+
+        const KeyType* operator->() const {
+            return &vertex(path[depth - 1]).key;
+        }
+
+        /* the data held by the current vertex */
+        const DataType& data() const {return vertex(path[depth - 1]).data;}
+
+        iterator& operator++(){
+            uint32_t curr = path[depth - 1];
+            if(vertex(curr).right != NIL){
+                /* the successor is the minimum of the right subtree */
+                descendLeft(vertex(curr).right);
+                return *this;
+            }
+
+            /* otherwise it's the first ancestor we reach from it's left
+             * subtree */
+            depth--;
+            while(depth > 0 && vertex(path[depth - 1]).right == curr){
+                curr = path[--depth];
+            }
+            return *this;
+        }
+
+        iterator operator++(int){
+            iterator prev(*this);
+            ++*this;
+            return prev;
+        }
+
+        iterator& operator--(){
+            if(depth == 0){
+                /* the predecessor of the end is the maximum of the tree */
+                descendRight(tree->root());
+                return *this;
+            }
+
+            uint32_t curr = path[depth - 1];
+            if(vertex(curr).left != NIL){
+                descendRight(vertex(curr).left);
+                return *this;
+            }
+
+            depth--;
+            while(depth > 0 && vertex(path[depth - 1]).left == curr){
+                curr = path[--depth];
+            }
+            return *this;
+        }
+
+        iterator operator--(int){
+            iterator prev(*this);
+            --*this;
+            return prev;
+        }
+
+        bool operator==(const iterator& other) const {
+            if(depth == 0 || other.depth == 0){
+                return depth == other.depth;
+            }
+            return path[depth - 1] == other.path[other.depth - 1];
+        }
+
+        bool operator!=(const iterator& other) const {
+            return !(*this == other);
+        }
+    };
+
+    /* constructor, of a tree with no file. create() or open() attach it to
+     * one */
+    MappedAVL_tree();
+
+    explicit MappedAVL_tree(const Compare& compare);
+
+    /* destructor, which unmaps the file. The changes are left to the OS to
+     * write, see sync() */
+    ~MappedAVL_tree();
+
+    MappedAVL_tree(const MappedAVL_tree& tree) = delete;
+    MappedAVL_tree& operator=(const MappedAVL_tree& tree) = delete;
+
+    /* create an empty tree file at "path" with room for "capacity" vertexes,
+     * replacing any file that was there, and open it for writing. The method
+     * returns false if the file could not be created */
+    bool create(const std::string& path, uint32_t capacity = 1024);
+
+    /* open an existing tree file in O(1). The method returns false if the
+     * file could not be opened or mapped, or is not a tree of this KeyType
+     * and DataType */
+    bool open(const std::string& path, OpenMode mode = READ_ONLY);
+
+    /* unmap and close the file, if the tree has one */
+    void close();
+
+    /* write the changes to the disk. The method returns false if it failed */
+    bool sync();
+
+    /* return true if the tree is attached to a file */
+    bool isOpen() const {return base != nullptr;}
+
+    /* return true if the tree can't be changed */
+    bool isReadOnly() const {return read_only;}
+
+    /* return true if a vertex with a matching key exists int the tree, false
+     * otherwise  */
+    bool keyExists(const KeyType& key) const;
+
+    /* the interface method to insert a vertex with a "key" and a copy of
+     * "data" to the tree. The method returns false if the tree is read only
+     * or the file could not grow */
+    bool insertKey(const KeyType& key, const DataType& data);
+
+    /* insert a vertex with "key" and "data", or if the key is already in the
+     * tree replace the data it holds. The method returns false if the tree
+     * is read only or the file could not grow */
+    bool insertOrAssign(const KeyType& key, const DataType& data);
+
+    /* the interface method to delete the vertex with the matching key from
+     * the tree. The method returns false if the key is not in the tree or the
+     * tree is read only. The slot of the vertex is reused by a later
+     * insertion */
+    bool deleteKey(const KeyType& key);
+
+    /* return the pointer to the data that the vertex with the matching key
+     * holds inside the mapping, or nullptr if the key is not in the tree */
+    const DataType* getData(const KeyType& key) const;
+
+    /* delete every vertex from the tree, keeping the size of the file */
+    bool clear();
+
+    /* replace the content of the tree with the (key, data) pairs in the
+     * range [first, last), which must be sorted by key. The tree is built
+     * perfectly balanced in O(n) and laid out in breadth first order. The
+     * method returns false if the tree is read only or the file could not
+     * grow */
+    template <class ForwardIt>
+    bool assignSorted(ForwardIt first, ForwardIt last);
+
+    /* the interface method to traverse the tree in an inorder manner, while
+     * applying the user supplied function to a vertex's key when visiting it */
+    template <class Func>
+    void inorder(Func& doSomething){inorderAux(root(), doSomething);}
+
+    /* return the number of keys in the tree */
+    uint32_t size() const {
+        return base == nullptr ? 0 : header().slot_count - header().free_count;
+    }
+
+    /* rewrite the slots of the file in breadth first order, dropping the free
+     * slots. Takes O(n) time and O(n) temporary memory, so it is meant to be
+     * called once in a while, e.g. after a batch of updates. The method
+     * returns false if the tree is read only */
+    bool compact();
+
+    /* iterators to the minimal key of the tree and past the maximal one */
+    iterator begin() const;
+    iterator end() const {return iterator(this);}
+
+    /* return an iterator to the first key that is not less than "key", or
+     * end() if there is no such key */
+    iterator lowerBound(const KeyType& key) const;
+
+    /* return an iterator to the first key that is greater than "key", or
+     * end() if there is no such key */
+    iterator upperBound(const KeyType& key) const;
+
+    /* return the range of keys that are equal to "key" */
+    std::pair<iterator, iterator> equalRange(const KeyType& key) const;
+
+private:
+    uint32_t root() const {return base == nullptr ? NIL : header().root;}
+};
+
+template<class KeyType, class DataType, class Compare>
+MappedAVL_tree<KeyType, DataType, Compare>::MappedAVL_tree()
+        : fd(-1), base(nullptr), mapped_size(0), read_only(true) {}
+
+template<class KeyType, class DataType, class Compare>
+MappedAVL_tree<KeyType, DataType, Compare>::MappedAVL_tree(const Compare& compare)
+        : compare(compare), fd(-1), base(nullptr), mapped_size(0),
+          read_only(true) {}
+
+template<class KeyType, class DataType, class Compare>
+MappedAVL_tree<KeyType, DataType, Compare>::~MappedAVL_tree() {
+    close();
+}
+
+template<class KeyType, class DataType, class Compare>
+char* MappedAVL_tree<KeyType, DataType, Compare>::mapFile(size_t size) const {
+    int protection = read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+    void* mapping = mmap(nullptr, size, protection, MAP_SHARED, fd, 0);
+    if(mapping == MAP_FAILED){
+        return nullptr;
+    }
+    return static_cast<char*>(mapping);
+}
+
+template<class KeyType, class DataType, class Compare>
+bool MappedAVL_tree<KeyType, DataType, Compare>::create(const std::string& path,
+        uint32_t capacity) {
+    close();
+    if(capacity >= NIL){
+        return false;
+    }
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        return false;
+    }
+    read_only = false;
+    size_t size = fileSize(capacity);
+    if(ftruncate(fd, off_t(size)) != 0 || (base = mapFile(size)) == nullptr){
+        close();
+        return false;
+    }
+    mapped_size = size;
+
+    FileHeader& h = header();
+    std::memset(&h, 0, sizeof(FileHeader));
+    std::memcpy(h.magic, "AVLMMAP", sizeof(h.magic));
+    h.version = VERSION;
+    h.key_size = sizeof(KeyType);
+    h.data_size = sizeof(DataType);
+    h.vertex_size = sizeof(AVLvertex);
+    h.root = NIL;
+    h.free_list = NIL;
+    h.capacity = capacity;
+    return true;
+}
+
+template<class KeyType, class DataType, class Compare>
+bool MappedAVL_tree<KeyType, DataType, Compare>::open(const std::string& path,
+        OpenMode mode) {
+    close();
+
+    read_only = mode == READ_ONLY;
+    fd = ::open(path.c_str(), read_only ? O_RDONLY : O_RDWR);
+    if(fd < 0){
+        return false;
+    }
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) != 0 ||
+            size_t(file_stat.st_size) < sizeof(FileHeader) ||
+            (base = mapFile(size_t(file_stat.st_size))) == nullptr){
+        close();
+        return false;
+    }
+    mapped_size = size_t(file_stat.st_size);
+
+    /* only the header is checked, the vertexes are paged in by the searches */
+    const FileHeader& h = header();
+    if(std::memcmp(h.magic, "AVLMMAP", sizeof(h.magic)) != 0 ||
+            h.version != VERSION || h.key_size != sizeof(KeyType) ||
+            h.data_size != sizeof(DataType) ||
+            h.vertex_size != sizeof(AVLvertex) ||
+            h.slot_count > h.capacity || h.free_count > h.slot_count ||
+            mapped_size < fileSize(h.capacity) ||
+            (h.root != NIL && h.root >= h.slot_count)){
+        close();
+        return false;
+    }
+    return true;
+}
+
+template<class KeyType, class DataType, class Compare>
+void MappedAVL_tree<KeyType, DataType, Compare>::close() {
+    if(base != nullptr){
+        munmap(base, mapped_size);
+        base = nullptr;
+        mapped_size = 0;
+    }
+    if(fd >= 0){
+        ::close(fd);
+        fd = -1;
+    }
+    read_only = true;
+}
+
+template<class KeyType, class DataType, class Compare>
+bool MappedAVL_tree<KeyType, DataType, Compare>::sync() {
+    if(base == nullptr){
+        return false;
+    }
+    return read_only || msync(base, mapped_size, MS_SYNC) == 0;
+}
+
+template<class KeyType, class DataType, class Compare>
+bool MappedAVL_tree<KeyType, DataType, Compare>::grow(uint32_t capacity) {
+    size_t size = fileSize(capacity);
+    if(ftruncate(fd, off_t(size)) != 0){
+        return false;
+    }
+
+    /* the file is mapped again before the old mapping is dropped, so a
+     * failure leaves the tree on the old mapping */
+    char* new_base = mapFile(size);
+    if(new_base == nullptr){
+        return false;
+    }
+    munmap(base, mapped_size);
+    base = new_base;
+    mapped_size = size;
+    header().capacity = capacity;
+    return true;
+}
+
+template<class KeyType, class DataType, class Compare>
+bool MappedAVL_tree<KeyType, DataType, Compare>::clear() {
+    if(base == nullptr || read_only){
+        return false;
+    }
+    FileHeader& h = header();
+    h.root = NIL;
+    h.free_list = NIL;
+    h.free_count = 0;
+    h.slot_count = 0;
+    return true;
+}
+
+template<class KeyType, class DataType, class Compare>
+template <class ForwardIt>
+bool MappedAVL_tree<KeyType, DataType, Compare>::assignSorted(ForwardIt first,
+        ForwardIt last) {
+    if(!clear()){
+        return false;
+    }
+
+    size_t size = std::distance(first, last);
+    if(size >= NIL){
+        return false;
+    }
+    if(size > header().capacity && !grow(uint32_t(size))){
+        return false;
+    }
+    header().root = buildBalancedTree(first, uint32_t(size));
+    return compact();
+}
+
+template<class KeyType, class DataType, class Compare>
+template <class InputIt>
+uint32_t MappedAVL_tree<KeyType, DataType, Compare>::buildBalancedTree(InputIt& it,
+        uint32_t size) {
+    if(size == 0){
+        return NIL;
+    }
+
+    uint32_t left_size = (size - 1) / 2;
+    uint32_t left_subtree = buildBalancedTree(it, left_size);
+
+    uint32_t new_root = createVertex(it->first, it->second);
+    ++it;
+    vertex(new_root).left = left_subtree;
+    uint32_t right_subtree = buildBalancedTree(it, size - 1 - left_size);
+    vertex(new_root).right = right_subtree;
+
+    updateHeight(new_root);
+    return new_root;
+}
+
+template<class KeyType, class DataType, class Compare>
+bool MappedAVL_tree<KeyType, DataType, Compare>::keyExists(const KeyType& key) const {
+    return searchVertex(key) != NIL;
+}
+
+template<class KeyType, class DataType, class Compare>
+const DataType* MappedAVL_tree<KeyType, DataType, Compare>::getData(const KeyType& key) const {
+    uint32_t v = searchVertex(key);
+    if(v == NIL){
+        return nullptr;
+    }
+
+    return &vertex(v).data;
+}
+
+template<class KeyType, class DataType, class Compare>
+uint32_t MappedAVL_tree<KeyType, DataType, Compare>::searchVertex
+(const KeyType& key) const {
+    uint32_t curr_root = root();
+    while (curr_root != NIL) {
+        const AVLvertex& v = vertex(curr_root);
+        int result = compare(v.key, key);
+        if (result == 0) {
+            return curr_root;
+        } else if (result < 0) {
+            curr_root = v.right;
+        } else {
+            curr_root = v.left;
+        }
+    }
+    return NIL;
+}
+
+template<class KeyType, class DataType, class Compare>
+int MappedAVL_tree<KeyType, DataType, Compare>::getHeight(uint32_t v) const {
+    if(v == NIL){
+        return 0;
+    } else {
+        return vertex(v).height;
+    }
+}
+
+template<class KeyType, class DataType, class Compare>
+void MappedAVL_tree<KeyType, DataType, Compare>::updateHeight(uint32_t v) {
+    int left_height = getHeight(vertex(v).left);
+    int right_height = getHeight(vertex(v).right);
+    vertex(v).height = 1 + (left_height > right_height ? left_height
+                                                       : right_height);
+}
+
+template<class KeyType, class DataType, class Compare>
+int MappedAVL_tree<KeyType, DataType, Compare>::getBF(uint32_t v) const {
+    if(v == NIL){
+        return 0;
+    } else{
+        return getHeight(vertex(v).left) - getHeight(vertex(v).right);
+    }
+}
+
+template<class KeyType, class DataType, class Compare>
+uint32_t MappedAVL_tree<KeyType, DataType, Compare>::rotateRight(uint32_t v) {
+    uint32_t to_rotate = v;
+    uint32_t to_rotate_left_child = vertex(to_rotate).left;
+    uint32_t right_subtree = vertex(to_rotate_left_child).right;
+
+    /* preform rotation */
+    vertex(to_rotate_left_child).right = to_rotate;
+    vertex(to_rotate).left = right_subtree;
+
+    /* update the height of the vertexes that their subtree changed */
+    updateHeight(to_rotate);
+    updateHeight(to_rotate_left_child);
+
+    /* return the root of the new subtree */
+    return to_rotate_left_child;
+}
+
+template<class KeyType, class DataType, class Compare>
+uint32_t MappedAVL_tree<KeyType, DataType, Compare>::rotateLeft(uint32_t v) {
+    uint32_t to_rotate = v;
+    uint32_t to_rotate_right_child = vertex(to_rotate).right;
+    uint32_t left_subtree = vertex(to_rotate_right_child).left;
+
+    /* preform rotation */
+    vertex(to_rotate_right_child).left = to_rotate;
+    vertex(to_rotate).right = left_subtree;
+
+    /* update the height of the vertexes that their subtree changed */
+    updateHeight(to_rotate);
+    updateHeight(to_rotate_right_child);
+
+    /* return the root of the new subtree */
+    return to_rotate_right_child;
+}
+
+template<class KeyType, class DataType, class Compare>
+uint32_t MappedAVL_tree<KeyType, DataType, Compare>::rebalanceVertex
+(uint32_t curr_root){
+
+    int BF = getBF(curr_root);
+
+    if(BF >= -1 && BF <= 1) {
+        /* balance factor is in bound therefore no rotations are needed */
+        return curr_root;
+    }
+
+    if(BF == 2){
+        if(getBF(vertex(curr_root).left) >= 0){
+            /* LL rotation */
+            return rotateRight(curr_root);
+        } else {
+            /* LR rotation */
+            vertex(curr_root).left = rotateLeft(vertex(curr_root).left);
+            return rotateRight(curr_root);
+        }
+    }
+
+    if(BF == -2){
+        if(getBF(vertex(curr_root).right) <= 0){
+            /* RR rotation */
+            return rotateLeft(curr_root);
+        } else {
+            /* RL rotation */
+            vertex(curr_root).right = rotateRight(vertex(curr_root).right);
+            return rotateLeft(curr_root);
+        }
+    }
+
+    return curr_root;
+}
+
+template<class KeyType, class DataType, class Compare>
+void MappedAVL_tree<KeyType, DataType, Compare>::rebalancePath(uint32_t* path[],
+        int depth) {
+    for(int i = depth - 1; i >= 0; i--){
+        uint32_t curr_root = *path[i];
+        int old_height = vertex(curr_root).height;
+
+        updateHeight(curr_root);
+
+        /* rebalance the current root if needed */
+        *path[i] = rebalanceVertex(curr_root);
+
+        if(vertex(*path[i]).height == old_height){
+            return;
+        }
+    }
+}
+
+template<class KeyType, class DataType, class Compare>
+bool MappedAVL_tree<KeyType, DataType, Compare>::reserveSlot() {
+    if(base == nullptr || read_only){
+        return false;
+    }
+    FileHeader& h = header();
+    if(h.free_list != NIL || h.slot_count < h.capacity){
+        return true;
+    }
+    if(h.capacity >= NIL - 1){
+        return false;
+    }
+
+    uint64_t capacity = h.capacity < 16 ? 16 : 2 * uint64_t(h.capacity);
+    if(capacity >= NIL){
+        capacity = NIL - 1;
+    }
+    return grow(uint32_t(capacity));
+}
+
+template<class KeyType, class DataType, class Compare>
+uint32_t MappedAVL_tree<KeyType, DataType, Compare>::createVertex(const KeyType& key,
+        const DataType& data) {
+    FileHeader& h = header();
+    uint32_t v;
+    if(h.free_list != NIL){
+        v = h.free_list;
+        h.free_list = vertex(v).left;
+        h.free_count--;
+    } else {
+        v = h.slot_count++;
+    }
+
+    AVLvertex& new_vertex = vertex(v);
+    new_vertex.key = key;
+    new_vertex.data = data;
+    new_vertex.left = NIL;
+    new_vertex.right = NIL;
+    new_vertex.height = 1;
+    return v;
+}
+
+template<class KeyType, class DataType, class Compare>
+void MappedAVL_tree<KeyType, DataType, Compare>::destroyVertex(uint32_t v) {
+    FileHeader& h = header();
+    vertex(v).left = h.free_list;
+    h.free_list = v;
+    h.free_count++;
+}
+
+template<class KeyType, class DataType, class Compare>
+uint32_t* MappedAVL_tree<KeyType, DataType, Compare>::searchLink(const KeyType& key,
+        uint32_t* path[], int& depth) {
+    uint32_t* link = &header().root;
+    while(*link != NIL){
+        int result = compare(vertex(*link).key, key);
+        if(result == 0){
+            break;
+        }
+        path[depth++] = link;
+        if(result < 0){
+            link = &vertex(*link).right;
+        } else {
+            link = &vertex(*link).left;
+        }
+    }
+    return link;
+}
+
+template<class KeyType, class DataType, class Compare>
+uint32_t MappedAVL_tree<KeyType, DataType, Compare>::insertAtLink(uint32_t* link,
+        uint32_t* path[], int depth, const KeyType& key, const DataType& data) {
+    uint32_t new_vertex = createVertex(key, data);
+    *link = new_vertex;
+
+    rebalancePath(path, depth);
+
+    /* rotations move vertexes around but never replace them, so the new
+     * vertex is still the one holding the key */
+    return new_vertex;
+}
+
+template<class KeyType, class DataType, class Compare>
+bool MappedAVL_tree<KeyType, DataType, Compare>::insertKey(const KeyType& key,
+        const DataType& data) {
+    if(!reserveSlot()){
+        return false;
+    }
+
+    uint32_t* path[MAX_HEIGHT];
+    int depth = 0;
+
+    /* preform the usual insertion like in a regular binary search tree,
+     * while recording the links that lead to the new vertex */
+    uint32_t* link = &header().root;
+    while(*link != NIL){
+        path[depth++] = link;
+        if(compare(vertex(*link).key, key) < 0){
+            link = &vertex(*link).right;
+        } else {
+            link = &vertex(*link).left;
+        }
+    }
+    insertAtLink(link, path, depth, key, data);
+    return true;
+}
+
+template<class KeyType, class DataType, class Compare>
+bool MappedAVL_tree<KeyType, DataType, Compare>::insertOrAssign(const KeyType& key,
+        const DataType& data) {
+    if(!reserveSlot()){
+        return false;
+    }
+
+    uint32_t* path[MAX_HEIGHT];
+    int depth = 0;
+    uint32_t* link = searchLink(key, path, depth);
+    if(*link != NIL){
+        vertex(*link).data = data;
+        return true;
+    }
+
+    insertAtLink(link, path, depth, key, data);
+    return true;
+}
+
+template<class KeyType, class DataType, class Compare>
+bool MappedAVL_tree<KeyType, DataType, Compare>::deleteKey(const KeyType& key) {
+    if(base == nullptr || read_only){
+        return false;
+    }
+
+    uint32_t* path[MAX_HEIGHT];
+    int depth = 0;
+    uint32_t* link = searchLink(key, path, depth);
+    if(*link == NIL){
+        /* the key is not in the tree */
+        return false;
+    }
+
+    /* preform the usual deletion like in a regular binary search tree */
+    uint32_t to_delete = *link;
+    if(vertex(to_delete).left == NIL || vertex(to_delete).right == NIL){
+        /* no children or one child case */
+        if(vertex(to_delete).left != NIL){
+            *link = vertex(to_delete).left;
+        } else {
+            *link = vertex(to_delete).right;
+        }
+    } else {
+        /* 2 children case: the successor's key and data are copied to the
+         * vertex, and the successor is unlinked from the right subtree */
+        path[depth++] = link;
+        uint32_t* successor_link = &vertex(to_delete).right;
+        while(vertex(*successor_link).left != NIL){
+            path[depth++] = successor_link;
+            successor_link = &vertex(*successor_link).left;
+        }
+        uint32_t successor = *successor_link;
+        vertex(to_delete).key = vertex(successor).key;
+        vertex(to_delete).data = vertex(successor).data;
+        *successor_link = vertex(successor).right;
+        to_delete = successor;
+    }
+    destroyVertex(to_delete);
+
+    rebalancePath(path, depth);
+
+    return true;
+}
+
+template<class KeyType, class DataType, class Compare>
+bool MappedAVL_tree<KeyType, DataType, Compare>::compact() {
+    if(base == nullptr || read_only){
+        return false;
+    }
+
+    /* list the live vertexes in breadth first order, the order vector itself
+     * being the queue of the traversal */
+    std::vector<uint32_t> order;
+    order.reserve(size());
+    if(root() != NIL){
+        order.push_back(root());
+        for(std::size_t i = 0; i < order.size(); i++){
+            const AVLvertex& v = vertex(order[i]);
+            if(v.left != NIL){
+                order.push_back(v.left);
+            }
+            if(v.right != NIL){
+                order.push_back(v.right);
+            }
+        }
+    }
+
+    /* the vertexes are copied aside, since a slot may be overwritten before
+     * it's own vertex moves */
+    std::vector<uint32_t> new_index(header().slot_count);
+    for(std::size_t i = 0; i < order.size(); i++){
+        new_index[order[i]] = i;
+    }
+    std::vector<AVLvertex> compacted;
+    compacted.reserve(order.size());
+    for(uint32_t old_index : order){
+        compacted.push_back(vertex(old_index));
+        AVLvertex& moved = compacted.back();
+        if(moved.left != NIL){
+            moved.left = new_index[moved.left];
+        }
+        if(moved.right != NIL){
+            moved.right = new_index[moved.right];
+        }
+    }
+    if(!compacted.empty()){
+        std::memcpy(&vertex(0), compacted.data(),
+                compacted.size() * sizeof(AVLvertex));
+    }
+
+    FileHeader& h = header();
+    h.root = compacted.empty() ? NIL : 0;
+    h.free_list = NIL;
+    h.free_count = 0;
+    h.slot_count = compacted.size();
+    return true;
+}
+
+template<class KeyType, class DataType, class Compare>
+typename MappedAVL_tree<KeyType, DataType, Compare>::iterator
+MappedAVL_tree<KeyType, DataType, Compare>::begin() const {
+    iterator it(this);
+    it.descendLeft(root());
+    return it;
+}
+
+template<class KeyType, class DataType, class Compare>
+typename MappedAVL_tree<KeyType, DataType, Compare>::iterator
+MappedAVL_tree<KeyType, DataType, Compare>::lowerBound(const KeyType& key) const {
+    iterator it(this);
+
+    /* the path to the last vertex we turned left at is the path to the
+     * first key which is not less than "key" */
+    int found_depth = 0;
+    uint32_t curr_root = root();
+    while(curr_root != NIL){
+        it.path[it.depth++] = curr_root;
+        if(compare(vertex(curr_root).key, key) < 0){
+            curr_root = vertex(curr_root).right;
+        } else {
+            found_depth = it.depth;
+            curr_root = vertex(curr_root).left;
+        }
+    }
+    it.depth = found_depth;
+    return it;
+}
+
+template<class KeyType, class DataType, class Compare>
+typename MappedAVL_tree<KeyType, DataType, Compare>::iterator
+MappedAVL_tree<KeyType, DataType, Compare>::upperBound(const KeyType& key) const {
+    iterator it(this);
+
+    int found_depth = 0;
+    uint32_t curr_root = root();
+    while(curr_root != NIL){
+        it.path[it.depth++] = curr_root;
+        if(compare(key, vertex(curr_root).key) < 0){
+            found_depth = it.depth;
+            curr_root = vertex(curr_root).left;
+        } else {
+            curr_root = vertex(curr_root).right;
+        }
+    }
+    it.depth = found_depth;
+    return it;
+}
+
+template<class KeyType, class DataType, class Compare>
+std::pair<typename MappedAVL_tree<KeyType, DataType, Compare>::iterator,
+        typename MappedAVL_tree<KeyType, DataType, Compare>::iterator>
+MappedAVL_tree<KeyType, DataType, Compare>::equalRange(const KeyType& key) const {
+    return std::make_pair(lowerBound(key), upperBound(key));
+}
+
+#endif //WET1CPP_MAPPEDAVL_TREE_H
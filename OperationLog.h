@@ -0,0 +1,437 @@
+#ifndef WET1CPP_OPERATIONLOG_H
+#define WET1CPP_OPERATIONLOG_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "TreeSnapshot.h"
+
+/* an append only log of tree updates (POSIX), kept in segment files:
+ *   header  - the magic "AVLOPLOG", the format version and the content kind
+ *             (see SnapshotHeader::Kind)
+ *   records - each one the 32 bit size and 32 bit checksum of it's payload,
+ *             followed by the payload: the operation byte and it's
+ *             arguments, as written by the codecs of TreeSnapshot.h
+ * A record is appended to a buffer in memory and becomes durable once the
+ * buffer is written and synced. Syncs are shared (group commit): a thread
+ * that waits for it's record syncs every record appended so far, and the
+ * threads that wait meanwhile are released by the same sync. With a flush
+ * interval, a background thread also syncs the buffer every interval, so
+ * updates may return before their record is durable.
+ *
+ * A crash may leave a torn record at the end of the last segment. Reading
+ * a segment stops at the first record which is short or fails it's
+ * checksum, and reports where the intact records end */
+class OperationLog{
+public:
+    enum Operation : uint8_t {INSERT = 1, DELETE = 2};
+
+private:
+    class SegmentHeader{
+    public:
+        char magic[8];
+        uint32_t version;
+        uint32_t kind;
+    };
+
+    static const uint32_t VERSION = 1;
+
+    /* guards everything below */
+    std::mutex lock;
+    /* signalled when a flush ends, and to wake the flusher thread */
+    std::condition_variable flushed;
+    std::condition_variable wake;
+    int fd;
+    /* the records which were appended but not written yet, and the buffer
+     * a flush writes them from while new records are appended */
+    std::vector<char> pending;
+    std::vector<char> writing;
+    /* the sequence numbers of the last appended and the last durable
+     * record */
+    uint64_t appended;
+    uint64_t durable;
+    /* the size of the segment, pending records included */
+    uint64_t size;
+    bool flushing;
+    bool failed;
+    bool stopping;
+    std::chrono::milliseconds flush_interval;
+    std::thread flusher;
+
+    static bool writeAll(int fd, const char* data, size_t size){
+        while(size > 0){
+            ssize_t written = ::write(fd, data, size);
+            if(written < 0){
+                if(errno == EINTR){
+                    continue;
+                }
+                return false;
+            }
+            data += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    static bool syncFile(int fd){
+#if defined(__linux__)
+        return fdatasync(fd) == 0;
+#else
+        return fsync(fd) == 0;
+#endif
+    }
+
+    /* write and sync the pending records, with "guard" held on entry and on
+     * return. The lock is released while writing, so records can be
+     * appended meanwhile */
+    void flushPending(std::unique_lock<std::mutex>& guard);
+
+    /* the body of the flusher thread */
+    void flushPeriodically();
+
+    /* start a log on the open file */
+    void start(uint64_t initial_size);
+
+public:
+    /* constructor, of a log with no file. create() or openForAppend()
+     * attach it to a segment */
+    explicit OperationLog(std::chrono::milliseconds flush_interval =
+            std::chrono::milliseconds(0));
+
+    /* destructor, which syncs and closes the segment */
+    ~OperationLog();
+
+    OperationLog(const OperationLog& log) = delete;
+    OperationLog& operator=(const OperationLog& log) = delete;
+
+    /* create an empty segment at "path", replacing any file that was there.
+     * The method returns false if the segment could not be created */
+    bool create(const std::string& path, SnapshotHeader::Kind kind);
+
+    /* append to the segment at "path", dropping whatever follows the first
+     * "valid_size" bytes (a torn record, see readSegment()). The method
+     * returns false if the segment could not be opened */
+    bool openForAppend(const std::string& path, uint64_t valid_size);
+
+    /* sync the pending records, stop the flusher and close the segment */
+    void close();
+
+    /* append a record with the given payload. The method returns the
+     * sequence number of the record, see waitDurable() */
+    uint64_t append(const char* payload, size_t payload_size);
+
+    /* wait until the record with the given sequence number is synced, by
+     * syncing every pending record unless another thread does it already.
+     * The method returns false if a write or a sync failed */
+    bool waitDurable(uint64_t sequence);
+
+    /* wait until every record appended so far is synced */
+    bool sync();
+
+    /* return the size of the segment in bytes, pending records included */
+    uint64_t segmentSize();
+
+    /* return false once a write or a sync failed. The records appended from
+     * then on are not durable */
+    bool good();
+
+    /* read the segment at "path", calling "onRecord(in)" with a reader over
+     * the payload of every intact record, in order. "valid_size" is set to
+     * the size of the intact part of the segment, which is 0 if even the
+     * header is missing. The method returns false if the segment can't be
+     * opened, was written for another kind of tree, or "onRecord" returns
+     * false */
+    template <class Func>
+    static bool readSegment(const std::string& path, SnapshotHeader::Kind kind,
+            Func onRecord, uint64_t& valid_size, uint64_t& file_size);
+
+    /* sync the directory that holds "path", so a file created or renamed
+     * there survives a crash */
+    static bool syncDirectory(const std::string& path);
+};
+
+/* the stream the codecs write the payload of a record to */
+class LogRecordWriter{
+    std::vector<char>& buffer;
+
+public:
+    explicit LogRecordWriter(std::vector<char>& buffer) : buffer(buffer) {}
+
+    void write(const void* data, size_t size){
+        const char* bytes = static_cast<const char*>(data);
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    }
+
+    template <class T>
+    void writeValue(const T& value){
+        write(&value, sizeof(T));
+    }
+};
+
+/* the stream the codecs read the payload of a record from */
+class LogRecordReader{
+    const char* position;
+    const char* end;
+
+public:
+    LogRecordReader(const char* data, size_t size) : position(data),
+                                                     end(data + size) {}
+
+    uint64_t bytesLeft() const {return end - position;}
+
+    bool read(void* data, size_t size){
+        if(size > bytesLeft()){
+            return false;
+        }
+        std::memcpy(data, position, size);
+        position += size;
+        return true;
+    }
+
+    template <class T>
+    bool readValue(T& value){
+        return read(&value, sizeof(T));
+    }
+};
+
+inline OperationLog::OperationLog(std::chrono::milliseconds flush_interval)
+        : fd(-1), appended(0), durable(0), size(0), flushing(false),
+          failed(false), stopping(false), flush_interval(flush_interval) {}
+
+inline OperationLog::~OperationLog() {
+    close();
+}
+
+inline void OperationLog::start(uint64_t initial_size) {
+    appended = 0;
+    durable = 0;
+    size = initial_size;
+    flushing = false;
+    failed = false;
+    stopping = false;
+    if(flush_interval.count() > 0){
+        flusher = std::thread(&OperationLog::flushPeriodically, this);
+    }
+}
+
+inline bool OperationLog::create(const std::string& path,
+        SnapshotHeader::Kind kind) {
+    close();
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        return false;
+    }
+
+    SegmentHeader header;
+    std::memcpy(header.magic, "AVLOPLOG", sizeof(header.magic));
+    header.version = VERSION;
+    header.kind = kind;
+    if(!writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header)) ||
+            !syncFile(fd) || !syncDirectory(path)){
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    start(sizeof(header));
+    return true;
+}
+
+inline bool OperationLog::openForAppend(const std::string& path,
+        uint64_t valid_size) {
+    close();
+    if(valid_size < sizeof(SegmentHeader)){
+        return false;
+    }
+    fd = ::open(path.c_str(), O_WRONLY);
+    if(fd < 0){
+        return false;
+    }
+    if(ftruncate(fd, off_t(valid_size)) != 0 ||
+            lseek(fd, 0, SEEK_END) != off_t(valid_size) || !syncFile(fd)){
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    start(valid_size);
+    return true;
+}
+
+inline void OperationLog::close() {
+    if(fd < 0){
+        return;
+    }
+    sync();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    if(flusher.joinable()){
+        flusher.join();
+    }
+    ::close(fd);
+    fd = -1;
+}
+
+inline uint64_t OperationLog::append(const char* payload,
+        size_t payload_size) {
+    SnapshotChecksum checksum;
+    checksum.update(payload, payload_size);
+    uint32_t frame[2] = {uint32_t(payload_size), uint32_t(checksum.value())};
+
+    std::lock_guard<std::mutex> guard(lock);
+    const char* frame_bytes = reinterpret_cast<const char*>(frame);
+    pending.insert(pending.end(), frame_bytes, frame_bytes + sizeof(frame));
+    pending.insert(pending.end(), payload, payload + payload_size);
+    size += sizeof(frame) + payload_size;
+    return ++appended;
+}
+
+inline void OperationLog::flushPending(std::unique_lock<std::mutex>& guard) {
+    flushing = true;
+    writing.swap(pending);
+    uint64_t target = appended;
+    guard.unlock();
+
+    bool ok = writeAll(fd, writing.data(), writing.size()) && syncFile(fd);
+    writing.clear();
+
+    guard.lock();
+    flushing = false;
+    if(ok){
+        durable = target;
+    } else {
+        failed = true;
+    }
+    flushed.notify_all();
+}
+
+inline bool OperationLog::waitDurable(uint64_t sequence) {
+    std::unique_lock<std::mutex> guard(lock);
+    while(durable < sequence && !failed){
+        if(flushing){
+            /* the records appended before the running flush started are
+             * synced by it, the later ones by the next flush */
+            flushed.wait(guard);
+        } else {
+            flushPending(guard);
+        }
+    }
+    return durable >= sequence;
+}
+
+inline bool OperationLog::sync() {
+    uint64_t last;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(fd < 0){
+            return false;
+        }
+        last = appended;
+    }
+    return waitDurable(last);
+}
+
+inline void OperationLog::flushPeriodically() {
+    std::unique_lock<std::mutex> guard(lock);
+    while(!stopping){
+        wake.wait_for(guard, flush_interval);
+        if(!pending.empty() && !flushing && !failed){
+            flushPending(guard);
+        }
+    }
+}
+
+inline uint64_t OperationLog::segmentSize() {
+    std::lock_guard<std::mutex> guard(lock);
+    return size;
+}
+
+inline bool OperationLog::good() {
+    std::lock_guard<std::mutex> guard(lock);
+    return fd >= 0 && !failed;
+}
+
+template <class Func>
+bool OperationLog::readSegment(const std::string& path,
+        SnapshotHeader::Kind kind, Func onRecord, uint64_t& valid_size,
+        uint64_t& file_size) {
+    valid_size = 0;
+    file_size = 0;
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if(file == nullptr){
+        return false;
+    }
+    struct stat file_stat;
+    if(fstat(fileno(file), &file_stat) != 0){
+        std::fclose(file);
+        return false;
+    }
+    file_size = uint64_t(file_stat.st_size);
+
+    /* a segment that is shorter than it's header was torn while created */
+    SegmentHeader header;
+    if(std::fread(&header, 1, sizeof(header), file) != sizeof(header)){
+        std::fclose(file);
+        return true;
+    }
+    if(std::memcmp(header.magic, "AVLOPLOG", sizeof(header.magic)) != 0 ||
+            header.version != VERSION || header.kind != uint32_t(kind)){
+        std::fclose(file);
+        return false;
+    }
+    valid_size = sizeof(header);
+
+    std::vector<char> payload;
+    uint32_t frame[2];
+    while(std::fread(frame, 1, sizeof(frame), file) == sizeof(frame)){
+        uint64_t record_end = valid_size + sizeof(frame) + frame[0];
+        if(record_end > file_size){
+            break;
+        }
+        payload.resize(frame[0]);
+        if(std::fread(payload.data(), 1, payload.size(), file) !=
+                payload.size()){
+            break;
+        }
+        SnapshotChecksum checksum;
+        checksum.update(payload.data(), payload.size());
+        if(uint32_t(checksum.value()) != frame[1]){
+            break;
+        }
+
+        LogRecordReader in(payload.data(), payload.size());
+        if(!onRecord(in)){
+            std::fclose(file);
+            return false;
+        }
+        valid_size = record_end;
+    }
+    std::fclose(file);
+    return true;
+}
+
+inline bool OperationLog::syncDirectory(const std::string& path) {
+    std::string::size_type slash = path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." :
+                            slash == 0 ? "/" : path.substr(0, slash);
+    int directory_fd = ::open(directory.c_str(), O_RDONLY);
+    if(directory_fd < 0){
+        return false;
+    }
+    bool ok = fsync(directory_fd) == 0;
+    ::close(directory_fd);
+    return ok;
+}
+
+#endif //WET1CPP_OPERATIONLOG_H
@@ -0,0 +1,618 @@
+#ifndef WET2CPP_PERSISTENTAVLRANKTREE_H
+#define WET2CPP_PERSISTENTAVLRANKTREE_H
+
+#include <atomic>
+#include <utility>
+#include "Augmentation.h"
+
+/* a persistent version of AVLrankTree: every version of the tree shares the
+ * vertexes it didn't change with the versions it was made from. An update
+ * copies only the vertexes on the path to the key it inserts or deletes
+ * (and the few vertexes a rotation touches), so it takes O(log n) time and
+ * space, and snapshot() is O(1).
+ *
+ * Vertexes are reference counted, a vertex is changed in place only when
+ * the version being updated is the only one that can reach it, so a
+ * version that no snapshot was taken of is updated without copying at all.
+ * A version may be read by any number of threads while other versions are
+ * updated, and readers never wait for writers. A single version object must
+ * not be updated while it's read or copied by another thread */
+template <class KeyType, class Augmentation = KeySum<> >
+class PersistentAVLrankTree{
+public:
+    typedef typename Augmentation::value_type aggregate_type;
+
+private:
+    class AVLvertex{
+    public:
+        KeyType key;
+        AVLvertex *left, *right;
+        int height;
+        int count;
+        aggregate_type aggregate;
+        /* the number of versions and vertexes pointing at the vertex */
+        std::atomic<int> references;
+
+        explicit AVLvertex(const KeyType& key)
+                : key(key), left(nullptr), right(nullptr), height(1),
+                  count(1), aggregate(Augmentation::fromKey(key)),
+                  references(1) {}
+
+        /* a private copy of "v", which shares it's children */
+        explicit AVLvertex(const AVLvertex& v)
+                : key(v.key), left(v.left), right(v.right), height(v.height),
+                  count(v.count), aggregate(v.aggregate), references(1) {}
+    };
+
+    AVLvertex* root;
+
+    /* add a reference to the given vertex and return it */
+    static AVLvertex* acquire(AVLvertex* v);
+
+    /* drop a reference to the given vertex, deallocating it and dropping
+     * it's references to it's children if it was the last one */
+    static void release(AVLvertex* v);
+
+    /* take over a reference to "v" and return a reference to a vertex with
+     * the same content which only the caller can reach: "v" itself if the
+     * reference was it's only one, otherwise a copy */
+    static AVLvertex* makeMutable(AVLvertex* v);
+
+    static int getHeight(const AVLvertex* v);
+
+    static int getCount(const AVLvertex* v);
+
+    /* the aggregate of the given subtree, the identity for an empty one */
+    static aggregate_type getAggregate(const AVLvertex* v);
+
+    /* recalculate the height, count and aggregate of the given vertex from
+     * it's children */
+    static void updateVertex(AVLvertex* v);
+
+    /* the rotations and rebalancing take a mutable vertex and return the
+     * mutable root of the new subtree, copying the children they change */
+    static AVLvertex* rotateRight(AVLvertex* v);
+
+    static AVLvertex* rotateLeft(AVLvertex* v);
+
+    static AVLvertex* rebalanceVertex(AVLvertex* curr_root);
+
+    /* the recursive updates take over a reference to the subtree which it's
+     * root is curr_root and return a reference to the updated subtree */
+    static AVLvertex* insertRec(AVLvertex* curr_root, const KeyType& key);
+
+    /* "key" must be in the subtree */
+    static AVLvertex* deleteRec(AVLvertex* curr_root, const KeyType& key);
+
+    /* remove the vertex with the minimal key of the subtree, which it's key
+     * is stored in "min_key" */
+    static AVLvertex* removeMinVertex(AVLvertex* curr_root, KeyType& min_key);
+
+    /* return the number of keys in the tree that are not greater than
+     * "key" */
+    int countNotGreater(const KeyType& key) const;
+
+    /* prepend the aggregate of the "remaining_elements_count" largest keys
+     * of the subtree to "curr_aggregate" */
+    static void aggregateOfkLargestKeysRec(const AVLvertex* curr_root,
+            int& remaining_elements_count, aggregate_type& curr_aggregate);
+
+    /* the recursive method to traverse the tree in an inorder manner, while
+     * applying the user supplied function to a vertex's key when visiting it */
+    template <class Func>
+    static void inorderAux(const AVLvertex* curr_root, Func& doSomething){
+        if(curr_root == nullptr){
+            return;
+        }
+        inorderAux(curr_root->left, doSomething);
+        doSomething(curr_root->key);
+        inorderAux(curr_root->right, doSomething);
+    }
+
+public:
+
+    /* constructor  */
+    PersistentAVLrankTree();
+
+    /* destructor, which releases the vertexes of this version only */
+    ~PersistentAVLrankTree();
+
+    /* a copy is a snapshot of the tree, and takes O(1) time */
+    PersistentAVLrankTree(const PersistentAVLrankTree& tree);
+    PersistentAVLrankTree(PersistentAVLrankTree&& tree) noexcept;
+    PersistentAVLrankTree& operator=(PersistentAVLrankTree tree);
+
+    /* return a version of the tree which later updates of the tree don't
+     * affect, in O(1) time */
+    PersistentAVLrankTree snapshot() const {
+        return *this;
+    }
+
+    /* delete every key from this version of the tree */
+    void clear();
+
+    /* return true if a vertex with a matching key exists int the tree, false
+     * otherwise */
+    bool keyExists(const KeyType& key) const;
+
+    /* the interface methods to insert "key" to the tree or delete a
+     * matching key from it, which copy only the vertexes that other
+     * versions share */
+    void insertKey(KeyType key);
+    void deleteKey(KeyType key);
+
+    /* return a new version of the tree with "key" inserted or deleted,
+     * leaving this version unchanged */
+    PersistentAVLrankTree withKeyInserted(KeyType key) const;
+    PersistentAVLrankTree withKeyDeleted(KeyType key) const;
+
+    /* the interface method to traverse the tree in an inorder manner, while
+     * applying the user supplied function to every key */
+    template <class Func>
+    void inorder(Func& doSomething) const {
+        inorderAux(root, doSomething);
+    }
+
+    /* return the number of keys in the tree */
+    int size() const {
+        return getCount(root);
+    }
+
+    /* return a pointer to the k-th smallest key (k-th largest key) of the
+     * tree, or nullptr if k is not between 1 and size(). The key stays valid
+     * as long as a version holding it exists */
+    const KeyType* select(int k) const;
+    const KeyType* selectLargest(int k) const;
+
+    /* return the number of keys in the tree that are less than "key" */
+    int rank(const KeyType& key) const;
+
+    /* return the number of keys in the tree between "low" and "high"
+     * (inclusive) */
+    int countInRange(const KeyType& low, const KeyType& high) const;
+
+    /* return the aggregate of the k largest keys of the tree, or of the
+     * whole tree if it has less than k keys */
+    aggregate_type aggregateOfkLargestKeys(int k) const;
+
+    aggregate_type sumOfkLargestKeys(int k) const {
+        return aggregateOfkLargestKeys(k);
+    }
+
+    /* return the aggregate of the keys between "low" and "high" (inclusive)
+     * in an inorder manner */
+    aggregate_type aggregate(const KeyType& low, const KeyType& high) const;
+};
+
+template<class KeyType, class Augmentation>
+PersistentAVLrankTree<KeyType, Augmentation>::PersistentAVLrankTree()
+        : root(nullptr) {}
+
+template<class KeyType, class Augmentation>
+PersistentAVLrankTree<KeyType, Augmentation>::~PersistentAVLrankTree() {
+    release(root);
+}
+
+template<class KeyType, class Augmentation>
+PersistentAVLrankTree<KeyType, Augmentation>::PersistentAVLrankTree
+(const PersistentAVLrankTree& tree) : root(acquire(tree.root)) {}
+
+template<class KeyType, class Augmentation>
+PersistentAVLrankTree<KeyType, Augmentation>::PersistentAVLrankTree
+(PersistentAVLrankTree&& tree) noexcept : root(tree.root) {
+    tree.root = nullptr;
+}
+
+template<class KeyType, class Augmentation>
+PersistentAVLrankTree<KeyType, Augmentation>&
+PersistentAVLrankTree<KeyType, Augmentation>::operator=(PersistentAVLrankTree tree) {
+    std::swap(root, tree.root);
+    return *this;
+}
+
+template<class KeyType, class Augmentation>
+void PersistentAVLrankTree<KeyType, Augmentation>::clear() {
+    release(root);
+    root = nullptr;
+}
+
+template<class KeyType, class Augmentation>
+typename PersistentAVLrankTree<KeyType, Augmentation>::AVLvertex*
+PersistentAVLrankTree<KeyType, Augmentation>::acquire(AVLvertex* v) {
+    if(v != nullptr){
+        v->references.fetch_add(1, std::memory_order_relaxed);
+    }
+    return v;
+}
+
+template<class KeyType, class Augmentation>
+void PersistentAVLrankTree<KeyType, Augmentation>::release(AVLvertex* v) {
+    /* the chain of vertexes that lost their last reference is followed
+     * iteratively to the right, so only the left spine recurses */
+    while(v != nullptr &&
+          v->references.fetch_sub(1, std::memory_order_acq_rel) == 1){
+        AVLvertex* right = v->right;
+        release(v->left);
+        delete v;
+        v = right;
+    }
+}
+
+template<class KeyType, class Augmentation>
+typename PersistentAVLrankTree<KeyType, Augmentation>::AVLvertex*
+PersistentAVLrankTree<KeyType, Augmentation>::makeMutable(AVLvertex* v) {
+    if(v->references.load(std::memory_order_acquire) == 1){
+        /* nobody else can reach the vertex, so nobody can start to */
+        return v;
+    }
+    AVLvertex* copy = new AVLvertex(*v);
+    acquire(copy->left);
+    acquire(copy->right);
+    release(v);
+    return copy;
+}
+
+template<class KeyType, class Augmentation>
+int PersistentAVLrankTree<KeyType, Augmentation>::getHeight(const AVLvertex* v) {
+    return v == nullptr ? 0 : v->height;
+}
+
+template<class KeyType, class Augmentation>
+int PersistentAVLrankTree<KeyType, Augmentation>::getCount(const AVLvertex* v) {
+    return v == nullptr ? 0 : v->count;
+}
+
+template<class KeyType, class Augmentation>
+typename PersistentAVLrankTree<KeyType, Augmentation>::aggregate_type
+PersistentAVLrankTree<KeyType, Augmentation>::getAggregate(const AVLvertex* v) {
+    return v == nullptr ? Augmentation::identity() : v->aggregate;
+}
+
+template<class KeyType, class Augmentation>
+void PersistentAVLrankTree<KeyType, Augmentation>::updateVertex(AVLvertex* v) {
+    int left_height = getHeight(v->left);
+    int right_height = getHeight(v->right);
+    v->height = 1 + (left_height > right_height ? left_height : right_height);
+    v->count = getCount(v->left) + getCount(v->right) + 1;
+    v->aggregate = Augmentation::combine(
+            Augmentation::combine(getAggregate(v->left),
+                    Augmentation::fromKey(v->key)),
+            getAggregate(v->right));
+}
+
+template<class KeyType, class Augmentation>
+typename PersistentAVLrankTree<KeyType, Augmentation>::AVLvertex*
+PersistentAVLrankTree<KeyType, Augmentation>::rotateRight(AVLvertex* v) {
+    /* the reference v had to it's left child moves to the copy */
+    AVLvertex* left = makeMutable(v->left);
+
+    /* preform rotation */
+    v->left = left->right;
+    left->right = v;
+
+    /* update the vertexes that their subtree changed */
+    updateVertex(v);
+    updateVertex(left);
+
+    /* return the root of the new subtree */
+    return left;
+}
+
+template<class KeyType, class Augmentation>
+typename PersistentAVLrankTree<KeyType, Augmentation>::AVLvertex*
+PersistentAVLrankTree<KeyType, Augmentation>::rotateLeft(AVLvertex* v) {
+    AVLvertex* right = makeMutable(v->right);
+
+    /* preform rotation */
+    v->right = right->left;
+    right->left = v;
+
+    /* update the vertexes that their subtree changed */
+    updateVertex(v);
+    updateVertex(right);
+
+    /* return the root of the new subtree */
+    return right;
+}
+
+template<class KeyType, class Augmentation>
+typename PersistentAVLrankTree<KeyType, Augmentation>::AVLvertex*
+PersistentAVLrankTree<KeyType, Augmentation>::rebalanceVertex(AVLvertex* curr_root) {
+    int BF = getHeight(curr_root->left) - getHeight(curr_root->right);
+
+    if(BF == 2){
+        AVLvertex* left = curr_root->left;
+        if(getHeight(left->left) < getHeight(left->right)){
+            /* LR */
+            curr_root->left = rotateLeft(makeMutable(left));
+        }
+        /* LL */
+        return rotateRight(curr_root);
+    }
+
+    if(BF == -2){
+        AVLvertex* right = curr_root->right;
+        if(getHeight(right->right) < getHeight(right->left)){
+            /* RL */
+            curr_root->right = rotateRight(makeMutable(right));
+        }
+        /* RR */
+        return rotateLeft(curr_root);
+    }
+
+    return curr_root;
+}
+
+template<class KeyType, class Augmentation>
+typename PersistentAVLrankTree<KeyType, Augmentation>::AVLvertex*
+PersistentAVLrankTree<KeyType, Augmentation>::insertRec(AVLvertex* curr_root,
+        const KeyType& key) {
+    if(curr_root == nullptr){
+        return new AVLvertex(key);
+    }
+
+    curr_root = makeMutable(curr_root);
+    if(curr_root->key < key){
+        curr_root->right = insertRec(curr_root->right, key);
+    } else {
+        curr_root->left = insertRec(curr_root->left, key);
+    }
+    updateVertex(curr_root);
+    return rebalanceVertex(curr_root);
+}
+
+template<class KeyType, class Augmentation>
+typename PersistentAVLrankTree<KeyType, Augmentation>::AVLvertex*
+PersistentAVLrankTree<KeyType, Augmentation>::removeMinVertex(AVLvertex* curr_root,
+        KeyType& min_key) {
+    curr_root = makeMutable(curr_root);
+    if(curr_root->left == nullptr){
+        /* the right subtree takes the vertex's place */
+        AVLvertex* right = curr_root->right;
+        min_key = curr_root->key;
+        curr_root->right = nullptr;
+        release(curr_root);
+        return right;
+    }
+
+    curr_root->left = removeMinVertex(curr_root->left, min_key);
+    updateVertex(curr_root);
+    return rebalanceVertex(curr_root);
+}
+
+template<class KeyType, class Augmentation>
+typename PersistentAVLrankTree<KeyType, Augmentation>::AVLvertex*
+PersistentAVLrankTree<KeyType, Augmentation>::deleteRec(AVLvertex* curr_root,
+        const KeyType& key) {
+    curr_root = makeMutable(curr_root);
+    if(curr_root->key == key){
+        if(curr_root->left == nullptr || curr_root->right == nullptr){
+            /* no children or one child case */
+            AVLvertex* child = curr_root->left != nullptr ? curr_root->left
+                                                          : curr_root->right;
+            curr_root->left = nullptr;
+            curr_root->right = nullptr;
+            release(curr_root);
+            return child;
+        }
+        /* 2 children case: the successor's key replaces the vertex's key */
+        curr_root->right = removeMinVertex(curr_root->right, curr_root->key);
+    } else if(curr_root->key < key){
+        curr_root->right = deleteRec(curr_root->right, key);
+    } else {
+        curr_root->left = deleteRec(curr_root->left, key);
+    }
+    updateVertex(curr_root);
+    return rebalanceVertex(curr_root);
+}
+
+template<class KeyType, class Augmentation>
+bool PersistentAVLrankTree<KeyType, Augmentation>::keyExists(const KeyType& key) const {
+    const AVLvertex* curr_root = root;
+    while(curr_root != nullptr){
+        if(curr_root->key == key){
+            return true;
+        }
+        if(curr_root->key < key){
+            curr_root = curr_root->right;
+        } else {
+            curr_root = curr_root->left;
+        }
+    }
+    return false;
+}
+
+template<class KeyType, class Augmentation>
+void PersistentAVLrankTree<KeyType, Augmentation>::insertKey(KeyType key) {
+    root = insertRec(root, key);
+}
+
+template<class KeyType, class Augmentation>
+void PersistentAVLrankTree<KeyType, Augmentation>::deleteKey(KeyType key) {
+    /* check first, so a missing key doesn't copy the path to it */
+    if(!keyExists(key)){
+        return;
+    }
+    root = deleteRec(root, key);
+}
+
+template<class KeyType, class Augmentation>
+PersistentAVLrankTree<KeyType, Augmentation>
+PersistentAVLrankTree<KeyType, Augmentation>::withKeyInserted(KeyType key) const {
+    PersistentAVLrankTree version(*this);
+    version.insertKey(key);
+    return version;
+}
+
+template<class KeyType, class Augmentation>
+PersistentAVLrankTree<KeyType, Augmentation>
+PersistentAVLrankTree<KeyType, Augmentation>::withKeyDeleted(KeyType key) const {
+    PersistentAVLrankTree version(*this);
+    version.deleteKey(key);
+    return version;
+}
+
+template<class KeyType, class Augmentation>
+const KeyType* PersistentAVLrankTree<KeyType, Augmentation>::select(int k) const {
+    if(k < 1 || k > getCount(root)){
+        return nullptr;
+    }
+
+    /* descend using the counts */
+    const AVLvertex* curr_root = root;
+    while(true){
+        int left_count = getCount(curr_root->left);
+        if(k <= left_count){
+            curr_root = curr_root->left;
+        } else if(k == left_count + 1){
+            return &curr_root->key;
+        } else {
+            k -= left_count + 1;
+            curr_root = curr_root->right;
+        }
+    }
+}
+
+template<class KeyType, class Augmentation>
+const KeyType* PersistentAVLrankTree<KeyType, Augmentation>::selectLargest(int k) const {
+    if(k < 1){
+        return nullptr;
+    }
+    return select(getCount(root) - k + 1);
+}
+
+template<class KeyType, class Augmentation>
+int PersistentAVLrankTree<KeyType, Augmentation>::rank(const KeyType& key) const {
+    int less_count = 0;
+    const AVLvertex* curr_root = root;
+    while(curr_root != nullptr){
+        if(curr_root->key < key){
+            /* curr_root and it's left subtree are all less than the key */
+            less_count += getCount(curr_root->left) + 1;
+            curr_root = curr_root->right;
+        } else {
+            curr_root = curr_root->left;
+        }
+    }
+    return less_count;
+}
+
+template<class KeyType, class Augmentation>
+int PersistentAVLrankTree<KeyType, Augmentation>::countNotGreater(const KeyType& key) const {
+    int not_greater_count = 0;
+    const AVLvertex* curr_root = root;
+    while(curr_root != nullptr){
+        if(key < curr_root->key){
+            curr_root = curr_root->left;
+        } else {
+            not_greater_count += getCount(curr_root->left) + 1;
+            curr_root = curr_root->right;
+        }
+    }
+    return not_greater_count;
+}
+
+template<class KeyType, class Augmentation>
+int PersistentAVLrankTree<KeyType, Augmentation>::countInRange(const KeyType& low,
+        const KeyType& high) const {
+    if(high < low){
+        return 0;
+    }
+    return countNotGreater(high) - rank(low);
+}
+
+template<class KeyType, class Augmentation>
+typename PersistentAVLrankTree<KeyType, Augmentation>::aggregate_type
+PersistentAVLrankTree<KeyType, Augmentation>::aggregateOfkLargestKeys(int k) const {
+    aggregate_type result = Augmentation::identity();
+    aggregateOfkLargestKeysRec(root, k, result);
+    return result;
+}
+
+template<class KeyType, class Augmentation>
+void PersistentAVLrankTree<KeyType, Augmentation>::aggregateOfkLargestKeysRec
+(const AVLvertex* curr_root, int& remaining_elements_count,
+        aggregate_type& curr_aggregate) {
+    if(curr_root == nullptr){
+        return;
+    }
+
+    /* the keys are visited from the largest down, so every part is
+     * prepended to the aggregate */
+    if(curr_root->count <= remaining_elements_count){
+        remaining_elements_count -= curr_root->count;
+        curr_aggregate = Augmentation::combine(curr_root->aggregate,
+                curr_aggregate);
+        return;
+    }
+
+    aggregateOfkLargestKeysRec(curr_root->right, remaining_elements_count,
+            curr_aggregate);
+    if(remaining_elements_count <= 0){
+        return;
+    }
+    curr_aggregate = Augmentation::combine(
+            Augmentation::fromKey(curr_root->key), curr_aggregate);
+    remaining_elements_count--;
+    aggregateOfkLargestKeysRec(curr_root->left, remaining_elements_count,
+            curr_aggregate);
+}
+
+template<class KeyType, class Augmentation>
+typename PersistentAVLrankTree<KeyType, Augmentation>::aggregate_type
+PersistentAVLrankTree<KeyType, Augmentation>::aggregate(const KeyType& low,
+        const KeyType& high) const {
+    /* find the highest vertex in the range, every other vertex in the range
+     * is in one of it's subtrees */
+    const AVLvertex* split_vertex = root;
+    while(split_vertex != nullptr){
+        if(split_vertex->key < low){
+            split_vertex = split_vertex->right;
+        } else if(high < split_vertex->key){
+            split_vertex = split_vertex->left;
+        } else {
+            break;
+        }
+    }
+    if(split_vertex == nullptr){
+        return Augmentation::identity();
+    }
+
+    /* along the left boundary every vertex in the range comes with it's
+     * right subtree, and precedes the parts that were already found */
+    aggregate_type left_aggregate = Augmentation::identity();
+    const AVLvertex* curr_root = split_vertex->left;
+    while(curr_root != nullptr){
+        if(curr_root->key < low){
+            curr_root = curr_root->right;
+        } else {
+            left_aggregate = Augmentation::combine(
+                    Augmentation::combine(Augmentation::fromKey(curr_root->key),
+                            getAggregate(curr_root->right)),
+                    left_aggregate);
+            curr_root = curr_root->left;
+        }
+    }
+
+    /* along the right boundary every vertex in the range comes with it's
+     * left subtree, and follows the parts that were already found */
+    aggregate_type right_aggregate = Augmentation::identity();
+    curr_root = split_vertex->right;
+    while(curr_root != nullptr){
+        if(high < curr_root->key){
+            curr_root = curr_root->left;
+        } else {
+            right_aggregate = Augmentation::combine(right_aggregate,
+                    Augmentation::combine(getAggregate(curr_root->left),
+                            Augmentation::fromKey(curr_root->key)));
+            curr_root = curr_root->right;
+        }
+    }
+
+    return Augmentation::combine(
+            Augmentation::combine(left_aggregate,
+                    Augmentation::fromKey(split_vertex->key)),
+            right_aggregate);
+}
+
+#endif //WET2CPP_PERSISTENTAVLRANKTREE_H
@@ -0,0 +1,764 @@
+#ifndef WET1CPP_SHARDEDAVL_H
+#define WET1CPP_SHARDEDAVL_H
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "AVL_tree.h"
+#include "AVLrankTree.h"
+#include "EpochReclaimer.h"
+#include "ForkJoinPool.h"
+
+/* trees that partition their keys into ranges ("shards"), each one a
+ * separate AVL_tree (ShardedAVL) or AVLrankTree (ShardedAVLrankTree) with
+ * it's own lock, so threads that update different ranges don't wait for
+ * each other.
+ *
+ * The shard boundaries form a layout which is replaced, never changed: an
+ * operation routes it's key by a binary search over the boundaries of the
+ * current layout, locks the shard, and checks that the layout is still the
+ * current one (otherwise it routes again). A new layout is published while
+ * every shard is locked, so holding the lock of a shard of the current
+ * layout means the layout stays current. Old layouts are freed through the
+ * EpochReclaimer.
+ *
+ * The trees start with a single shard, which is split as it grows until
+ * there are "shard_count" shards. From then on, a shard that grows beyond
+ * twice the average shard size shares it's keys with it's smaller
+ * neighbour, split at about their middle key. A tree of a single shard
+ * just grows. Queries over several shards (inorder, rank, select and the
+ * aggregates) lock one shard at a time, so they are exact only while no
+ * updates run concurrently */
+template <class KeyType, class Tree>
+class ShardedTreeBase{
+protected:
+    class Shard{
+    public:
+        std::mutex lock;
+        Tree tree;
+        /* the number of keys in the tree, changed only under the lock */
+        std::atomic<int> size;
+
+        Shard() : size(0) {}
+    };
+
+    class Layout{
+    public:
+        /* boundaries[i] is the smallest key that shards[i + 1] may hold */
+        std::vector<KeyType> boundaries;
+        std::vector<Shard*> shards;
+
+        int route(const KeyType& key) const {
+            return std::upper_bound(boundaries.begin(), boundaries.end(), key) -
+                   boundaries.begin();
+        }
+    };
+
+    /* the smallest shard size that is worth splitting */
+    static const int MIN_SPLIT_SIZE = 1024;
+
+    std::atomic<Layout*> layout;
+    int max_shards;
+    /* a shard which is larger than the limit is rebalanced */
+    std::atomic<int> shard_limit;
+    /* serializes the rebalancing */
+    std::mutex rebalance_lock;
+
+    static void destroyLayout(void* object){
+        delete static_cast<Layout*>(object);
+    }
+
+    /* the key to split a tree at: the median of a rank tree, found by
+     * select() in O(log n), or the root key of an AVL_tree, which has no
+     * subtree sizes to find the median by */
+    template <class DataType, template <class> class VertexAllocator>
+    static KeyType middleKey(AVL_tree<KeyType, DataType, VertexAllocator>& tree){
+        return *tree.middle();
+    }
+
+    template <template <class> class VertexAllocator, class Augmentation>
+    static KeyType middleKey(AVLrankTree<KeyType, VertexAllocator, Augmentation>& tree){
+        return *tree.select(tree.size() / 2 + 1);
+    }
+
+    /* return the number of keys in "lower", after the "total" keys of a
+     * shard were split between "lower" and "upper". The keys of an AVL_tree
+     * are counted through both trees at once, until the smaller one ends */
+    template <class DataType, template <class> class VertexAllocator>
+    static int lowerCount(AVL_tree<KeyType, DataType, VertexAllocator>& lower,
+            AVL_tree<KeyType, DataType, VertexAllocator>& upper, int total){
+        typedef typename AVL_tree<KeyType, DataType, VertexAllocator>::iterator
+                Iterator;
+        Iterator lower_it = lower.begin(), lower_end = lower.end();
+        Iterator upper_it = upper.begin(), upper_end = upper.end();
+        int count = 0;
+        while(lower_it != lower_end && upper_it != upper_end){
+            ++lower_it;
+            ++upper_it;
+            count++;
+        }
+        return lower_it == lower_end ? count : total - count;
+    }
+
+    template <template <class> class VertexAllocator, class Augmentation>
+    static int lowerCount(AVLrankTree<KeyType, VertexAllocator, Augmentation>& lower,
+            AVLrankTree<KeyType, VertexAllocator, Augmentation>&, int){
+        return lower.size();
+    }
+
+    explicit ShardedTreeBase(int shard_count);
+    ~ShardedTreeBase();
+
+    ShardedTreeBase(const ShardedTreeBase& tree) = delete;
+    ShardedTreeBase& operator=(const ShardedTreeBase& tree) = delete;
+
+    /* lock the shard that holds "key" and return "func(shard)" */
+    template <class Func>
+    auto applyToShard(const KeyType& key, Func func)
+            -> decltype(func(std::declval<Shard&>()));
+
+    /* call "func(shard, item)" for the items 0 to count-1, where the shard
+     * holds the key "keyOf(item)". The items of each shard are applied in
+     * their order, and the shards are processed in parallel */
+    template <class KeyOf, class Func>
+    void applyBatch(int count, KeyOf keyOf, Func func);
+
+    /* lock the shards of the current layout one at a time, from the first
+     * shard (the last one if "backwards"), calling "func(shard)" until it
+     * returns false */
+    template <class Func>
+    void forEachShard(bool backwards, Func func);
+
+    /* call "func(index)" for the indexes [first, last) in parallel */
+    template <class Func>
+    static void parallelFor(int first, int last, Func& func);
+
+    /* split "shard" if there are less than max_shards shards, otherwise
+     * share it's keys with a neighbour, if it's still over the limit. Only
+     * O(log n) splits and joins run while every shard is locked, the keys
+     * of the two shards that changed are counted after the others are
+     * unlocked */
+    void rebalance(Shard* shard);
+
+    /* move the keys of "lower" from about the middle one onwards into the
+     * empty "upper" in O(log n), storing the smallest key that moved in
+     * "boundary". Each shard keeps an allocator of it's own, so with an
+     * ArenaVertexAllocator the moved keys are copied in O(n) instead (and
+     * so are the keys of a join), see AVL_tree::splitDetached(). Return
+     * false, moving nothing, if the keys can't be split because they are all
+     * equal. The sizes are not updated */
+    static bool splitShard(Shard& lower, Shard& upper, KeyType& boundary);
+
+    /* rebalance every shard that is over the limit */
+    void rebalanceOversized();
+
+public:
+    /* return the number of keys in the tree */
+    int size();
+
+    /* return the current number of shards */
+    int shardCount(){
+        EpochReclaimer::Guard guard;
+        return layout.load()->shards.size();
+    }
+
+    /* the interface method to traverse the tree in an inorder manner, while
+     * applying the user supplied function to every key */
+    template <class Func>
+    void inorder(Func& doSomething){
+        forEachShard(false, [&](Shard& shard){
+            shard.tree.inorder(doSomething);
+            return true;
+        });
+    }
+};
+
+template <class KeyType, class Tree>
+ShardedTreeBase<KeyType, Tree>::ShardedTreeBase(int shard_count)
+        : layout(new Layout()), max_shards(shard_count > 0 ? shard_count : 1),
+          shard_limit(MIN_SPLIT_SIZE) {
+    layout.load()->shards.push_back(new Shard());
+}
+
+template <class KeyType, class Tree>
+ShardedTreeBase<KeyType, Tree>::~ShardedTreeBase() {
+    /* every shard that was ever created is in the current layout */
+    Layout* current = layout.load();
+    for(Shard* shard : current->shards){
+        delete shard;
+    }
+    delete current;
+}
+
+template <class KeyType, class Tree>
+template <class Func>
+auto ShardedTreeBase<KeyType, Tree>::applyToShard(const KeyType& key, Func func)
+        -> decltype(func(std::declval<Shard&>())) {
+    EpochReclaimer::Guard guard;
+    while(true){
+        Layout* current = layout.load();
+        Shard* shard = current->shards[current->route(key)];
+        std::lock_guard<std::mutex> lock(shard->lock);
+        if(layout.load() == current){
+            return func(*shard);
+        }
+        /* the layout was replaced meanwhile, route again */
+    }
+}
+
+template <class KeyType, class Tree>
+template <class Func>
+void ShardedTreeBase<KeyType, Tree>::parallelFor(int first, int last, Func& func) {
+    if(last - first <= 1){
+        if(last > first){
+            func(first);
+        }
+        return;
+    }
+    int mid = first + (last - first) / 2;
+    ForkJoinPool::shared().invokeBoth([&]{parallelFor(first, mid, func);},
+                                      [&]{parallelFor(mid, last, func);});
+}
+
+template <class KeyType, class Tree>
+template <class KeyOf, class Func>
+void ShardedTreeBase<KeyType, Tree>::applyBatch(int count, KeyOf keyOf,
+        Func func) {
+    EpochReclaimer::Guard guard;
+    std::vector<int> pending(count);
+    for(int i = 0; i < count; i++){
+        pending[i] = i;
+    }
+
+    while(!pending.empty()){
+        Layout* current = layout.load();
+        int shard_count = current->shards.size();
+        std::vector<std::vector<int> > buckets(shard_count);
+        for(int item : pending){
+            buckets[current->route(keyOf(item))].push_back(item);
+        }
+
+        /* a bucket whose shard finds the layout replaced is routed again */
+        std::vector<char> stale(shard_count, 0);
+        auto applyBucket = [&](int index){
+            if(buckets[index].empty()){
+                return;
+            }
+            Shard* shard = current->shards[index];
+            std::lock_guard<std::mutex> lock(shard->lock);
+            if(layout.load() != current){
+                stale[index] = 1;
+                return;
+            }
+            for(int item : buckets[index]){
+                func(*shard, item);
+            }
+        };
+        parallelFor(0, shard_count, applyBucket);
+
+        pending.clear();
+        for(int i = 0; i < shard_count; i++){
+            if(stale[i]){
+                pending.insert(pending.end(), buckets[i].begin(),
+                        buckets[i].end());
+            }
+        }
+    }
+}
+
+template <class KeyType, class Tree>
+template <class Func>
+void ShardedTreeBase<KeyType, Tree>::forEachShard(bool backwards, Func func) {
+    EpochReclaimer::Guard guard;
+    Layout* current = layout.load();
+    int shard_count = current->shards.size();
+    for(int i = 0; i < shard_count; i++){
+        Shard* shard = current->shards[backwards ? shard_count - 1 - i : i];
+        std::lock_guard<std::mutex> lock(shard->lock);
+        if(!func(*shard)){
+            return;
+        }
+    }
+}
+
+template <class KeyType, class Tree>
+int ShardedTreeBase<KeyType, Tree>::size() {
+    EpochReclaimer::Guard guard;
+    int total = 0;
+    for(Shard* shard : layout.load()->shards){
+        total += shard->size.load();
+    }
+    return total;
+}
+
+template <class KeyType, class Tree>
+bool ShardedTreeBase<KeyType, Tree>::splitShard(Shard& lower, Shard& upper,
+        KeyType& boundary) {
+    if(lower.tree.begin() == lower.tree.end()){
+        return false;
+    }
+    boundary = middleKey(lower.tree);
+    if(!(*lower.tree.begin() < boundary)){
+        /* the lower part would hold only copies of the middle key, so the
+         * boundary is moved to the first greater key */
+        typename Tree::iterator it = lower.tree.upperBound(boundary);
+        if(it == lower.tree.end()){
+            return false;
+        }
+        boundary = *it;
+    }
+    lower.tree.splitDetached(boundary, upper.tree);
+    return true;
+}
+
+template <class KeyType, class Tree>
+void ShardedTreeBase<KeyType, Tree>::rebalance(Shard* shard) {
+    std::lock_guard<std::mutex> rebalance_guard(rebalance_lock);
+    int oversized_size = shard->size.load();
+    if(oversized_size <= shard_limit.load()){
+        /* another thread rebalanced it already */
+        return;
+    }
+
+    Layout* current = layout.load();
+    int index = std::find(current->shards.begin(), current->shards.end(),
+            shard) - current->shards.begin();
+    for(Shard* locked : current->shards){
+        locked->lock.lock();
+    }
+
+    Layout* next = new Layout(*current);
+    /* the shards whose keys changed, which stay locked until they are
+     * counted */
+    Shard* lower = nullptr;
+    Shard* upper = nullptr;
+    int total = 0;
+    KeyType boundary;
+    int shard_count = current->shards.size();
+    if(shard_count < max_shards){
+        Shard* created = new Shard();
+        created->lock.lock();
+        if(splitShard(*shard, *created, boundary)){
+            next->shards.insert(next->shards.begin() + index + 1, created);
+            next->boundaries.insert(next->boundaries.begin() + index, boundary);
+            lower = shard;
+            upper = created;
+            total = oversized_size;
+        } else {
+            created->lock.unlock();
+            delete created;
+        }
+    } else if(shard_count > 1){
+        /* join the smaller neighbour's keys and split the two again */
+        int last = shard_count - 1;
+        int neighbour = index == 0 ? 1 : index == last ? last - 1 :
+                        current->shards[index - 1]->size.load() <
+                        current->shards[index + 1]->size.load() ? index - 1
+                                                                : index + 1;
+        int first = std::min(index, neighbour);
+        Shard& joined = *current->shards[first];
+        Shard& emptied = *current->shards[first + 1];
+        joined.tree.join(emptied.tree);
+        if(splitShard(joined, emptied, boundary)){
+            next->boundaries[first] = boundary;
+            lower = &joined;
+            upper = &emptied;
+            total = joined.size.load() + emptied.size.load();
+        } else {
+            /* restore the previous split, the sizes didn't change */
+            joined.tree.splitDetached(current->boundaries[first], emptied.tree);
+        }
+    }
+    /* with a single shard allowed there is nothing to share the keys with */
+
+    layout.store(next);
+    for(Shard* locked : current->shards){
+        if(locked != lower && locked != upper){
+            locked->lock.unlock();
+        }
+    }
+
+    bool balanced = lower != nullptr;
+    if(balanced){
+        int lower_size = lowerCount(lower->tree, upper->tree, total);
+        lower->size.store(lower_size);
+        upper->size.store(total - lower_size);
+        /* a split of the joined keys may leave one part as large as the
+         * oversized shard was */
+        balanced = std::max(lower_size, total - lower_size) < oversized_size;
+    }
+
+    /* the limit follows the average shard size */
+    long long keys = 0;
+    for(Shard* counted : next->shards){
+        keys += counted->size.load();
+    }
+    int limit = (int)next->shards.size() < max_shards ? MIN_SPLIT_SIZE :
+                std::max<long long>(MIN_SPLIT_SIZE, 2 * keys / max_shards);
+    if(!balanced){
+        /* the keys can't be split, don't try again until the shard doubles */
+        int largest = lower == nullptr ? oversized_size :
+                      std::max(lower->size.load(), upper->size.load());
+        limit = std::max(limit, 2 * largest);
+    }
+    shard_limit.store(limit);
+
+    if(lower != nullptr){
+        lower->lock.unlock();
+        upper->lock.unlock();
+    }
+    EpochReclaimer::shared().retire(current, &destroyLayout);
+}
+
+template <class KeyType, class Tree>
+void ShardedTreeBase<KeyType, Tree>::rebalanceOversized() {
+    while(true){
+        Shard* oversized = nullptr;
+        {
+            EpochReclaimer::Guard guard;
+            for(Shard* shard : layout.load()->shards){
+                if(shard->size.load() > shard_limit.load()){
+                    oversized = shard;
+                    break;
+                }
+            }
+        }
+        if(oversized == nullptr){
+            return;
+        }
+        rebalance(oversized);
+    }
+}
+
+/* a ShardedTreeBase of AVL_trees, which own the data of their keys */
+template <class KeyType, class DataType,
+        template <class> class VertexAllocator = HeapVertexAllocator>
+class ShardedAVL
+        : public ShardedTreeBase<KeyType, AVL_tree<KeyType, DataType, VertexAllocator> >{
+    typedef ShardedTreeBase<KeyType, AVL_tree<KeyType, DataType, VertexAllocator> > Base;
+    typedef typename Base::Shard Shard;
+
+public:
+    /* constructor, "shard_count" is the number of shards the tree grows
+     * into. The default is a shard per hardware thread */
+    explicit ShardedAVL(int shard_count = ForkJoinPool::defaultThreads())
+            : Base(shard_count) {}
+
+    /* return true if a vertex with a matching key exists int the tree, false
+     * otherwise */
+    bool keyExists(const KeyType& key){
+        return this->applyToShard(key, [&](Shard& shard){
+            return shard.tree.keyExists(key);
+        });
+    }
+
+    /* return the pointer to the data of the matching key, or nullptr */
+    DataType* getData(const KeyType& key){
+        return this->applyToShard(key, [&](Shard& shard){
+            return shard.tree.getData(key);
+        });
+    }
+
+    /* the interface method to insert a vertex with a "key" and "data" to the
+     * tree */
+    void insertKey(const KeyType& key, DataType* data);
+
+    /* the interface method to delete a vertex with the matching key from the
+     * tree. The vertex's data is detached from the tree and returned to the
+     * caller, or nullptr if the key is not in the tree */
+    DataType* deleteKey(const KeyType& key);
+
+    /* the batch versions of the methods above, which process the shards in
+     * parallel. insertBatch() takes a range of (key, data pointer) pairs.
+     * The results are stored in the i-th cell of "results" / "removed" */
+    template <class InputIt>
+    void insertBatch(InputIt first, InputIt last);
+
+    void getDataBatch(const KeyType* keys, int count, DataType** results);
+
+    void deleteBatch(const KeyType* keys, int count, DataType** removed);
+};
+
+template <class KeyType, class DataType,
+        template <class> class VertexAllocator>
+void ShardedAVL<KeyType, DataType, VertexAllocator>::insertKey(const KeyType& key,
+        DataType* data) {
+    Shard* oversized = this->applyToShard(key, [&](Shard& shard){
+        shard.tree.insertKey(key, data);
+        int size = shard.size.load() + 1;
+        shard.size.store(size);
+        return size > this->shard_limit.load() ? &shard : nullptr;
+    });
+    if(oversized != nullptr){
+        this->rebalance(oversized);
+    }
+}
+
+template <class KeyType, class DataType,
+        template <class> class VertexAllocator>
+DataType* ShardedAVL<KeyType, DataType, VertexAllocator>::deleteKey(const KeyType& key) {
+    return this->applyToShard(key, [&](Shard& shard){
+        DataType* detached_data = nullptr;
+        if(shard.tree.deleteKey(key, detached_data)){
+            shard.size.store(shard.size.load() - 1);
+        }
+        return detached_data;
+    });
+}
+
+template <class KeyType, class DataType,
+        template <class> class VertexAllocator>
+template <class InputIt>
+void ShardedAVL<KeyType, DataType, VertexAllocator>::insertBatch(InputIt first,
+        InputIt last) {
+    std::vector<std::pair<KeyType, DataType*> > pairs(first, last);
+    this->applyBatch(pairs.size(),
+            [&](int item) -> const KeyType& {return pairs[item].first;},
+            [&](Shard& shard, int item){
+                shard.tree.insertKey(pairs[item].first, pairs[item].second);
+                shard.size.store(shard.size.load() + 1);
+            });
+    this->rebalanceOversized();
+}
+
+template <class KeyType, class DataType,
+        template <class> class VertexAllocator>
+void ShardedAVL<KeyType, DataType, VertexAllocator>::getDataBatch(const KeyType* keys,
+        int count, DataType** results) {
+    this->applyBatch(count,
+            [&](int item) -> const KeyType& {return keys[item];},
+            [&](Shard& shard, int item){
+                results[item] = shard.tree.getData(keys[item]);
+            });
+}
+
+template <class KeyType, class DataType,
+        template <class> class VertexAllocator>
+void ShardedAVL<KeyType, DataType, VertexAllocator>::deleteBatch(const KeyType* keys,
+        int count, DataType** removed) {
+    this->applyBatch(count,
+            [&](int item) -> const KeyType& {return keys[item];},
+            [&](Shard& shard, int item){
+                removed[item] = nullptr;
+                if(shard.tree.deleteKey(keys[item], removed[item])){
+                    shard.size.store(shard.size.load() - 1);
+                }
+            });
+}
+
+/* a ShardedTreeBase of AVLrankTrees, which answers the rank tree's queries
+ * across the shards */
+template <class KeyType, class Augmentation = KeySum<> >
+class ShardedAVLrankTree
+        : public ShardedTreeBase<KeyType,
+                AVLrankTree<KeyType, HeapVertexAllocator, Augmentation> >{
+    typedef ShardedTreeBase<KeyType,
+            AVLrankTree<KeyType, HeapVertexAllocator, Augmentation> > Base;
+    typedef typename Base::Shard Shard;
+
+public:
+    typedef typename Augmentation::value_type aggregate_type;
+
+    /* constructor, see ShardedAVL */
+    explicit ShardedAVLrankTree(int shard_count = ForkJoinPool::defaultThreads())
+            : Base(shard_count) {}
+
+    /* return true if a vertex with a matching key exists int the tree, false
+     * otherwise */
+    bool keyExists(const KeyType& key){
+        return this->applyToShard(key, [&](Shard& shard){
+            return shard.tree.keyExists(key);
+        });
+    }
+
+    /* the interface methods to insert "key" to the tree or delete a matching
+     * key from it */
+    void insertKey(const KeyType& key);
+    void deleteKey(const KeyType& key);
+
+    /* insert or delete every key in the range [first, last), processing the
+     * shards in parallel */
+    template <class InputIt>
+    void insertBatch(InputIt first, InputIt last);
+
+    template <class InputIt>
+    void deleteBatch(InputIt first, InputIt last);
+
+    /* store the k-th smallest key (k-th largest key) of the tree in "key"
+     * and return true, or return false if k is not between 1 and size() */
+    bool select(int k, KeyType& key);
+    bool selectLargest(int k, KeyType& key);
+
+    /* return the number of keys in the tree that are less than "key" */
+    int rank(const KeyType& key);
+
+    /* return the number of keys in the tree between "low" and "high"
+     * (inclusive) */
+    int countInRange(const KeyType& low, const KeyType& high);
+
+    /* return the aggregate of the k largest keys of the tree, or of the
+     * whole tree if it has less than k keys */
+    aggregate_type aggregateOfkLargestKeys(int k);
+
+    aggregate_type sumOfkLargestKeys(int k){
+        return aggregateOfkLargestKeys(k);
+    }
+
+    /* return the aggregate of the keys between "low" and "high" (inclusive)
+     * in an inorder manner */
+    aggregate_type aggregate(const KeyType& low, const KeyType& high);
+};
+
+template <class KeyType, class Augmentation>
+void ShardedAVLrankTree<KeyType, Augmentation>::insertKey(const KeyType& key) {
+    Shard* oversized = this->applyToShard(key, [&](Shard& shard){
+        shard.tree.insertKey(key);
+        shard.size.store(shard.tree.size());
+        return shard.size.load() > this->shard_limit.load() ? &shard : nullptr;
+    });
+    if(oversized != nullptr){
+        this->rebalance(oversized);
+    }
+}
+
+template <class KeyType, class Augmentation>
+void ShardedAVLrankTree<KeyType, Augmentation>::deleteKey(const KeyType& key) {
+    this->applyToShard(key, [&](Shard& shard){
+        shard.tree.deleteKey(key);
+        shard.size.store(shard.tree.size());
+    });
+}
+
+template <class KeyType, class Augmentation>
+template <class InputIt>
+void ShardedAVLrankTree<KeyType, Augmentation>::insertBatch(InputIt first,
+        InputIt last) {
+    std::vector<KeyType> keys(first, last);
+    this->applyBatch(keys.size(),
+            [&](int item) -> const KeyType& {return keys[item];},
+            [&](Shard& shard, int item){
+                shard.tree.insertKey(keys[item]);
+                shard.size.store(shard.tree.size());
+            });
+    this->rebalanceOversized();
+}
+
+template <class KeyType, class Augmentation>
+template <class InputIt>
+void ShardedAVLrankTree<KeyType, Augmentation>::deleteBatch(InputIt first,
+        InputIt last) {
+    std::vector<KeyType> keys(first, last);
+    this->applyBatch(keys.size(),
+            [&](int item) -> const KeyType& {return keys[item];},
+            [&](Shard& shard, int item){
+                shard.tree.deleteKey(keys[item]);
+                shard.size.store(shard.tree.size());
+            });
+}
+
+template <class KeyType, class Augmentation>
+bool ShardedAVLrankTree<KeyType, Augmentation>::select(int k, KeyType& key) {
+    bool found = false;
+    if(k < 1){
+        return false;
+    }
+    this->forEachShard(false, [&](Shard& shard){
+        int size = shard.tree.size();
+        if(k > size){
+            k -= size;
+            return true;
+        }
+        key = *shard.tree.select(k);
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+template <class KeyType, class Augmentation>
+bool ShardedAVLrankTree<KeyType, Augmentation>::selectLargest(int k, KeyType& key) {
+    bool found = false;
+    if(k < 1){
+        return false;
+    }
+    this->forEachShard(true, [&](Shard& shard){
+        int size = shard.tree.size();
+        if(k > size){
+            k -= size;
+            return true;
+        }
+        key = *shard.tree.selectLargest(k);
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+template <class KeyType, class Augmentation>
+int ShardedAVLrankTree<KeyType, Augmentation>::rank(const KeyType& key) {
+    /* the shards before the key's shard count whole */
+    int less_count = 0;
+    this->forEachShard(false, [&](Shard& shard){
+        int shard_rank = shard.tree.rank(key);
+        less_count += shard_rank;
+        return shard_rank == shard.tree.size();
+    });
+    return less_count;
+}
+
+template <class KeyType, class Augmentation>
+int ShardedAVLrankTree<KeyType, Augmentation>::countInRange(const KeyType& low,
+        const KeyType& high) {
+    if(high < low){
+        return 0;
+    }
+    int count = 0;
+    this->forEachShard(false, [&](Shard& shard){
+        if(shard.tree.size() > 0 && high < *shard.tree.select(1)){
+            return false;
+        }
+        count += shard.tree.countInRange(low, high);
+        return true;
+    });
+    return count;
+}
+
+template <class KeyType, class Augmentation>
+typename ShardedAVLrankTree<KeyType, Augmentation>::aggregate_type
+ShardedAVLrankTree<KeyType, Augmentation>::aggregateOfkLargestKeys(int k) {
+    aggregate_type result = Augmentation::identity();
+    this->forEachShard(true, [&](Shard& shard){
+        if(k <= 0){
+            return false;
+        }
+        /* the shards are visited from the largest keys down, so every part
+         * is prepended */
+        result = Augmentation::combine(shard.tree.aggregateOfkLargestKeys(k),
+                result);
+        k -= shard.tree.size();
+        return true;
+    });
+    return result;
+}
+
+template <class KeyType, class Augmentation>
+typename ShardedAVLrankTree<KeyType, Augmentation>::aggregate_type
+ShardedAVLrankTree<KeyType, Augmentation>::aggregate(const KeyType& low,
+        const KeyType& high) {
+    aggregate_type result = Augmentation::identity();
+    if(high < low){
+        return result;
+    }
+    this->forEachShard(false, [&](Shard& shard){
+        if(shard.tree.size() > 0 && high < *shard.tree.select(1)){
+            return false;
+        }
+        result = Augmentation::combine(result, shard.tree.aggregate(low, high));
+        return true;
+    });
+    return result;
+}
+
+#endif //WET1CPP_SHARDEDAVL_H
@@ -0,0 +1,341 @@
+#ifndef WET1CPP_TREESNAPSHOT_H
+#define WET1CPP_TREESNAPSHOT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <unistd.h>
+
+/* the binary snapshot format of saveTo() and loadFrom() on AVL_tree and
+ * AVLrankTree, in the native byte order:
+ *   header  - the magic "AVLSNAP", the format version, the content kind
+ *             (keys only, or keys and data) and the number of keys
+ *   records - the keys in an inorder manner, each followed by a presence
+ *             byte and the data if the snapshot holds data, as written by
+ *             the key and data codecs
+ *   footer  - a 64 bit checksum of the header and the records
+ * The per vertex counts and aggregates are not stored: the tree is rebuilt
+ * perfectly balanced in a single O(n) pass, which recalculates them in O(1)
+ * per vertex from the children.
+ *
+ * A codec writes a value to a SnapshotWriter and reads it back:
+ *   void write(SnapshotWriter& out, const T& value) const
+ *   bool read(SnapshotReader& in, T& value) const  - false on a short read
+ * The provided codecs are templates over the stream, so they also encode
+ * the records of OperationLog.h. A stream has write(data, size) and
+ * writeValue(value), or read(data, size), readValue(value) and
+ * bytesLeft() */
+
+/* the streaming checksum of a snapshot, which hashes 8 bytes at a time no
+ * matter how the bytes are split between update() calls */
+class SnapshotChecksum{
+    uint64_t state;
+    uint64_t length;
+    unsigned char pending[8];
+    int pending_size;
+
+    static uint64_t rotl(uint64_t x, int r){
+        return (x << r) | (x >> (64 - r));
+    }
+
+    void mix(uint64_t word){
+        word *= 0x87c37b91114253d5ULL;
+        word = rotl(word, 31);
+        word *= 0x4cf5ad432745937fULL;
+        state ^= word;
+        state = rotl(state, 27) * 5 + 0x52dce729;
+    }
+
+public:
+    SnapshotChecksum() : state(0x9e3779b97f4a7c15ULL), length(0),
+                         pending_size(0) {}
+
+    void update(const void* data, size_t size){
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        length += size;
+        while(pending_size > 0 && pending_size < 8 && size > 0){
+            pending[pending_size++] = *bytes++;
+            size--;
+        }
+        if(pending_size == 8){
+            uint64_t word;
+            std::memcpy(&word, pending, 8);
+            mix(word);
+            pending_size = 0;
+        }
+        for(; size >= 8; bytes += 8, size -= 8){
+            uint64_t word;
+            std::memcpy(&word, bytes, 8);
+            mix(word);
+        }
+        while(size > 0){
+            pending[pending_size++] = *bytes++;
+            size--;
+        }
+    }
+
+    uint64_t value() const {
+        uint64_t word = 0;
+        std::memcpy(&word, pending, pending_size);
+        uint64_t h = state ^ (word * 0x87c37b91114253d5ULL) ^ length;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+};
+
+/* the header of a snapshot */
+class SnapshotHeader{
+public:
+    static const uint32_t VERSION = 1;
+    enum Kind : uint32_t {KEYS_ONLY = 0, KEYS_AND_DATA = 1};
+
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;
+    uint64_t key_count;
+
+    SnapshotHeader() : version(0), kind(0), key_count(0) {
+        std::memset(magic, 0, sizeof(magic));
+    }
+
+    SnapshotHeader(Kind kind, uint64_t key_count)
+            : version(VERSION), kind(kind), key_count(key_count) {
+        std::memcpy(magic, "AVLSNAP", sizeof(magic));
+    }
+
+    bool isValid(Kind expected_kind) const {
+        return std::memcmp(magic, "AVLSNAP", sizeof(magic)) == 0 &&
+               version == VERSION && kind == uint32_t(expected_kind);
+    }
+};
+
+/* writes a snapshot through a large buffer. The snapshot is written to
+ * "path.tmp", synced and renamed over "path" by finish(), so a crash while
+ * saving leaves the previous snapshot intact */
+class SnapshotWriter{
+    static const size_t BUFFER_SIZE = 1 << 20;
+
+    std::string path;
+    std::string temp_path;
+    std::FILE* file;
+    std::vector<char> buffer;
+    size_t used;
+    SnapshotChecksum checksum;
+    bool ok;
+
+    void flush(){
+        if(used == 0){
+            return;
+        }
+        checksum.update(buffer.data(), used);
+        if(ok && std::fwrite(buffer.data(), 1, used, file) != used){
+            ok = false;
+        }
+        used = 0;
+    }
+
+public:
+    explicit SnapshotWriter(const std::string& path)
+            : path(path), temp_path(path + ".tmp"),
+              file(std::fopen(temp_path.c_str(), "wb")),
+              buffer(BUFFER_SIZE), used(0), ok(file != nullptr) {}
+
+    /* a writer that was not finished removes it's temporary file */
+    ~SnapshotWriter(){
+        if(file != nullptr){
+            std::fclose(file);
+            std::remove(temp_path.c_str());
+        }
+    }
+
+    SnapshotWriter(const SnapshotWriter& writer) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter& writer) = delete;
+
+    void write(const void* data, size_t size){
+        if(size > BUFFER_SIZE - used){
+            flush();
+            if(size > BUFFER_SIZE){
+                checksum.update(data, size);
+                if(ok && std::fwrite(data, 1, size, file) != size){
+                    ok = false;
+                }
+                return;
+            }
+        }
+        std::memcpy(buffer.data() + used, data, size);
+        used += size;
+    }
+
+    template <class T>
+    void writeValue(const T& value){
+        write(&value, sizeof(T));
+    }
+
+    /* write the footer and replace the snapshot at "path". The method
+     * returns false if any write failed */
+    bool finish(){
+        if(file == nullptr){
+            return false;
+        }
+        flush();
+        uint64_t sum = checksum.value();
+        if(ok && std::fwrite(&sum, 1, sizeof(sum), file) != sizeof(sum)){
+            ok = false;
+        }
+        /* the content must reach the disk before the rename does, or a crash
+         * could leave a renamed but empty snapshot */
+        if(ok && (std::fflush(file) != 0 || fsync(fileno(file)) != 0)){
+            ok = false;
+        }
+        if(std::fclose(file) != 0){
+            ok = false;
+        }
+        file = nullptr;
+        if(ok && std::rename(temp_path.c_str(), path.c_str()) != 0){
+            ok = false;
+        }
+        if(!ok){
+            std::remove(temp_path.c_str());
+        }
+        return ok;
+    }
+};
+
+/* reads a snapshot through a large buffer, hashing the header and the
+ * records as they are read */
+class SnapshotReader{
+    static const size_t BUFFER_SIZE = 1 << 20;
+
+    std::FILE* file;
+    std::vector<char> buffer;
+    size_t position;
+    size_t filled;
+    /* the number of bytes of header and records not read into the buffer
+     * yet, which leaves the footer out */
+    uint64_t remaining;
+    SnapshotChecksum checksum;
+
+    bool refill(){
+        size_t size = BUFFER_SIZE;
+        if(remaining < size){
+            size = size_t(remaining);
+        }
+        if(size == 0 || std::fread(buffer.data(), 1, size, file) != size){
+            return false;
+        }
+        checksum.update(buffer.data(), size);
+        remaining -= size;
+        position = 0;
+        filled = size;
+        return true;
+    }
+
+public:
+    explicit SnapshotReader(const std::string& path)
+            : file(std::fopen(path.c_str(), "rb")), buffer(BUFFER_SIZE),
+              position(0), filled(0), remaining(0) {
+        if(file == nullptr){
+            return;
+        }
+        long size = -1;
+        if(std::fseek(file, 0, SEEK_END) == 0){
+            size = std::ftell(file);
+        }
+        if(size < long(sizeof(uint64_t)) || std::fseek(file, 0, SEEK_SET) != 0){
+            std::fclose(file);
+            file = nullptr;
+            return;
+        }
+        remaining = uint64_t(size) - sizeof(uint64_t);
+    }
+
+    ~SnapshotReader(){
+        if(file != nullptr){
+            std::fclose(file);
+        }
+    }
+
+    SnapshotReader(const SnapshotReader& reader) = delete;
+    SnapshotReader& operator=(const SnapshotReader& reader) = delete;
+
+    bool isOpen() const {return file != nullptr;}
+
+    /* the number of bytes left before the footer */
+    uint64_t bytesLeft() const {return remaining + (filled - position);}
+
+    bool read(void* data, size_t size){
+        char* out = static_cast<char*>(data);
+        while(size > 0){
+            if(position == filled && !refill()){
+                return false;
+            }
+            size_t chunk = filled - position < size ? filled - position : size;
+            std::memcpy(out, buffer.data() + position, chunk);
+            position += chunk;
+            out += chunk;
+            size -= chunk;
+        }
+        return true;
+    }
+
+    template <class T>
+    bool readValue(T& value){
+        return read(&value, sizeof(T));
+    }
+
+    /* check that every record was read and that the checksum matches the
+     * footer */
+    bool finish(){
+        uint64_t sum;
+        return bytesLeft() == 0 &&
+               std::fread(&sum, 1, sizeof(sum), file) == sizeof(sum) &&
+               sum == checksum.value();
+    }
+};
+
+/* the codec of the trivially copyable types, which are written as is */
+template <class T>
+class TrivialCodec{
+    static_assert(std::is_trivially_copyable<T>::value,
+            "TrivialCodec needs a trivially copyable type, pass a codec");
+public:
+    template <class Writer>
+    void write(Writer& out, const T& value) const {
+        out.writeValue(value);
+    }
+
+    template <class Reader>
+    bool read(Reader& in, T& value) const {
+        return in.readValue(value);
+    }
+};
+
+/* the codec of std::string, written as it's length and it's characters */
+class StringCodec{
+public:
+    template <class Writer>
+    void write(Writer& out, const std::string& value) const {
+        uint64_t size = value.size();
+        out.writeValue(size);
+        out.write(value.data(), value.size());
+    }
+
+    template <class Reader>
+    bool read(Reader& in, std::string& value) const {
+        uint64_t size;
+        if(!in.readValue(size) || size > in.bytesLeft()){
+            return false;
+        }
+        value.resize(size_t(size));
+        return size == 0 || in.read(&value[0], size_t(size));
+    }
+};
+
+#endif //WET1CPP_TREESNAPSHOT_H
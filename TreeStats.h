@@ -0,0 +1,217 @@
+#ifndef WET1CPP_TREESTATS_H
+#define WET1CPP_TREESTATS_H
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/* the statistics policies of AVL_tree and AVLrankTree. A tree calls it's
+ * policy on the events of it's hot paths:
+ *   countComparison()     - two keys were compared
+ *   countSingleRotation() - rebalanceVertex() preformed an LL or RR rotation
+ *   countDoubleRotation() - rebalanceVertex() preformed an LR or RL rotation
+ *   countAllocation()     - a vertex was allocated
+ *   countDeallocation()   - a vertex was deallocated
+ *   countPath(length)     - a search, insertion or deletion descended
+ *                           through "length" vertexes
+ *   counters()            - the totals of the events so far
+ *   reset()               - zero the totals
+ * The policy of a tree is never copied, moved or swapped with it, so the
+ * totals are those of the tree object */
+
+/* the totals a statistics policy reports */
+class TreeCounters{
+public:
+    uint64_t comparisons;
+    uint64_t single_rotations;
+    uint64_t double_rotations;
+    uint64_t allocations;
+    uint64_t deallocations;
+    /* the number of paths counted, and the number of vertexes on all of
+     * them */
+    uint64_t paths;
+    uint64_t path_length;
+
+    TreeCounters() : comparisons(0), single_rotations(0), double_rotations(0),
+            allocations(0), deallocations(0), paths(0), path_length(0) {}
+};
+
+/* the default policy: nothing is counted, and the empty inline methods
+ * leave no trace in the compiled hot paths */
+class NoTreeStats{
+public:
+    void countComparison() {}
+    void countSingleRotation() {}
+    void countDoubleRotation() {}
+    void countAllocation() {}
+    void countDeallocation() {}
+    void countPath(int) {}
+    TreeCounters counters() const {return TreeCounters();}
+    void reset() {}
+};
+
+/* every event is counted in the slot of the calling thread, and the slots
+ * are summed when the totals are read, so the threads that share a tree (a
+ * parallel batch operation, or the readers of a locked tree) don't fight
+ * over one cache line. Threads take the slots in turn, and threads beyond
+ * SLOTS share slots, which is why the counters are still atomic */
+class TreeStats{
+    static const int SLOTS = 64;
+
+    class Slot{
+    public:
+        std::atomic<uint64_t> comparisons;
+        std::atomic<uint64_t> single_rotations;
+        std::atomic<uint64_t> double_rotations;
+        std::atomic<uint64_t> allocations;
+        std::atomic<uint64_t> deallocations;
+        std::atomic<uint64_t> paths;
+        std::atomic<uint64_t> path_length;
+        /* more than a cache line between the counters of adjacent slots,
+         * wherever the array starts */
+        char padding[72];
+
+        Slot() : comparisons(0), single_rotations(0), double_rotations(0),
+                allocations(0), deallocations(0), paths(0), path_length(0) {}
+    };
+
+    std::unique_ptr<Slot[]> slots;
+
+    static int threadSlot(){
+        static std::atomic<unsigned> thread_count(0);
+        static thread_local int slot = int(thread_count.fetch_add(1) % SLOTS);
+        return slot;
+    }
+
+    static void add(std::atomic<uint64_t>& counter, uint64_t n){
+        counter.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    static uint64_t sum(const Slot* slots,
+            const std::atomic<uint64_t> Slot::* counter){
+        uint64_t total = 0;
+        for(int i = 0; i < SLOTS; i++){
+            total += (slots[i].*counter).load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+public:
+    TreeStats() : slots(new Slot[SLOTS]) {}
+
+    TreeStats(const TreeStats& stats) = delete;
+    TreeStats& operator=(const TreeStats& stats) = delete;
+
+    void countComparison() {add(slots[threadSlot()].comparisons, 1);}
+    void countSingleRotation() {add(slots[threadSlot()].single_rotations, 1);}
+    void countDoubleRotation() {add(slots[threadSlot()].double_rotations, 1);}
+    void countAllocation() {add(slots[threadSlot()].allocations, 1);}
+    void countDeallocation() {add(slots[threadSlot()].deallocations, 1);}
+
+    void countPath(int length){
+        Slot& slot = slots[threadSlot()];
+        add(slot.paths, 1);
+        add(slot.path_length, length);
+    }
+
+    /* the slots are read one by one while other threads may still count,
+     * so the totals of a tree that is in use are a close approximation */
+    TreeCounters counters() const {
+        TreeCounters totals;
+        totals.comparisons = sum(slots.get(), &Slot::comparisons);
+        totals.single_rotations = sum(slots.get(), &Slot::single_rotations);
+        totals.double_rotations = sum(slots.get(), &Slot::double_rotations);
+        totals.allocations = sum(slots.get(), &Slot::allocations);
+        totals.deallocations = sum(slots.get(), &Slot::deallocations);
+        totals.paths = sum(slots.get(), &Slot::paths);
+        totals.path_length = sum(slots.get(), &Slot::path_length);
+        return totals;
+    }
+
+    void reset(){
+        for(int i = 0; i < SLOTS; i++){
+            slots[i].comparisons.store(0);
+            slots[i].single_rotations.store(0);
+            slots[i].double_rotations.store(0);
+            slots[i].allocations.store(0);
+            slots[i].deallocations.store(0);
+            slots[i].paths.store(0);
+            slots[i].path_length.store(0);
+        }
+    }
+};
+
+/* what stats() returns: the totals of the tree's statistics policy (all
+ * zero under NoTreeStats), and the shape of the tree when it was called */
+class TreeStatsReport{
+public:
+    TreeCounters counters;
+    int size;
+    int height;
+    /* depth_histogram[d] is the number of vertexes d levels below the
+     * root */
+    std::vector<int> depth_histogram;
+    /* the average number of vertexes a search for a key of the tree
+     * compares against, and the log2(size) that a perfectly balanced tree
+     * approaches */
+    double average_depth;
+    double ideal_depth;
+    /* the average length of the paths the policy counted, 0 if none */
+    double average_path_length;
+    /* the vertex and the data it holds outside of it, without the
+     * bookkeeping of the allocator */
+    double bytes_per_vertex;
+
+    TreeStatsReport() : size(0), height(0), average_depth(0),
+            ideal_depth(0), average_path_length(0), bytes_per_vertex(0) {}
+};
+
+/* the recursive method behind measureTreeShape, which adds the vertexes of
+ * the subtree which it's root is curr_root (at the given depth) to the
+ * histogram and their bytes to "bytes" */
+template <class Vertex, class BytesOf>
+void measureSubtree(const Vertex* curr_root, int depth,
+        std::vector<int>& histogram, double& bytes, BytesOf& bytesOf){
+    if(curr_root == nullptr){
+        return;
+    }
+    if(int(histogram.size()) <= depth){
+        histogram.resize(depth + 1, 0);
+    }
+    histogram[depth]++;
+    bytes += double(bytesOf(curr_root));
+    measureSubtree(curr_root->left, depth + 1, histogram, bytes, bytesOf);
+    measureSubtree(curr_root->right, depth + 1, histogram, bytes, bytesOf);
+}
+
+/* fill the shape of "report" out of the tree which it's root is "root", in
+ * O(n). "bytesOf" returns the number of bytes a vertex takes */
+template <class Vertex, class BytesOf>
+void measureTreeShape(const Vertex* root, TreeStatsReport& report,
+        BytesOf bytesOf){
+    double bytes = 0;
+    report.depth_histogram.clear();
+    measureSubtree(root, 0, report.depth_histogram, bytes, bytesOf);
+
+    report.size = 0;
+    report.height = int(report.depth_histogram.size());
+    double total_depth = 0;
+    for(int depth = 0; depth < report.height; depth++){
+        report.size += report.depth_histogram[depth];
+        total_depth += double(depth + 1) * report.depth_histogram[depth];
+    }
+    if(report.size > 0){
+        report.average_depth = total_depth / report.size;
+        report.ideal_depth = std::log2(double(report.size));
+        report.bytes_per_vertex = bytes / report.size;
+    }
+    if(report.counters.paths > 0){
+        report.average_path_length = double(report.counters.path_length) /
+                double(report.counters.paths);
+    }
+}
+
+#endif //WET1CPP_TREESTATS_H
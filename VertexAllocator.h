@@ -0,0 +1,176 @@
+#ifndef WET1CPP_VERTEXALLOCATOR_H
+#define WET1CPP_VERTEXALLOCATOR_H
+
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/* the vertex allocation policies of AVL_tree and AVLrankTree. A policy is a
+ * class template over the vertex type which provides:
+ *   create(args...)  - allocate and construct a vertex
+ *   destroy(v)       - destruct and deallocate a single vertex
+ *   reserve(n)       - a hint that n vertices are about to be created
+ *   canReleaseAll()  - true if releaseAll() may be used by the tree
+ *   canCreateConcurrently() - true if create() and destroy() may be called
+ *                      by several threads at the same time
+ *   releaseAll()     - drop the memory of every vertex at once, without
+ *                      running their destructors */
+
+/* the tag that makes a vertex construct it's content in place out of the
+ * arguments that follow it, as in create(InPlace(), args...) */
+class InPlace{};
+
+/* the default policy: every vertex is a separate heap allocation */
+template <class Vertex>
+class HeapVertexAllocator{
+public:
+    template <class... Args>
+    Vertex* create(Args&&... args){
+        return new Vertex(std::forward<Args>(args)...);
+    }
+
+    void destroy(Vertex* v){
+        delete v;
+    }
+
+    void reserve(int){}
+
+    bool canReleaseAll() const {return false;}
+
+    bool canCreateConcurrently() const {return true;}
+
+    void releaseAll(){}
+
+    /* vertices allocated by one heap allocator may be freed by any other */
+    bool operator==(const HeapVertexAllocator&) const {return true;}
+    bool operator!=(const HeapVertexAllocator&) const {return false;}
+};
+
+/* a slab policy: vertices are carved out of contiguous chunks, so vertices
+ * created one after the other share cache lines, and deleted vertices are
+ * kept in a free list for reuse. Copies of the allocator share the same
+ * arena, which is dropped as a whole when the last copy is destroyed */
+template <class Vertex>
+class ArenaVertexAllocator{
+    /* a free slot holds the pointer to the next free slot in the free list */
+    union Slot{
+        Slot* next;
+        alignas(Vertex) unsigned char storage[sizeof(Vertex)];
+    };
+
+    class Arena{
+    public:
+        std::vector<Slot*> chunks;
+        Slot* free_list;
+        Slot* chunk_next;
+        Slot* chunk_end;
+        int next_chunk_size;
+        /* the number of slots that are still to be taken from the current
+         * chunk rather than from the free list, see reserve() */
+        int reserved;
+
+        Arena() : free_list(nullptr), chunk_next(nullptr), chunk_end(nullptr),
+                  next_chunk_size(MIN_CHUNK_SIZE), reserved(0) {}
+
+        ~Arena(){
+            for(Slot* chunk : chunks){
+                delete[] chunk;
+            }
+        }
+
+        Arena(const Arena& arena) = delete;
+        Arena& operator=(const Arena& arena) = delete;
+
+        /* allocate a new chunk of at least "size" slots and make it the
+         * chunk new vertices are carved from */
+        void addChunk(int size){
+            /* the untouched tail of the current chunk is not lost */
+            while(chunk_next != chunk_end){
+                chunk_next->next = free_list;
+                free_list = chunk_next;
+                chunk_next++;
+            }
+            Slot* chunk = new Slot[size];
+            chunks.push_back(chunk);
+            chunk_next = chunk;
+            chunk_end = chunk + size;
+            if(next_chunk_size < MAX_CHUNK_SIZE){
+                next_chunk_size *= 2;
+            }
+        }
+
+        Slot* allocateSlot(){
+            if(reserved > 0){
+                reserved--;
+                return chunk_next++;
+            }
+            if(free_list != nullptr){
+                Slot* slot = free_list;
+                free_list = slot->next;
+                return slot;
+            }
+            if(chunk_next == chunk_end){
+                addChunk(next_chunk_size);
+            }
+            return chunk_next++;
+        }
+
+        void deallocateSlot(Slot* slot){
+            slot->next = free_list;
+            free_list = slot;
+        }
+    };
+
+    std::shared_ptr<Arena> arena;
+
+public:
+    static const int MIN_CHUNK_SIZE = 64;
+    static const int MAX_CHUNK_SIZE = 1 << 16;
+
+    ArenaVertexAllocator() : arena(std::make_shared<Arena>()) {}
+
+    template <class... Args>
+    Vertex* create(Args&&... args){
+        Slot* slot = arena->allocateSlot();
+        try {
+            return new (slot->storage) Vertex(std::forward<Args>(args)...);
+        } catch (...) {
+            arena->deallocateSlot(slot);
+            throw;
+        }
+    }
+
+    void destroy(Vertex* v){
+        v->~Vertex();
+        arena->deallocateSlot(reinterpret_cast<Slot*>(v));
+    }
+
+    /* make sure the next n vertices are carved out of a single chunk */
+    void reserve(int n){
+        if(arena->chunk_end - arena->chunk_next < n){
+            arena->addChunk(n);
+        }
+        arena->reserved = n;
+    }
+
+    /* the arena can be dropped only if no other allocator shares it */
+    bool canReleaseAll() const {return arena.use_count() == 1;}
+
+    void releaseAll(){
+        arena = std::make_shared<Arena>();
+    }
+
+    /* the arena is not synchronized */
+    bool canCreateConcurrently() const {return false;}
+
+    /* vertices may only move between trees whose allocators share an arena */
+    bool operator==(const ArenaVertexAllocator& other) const {
+        return arena == other.arena;
+    }
+    bool operator!=(const ArenaVertexAllocator& other) const {
+        return arena != other.arena;
+    }
+};
+
+#endif //WET1CPP_VERTEXALLOCATOR_H
@@ -0,0 +1,137 @@
+/* compares the throughput of ConcurrentAVL_tree against an AVL_tree behind a
+ * single mutex, for 1 to 64 threads and 50% to 99% reads. The rest of the
+ * operations are inserts and deletes in equal parts.
+ * Usage: concurrent_throughput [key range] [milliseconds per run] */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "../AVL_tree.h"
+#include "../ConcurrentAVL_tree.h"
+
+/* the baseline, every operation holds the same lock */
+class LockedAVL_tree{
+    AVL_tree<int, int> tree;
+    std::mutex mutex;
+
+public:
+    ~LockedAVL_tree(){
+        std::vector<int> keys;
+        auto collect = [&](const int& key){ keys.push_back(key); };
+        tree.inorder(collect);
+        for(int key : keys){
+            delete tree.deleteKey(key);
+        }
+    }
+
+    bool keyExists(int key){
+        std::lock_guard<std::mutex> lock(mutex);
+        return tree.keyExists(key);
+    }
+
+    bool insertKey(int key, int* data){
+        std::lock_guard<std::mutex> lock(mutex);
+        return tree.tryEmplace(key, data).second;
+    }
+
+    int* deleteKey(int key){
+        std::lock_guard<std::mutex> lock(mutex);
+        return tree.deleteKey(key);
+    }
+};
+
+/* run "thread_count" threads on "tree" for "milliseconds", return the
+ * millions of operations per second */
+template <class Tree>
+static double measureThroughput(Tree& tree, int thread_count, int read_percent,
+        int key_range, int milliseconds){
+    std::atomic<bool> start(false), stop(false);
+    std::atomic<long long> operations(0);
+    std::vector<std::thread> threads;
+    for(int id = 0; id < thread_count; id++){
+        threads.emplace_back([&, id]{
+            std::mt19937 rng(id + 1);
+            long long done = 0;
+            while(!start.load()){
+                std::this_thread::yield();
+            }
+            while(!stop.load(std::memory_order_relaxed)){
+                int key = rng() % key_range;
+                int op = rng() % 100;
+                if(op < read_percent){
+                    tree.keyExists(key);
+                } else if((op - read_percent) % 2 == 0){
+                    int* data = new int(key);
+                    if(!tree.insertKey(key, data)){
+                        delete data;
+                    }
+                } else {
+                    delete tree.deleteKey(key);
+                }
+                done++;
+            }
+            operations += done;
+        });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+    stop = true;
+    for(std::thread& thread : threads){
+        thread.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    return operations.load() / seconds / 1e6;
+}
+
+/* half of the key range, so inserts and deletes keep the size steady */
+template <class Tree>
+static void prefill(Tree& tree, int key_range){
+    std::mt19937 rng(12345);
+    for(int i = 0; i < key_range / 2; i++){
+        int key = rng() % key_range;
+        int* data = new int(key);
+        if(!tree.insertKey(key, data)){
+            delete data;
+        }
+    }
+}
+
+int main(int argc, char** argv){
+    int key_range = argc > 1 ? std::atoi(argv[1]) : 1 << 20;
+    int milliseconds = argc > 2 ? std::atoi(argv[2]) : 1000;
+    const int thread_counts[] = {1, 2, 4, 8, 16, 32, 64};
+    const int read_percents[] = {50, 90, 99};
+
+    std::printf("%d keys, %d ms per run, %u hardware threads\n", key_range,
+            milliseconds, std::thread::hardware_concurrency());
+    std::printf("%7s %7s %18s %18s\n", "threads", "reads", "concurrent Mops/s",
+            "locked Mops/s");
+    for(int read_percent : read_percents){
+        for(int thread_count : thread_counts){
+            double concurrent, locked;
+            {
+                ConcurrentAVL_tree<int, int> tree;
+                prefill(tree, key_range);
+                concurrent = measureThroughput(tree, thread_count,
+                        read_percent, key_range, milliseconds);
+            }
+            {
+                LockedAVL_tree tree;
+                prefill(tree, key_range);
+                locked = measureThroughput(tree, thread_count, read_percent,
+                        key_range, milliseconds);
+            }
+            std::printf("%7d %6d%% %18.2f %18.2f\n", thread_count,
+                    read_percent, concurrent, locked);
+        }
+    }
+    return 0;
+}
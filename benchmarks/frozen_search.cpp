@@ -0,0 +1,100 @@
+/* compares lookups on AVL_tree and AVLrankTree against their frozen
+ * snapshots. Usage: frozen_search [number of keys] [number of queries] */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "../AVL_tree.h"
+#include "../AVLrankTree.h"
+
+template <class Func>
+static double measureNs(int queries, Func run){
+    auto start = std::chrono::steady_clock::now();
+    run();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() /
+           queries;
+}
+
+static void report(const char* name, double ns_per_query, long long check){
+    std::printf("%-36s %8.1f ns/query  (check %lld)\n", name, ns_per_query,
+            check);
+}
+
+int main(int argc, char** argv){
+    int key_count = argc > 1 ? std::atoi(argv[1]) : 1 << 20;
+    int query_count = argc > 2 ? std::atoi(argv[2]) : 1 << 22;
+
+    std::mt19937 rng(12345);
+    std::vector<std::pair<int, int*> > pairs;
+    std::vector<int> keys;
+    for(int i = 0; i < key_count; i++){
+        /* even keys only, so about half of the queries miss */
+        pairs.push_back(std::make_pair(2 * i, nullptr));
+        keys.push_back(2 * i);
+    }
+    std::vector<int> queries(query_count);
+    for(int& query : queries){
+        query = rng() % (2 * key_count);
+    }
+
+    AVL_tree<int, int> tree(pairs.begin(), pairs.end());
+    FrozenAVL_tree<int, int> frozen_tree = tree.freeze();
+    AVLrankTree<int> rank_tree;
+    rank_tree.assignSorted(keys.begin(), keys.end());
+    FrozenAVLrankTree<int> frozen_rank_tree = rank_tree.freeze();
+
+    std::printf("%d keys, %d queries\n", key_count, query_count);
+
+    long long found = 0;
+    double ns = measureNs(query_count, [&]{
+        for(int query : queries){
+            found += tree.keyExists(query);
+        }
+    });
+    report("AVL_tree::keyExists", ns, found);
+
+    found = 0;
+    ns = measureNs(query_count, [&]{
+        for(int query : queries){
+            found += frozen_tree.keyExists(query);
+        }
+    });
+    report("FrozenAVL_tree::keyExists", ns, found);
+
+    std::vector<int*> results(query_count);
+    ns = measureNs(query_count, [&]{
+        frozen_tree.getDataBatch(queries.data(), query_count, results.data());
+    });
+    report("FrozenAVL_tree::getDataBatch", ns, 0);
+
+    long long rank_sum = 0;
+    ns = measureNs(query_count, [&]{
+        for(int query : queries){
+            rank_sum += rank_tree.rank(query);
+        }
+    });
+    report("AVLrankTree::rank", ns, rank_sum);
+
+    rank_sum = 0;
+    ns = measureNs(query_count, [&]{
+        for(int query : queries){
+            rank_sum += frozen_rank_tree.rank(query);
+        }
+    });
+    report("FrozenAVLrankTree::rank", ns, rank_sum);
+
+    std::vector<int> ranks(query_count);
+    ns = measureNs(query_count, [&]{
+        frozen_rank_tree.rankBatch(queries.data(), query_count, ranks.data());
+    });
+    rank_sum = 0;
+    for(int rank : ranks){
+        rank_sum += rank;
+    }
+    report("FrozenAVLrankTree::rankBatch", ns, rank_sum);
+
+    return 0;
+}
@@ -0,0 +1,687 @@
+/* the benchmark suite of AVL_tree and AVLrankTree against the standard
+ * containers: insert, delete, getData hits and misses, inorder scans,
+ * sumOfkLargestKeys and mergeTrees, over uniform, Zipfian, sequential and
+ * reverse sorted keys. Every case runs in it's own process, so the peak RSS
+ * is the case's own, and the results are written as JSON.
+ * Usage: tree_bench [--sizes=1e3,1e4,1e5,1e6]
+ *                   [--distributions=uniform,zipf,sequential,reverse]
+ *                   [--cases=insert,delete,getData_hit,getData_miss,inorder,
+ *                            sumOfkLargestKeys,mergeTrees]
+ *                   [--output=file.json]
+ * Sizes up to 1e8 are accepted, which take a few GB per case. */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#include "../AVL_tree.h"
+#include "../AVLrankTree.h"
+#include "../DataStorage.h"
+
+/* every case runs at least this many operations, repeating the workload on
+ * the small sizes */
+static const long long MIN_OPS = 1000000;
+
+enum Distribution {UNIFORM, ZIPF, SEQUENTIAL, REVERSE};
+
+static const char* const DISTRIBUTION_NAMES[] = {"uniform", "zipf",
+                                                 "sequential", "reverse"};
+
+/* Zipfian ranks in [0, n) with the skew of YCSB (0.99), after Gray et al.,
+ * "Quickly generating billion-record synthetic databases" */
+class ZipfGenerator{
+    double theta;
+    double alpha;
+    double zeta_n;
+    double eta;
+    uint32_t n;
+
+public:
+    explicit ZipfGenerator(uint32_t n, double theta = 0.99)
+            : theta(theta), n(n) {
+        zeta_n = 0;
+        for(uint32_t i = 1; i <= n; i++){
+            zeta_n += 1 / std::pow(double(i), theta);
+        }
+        double zeta_2 = 1 + 1 / std::pow(2.0, theta);
+        alpha = 1 / (1 - theta);
+        eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta_2 / zeta_n);
+    }
+
+    template <class Rng>
+    uint32_t next(Rng& rng){
+        double u = std::uniform_real_distribution<double>(0, 1)(rng);
+        double uz = u * zeta_n;
+        if(uz < 1){
+            return 0;
+        }
+        if(uz < 1 + std::pow(0.5, theta)){
+            return 1;
+        }
+        uint32_t rank = uint32_t(n * std::pow(eta * u - eta + 1, alpha));
+        return rank < n ? rank : n - 1;
+    }
+};
+
+/* the key of every rank: the keys of a tree of n keys are the even numbers
+ * below 2n, so the odd numbers miss */
+static long long keyOf(uint32_t rank){
+    return 2 * (long long)rank;
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b){
+    while(b != 0){
+        uint64_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+/* the ranks of the keys a workload touches, in order. Uniform is a random
+ * permutation, so every key is touched once; Zipfian draws with repeats,
+ * the popular ranks scattered over the key range */
+static std::vector<uint32_t> rankStream(Distribution distribution, uint32_t n,
+        unsigned seed){
+    std::vector<uint32_t> ranks(n);
+    std::mt19937_64 rng(seed);
+    switch(distribution){
+        case UNIFORM:
+            for(uint32_t i = 0; i < n; i++){
+                ranks[i] = i;
+            }
+            std::shuffle(ranks.begin(), ranks.end(), rng);
+            break;
+        case ZIPF: {
+            ZipfGenerator zipf(n);
+            /* a multiplier coprime with n scatters the popular ranks */
+            uint64_t step = 2654435761u % n;
+            while(step == 0 || gcd(step, n) != 1){
+                step++;
+            }
+            for(uint32_t i = 0; i < n; i++){
+                ranks[i] = uint32_t(zipf.next(rng) * step % n);
+            }
+            break;
+        }
+        case SEQUENTIAL:
+            for(uint32_t i = 0; i < n; i++){
+                ranks[i] = i;
+            }
+            break;
+        case REVERSE:
+            for(uint32_t i = 0; i < n; i++){
+                ranks[i] = n - 1 - i;
+            }
+            break;
+    }
+    return ranks;
+}
+
+/* counts the cache misses of the timed sections through perf_event_open,
+ * where the kernel allows it */
+class CacheMissCounter{
+    int fd;
+
+public:
+    CacheMissCounter() : fd(-1) {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if(fd >= 0){
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        }
+#endif
+    }
+
+    ~CacheMissCounter(){
+        if(fd >= 0){
+            close(fd);
+        }
+    }
+
+    bool available() const {return fd >= 0;}
+
+    void start(){
+#ifdef __linux__
+        if(fd >= 0){
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    void stop(){
+#ifdef __linux__
+        if(fd >= 0){
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+#endif
+    }
+
+    /* the misses counted in every timed section so far */
+    long long total() const {
+        long long count = 0;
+        if(fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count)){
+            return -1;
+        }
+        return count;
+    }
+};
+
+/* the time and the operations of a case, summed over it's timed sections */
+class Measurement{
+    CacheMissCounter counter;
+
+public:
+    double seconds;
+    long long ops;
+    long long check;
+
+    Measurement() : seconds(0), ops(0), check(0) {}
+
+    template <class Func>
+    void timed(long long section_ops, Func func){
+        counter.start();
+        auto start = std::chrono::steady_clock::now();
+        func();
+        auto end = std::chrono::steady_clock::now();
+        counter.stop();
+        seconds += std::chrono::duration<double>(end - start).count();
+        ops += section_ops;
+    }
+
+    long long cacheMisses() const {return counter.total();}
+};
+
+/* the structures under test, behind one interface */
+class AVLtreeBench{
+public:
+    AVL_tree<long long, long long, HeapVertexAllocator, ThreeWayCompare,
+            InlineData> tree;
+
+    void build(uint32_t n){
+        std::vector<std::pair<long long, long long*> > pairs(n);
+        for(uint32_t i = 0; i < n; i++){
+            pairs[i] = std::make_pair(keyOf(i), nullptr);
+        }
+        tree.assignSorted(pairs.begin(), pairs.end());
+    }
+
+    void insert(long long key) {tree.tryEmplace(key, nullptr);}
+    void erase(long long key) {tree.eraseKey(key);}
+    bool find(long long key) {return tree.getData(key) != nullptr;}
+
+    long long scan(){
+        long long sum = 0;
+        auto add = [&](const long long& key){ sum += key; };
+        tree.inorder(add);
+        return sum;
+    }
+};
+
+class MapBench{
+public:
+    std::map<long long, long long> tree;
+
+    void build(uint32_t n){
+        for(uint32_t i = 0; i < n; i++){
+            tree.emplace_hint(tree.end(), keyOf(i), 0);
+        }
+    }
+
+    void insert(long long key) {tree.emplace(key, 0);}
+    void erase(long long key) {tree.erase(key);}
+    bool find(long long key) {return tree.find(key) != tree.end();}
+
+    long long scan(){
+        long long sum = 0;
+        for(const std::pair<const long long, long long>& pair : tree){
+            sum += pair.first;
+        }
+        return sum;
+    }
+};
+
+/* the rank tree keeps repeated keys, so it's baseline is std::multiset */
+class RankTreeBench{
+public:
+    AVLrankTree<long long> tree;
+
+    void build(uint32_t n){
+        std::vector<long long> keys(n);
+        for(uint32_t i = 0; i < n; i++){
+            keys[i] = keyOf(i);
+        }
+        tree.assignSorted(keys.begin(), keys.end());
+    }
+
+    void insert(long long key) {tree.insertKey(key);}
+    void erase(long long key) {tree.deleteKey(key);}
+    bool find(long long key) {return tree.keyExists(key);}
+
+    long long scan(){
+        long long sum = 0;
+        auto add = [&](const long long& key){ sum += key; };
+        tree.inorder(add);
+        return sum;
+    }
+
+    long long sumOfkLargest(int k) {return tree.sumOfkLargestKeys(k);}
+
+    void merge(RankTreeBench& other) {tree.mergeTrees(other.tree);}
+};
+
+class MultisetBench{
+public:
+    std::multiset<long long> tree;
+
+    void build(uint32_t n){
+        for(uint32_t i = 0; i < n; i++){
+            tree.insert(tree.end(), keyOf(i));
+        }
+    }
+
+    void insert(long long key) {tree.insert(key);}
+
+    void erase(long long key){
+        std::multiset<long long>::iterator it = tree.find(key);
+        if(it != tree.end()){
+            tree.erase(it);
+        }
+    }
+
+    bool find(long long key) {return tree.find(key) != tree.end();}
+
+    long long scan(){
+        long long sum = 0;
+        for(long long key : tree){
+            sum += key;
+        }
+        return sum;
+    }
+
+    /* the k largest keys are summed one by one, so this costs O(k) */
+    long long sumOfkLargest(int k){
+        long long sum = 0;
+        std::multiset<long long>::reverse_iterator it = tree.rbegin();
+        for(; k > 0 && it != tree.rend(); k--, ++it){
+            sum += *it;
+        }
+        return sum;
+    }
+
+    void merge(MultisetBench& other){
+#if __cplusplus >= 201703L
+        tree.merge(other.tree);
+#else
+        tree.insert(other.tree.begin(), other.tree.end());
+        other.tree.clear();
+#endif
+    }
+};
+
+static long long repetitions(uint32_t n){
+    return std::max<long long>(1, MIN_OPS / n);
+}
+
+/* the cases, each run on a fresh structure per repetition */
+template <class Bench>
+static void runInsert(Measurement& m, const std::vector<uint32_t>& ranks){
+    for(long long rep = repetitions(ranks.size()); rep > 0; rep--){
+        Bench bench;
+        m.timed(ranks.size(), [&]{
+            for(uint32_t rank : ranks){
+                bench.insert(keyOf(rank));
+            }
+        });
+        m.check += bench.scan();
+    }
+}
+
+template <class Bench>
+static void runDelete(Measurement& m, const std::vector<uint32_t>& ranks){
+    for(long long rep = repetitions(ranks.size()); rep > 0; rep--){
+        Bench bench;
+        bench.build(ranks.size());
+        m.timed(ranks.size(), [&]{
+            for(uint32_t rank : ranks){
+                bench.erase(keyOf(rank));
+            }
+        });
+        m.check += bench.scan();
+    }
+}
+
+template <class Bench>
+static void runLookup(Measurement& m, const std::vector<uint32_t>& ranks,
+        bool hit){
+    Bench bench;
+    bench.build(ranks.size());
+    long long offset = hit ? 0 : 1;
+    for(long long rep = repetitions(ranks.size()); rep > 0; rep--){
+        long long found = 0;
+        m.timed(ranks.size(), [&]{
+            for(uint32_t rank : ranks){
+                found += bench.find(keyOf(rank) + offset);
+            }
+        });
+        m.check += found;
+    }
+}
+
+template <class Bench>
+static void runInorder(Measurement& m, uint32_t n){
+    Bench bench;
+    bench.build(n);
+    for(long long rep = repetitions(n); rep > 0; rep--){
+        long long sum = 0;
+        m.timed(n, [&]{ sum = bench.scan(); });
+        m.check += sum;
+    }
+}
+
+/* k follows the distribution of the ranks. The O(k) baseline visits about
+ * 10^8 keys in total, so it finishes in reasonable time on every size */
+template <class Bench>
+static void runSumOfkLargest(Measurement& m, const std::vector<uint32_t>& ranks,
+        bool linear){
+    Bench bench;
+    bench.build(ranks.size());
+    long long queries = std::min<long long>(ranks.size(), 100000);
+    long long reps = repetitions(queries);
+    if(linear){
+        queries = std::max<long long>(10,
+                std::min<long long>(queries, 200000000LL / ranks.size()));
+        reps = std::max<long long>(1, 200000000LL / ranks.size() / queries);
+    }
+    for(long long rep = reps; rep > 0; rep--){
+        long long sum = 0;
+        m.timed(queries, [&]{
+            for(long long i = 0; i < queries; i++){
+                sum += bench.sumOfkLargest(ranks[i] + 1);
+            }
+        });
+        m.check += sum;
+    }
+}
+
+/* the distribution decides which keys go to which tree: uniform splits
+ * them at random, zipf gives the second tree a tenth of them (so the trees
+ * differ in size), sequential gives it the upper half and reverse the lower
+ * half */
+template <class Bench>
+static void runMerge(Measurement& m, Distribution distribution, uint32_t n){
+    std::vector<char> in_second(n);
+    std::mt19937 rng(7);
+    for(uint32_t i = 0; i < n; i++){
+        switch(distribution){
+            case UNIFORM: in_second[i] = rng() % 2; break;
+            case ZIPF: in_second[i] = rng() % 10 == 0; break;
+            case SEQUENTIAL: in_second[i] = i >= n / 2; break;
+            case REVERSE: in_second[i] = i < n / 2; break;
+        }
+    }
+
+    for(long long rep = repetitions(n); rep > 0; rep--){
+        Bench first, second;
+        std::vector<long long> first_keys, second_keys;
+        for(uint32_t i = 0; i < n; i++){
+            (in_second[i] ? second_keys : first_keys).push_back(keyOf(i));
+        }
+        for(long long key : first_keys){
+            first.insert(key);
+        }
+        for(long long key : second_keys){
+            second.insert(key);
+        }
+        m.timed(n, [&]{ first.merge(second); });
+        m.check += first.scan();
+    }
+}
+
+/* run a case on one structure in this process, returning false if the case
+ * does not apply to it */
+template <class Bench>
+static bool runCase(Measurement& m, const std::string& name,
+        Distribution distribution, uint32_t n){
+    std::vector<uint32_t> ranks = rankStream(distribution, n, 12345);
+    if(name == "insert"){
+        runInsert<Bench>(m, ranks);
+    } else if(name == "delete"){
+        runDelete<Bench>(m, ranks);
+    } else if(name == "getData_hit"){
+        runLookup<Bench>(m, ranks, true);
+    } else if(name == "getData_miss"){
+        runLookup<Bench>(m, ranks, false);
+    } else if(name == "inorder"){
+        runInorder<Bench>(m, n);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+template <class Bench>
+static bool runRankCase(Measurement& m, const std::string& name,
+        Distribution distribution, uint32_t n, bool linear){
+    if(name == "sumOfkLargestKeys"){
+        runSumOfkLargest<Bench>(m, rankStream(distribution, n, 12345), linear);
+    } else if(name == "mergeTrees"){
+        runMerge<Bench>(m, distribution, n);
+    } else {
+        return runCase<Bench>(m, name, distribution, n);
+    }
+    return true;
+}
+
+/* the structures each case compares */
+static std::vector<std::string> structuresOf(const std::string& name){
+    if(name == "sumOfkLargestKeys" || name == "mergeTrees"){
+        return {"AVLrankTree", "std::multiset"};
+    }
+    return {"AVL_tree", "std::map", "AVLrankTree", "std::multiset"};
+}
+
+/* run the case in a child process and return it's JSON object */
+static std::string runIsolated(const std::string& name,
+        const std::string& structure, Distribution distribution, uint32_t n){
+    int fds[2];
+    if(pipe(fds) != 0){
+        return "";
+    }
+    pid_t pid = fork();
+    if(pid < 0){
+        close(fds[0]);
+        close(fds[1]);
+        return "";
+    }
+    if(pid == 0){
+        close(fds[0]);
+        Measurement m;
+        bool ran = false;
+        if(structure == "AVL_tree"){
+            ran = runCase<AVLtreeBench>(m, name, distribution, n);
+        } else if(structure == "std::map"){
+            ran = runCase<MapBench>(m, name, distribution, n);
+        } else if(structure == "AVLrankTree"){
+            ran = runRankCase<RankTreeBench>(m, name, distribution, n, false);
+        } else {
+            ran = runRankCase<MultisetBench>(m, name, distribution, n, true);
+        }
+        if(!ran){
+            _exit(2);
+        }
+
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        long long misses = m.cacheMisses();
+        char misses_text[32] = "null";
+        if(misses >= 0){
+            std::snprintf(misses_text, sizeof(misses_text), "%.4f",
+                    double(misses) / m.ops);
+        }
+        char line[512];
+        int length = std::snprintf(line, sizeof(line),
+                "{\"case\": \"%s\", \"structure\": \"%s\", "
+                "\"distribution\": \"%s\", \"size\": %u, \"ops\": %lld, "
+                "\"ns_per_op\": %.2f, \"ops_per_sec\": %.0f, "
+                "\"peak_rss_kb\": %ld, \"cache_misses_per_op\": %s, "
+                "\"check\": %lld}",
+                name.c_str(), structure.c_str(),
+                DISTRIBUTION_NAMES[distribution], n, m.ops,
+                m.seconds * 1e9 / m.ops, m.ops / m.seconds,
+                usage.ru_maxrss, misses_text, m.check);
+        ssize_t written = write(fds[1], line, length);
+        _exit(written == length ? 0 : 1);
+    }
+    close(fds[1]);
+
+    std::string result;
+    char buffer[512];
+    ssize_t got;
+    while((got = read(fds[0], buffer, sizeof(buffer))) > 0){
+        result.append(buffer, got);
+    }
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+        /* most likely out of memory on the large sizes */
+        char line[256];
+        std::snprintf(line, sizeof(line),
+                "{\"case\": \"%s\", \"structure\": \"%s\", "
+                "\"distribution\": \"%s\", \"size\": %u, "
+                "\"error\": \"the case did not finish\"}",
+                name.c_str(), structure.c_str(),
+                DISTRIBUTION_NAMES[distribution], n);
+        return line;
+    }
+    return result;
+}
+
+static std::vector<std::string> splitList(const std::string& list){
+    std::vector<std::string> items;
+    std::string::size_type start = 0;
+    while(start <= list.size()){
+        std::string::size_type comma = list.find(',', start);
+        if(comma == std::string::npos){
+            comma = list.size();
+        }
+        if(comma > start){
+            items.push_back(list.substr(start, comma - start));
+        }
+        start = comma + 1;
+    }
+    return items;
+}
+
+int main(int argc, char** argv){
+    std::vector<std::string> sizes = {"1e3", "1e4", "1e5", "1e6"};
+    std::vector<std::string> distributions = {"uniform", "zipf", "sequential",
+                                              "reverse"};
+    const std::vector<std::string> known_cases = {"insert", "delete",
+            "getData_hit", "getData_miss", "inorder", "sumOfkLargestKeys",
+            "mergeTrees"};
+    std::vector<std::string> cases;
+    std::string output;
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if(arg.compare(0, 8, "--sizes=") == 0){
+            sizes = splitList(arg.substr(8));
+        } else if(arg.compare(0, 16, "--distributions=") == 0){
+            distributions = splitList(arg.substr(16));
+        } else if(arg.compare(0, 8, "--cases=") == 0){
+            cases = splitList(arg.substr(8));
+        } else if(arg.compare(0, 9, "--output=") == 0){
+            output = arg.substr(9);
+        } else {
+            std::fprintf(stderr, "unknown argument %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    if(cases.empty()){
+        cases = known_cases;
+    }
+    for(const std::string& name : cases){
+        if(std::find(known_cases.begin(), known_cases.end(), name) ==
+                known_cases.end()){
+            std::fprintf(stderr, "unknown case %s\n", name.c_str());
+            return 1;
+        }
+    }
+
+    std::string json = "{\n  \"benchmark\": \"tree_bench\",\n";
+    json += std::string("  \"cache_miss_counter\": ") +
+            (CacheMissCounter().available() ? "true" : "false") + ",\n";
+    json += "  \"results\": [";
+    bool first_result = true;
+    for(const std::string& name : cases){
+        for(const std::string& size_text : sizes){
+            double size = std::atof(size_text.c_str());
+            if(size < 1 || size > 4e9){
+                std::fprintf(stderr, "bad size %s\n", size_text.c_str());
+                return 1;
+            }
+            uint32_t n = uint32_t(size);
+            for(const std::string& distribution_name : distributions){
+                int distribution = 0;
+                while(distribution < 4 &&
+                        distribution_name != DISTRIBUTION_NAMES[distribution]){
+                    distribution++;
+                }
+                if(distribution == 4){
+                    std::fprintf(stderr, "unknown distribution %s\n",
+                            distribution_name.c_str());
+                    return 1;
+                }
+                for(const std::string& structure : structuresOf(name)){
+                    std::fprintf(stderr, "%s %s %s %u\n", name.c_str(),
+                            structure.c_str(), distribution_name.c_str(), n);
+                    std::string result = runIsolated(name, structure,
+                            Distribution(distribution), n);
+                    json += first_result ? "\n    " : ",\n    ";
+                    json += result;
+                    first_result = false;
+                }
+            }
+        }
+    }
+    json += "\n  ]\n}\n";
+
+    if(output.empty()){
+        std::fputs(json.c_str(), stdout);
+        return 0;
+    }
+    std::FILE* file = std::fopen(output.c_str(), "w");
+    if(file == nullptr || std::fputs(json.c_str(), file) < 0){
+        std::fprintf(stderr, "could not write %s\n", output.c_str());
+        return 1;
+    }
+    std::fclose(file);
+    return 0;
+}
@@ -0,0 +1,213 @@
+/* randomized equivalence checks of insertBatch() and deleteBatch() of
+ * AVL_tree against std::multimap and of AVLrankTree against std::multiset,
+ * with unsorted batches, duplicate keys, keys that are not in the tree, and
+ * batch sizes around the grain size of the parallel merge. The test exits
+ * with 1 on the first mismatch */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+#include "../AVL_tree.h"
+#include "../AVLrankTree.h"
+#include "check.h"
+
+/* the data of a key holds the key and a serial number, so the data of a
+ * deleted vertex tells which copy of the key was deleted */
+static const long long SERIAL_RANGE = 10000000;
+
+typedef AVL_tree<int, long long> Tree;
+typedef std::multimap<int, long long> Model;
+
+/* an unsorted batch of keys out of [0, range), with duplicates when the
+ * range is small. Some batches come sorted or reversed instead */
+static std::vector<int> randomBatch(std::mt19937& random, int size,
+        int range){
+    std::vector<int> keys;
+    for(int i = 0; i < size; i++){
+        keys.push_back(random() % range);
+    }
+    int order = random() % 4;
+    if(order == 0){
+        std::sort(keys.begin(), keys.end());
+    } else if(order == 1){
+        std::sort(keys.rbegin(), keys.rend());
+    }
+    return keys;
+}
+
+/* compare the (key, data) pairs of the tree with the model. Equal keys
+ * may hold their data in any order */
+static void checkSame(Tree& tree, const Model& model){
+    std::vector<std::pair<int, long long> > pairs;
+    for(Tree::iterator it = tree.begin(); it != tree.end(); ++it){
+        pairs.push_back(std::make_pair(*it, *it.data()));
+    }
+    CHECK(pairs.size() == model.size());
+    for(size_t i = 1; i < pairs.size(); i++){
+        CHECK(pairs[i - 1].first <= pairs[i].first);
+    }
+
+    std::sort(pairs.begin(), pairs.end());
+    std::vector<std::pair<int, long long> > expected(model.begin(),
+            model.end());
+    std::sort(expected.begin(), expected.end());
+    CHECK(pairs == expected);
+}
+
+static void testTreeBatches(int grain_size, unsigned seed){
+    std::mt19937 random(seed);
+    Tree tree;
+    Model model;
+    long long serial = 0;
+
+    /* the batch sizes around the grain size, for both a sparse key range
+     * and one with many duplicates */
+    const int sizes[] = {0, 1, grain_size - 1, grain_size, grain_size + 1,
+                         2 * grain_size, 4 * grain_size + 3};
+    for(int round = 0; round < 6; round++){
+        int range = round % 2 == 0 ? 100000 : std::max(2, grain_size / 2);
+        for(int size : sizes){
+            if(size < 0){
+                continue;
+            }
+            std::vector<int> keys = randomBatch(random, size, range);
+            std::vector<std::pair<int, long long*> > pairs;
+            for(int key : keys){
+                long long value = key * SERIAL_RANGE + serial++;
+                pairs.push_back(std::make_pair(key, new long long(value)));
+                model.insert(std::make_pair(key, value));
+            }
+            tree.insertBatch(pairs.begin(), pairs.end(), grain_size);
+            checkSame(tree, model);
+
+            /* delete a batch of the same size, about half of which is not
+             * in the tree, with some keys asked for more times than they
+             * are in the tree */
+            std::vector<int> deleted = randomBatch(random, size, 2 * range);
+            std::vector<long long*> removed(deleted.size());
+            std::vector<long long*>::iterator removed_end = tree.deleteBatch(
+                    deleted.begin(), deleted.end(), removed.begin(),
+                    grain_size);
+
+            std::map<int, int> requested;
+            for(int key : deleted){
+                requested[key]++;
+            }
+            size_t expected_count = 0;
+            for(const std::pair<const int, int>& entry : requested){
+                expected_count += std::min<size_t>(entry.second,
+                        model.count(entry.first));
+            }
+            CHECK((size_t)(removed_end - removed.begin()) == expected_count);
+
+            int previous_key = -1;
+            for(std::vector<long long*>::iterator it = removed.begin();
+                it != removed_end; ++it){
+                int key = **it / SERIAL_RANGE;
+                /* the removed data is in key order */
+                CHECK(previous_key <= key);
+                previous_key = key;
+                CHECK(requested[key]-- > 0);
+                std::pair<Model::iterator, Model::iterator> range_of =
+                        model.equal_range(key);
+                Model::iterator found = range_of.first;
+                while(found != range_of.second && found->second != **it){
+                    ++found;
+                }
+                CHECK(found != range_of.second);
+                model.erase(found);
+                delete *it;
+            }
+            checkSame(tree, model);
+        }
+
+        /* a batch of every key in the tree, shuffled, empties it. This also
+         * keeps the tree small for the next round */
+        std::vector<int> all_keys;
+        for(const std::pair<const int, long long>& entry : model){
+            all_keys.push_back(entry.first);
+        }
+        std::shuffle(all_keys.begin(), all_keys.end(), random);
+        std::vector<long long*> removed(all_keys.size());
+        CHECK(tree.deleteBatch(all_keys.begin(), all_keys.end(),
+                removed.begin(), grain_size) == removed.end());
+        for(long long* data : removed){
+            delete data;
+        }
+        model.clear();
+        checkSame(tree, model);
+    }
+}
+
+/* compare the keys, rank, select and sum of the rank tree with the model */
+static void checkSame(AVLrankTree<int>& tree, const std::multiset<int>& model){
+    std::vector<int> keys(model.begin(), model.end());
+    int size = keys.size();
+    CHECK(tree.size() == size);
+    std::vector<int> in_order(tree.begin(), tree.end());
+    CHECK(in_order == keys);
+
+    long long total = 0;
+    for(int key : keys){
+        total += key;
+    }
+    CHECK(tree.sumOfkLargestKeys(size) == total);
+    for(int k = 1; k <= size; k += 1 + size / 16){
+        CHECK(*tree.select(k) == keys[k - 1]);
+        CHECK(tree.rank(keys[k - 1]) ==
+              std::lower_bound(keys.begin(), keys.end(), keys[k - 1]) -
+              keys.begin());
+    }
+}
+
+static void testRankTreeBatches(int grain_size, unsigned seed){
+    std::mt19937 random(seed);
+    AVLrankTree<int> tree;
+    std::multiset<int> model;
+
+    const int sizes[] = {0, 1, grain_size - 1, grain_size, grain_size + 1,
+                         2 * grain_size, 4 * grain_size + 3};
+    for(int round = 0; round < 6; round++){
+        int range = round % 2 == 0 ? 100000 : std::max(2, grain_size / 2);
+        for(int size : sizes){
+            if(size < 0){
+                continue;
+            }
+            std::vector<int> keys = randomBatch(random, size, range);
+            tree.insertBatch(keys.begin(), keys.end(), grain_size);
+            model.insert(keys.begin(), keys.end());
+            checkSame(tree, model);
+
+            std::vector<int> deleted = randomBatch(random, size, 2 * range);
+            tree.deleteBatch(deleted.begin(), deleted.end(), grain_size);
+            for(int key : deleted){
+                std::multiset<int>::iterator it = model.find(key);
+                if(it != model.end()){
+                    model.erase(it);
+                }
+            }
+            checkSame(tree, model);
+        }
+
+        std::vector<int> all_keys(model.begin(), model.end());
+        std::shuffle(all_keys.begin(), all_keys.end(), random);
+        tree.deleteBatch(all_keys.begin(), all_keys.end(), grain_size);
+        model.clear();
+        checkSame(tree, model);
+    }
+}
+
+int main(){
+    /* grain size 1 merges every part in parallel */
+    for(int grain_size : {1, 2, 16, 255, 1 << 13}){
+        testTreeBatches(grain_size, 1000 + grain_size);
+        testRankTreeBatches(grain_size, 2000 + grain_size);
+    }
+    std::printf("batch_test passed\n");
+    return 0;
+}
@@ -0,0 +1,181 @@
+/* randomized equivalence checks of BlockAVL_tree against std::multimap, with
+ * duplicate keys and small blocks, so the blocks are split, merged and take
+ * keys from their neighbours many times. The test exits with 1 on the first
+ * mismatch */
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+#include "../BlockAVL_tree.h"
+#include "check.h"
+
+typedef std::multimap<int, int> Model;
+
+/* the keys of the tree, in order */
+template <class Tree>
+static std::vector<int> keysOf(Tree& tree){
+    std::vector<int> keys;
+    auto collect = [&](const int& key){keys.push_back(key);};
+    tree.inorder(collect);
+    return keys;
+}
+
+static std::vector<int> keysOf(const Model& model){
+    std::vector<int> keys;
+    for(const std::pair<const int, int>& entry : model){
+        keys.push_back(entry.first);
+    }
+    return keys;
+}
+
+/* true if "data" is the data of one of the copies of "key" in the model */
+static bool holds(const Model& model, int key, const int* data){
+    std::pair<Model::const_iterator, Model::const_iterator> range =
+            model.equal_range(key);
+    for(Model::const_iterator it = range.first; it != range.second; ++it){
+        if(it->second == *data){
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class Tree>
+static void checkSame(Tree& tree, const Model& model){
+    CHECK(tree.size() == (int)model.size());
+    CHECK(keysOf(tree) == keysOf(model));
+}
+
+template <class Tree>
+static void insert(Tree& tree, Model& model, int key, int value){
+    tree.insertKey(key, new int(value));
+    model.insert(std::make_pair(key, value));
+}
+
+/* delete a copy of "key" from both, the data tells which copy the tree
+ * deleted */
+template <class Tree>
+static void erase(Tree& tree, Model& model, int key){
+    int* data = tree.deleteKey(key);
+    CHECK((data != nullptr) == (model.count(key) != 0));
+    if(data == nullptr){
+        return;
+    }
+    std::pair<Model::iterator, Model::iterator> range = model.equal_range(key);
+    Model::iterator it = range.first;
+    while(it != range.second && it->second != *data){
+        ++it;
+    }
+    CHECK(it != range.second);
+    model.erase(it);
+    delete data;
+}
+
+template <class Tree>
+static void find(Tree& tree, const Model& model, int key){
+    int* data = tree.getData(key);
+    CHECK(tree.keyExists(key) == (model.count(key) != 0));
+    CHECK((data != nullptr) == (model.count(key) != 0));
+    CHECK(data == nullptr || holds(model, key, data));
+}
+
+template <int BlockSize>
+static void testBlockTree(int key_range, unsigned seed){
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> key_of(0, key_range);
+    BlockAVL_tree<int, int, BlockSize> tree;
+    Model model;
+    int value = 0;
+
+    /* grow the tree, which splits the blocks */
+    for(int i = 0; i < 4000; i++){
+        insert(tree, model, key_of(random), value++);
+    }
+    checkSame(tree, model);
+
+    /* shrink it to a few keys, which merges the blocks and makes them take
+     * keys from their neighbours */
+    while(model.size() > 10){
+        erase(tree, model, key_of(random));
+        if(model.size() % 97 == 0){
+            checkSame(tree, model);
+        }
+    }
+    checkSame(tree, model);
+
+    /* a random mix of the operations, with runs of insertions and deletions
+     * so the size swings back and forth */
+    for(int round = 0; round < 20; round++){
+        int insert_percent = round % 2 == 0 ? 70 : 30;
+        for(int step = 0; step < 2000; step++){
+            int key = key_of(random);
+            int operation = random() % 100;
+            if(operation < insert_percent){
+                insert(tree, model, key, value++);
+            } else if(operation < 90){
+                erase(tree, model, key);
+            } else {
+                find(tree, model, key);
+            }
+        }
+        checkSame(tree, model);
+
+        int low = key_of(random);
+        int high = low + key_range / 10;
+        std::vector<int> in_range;
+        auto collect = [&](const int& key){in_range.push_back(key);};
+        tree.forEachInRange(low, high, collect);
+        std::vector<int> expected;
+        for(Model::iterator it = model.lower_bound(low);
+            it != model.upper_bound(high); ++it){
+            expected.push_back(it->first);
+        }
+        CHECK(in_range == expected);
+    }
+
+    for(int key = -1; key <= key_range + 1; key++){
+        find(tree, model, key);
+    }
+
+    /* delete everything, the root block goes last */
+    while(!model.empty()){
+        erase(tree, model, model.begin()->first);
+    }
+    checkSame(tree, model);
+    CHECK(tree.getData(0) == nullptr);
+
+    /* a sorted assignment with full blocks, then updates on top of it */
+    std::vector<std::pair<int, int*> > pairs;
+    for(int i = 0; i < 1000; i++){
+        pairs.push_back(std::make_pair(i / 3, new int(value)));
+        model.insert(std::make_pair(i / 3, value++));
+    }
+    tree.assignSorted(pairs.begin(), pairs.end());
+    checkSame(tree, model);
+    for(int step = 0; step < 3000; step++){
+        int key = random() % 400;
+        if(random() % 2 == 0){
+            insert(tree, model, key, value++);
+        } else {
+            erase(tree, model, key);
+        }
+    }
+    checkSame(tree, model);
+}
+
+int main(){
+    /* few distinct keys make long runs of duplicates across blocks */
+    testBlockTree<4>(50, 1);
+    testBlockTree<4>(5000, 2);
+    testBlockTree<8>(300, 3);
+    /* mostly distinct keys fill a block's neighbours, so a block that gets
+     * too small takes keys from them rather than merging */
+    testBlockTree<8>(100000, 5);
+    testBlockTree<16>(100000, 6);
+    testBlockTree<64>(1000, 4);
+    std::printf("block_test passed\n");
+    return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef WET1CPP_TESTS_CHECK_H
+#define WET1CPP_TESTS_CHECK_H
+
+#include <cstdio>
+#include <cstdlib>
+
+/* the assertion of the tests, which stays on in release builds: print the
+ * failed condition and exit with 1 */
+#define CHECK(condition) \
+    do { \
+        if(!(condition)){ \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, \
+                    __LINE__, #condition); \
+            std::exit(1); \
+        } \
+    } while(0)
+
+#endif //WET1CPP_TESTS_CHECK_H
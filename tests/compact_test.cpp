@@ -0,0 +1,170 @@
+/* randomized equivalence checks of CompactAVL_tree against std::map, with
+ * compactions in both layouts in the middle of the updates, and a check that
+ * the slots of deleted vertexes are reused. The test exits with 1 on the
+ * first mismatch */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+#include "../CompactAVL_tree.h"
+#include "check.h"
+
+typedef CompactAVL_tree<int, int> Tree;
+typedef std::map<int, int> Model;
+
+/* compare the keys and data in order, both forwards and backwards */
+static void checkSame(Tree& tree, const Model& model){
+    CHECK(tree.size() == (int)model.size());
+    Model::const_iterator expected = model.begin();
+    for(Tree::iterator it = tree.begin(); it != tree.end(); ++it, ++expected){
+        CHECK(expected != model.end());
+        CHECK(*it == expected->first);
+        CHECK(*it.data() == expected->second);
+    }
+    CHECK(expected == model.end());
+
+    Model::const_reverse_iterator reversed = model.rbegin();
+    Tree::iterator it = tree.end();
+    while(it != tree.begin()){
+        --it;
+        CHECK(reversed != model.rend() && *it == reversed->first);
+        ++reversed;
+    }
+    CHECK(reversed == model.rend());
+}
+
+static void checkQueries(Tree& tree, const Model& model, int key){
+    Tree::Handle handle = tree.find(key);
+    Model::const_iterator found = model.find(key);
+    CHECK(tree.keyExists(key) == (found != model.end()));
+    CHECK((bool)handle == (found != model.end()));
+    if(handle){
+        CHECK(*handle.data() == found->second);
+        CHECK(*tree.getData(key) == found->second);
+    }
+
+    Tree::iterator lower = tree.lowerBound(key);
+    Model::const_iterator expected = model.lower_bound(key);
+    CHECK((lower == tree.end()) == (expected == model.end()));
+    CHECK(lower == tree.end() || *lower == expected->first);
+    Tree::iterator upper = tree.upperBound(key);
+    expected = model.upper_bound(key);
+    CHECK((upper == tree.end()) == (expected == model.end()));
+    CHECK(upper == tree.end() || *upper == expected->first);
+
+    std::vector<int> in_range;
+    auto collect = [&](const int& curr){in_range.push_back(curr);};
+    tree.forEachInRange(key, key + 50, collect);
+    std::vector<int> expected_range;
+    for(expected = model.lower_bound(key);
+        expected != model.upper_bound(key + 50); ++expected){
+        expected_range.push_back(expected->first);
+    }
+    CHECK(in_range == expected_range);
+}
+
+static void testRandomUpdates(unsigned seed){
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> key_of(0, 20000);
+    Tree tree;
+    Model model;
+
+    for(int step = 0; step < 200000; step++){
+        int key = key_of(random);
+        int operation = random() % 10;
+        if(operation < 5){
+            if(model.count(key) == 0){
+                tree.insertKey(key, new int(step));
+                model[key] = step;
+            }
+        } else if(operation < 8){
+            int* data = tree.deleteKey(key);
+            Model::iterator it = model.find(key);
+            CHECK((data != nullptr) == (it != model.end()));
+            if(data != nullptr){
+                CHECK(*data == it->second);
+                model.erase(it);
+                delete data;
+            }
+        } else {
+            checkQueries(tree, model, key);
+        }
+
+        /* compact partway through, with free slots left by the deletions,
+         * alternating the layouts */
+        if(step % 25000 == 12500){
+            checkSame(tree, model);
+            tree.compact(step % 50000 == 12500 ? Tree::BREADTH_FIRST
+                                               : Tree::PREORDER);
+            checkSame(tree, model);
+        }
+    }
+    checkSame(tree, model);
+}
+
+/* the addresses of the keys of the tree, in increasing order */
+static std::vector<const int*> slotsOf(Tree& tree){
+    std::vector<const int*> slots;
+    for(Tree::iterator it = tree.begin(); it != tree.end(); ++it){
+        slots.push_back(&*it);
+    }
+    std::sort(slots.begin(), slots.end());
+    return slots;
+}
+
+/* the insertions after a batch of deletions take the freed slots before the
+ * vector grows, so the keys end up in the very same slots. A deletion may
+ * free the slot of the deleted key's successor rather than it's own, so
+ * the slots are compared as a set */
+static void testSlotReuse(){
+    Tree tree;
+    for(int i = 0; i < 1000; i++){
+        tree.insertKey(i, new int(i));
+    }
+
+    for(Tree::Layout layout : {Tree::BREADTH_FIRST, Tree::PREORDER}){
+        for(int stride : {2, 3, 7}){
+            std::vector<const int*> slots = slotsOf(tree);
+            for(int i = 0; i < 1000; i += stride){
+                delete tree.deleteKey(i);
+            }
+            CHECK(tree.size() == 1000 - (999 / stride + 1));
+            for(int i = 0; i < 1000; i += stride){
+                tree.insertKey(i, new int(i));
+            }
+            CHECK(tree.size() == 1000);
+            CHECK(slotsOf(tree) == slots);
+        }
+
+        /* a single freed slot is taken by the next insertion */
+        std::vector<const int*> slots = slotsOf(tree);
+        delete tree.deleteKey(500);
+        tree.insertKey(1000000, new int(500));
+        CHECK(slotsOf(tree) == slots);
+        delete tree.deleteKey(1000000);
+        tree.insertKey(500, new int(500));
+
+        /* the compaction drops nothing but the free slots */
+        Model model;
+        for(Tree::iterator it = tree.begin(); it != tree.end(); ++it){
+            model[*it] = *it.data();
+        }
+        delete tree.deleteKey(2);
+        model.erase(2);
+        tree.compact(layout);
+        checkSame(tree, model);
+        tree.insertKey(2, new int(2));
+    }
+}
+
+int main(){
+    testRandomUpdates(1);
+    testRandomUpdates(2);
+    testSlotReuse();
+    std::printf("compact_test passed\n");
+    return 0;
+}
@@ -0,0 +1,117 @@
+/* a multi-threaded equivalence check of ConcurrentAVL_tree. Every updater
+ * thread owns the keys that are equal to it's index modulo the number of
+ * updaters, so it can check every result against a std::map of it's own,
+ * while the others rotate the same paths. Reader threads search all the keys
+ * meanwhile. Once the threads end, the tree must hold exactly the keys of
+ * the maps. The test exits with 1 on the first mismatch */
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+#include "../ConcurrentAVL_tree.h"
+#include "check.h"
+
+static const int UPDATERS = 4;
+static const int READERS = 2;
+static const int STEPS = 200000;
+static const int KEY_RANGE = 4000;
+
+/* the data of a key holds the key and the step that inserted it */
+class Entry{
+public:
+    int key;
+    int step;
+
+    Entry(int key, int step) : key(key), step(step) {}
+};
+
+static void update(ConcurrentAVL_tree<int, Entry>& tree, int index,
+        std::map<int, int>& model){
+    std::mt19937 random(index + 1);
+    for(int step = 0; step < STEPS; step++){
+        int key = (random() % (KEY_RANGE / UPDATERS)) * UPDATERS + index;
+        int operation = random() % 10;
+        if(operation < 5){
+            Entry* entry = new Entry(key, step);
+            bool inserted = tree.insertKey(key, entry);
+            CHECK(inserted == (model.count(key) == 0));
+            if(inserted){
+                model[key] = step;
+            } else {
+                delete entry;
+            }
+        } else if(operation < 8){
+            Entry* entry = tree.deleteKey(key);
+            std::map<int, int>::iterator it = model.find(key);
+            CHECK((entry != nullptr) == (it != model.end()));
+            if(entry != nullptr){
+                CHECK(entry->key == key && entry->step == it->second);
+                model.erase(it);
+                delete entry;
+            }
+        } else {
+            /* only this thread deletes the key, so the data stays valid */
+            Entry* entry = tree.getData(key);
+            std::map<int, int>::iterator it = model.find(key);
+            CHECK((entry != nullptr) == (it != model.end()));
+            if(entry != nullptr){
+                CHECK(entry->key == key && entry->step == it->second);
+            }
+        }
+    }
+}
+
+int main(){
+    ConcurrentAVL_tree<int, Entry> tree;
+    /* a key without data would be a routing vertex, so it's rejected */
+    CHECK(!tree.insertKey(0, nullptr));
+    CHECK(!tree.keyExists(0));
+
+    std::vector<std::map<int, int> > models(UPDATERS);
+    std::atomic<bool> done(false);
+
+    std::vector<std::thread> threads;
+    for(int i = 0; i < UPDATERS; i++){
+        threads.push_back(std::thread([&, i]{update(tree, i, models[i]);}));
+    }
+    std::atomic<long long> found(0);
+    for(int i = 0; i < READERS; i++){
+        threads.push_back(std::thread([&, i]{
+            std::mt19937 random(100 + i);
+            long long hits = 0;
+            while(!done.load()){
+                hits += tree.keyExists(random() % KEY_RANGE);
+            }
+            found += hits;
+        }));
+    }
+    for(int i = 0; i < UPDATERS; i++){
+        threads[i].join();
+    }
+    done.store(true);
+    for(int i = UPDATERS; i < UPDATERS + READERS; i++){
+        threads[i].join();
+    }
+
+    std::map<int, int> expected;
+    for(const std::map<int, int>& model : models){
+        expected.insert(model.begin(), model.end());
+    }
+    std::vector<int> keys;
+    auto collect = [&](const int& key){keys.push_back(key);};
+    tree.inorder(collect);
+    CHECK(keys.size() == expected.size());
+    std::map<int, int>::iterator it = expected.begin();
+    for(int key : keys){
+        CHECK(key == it->first);
+        Entry* entry = tree.getData(key);
+        CHECK(entry != nullptr && entry->step == it->second);
+        ++it;
+    }
+    std::printf("concurrent_test passed\n");
+    return 0;
+}
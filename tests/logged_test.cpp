@@ -0,0 +1,253 @@
+/* crash tests of LoggedAVL_tree and LoggedAVLrankTree: a child process
+ * applies random updates with compactions running in the background and
+ * exits abruptly by _exit() after a random number of them. The tree is then
+ * recovered and compared with std::map (std::multiset) after the same
+ * updates, and the files a crash leaves behind must be gone. The test exits
+ * with 1 on the first mismatch */
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../LoggedAVL.h"
+#include "check.h"
+
+/* the segments are compacted every few hundred updates */
+static const uint64_t COMPACT_THRESHOLD = 4096;
+
+/* the update "step" of the random sequence "seed" */
+class Update{
+public:
+    bool insert;
+    int key;
+    int value;
+
+    Update(unsigned seed, int step){
+        std::mt19937 random(seed * 1000003u + step);
+        insert = random() % 3 != 0;
+        key = random() % 500;
+        value = step;
+    }
+};
+
+/* the names of the files in "directory" */
+static std::vector<std::string> listFiles(const std::string& directory){
+    std::vector<std::string> names;
+    DIR* listing = opendir(directory.c_str());
+    CHECK(listing != nullptr);
+    while(struct dirent* entry = readdir(listing)){
+        std::string name = entry->d_name;
+        if(name != "." && name != ".."){
+            names.push_back(name);
+        }
+    }
+    closedir(listing);
+    return names;
+}
+
+/* after a recovery the tree named "prefix" has at most one snapshot and no
+ * temporary file, and every segment is at least as new as the snapshot */
+static void checkNoLeftovers(const std::string& directory,
+        const std::string& prefix){
+    std::string snapshot;
+    std::vector<std::string> names;
+    for(const std::string& name : listFiles(directory)){
+        if(name.compare(0, prefix.size() + 1, prefix + ".") == 0){
+            names.push_back(name);
+        }
+    }
+    for(const std::string& name : names){
+        CHECK(name.find(".tmp") == std::string::npos);
+        if(name.find(".snap.") != std::string::npos){
+            CHECK(snapshot.empty());
+            snapshot = name;
+        }
+    }
+    if(snapshot.empty()){
+        return;
+    }
+    uint64_t snapshot_generation = std::strtoull(
+            snapshot.substr(snapshot.rfind('.') + 1).c_str(), nullptr, 10);
+    for(const std::string& name : names){
+        if(name.find(".log.") != std::string::npos){
+            CHECK(std::strtoull(name.substr(name.rfind('.') + 1).c_str(),
+                    nullptr, 10) >= snapshot_generation);
+        }
+    }
+}
+
+/* run "child()" in a child process and wait for it */
+template <class Child>
+static void runChild(Child child){
+    std::fflush(nullptr);
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if(pid == 0){
+        child();
+        _exit(0);
+    }
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status));
+}
+
+/* the child applies the updates [begin, end) to the tree it recovers, so
+ * after the crash the tree holds the updates [0, end) */
+static void testLoggedAVL(const std::string& directory, unsigned seed,
+        int begin, int end){
+    std::string path = directory + "/tree";
+    runChild([&]{
+        LoggedAVL_tree<int, int> tree(std::chrono::milliseconds(0),
+                COMPACT_THRESHOLD);
+        if(!tree.open(path)){
+            _exit(2);
+        }
+        for(int step = begin; step < end; step++){
+            Update update(seed, step);
+            if(update.insert){
+                if(!tree.keyExists(update.key)){
+                    tree.insertKey(update.key, new int(update.value));
+                }
+            } else {
+                delete tree.deleteKey(update.key);
+            }
+        }
+        /* every update returned once it was synced, and a crash now may
+         * find a compaction half done */
+    });
+
+    std::map<int, int> model;
+    for(int step = 0; step < end; step++){
+        Update update(seed, step);
+        if(update.insert){
+            model.insert(std::make_pair(update.key, update.value));
+        } else {
+            model.erase(update.key);
+        }
+    }
+
+    LoggedAVL_tree<int, int> recovered(std::chrono::milliseconds(0), 0);
+    CHECK(recovered.open(path));
+    checkNoLeftovers(directory, "tree");
+    std::vector<std::pair<int, int> > entries;
+    recovered.query([&](AVL_tree<int, int>& tree){
+        for(AVL_tree<int, int>::iterator it = tree.begin(); it != tree.end();
+            ++it){
+            entries.push_back(std::make_pair(*it, *tree.getData(*it)));
+        }
+        return 0;
+    });
+    std::vector<std::pair<int, int> > expected(model.begin(), model.end());
+    CHECK(entries == expected);
+}
+
+static void testLoggedRankTree(const std::string& directory, unsigned seed,
+        int begin, int end){
+    std::string path = directory + "/rank";
+    runChild([&]{
+        LoggedAVLrankTree<int> tree(std::chrono::milliseconds(0),
+                COMPACT_THRESHOLD);
+        if(!tree.open(path)){
+            _exit(2);
+        }
+        for(int step = begin; step < end; step++){
+            Update update(seed, step);
+            if(update.insert){
+                tree.insertKey(update.key);
+            } else {
+                tree.deleteKey(update.key);
+            }
+        }
+    });
+
+    std::multiset<int> model;
+    for(int step = 0; step < end; step++){
+        Update update(seed, step);
+        if(update.insert){
+            model.insert(update.key);
+        } else if(model.find(update.key) != model.end()){
+            model.erase(model.find(update.key));
+        }
+    }
+
+    LoggedAVLrankTree<int> recovered(std::chrono::milliseconds(0), 0);
+    CHECK(recovered.open(path));
+    checkNoLeftovers(directory, "rank");
+    CHECK(recovered.size() == (int)model.size());
+    std::vector<int> keys;
+    recovered.query([&](AVLrankTree<int>& tree){
+        for(AVLrankTree<int>::iterator it = tree.begin(); it != tree.end();
+            ++it){
+            keys.push_back(*it);
+        }
+        return 0;
+    });
+    CHECK(keys == std::vector<int>(model.begin(), model.end()));
+}
+
+/* the files of crashes at other points: a segment older than the
+ * snapshot, a snapshot that was never committed and temporary files */
+static void testStaleFiles(const std::string& directory){
+    std::string path = directory + "/stale";
+    {
+        LoggedAVLrankTree<int> tree(std::chrono::milliseconds(0), 0);
+        CHECK(tree.open(path));
+        for(int i = 0; i < 100; i++){
+            tree.insertKey(i);
+        }
+        CHECK(tree.compact());
+        CHECK(tree.waitForCompaction());
+    }
+    const char* const stale_files[] = {".log.0", ".snap.5", ".snap.61.tmp",
+                                       ".manifest.tmp"};
+    for(const char* suffix : stale_files){
+        std::FILE* file = std::fopen((path + suffix).c_str(), "wb");
+        CHECK(file != nullptr);
+        std::fclose(file);
+    }
+
+    LoggedAVLrankTree<int> recovered(std::chrono::milliseconds(0), 0);
+    CHECK(recovered.open(path));
+    CHECK(recovered.size() == 100);
+    std::vector<std::string> names = listFiles(directory);
+    for(const char* suffix : stale_files){
+        for(const std::string& name : names){
+            CHECK(name != std::string("stale") + suffix);
+        }
+    }
+    checkNoLeftovers(directory, "stale");
+}
+
+int main(){
+    char directory_template[] = "/tmp/logged_test.XXXXXX";
+    char* directory = mkdtemp(directory_template);
+    CHECK(directory != nullptr);
+
+    std::mt19937 random(7);
+    for(unsigned seed = 1; seed <= 10; seed++){
+        std::string round = std::string(directory) + "/" + std::to_string(seed);
+        CHECK(mkdir(round.c_str(), 0755) == 0);
+        /* several crashes in a row on the same files */
+        int steps = 0;
+        for(int crash = 0; crash < 3; crash++){
+            int next_steps = steps + random() % 1000;
+            testLoggedAVL(round, seed, steps, next_steps);
+            testLoggedRankTree(round, seed, steps, next_steps);
+            steps = next_steps;
+        }
+    }
+    std::string stale = std::string(directory) + "/stale";
+    CHECK(mkdir(stale.c_str(), 0755) == 0);
+    testStaleFiles(stale);
+
+    CHECK(std::system((std::string("rm -rf ") + directory).c_str()) == 0);
+    std::printf("logged_test passed\n");
+    return 0;
+}
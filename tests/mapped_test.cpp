@@ -0,0 +1,117 @@
+/* randomized equivalence checks of MappedAVL_tree against std::map, with
+ * the file closed and reopened between rounds of updates, compacted, opened
+ * read only, and written by a child process that exits without closing it.
+ * The test exits with 1 on the first mismatch */
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../MappedAVL_tree.h"
+#include "check.h"
+
+typedef MappedAVL_tree<int, long long> Tree;
+
+/* the tree must hold exactly the entries of the model */
+static void checkEqual(const Tree& tree, const std::map<int, long long>& model){
+    CHECK(tree.size() == model.size());
+    std::map<int, long long>::const_iterator expected = model.begin();
+    for(Tree::iterator it = tree.begin(); it != tree.end(); ++it, ++expected){
+        CHECK(expected != model.end());
+        CHECK(*it == expected->first && it.data() == expected->second);
+    }
+    CHECK(expected == model.end());
+}
+
+/* apply "steps" random updates to the model and, unless it's nullptr, to
+ * the tree, checking every result */
+static void applyUpdates(Tree* tree, std::map<int, long long>& model,
+        std::mt19937& random, int steps){
+    for(int step = 0; step < steps; step++){
+        int key = random() % 3000;
+        long long value = random();
+        int operation = random() % 10;
+        if(operation < 4){
+            if(model.count(key) == 0){
+                CHECK(tree == nullptr || tree->insertKey(key, value));
+                model[key] = value;
+            }
+        } else if(operation < 6){
+            CHECK(tree == nullptr || tree->insertOrAssign(key, value));
+            model[key] = value;
+        } else if(operation < 9){
+            bool erased = model.erase(key) > 0;
+            CHECK(tree == nullptr || tree->deleteKey(key) == erased);
+        } else if(tree != nullptr){
+            const long long* data = tree->getData(key);
+            std::map<int, long long>::iterator it = model.find(key);
+            CHECK((data != nullptr) == (it != model.end()));
+            CHECK(data == nullptr || *data == it->second);
+        }
+    }
+}
+
+int main(){
+    char directory_template[] = "/tmp/mapped_test.XXXXXX";
+    char* directory = mkdtemp(directory_template);
+    CHECK(directory != nullptr);
+    std::string path = std::string(directory) + "/tree";
+
+    std::mt19937 random(11);
+    std::map<int, long long> model;
+    {
+        /* a small capacity, so the file grows a few times */
+        Tree tree;
+        CHECK(tree.create(path, 16));
+        applyUpdates(&tree, model, random, 20000);
+        checkEqual(tree, model);
+    }
+
+    for(int round = 0; round < 10; round++){
+        Tree tree;
+        CHECK(tree.open(path, Tree::READ_WRITE));
+        checkEqual(tree, model);
+        applyUpdates(&tree, model, random, 5000);
+        if(round % 3 == 0){
+            CHECK(tree.compact());
+            checkEqual(tree, model);
+        }
+        CHECK(tree.sync());
+    }
+
+    /* a process that exits without closing or syncing leaves it's changes
+     * in the shared mapping */
+    std::fflush(nullptr);
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if(pid == 0){
+        Tree tree;
+        if(!tree.open(path, Tree::READ_WRITE)){
+            _exit(2);
+        }
+        applyUpdates(&tree, model, random, 5000);
+        _exit(0);
+    }
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    applyUpdates(nullptr, model, random, 5000);
+    {
+        Tree tree;
+        CHECK(tree.open(path, Tree::READ_ONLY));
+        CHECK(tree.isReadOnly());
+        checkEqual(tree, model);
+        CHECK(!tree.insertKey(-1, 0));
+        CHECK(!tree.deleteKey(model.begin()->first));
+        checkEqual(tree, model);
+    }
+
+    CHECK(std::system((std::string("rm -rf ") + directory).c_str()) == 0);
+    std::printf("mapped_test passed\n");
+    return 0;
+}
@@ -0,0 +1,149 @@
+/* randomized equivalence checks of AVLrankTree::mergeTrees() against
+ * std::merge, with overlapping and disjoint key ranges, duplicate keys, an
+ * empty tree on either side, and sizes that take both the rebuild and the
+ * split and join paths. The test exits with 1 on the first mismatch */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <vector>
+#include "../AVLrankTree.h"
+#include "check.h"
+
+/* compare the keys, rank, select and sum of the tree with "keys" */
+template <class Tree>
+static void checkSame(Tree& tree, const std::vector<int>& keys){
+    int size = keys.size();
+    CHECK(tree.size() == size);
+    std::vector<int> in_order(tree.begin(), tree.end());
+    CHECK(in_order == keys);
+
+    long long total = 0;
+    for(int key : keys){
+        total += key;
+    }
+    CHECK(tree.sumOfkLargestKeys(size) == total);
+    for(int k = 1; k <= size; k += 1 + size / 16){
+        CHECK(*tree.select(k) == keys[k - 1]);
+        CHECK(tree.rank(keys[k - 1]) ==
+              std::lower_bound(keys.begin(), keys.end(), keys[k - 1]) -
+              keys.begin());
+    }
+}
+
+/* a sorted multiset of "size" keys out of [low, low + range) */
+static std::vector<int> randomKeys(std::mt19937& random, int size, int low,
+        int range){
+    std::vector<int> keys;
+    for(int i = 0; i < size; i++){
+        keys.push_back(low + random() % range);
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+/* merge the trees, compare the result with std::merge, then update the
+ * merged tree and the emptied one to see that both are still sound */
+template <class Tree>
+static void checkMerge(Tree& tree, Tree& other_tree,
+        const std::vector<int>& a, const std::vector<int>& b){
+    for(int key : a){
+        tree.insertKey(key);
+    }
+    for(int key : b){
+        other_tree.insertKey(key);
+    }
+    tree.mergeTrees(other_tree);
+
+    std::vector<int> expected;
+    std::merge(a.begin(), a.end(), b.begin(), b.end(),
+            std::back_inserter(expected));
+    checkSame(tree, expected);
+    CHECK(other_tree.size() == 0);
+    CHECK(other_tree.begin() == other_tree.end());
+
+    for(int i = 0; i < 50 && !expected.empty(); i++){
+        int key = expected[i * 7919 % expected.size()];
+        tree.deleteKey(key);
+        expected.erase(std::lower_bound(expected.begin(), expected.end(),
+                key));
+    }
+    for(int key : {-5, 3, 1000000}){
+        tree.insertKey(key);
+        expected.insert(std::upper_bound(expected.begin(), expected.end(),
+                key), key);
+    }
+    checkSame(tree, expected);
+
+    other_tree.insertKey(7);
+    CHECK(other_tree.size() == 1 && *other_tree.begin() == 7);
+}
+
+template <template <class> class VertexAllocator>
+static void checkSeparate(const std::vector<int>& a,
+        const std::vector<int>& b){
+    AVLrankTree<int, VertexAllocator> tree;
+    AVLrankTree<int, VertexAllocator> other_tree;
+    checkMerge(tree, other_tree, a, b);
+}
+
+/* splitting the empty tree makes both trees allocate from one arena, so
+ * the merge may reuse the vertexes of both */
+static void checkSharedArena(const std::vector<int>& a,
+        const std::vector<int>& b){
+    AVLrankTree<int, ArenaVertexAllocator> tree;
+    AVLrankTree<int, ArenaVertexAllocator> other_tree;
+    tree.split(0, other_tree);
+    checkMerge(tree, other_tree, a, b);
+}
+
+static void testMerge(unsigned seed){
+    std::mt19937 random(seed);
+    /* empty trees on either side, trees of similar sizes, which are
+     * rebuilt, and trees far apart in size, which are split and joined */
+    const int sizes[][2] = {{0, 0}, {0, 500}, {500, 0}, {1, 1}, {1, 3000},
+                            {1000, 1000}, {1000, 3999}, {1000, 4000},
+                            {10, 5000}, {5000, 10}, {3, 20000}, {20000, 3}};
+    for(const int* size : sizes){
+        int range = std::max(1, size[0] + size[1]);
+        /* the same range with duplicates, ranges far apart in both orders,
+         * and a small range inside a large one */
+        std::vector<int> layouts[][2] = {
+            {randomKeys(random, size[0], 0, range / 4 + 1),
+             randomKeys(random, size[1], 0, range / 4 + 1)},
+            {randomKeys(random, size[0], 0, range),
+             randomKeys(random, size[1], 10 * range, range)},
+            {randomKeys(random, size[0], 10 * range, range),
+             randomKeys(random, size[1], 0, range)},
+            {randomKeys(random, size[0], 0, 100 * range),
+             randomKeys(random, size[1], 50 * range, 10)}};
+        for(const std::vector<int>* keys : layouts){
+            checkSeparate<HeapVertexAllocator>(keys[0], keys[1]);
+            checkSeparate<ArenaVertexAllocator>(keys[0], keys[1]);
+            checkSharedArena(keys[0], keys[1]);
+        }
+    }
+}
+
+/* trees of one repeated key, so every key of one tree equals every key of
+ * the other */
+static void testEqualKeys(){
+    for(int other_size : {0, 1, 100, 1000}){
+        std::vector<int> a(250, 42);
+        std::vector<int> b(other_size, 42);
+        checkSeparate<HeapVertexAllocator>(a, b);
+        checkSeparate<HeapVertexAllocator>(b, a);
+        checkSharedArena(a, b);
+        checkSharedArena(b, a);
+    }
+}
+
+int main(){
+    testMerge(1);
+    testMerge(2);
+    testEqualKeys();
+    std::printf("merge_test passed\n");
+    return 0;
+}
@@ -0,0 +1,210 @@
+/* randomized checks of PersistentAVLrankTree: snapshots taken in the middle
+ * of random insertions and deletions must keep their keys, rank, select and
+ * aggregates while the tree and the other snapshots change, and releasing
+ * every version must free every vertex. The keys count their live copies,
+ * so a leaked vertex is found without a sanitizer. The test exits with 1 on
+ * the first mismatch */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <utility>
+#include <vector>
+#include "../PersistentAVLrankTree.h"
+#include "check.h"
+
+/* an int key that counts how many copies of it exist, which are the keys
+ * held by vertexes once the test's own copies are gone */
+class CountedKey{
+    int key;
+
+public:
+    static long live;
+
+    CountedKey(int key = 0) : key(key) {live++;}
+    CountedKey(const CountedKey& other) : key(other.key) {live++;}
+    CountedKey& operator=(const CountedKey& other){
+        key = other.key;
+        return *this;
+    }
+    ~CountedKey(){live--;}
+
+    int getKey() const {return key;}
+
+    bool operator<(const CountedKey& other) const {return key < other.key;}
+    bool operator==(const CountedKey& other) const {return key == other.key;}
+};
+
+long CountedKey::live = 0;
+
+typedef PersistentAVLrankTree<CountedKey> Tree;
+
+/* a version of the tree together with the sorted keys it must hold */
+class Version{
+public:
+    Tree tree;
+    std::vector<int> keys;
+
+    Version(const Tree& tree, const std::vector<int>& keys)
+            : tree(tree), keys(keys) {}
+};
+
+static void insert(Tree& tree, std::vector<int>& keys, int key){
+    tree.insertKey(key);
+    keys.insert(std::upper_bound(keys.begin(), keys.end(), key), key);
+}
+
+static void erase(Tree& tree, std::vector<int>& keys, int key){
+    tree.deleteKey(key);
+    std::vector<int>::iterator it = std::lower_bound(keys.begin(),
+            keys.end(), key);
+    if(it != keys.end() && *it == key){
+        keys.erase(it);
+    }
+}
+
+static long long sum(std::vector<int>::const_iterator first,
+        std::vector<int>::const_iterator last){
+    long long total = 0;
+    for(; first != last; ++first){
+        total += *first;
+    }
+    return total;
+}
+
+/* compare every query of the version with it's keys */
+static void checkVersion(const Version& version, std::mt19937& random){
+    const Tree& tree = version.tree;
+    const std::vector<int>& keys = version.keys;
+    int size = keys.size();
+    CHECK(tree.size() == size);
+
+    std::vector<int> in_order;
+    auto collect = [&](const CountedKey& key){
+        in_order.push_back(key.getKey());
+    };
+    tree.inorder(collect);
+    CHECK(in_order == keys);
+
+    CHECK(tree.select(0) == nullptr);
+    CHECK(tree.select(size + 1) == nullptr);
+    for(int i = 0; i < 20 && size > 0; i++){
+        int k = random() % size + 1;
+        CHECK(tree.select(k)->getKey() == keys[k - 1]);
+        CHECK(tree.selectLargest(k)->getKey() == keys[size - k]);
+        CHECK(tree.aggregateOfkLargestKeys(k) ==
+              sum(keys.end() - k, keys.end()));
+    }
+    CHECK(tree.aggregateOfkLargestKeys(size + 5) ==
+          sum(keys.begin(), keys.end()));
+
+    for(int i = 0; i < 20; i++){
+        int low = random() % 1200 - 100;
+        int high = low + random() % 300;
+        std::vector<int>::const_iterator first = std::lower_bound(keys.begin(),
+                keys.end(), low);
+        std::vector<int>::const_iterator last = std::upper_bound(keys.begin(),
+                keys.end(), high);
+        CHECK(tree.rank(low) == first - keys.begin());
+        CHECK(tree.countInRange(low, high) == last - first);
+        CHECK(tree.aggregate(low, high) == sum(first, last));
+        CHECK(tree.keyExists(low) ==
+              std::binary_search(keys.begin(), keys.end(), low));
+    }
+}
+
+static void testSnapshots(unsigned seed){
+    std::mt19937 random(seed);
+    {
+        Tree tree;
+        std::vector<int> keys;
+        std::vector<Version> versions;
+
+        for(int step = 0; step < 40000; step++){
+            /* few distinct keys, so there are duplicates */
+            int key = random() % 1000;
+            if(random() % 10 < 6){
+                insert(tree, keys, key);
+            } else {
+                erase(tree, keys, key);
+            }
+
+            if(step % 1000 == 999){
+                /* take snapshots the three ways, keeping at most 8 alive */
+                int way = step / 1000 % 3;
+                if(way == 0){
+                    versions.push_back(Version(tree.snapshot(), keys));
+                } else if(way == 1){
+                    versions.push_back(Version(tree, keys));
+                } else {
+                    std::vector<int> inserted_keys = keys;
+                    inserted_keys.insert(std::upper_bound(inserted_keys.begin(),
+                            inserted_keys.end(), key), key);
+                    versions.push_back(Version(tree.withKeyInserted(key),
+                            inserted_keys));
+                }
+                if(versions.size() > 8){
+                    versions.erase(versions.begin() +
+                                   random() % versions.size());
+                }
+                for(const Version& version : versions){
+                    checkVersion(version, random);
+                }
+            }
+
+            if(step % 5000 == 4999 && !versions.empty()){
+                /* a snapshot is a version of it's own, which may be updated
+                 * without changing the tree or the other snapshots */
+                Version& branch = versions[random() % versions.size()];
+                for(int i = 0; i < 200; i++){
+                    int branch_key = random() % 1000;
+                    if(random() % 2 == 0){
+                        insert(branch.tree, branch.keys, branch_key);
+                    } else {
+                        erase(branch.tree, branch.keys, branch_key);
+                    }
+                }
+                if(!branch.keys.empty()){
+                    int deleted_key = branch.keys[branch.keys.size() / 2];
+                    Version deleted(branch.tree.withKeyDeleted(deleted_key),
+                            branch.keys);
+                    deleted.keys.erase(std::lower_bound(deleted.keys.begin(),
+                            deleted.keys.end(), deleted_key));
+                    checkVersion(deleted, random);
+                }
+                for(const Version& version : versions){
+                    checkVersion(version, random);
+                }
+                checkVersion(Version(tree, keys), random);
+            }
+        }
+
+        checkVersion(Version(tree, keys), random);
+        for(const Version& version : versions){
+            checkVersion(version, random);
+        }
+
+        /* release the snapshots in a random order, each one leaves the
+         * others intact */
+        std::shuffle(versions.begin(), versions.end(), random);
+        while(!versions.empty()){
+            versions.pop_back();
+            for(const Version& version : versions){
+                checkVersion(version, random);
+            }
+        }
+        checkVersion(Version(tree, keys), random);
+        tree.clear();
+        CHECK(tree.size() == 0);
+    }
+    /* every vertex of every version is gone */
+    CHECK(CountedKey::live == 0);
+}
+
+int main(){
+    testSnapshots(1);
+    testSnapshots(2);
+    std::printf("persistent_test passed\n");
+    return 0;
+}
@@ -0,0 +1,168 @@
+/* randomized equivalence checks of the set operations of AVLrankTree against
+ * std::set_union, std::set_intersection and std::set_difference, over
+ * several grain sizes, with trees on separate heaps, on separate arenas and
+ * on one shared arena. The test exits with 1 on the first mismatch */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <set>
+#include <vector>
+#include "../AVLrankTree.h"
+#include "check.h"
+
+enum Operation {UNION, INTERSECTION, DIFFERENCE};
+
+/* compare the keys, the counts and the sums of the tree with "keys" */
+template <class Tree>
+static void checkSame(Tree& tree, const std::vector<int>& keys){
+    int size = keys.size();
+    CHECK(tree.size() == size);
+    std::vector<int> in_order(tree.begin(), tree.end());
+    CHECK(in_order == keys);
+
+    long long total = 0;
+    for(int key : keys){
+        total += key;
+    }
+    CHECK(tree.sumOfkLargestKeys(size) == total);
+    for(int k = 1; k <= size; k += 1 + size / 16){
+        CHECK(*tree.select(k) == keys[k - 1]);
+        CHECK(tree.rank(keys[k - 1]) == k - 1);
+    }
+}
+
+/* a sorted set of "size" keys out of [0, range) */
+static std::vector<int> randomSet(std::mt19937& random, int size, int range){
+    std::set<int> keys;
+    while((int)keys.size() < size){
+        keys.insert(random() % range);
+    }
+    return std::vector<int>(keys.begin(), keys.end());
+}
+
+static std::vector<int> expectedResult(Operation operation,
+        const std::vector<int>& a, const std::vector<int>& b){
+    std::vector<int> result;
+    if(operation == UNION){
+        std::set_union(a.begin(), a.end(), b.begin(), b.end(),
+                std::back_inserter(result));
+    } else if(operation == INTERSECTION){
+        std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                std::back_inserter(result));
+    } else {
+        std::set_difference(a.begin(), a.end(), b.begin(), b.end(),
+                std::back_inserter(result));
+    }
+    return result;
+}
+
+template <class Tree>
+static void apply(Operation operation, Tree& tree, Tree& other_tree,
+        int grain_size){
+    if(operation == UNION){
+        tree.unionWith(other_tree, grain_size);
+    } else if(operation == INTERSECTION){
+        tree.intersectWith(other_tree, grain_size);
+    } else {
+        tree.differenceWith(other_tree, grain_size);
+    }
+}
+
+/* build the trees with their own allocators, apply the operation and
+ * compare it with the standard algorithm */
+template <template <class> class VertexAllocator>
+static void checkOperation(Operation operation, const std::vector<int>& a,
+        const std::vector<int>& b, int grain_size){
+    AVLrankTree<int, VertexAllocator> tree(a.begin(), a.end());
+    AVLrankTree<int, VertexAllocator> other_tree;
+    /* inserted one by one, so the other tree is shaped differently */
+    for(int key : b){
+        other_tree.insertKey(key);
+    }
+    apply(operation, tree, other_tree, grain_size);
+    checkSame(tree, expectedResult(operation, a, b));
+    CHECK(other_tree.size() == 0);
+
+    /* the emptied tree is still usable */
+    other_tree.insertKey(7);
+    CHECK(other_tree.size() == 1 && *other_tree.begin() == 7);
+}
+
+/* the trees share an arena when one is split off the other, so the
+ * operation reuses the vertexes of both instead of copying the other tree.
+ * Splitting the empty tree makes both trees allocate from one arena */
+static void checkSharedArena(Operation operation, const std::vector<int>& a,
+        const std::vector<int>& b, int grain_size){
+    AVLrankTree<int, ArenaVertexAllocator> tree;
+    AVLrankTree<int, ArenaVertexAllocator> other_tree;
+    tree.split(0, other_tree);
+    for(int key : a){
+        tree.insertKey(key);
+    }
+    for(int key : b){
+        other_tree.insertKey(key);
+    }
+    apply(operation, tree, other_tree, grain_size);
+    checkSame(tree, expectedResult(operation, a, b));
+    CHECK(other_tree.size() == 0);
+}
+
+static void testSetOperations(unsigned seed){
+    std::mt19937 random(seed);
+    /* the sizes of the two sets: empty ones, equal sizes, and one set much
+     * smaller than the other */
+    const int sizes[][2] = {{0, 0}, {0, 300}, {300, 0}, {1, 1}, {500, 500},
+                            {3000, 3000}, {20, 4000}, {4000, 20},
+                            {20000, 15000}};
+    for(const int* size : sizes){
+        /* a range close to the sizes makes the sets overlap a lot, a wide
+         * one makes them almost disjoint */
+        for(int range_factor : {2, 100}){
+            int range = std::max(1, (size[0] + size[1]) * range_factor);
+            std::vector<int> a = randomSet(random, size[0], range);
+            std::vector<int> b = randomSet(random, size[1], range);
+            for(Operation operation : {UNION, INTERSECTION, DIFFERENCE}){
+                for(int grain_size : {1, 64, 1 << 13, 1 << 30}){
+                    checkOperation<HeapVertexAllocator>(operation, a, b,
+                            grain_size);
+                    checkOperation<ArenaVertexAllocator>(operation, a, b,
+                            grain_size);
+                    checkSharedArena(operation, a, b, grain_size);
+                }
+            }
+        }
+    }
+}
+
+/* sets of the same keys, and sets whose key ranges don't overlap at all */
+static void testEdgeCases(){
+    std::vector<int> evens, odds, low, high;
+    for(int i = 0; i < 5000; i++){
+        (i % 2 == 0 ? evens : odds).push_back(i);
+        low.push_back(i);
+        high.push_back(i + 5000);
+    }
+    for(Operation operation : {UNION, INTERSECTION, DIFFERENCE}){
+        for(int grain_size : {1, 1 << 13}){
+            checkOperation<HeapVertexAllocator>(operation, low, low,
+                    grain_size);
+            checkOperation<HeapVertexAllocator>(operation, evens, odds,
+                    grain_size);
+            checkOperation<ArenaVertexAllocator>(operation, low, high,
+                    grain_size);
+            checkOperation<ArenaVertexAllocator>(operation, high, low,
+                    grain_size);
+            checkSharedArena(operation, evens, low, grain_size);
+        }
+    }
+}
+
+int main(){
+    testSetOperations(1);
+    testEdgeCases();
+    std::printf("set_operations_test passed\n");
+    return 0;
+}
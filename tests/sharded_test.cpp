@@ -0,0 +1,214 @@
+/* randomized equivalence checks of ShardedAVL against std::map and of
+ * ShardedAVLrankTree against std::multiset, across the splits and the
+ * rebalancing of the shards, and a check of ShardedAVL with an
+ * ArenaVertexAllocator under concurrent updates. The test exits with 1 on
+ * the first mismatch */
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../ShardedAVL.h"
+#include "check.h"
+
+/* the keys of the tree, in order */
+template <class Tree>
+static std::vector<int> keysOf(Tree& tree){
+    std::vector<int> keys;
+    auto collect = [&](const int& key){keys.push_back(key);};
+    tree.inorder(collect);
+    return keys;
+}
+
+/* a single shard has no neighbour to share it's keys with, so the tree
+ * must keep growing past the split size without rebalancing */
+static void testSingleShard(){
+    ShardedAVL<int, int> tree(1);
+    for(int i = 0; i < 5000; i++){
+        tree.insertKey(i, new int(i));
+    }
+    CHECK(tree.size() == 5000);
+    CHECK(tree.shardCount() == 1);
+    for(int i = 0; i < 5000; i += 7){
+        CHECK(*tree.getData(i) == i);
+    }
+
+    ShardedAVLrankTree<int> rank_tree(1);
+    for(int i = 0; i < 5000; i++){
+        rank_tree.insertKey(i);
+    }
+    CHECK(rank_tree.size() == 5000);
+}
+
+template <template <class> class VertexAllocator>
+static void testShardedAVL(int shard_count, unsigned seed){
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> key_of(0, 20000);
+    ShardedAVL<int, int, VertexAllocator> tree(shard_count);
+    std::map<int, int> model;
+
+    for(int step = 0; step < 200000; step++){
+        int key = key_of(random);
+        int operation = random() % 10;
+        if(operation < 5){
+            if(model.count(key) == 0){
+                /* some keys hold no data */
+                bool with_data = random() % 8 != 0;
+                tree.insertKey(key, with_data ? new int(step) : nullptr);
+                model[key] = with_data ? step : -1;
+            }
+        } else if(operation < 8){
+            int* data = tree.deleteKey(key);
+            std::map<int, int>::iterator it = model.find(key);
+            if(it == model.end() || it->second == -1){
+                CHECK(data == nullptr);
+            } else {
+                CHECK(data != nullptr && *data == it->second);
+            }
+            if(it != model.end()){
+                model.erase(it);
+            }
+            delete data;
+        } else {
+            int* data = tree.getData(key);
+            std::map<int, int>::iterator it = model.find(key);
+            CHECK(tree.keyExists(key) == (it != model.end()));
+            CHECK((data != nullptr) == (it != model.end() && it->second != -1));
+            if(data != nullptr){
+                CHECK(*data == it->second);
+            }
+        }
+        if(step % 20000 == 0){
+            CHECK(tree.size() == (int)model.size());
+        }
+    }
+
+    /* a batch deletion of every other key, then a batch insertion back */
+    std::vector<int> keys;
+    for(const std::pair<const int, int>& entry : model){
+        keys.push_back(entry.first);
+    }
+    std::vector<int> removed_keys;
+    for(size_t i = 0; i < keys.size(); i += 2){
+        removed_keys.push_back(keys[i]);
+    }
+    std::vector<int*> removed(removed_keys.size());
+    tree.deleteBatch(removed_keys.data(), removed_keys.size(), removed.data());
+    std::vector<std::pair<int, int*> > pairs;
+    for(size_t i = 0; i < removed_keys.size(); i++){
+        int expected = model[removed_keys[i]];
+        CHECK((removed[i] == nullptr) == (expected == -1));
+        CHECK(removed[i] == nullptr || *removed[i] == expected);
+        pairs.push_back(std::make_pair(removed_keys[i], removed[i]));
+    }
+    CHECK(tree.size() == (int)(keys.size() - removed_keys.size()));
+    tree.insertBatch(pairs.begin(), pairs.end());
+
+    CHECK(tree.size() == (int)model.size());
+    CHECK(keysOf(tree) == keys);
+    CHECK(tree.shardCount() <= shard_count);
+}
+
+/* every thread inserts and deletes the keys that are equal to it's index
+ * modulo the thread count while the shards split and rebalance, and the
+ * batch methods update the shards in parallel. Each shard must have an
+ * arena of it's own for this to be free of races */
+static void testConcurrentArena(int shard_count){
+    const int thread_count = 4;
+    const int key_count = 40000;
+    ShardedAVL<int, int, ArenaVertexAllocator> tree(shard_count);
+
+    std::vector<std::thread> threads;
+    for(int t = 0; t < thread_count; t++){
+        threads.emplace_back([&tree, t](){
+            for(int key = t; key < key_count; key += thread_count){
+                tree.insertKey(key, new int(key));
+            }
+            /* delete the odd keys */
+            for(int key = t; key < key_count; key += thread_count){
+                if(key % 2 == 1){
+                    int* data = tree.deleteKey(key);
+                    CHECK(data != nullptr && *data == key);
+                    delete data;
+                }
+            }
+        });
+    }
+    for(std::thread& thread : threads){
+        thread.join();
+    }
+    CHECK(tree.size() == key_count / 2);
+    CHECK(tree.shardCount() == shard_count);
+
+    std::vector<int> keys;
+    for(int key = 0; key < key_count; key += 2){
+        keys.push_back(key);
+    }
+    CHECK(keysOf(tree) == keys);
+
+    std::vector<int*> removed(keys.size());
+    tree.deleteBatch(keys.data(), keys.size(), removed.data());
+    std::vector<std::pair<int, int*> > pairs;
+    for(size_t i = 0; i < keys.size(); i++){
+        CHECK(removed[i] != nullptr && *removed[i] == keys[i]);
+        pairs.push_back(std::make_pair(keys[i], removed[i]));
+    }
+    CHECK(tree.size() == 0);
+    tree.insertBatch(pairs.begin(), pairs.end());
+    CHECK(keysOf(tree) == keys);
+}
+
+static void testShardedRankTree(int shard_count, unsigned seed){
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> key_of(0, 5000);
+    ShardedAVLrankTree<int> tree(shard_count);
+    std::multiset<int> model;
+
+    for(int step = 0; step < 100000; step++){
+        int key = key_of(random);
+        int operation = random() % 10;
+        if(operation < 6){
+            tree.insertKey(key);
+            model.insert(key);
+        } else if(operation < 8){
+            tree.deleteKey(key);
+            std::multiset<int>::iterator it = model.find(key);
+            if(it != model.end()){
+                model.erase(it);
+            }
+        } else if(!model.empty() && step % 16 == 0){
+            /* the model answers in linear time, so only some steps query */
+            int k = random() % model.size() + 1;
+            int selected;
+            CHECK(tree.select(k, selected));
+            std::multiset<int>::iterator it = model.begin();
+            std::advance(it, k - 1);
+            CHECK(selected == *it);
+            CHECK(tree.rank(key) == (int)std::distance(model.begin(),
+                    model.lower_bound(key)));
+            int high = key + 100;
+            CHECK(tree.countInRange(key, high) == (int)std::distance(
+                    model.lower_bound(key), model.upper_bound(high)));
+        }
+    }
+
+    CHECK(tree.size() == (int)model.size());
+    std::vector<int> keys(model.begin(), model.end());
+    CHECK(keysOf(tree) == keys);
+}
+
+int main(){
+    testSingleShard();
+    for(int shard_count : {2, 4, 8}){
+        testShardedAVL<HeapVertexAllocator>(shard_count, 1000 + shard_count);
+        testShardedRankTree(shard_count, 2000 + shard_count);
+    }
+    testShardedAVL<ArenaVertexAllocator>(4, 3004);
+    testConcurrentArena(4);
+    std::printf("sharded_test passed\n");
+    return 0;
+}